@@ -1,4 +1,7 @@
 #include "MPIProcessorInfo.hpp"
+#include "MPIRegionTimer.hpp"
+#include "MapReduce.hpp"
+#include "Partition.hpp"
 #include "debug.h"
 
 #ifndef CONFIG_PRECISION
@@ -16,7 +19,8 @@
  * @return double Result, equals to PI
  */
 double GetPIMapReduce(const MPIProcessorInfo& Processor) {
-    double dPI, dPartialSum, dSum;
+    REGION_SCOPE("GetPIMapReduce");
+    double dPI, dPartialSum = 0, dSum;
     const long long llN = CONFIG_PRECISION; // Avoid float computation
     const double delta = 1 / ((double)llN * (double)llN); //delta = (1 / ((double)N ) / ((double)N 
 
@@ -24,15 +28,28 @@ double GetPIMapReduce(const MPIProcessorInfo& Processor) {
     MPI_Barrier(MPI_COMM_WORLD);
     auto begin = MPI_Wtime();
 
-    /** Calculate sum, each calculate a 1 / Processor.iSize() part **/
-    for (int i = Processor.iRank(); i < llN; i += Processor.iSize()) {
-        dPartialSum += 4.0 / (1.0 + delta * i * i);
+    /** Calculate sum, each calculate a 1 / Processor.iSize() part, dealt cyclically **/
+    {
+        REGION_SCOPE("compute");
+        const auto Terms = mpimath::Partition<int64_t>::Cyclic(llN, Processor.iSize());
+        const int64_t lTerms = Terms.Size(Processor.iRank());
+        for (int64_t j = 0; j < lTerms; ++j) {
+            const int64_t i = Terms.Global(Processor.iRank(), j);
+            dPartialSum += 4.0 / (1.0 + delta * i * i);
+        }
+    }
+    /** Sum the result with MPI_Reduce, inside every node first **/
+    {
+        REGION_SCOPE("reduce");
+        Processor.NodeReduce(&dPartialSum, &dSum, 1, MPI_DOUBLE, MPI_SUM);
+        REGION_BYTES(sizeof(double));
     }
-    /** Sum the result with MPI_Reduce **/
-    MPI_Reduce(&dPartialSum, &dSum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 
     /** Sync  between processes **/
-    MPI_Barrier(MPI_COMM_WORLD);
+    {
+        REGION_SCOPE("barrier");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
     auto end = MPI_Wtime();
 
     /** Only output on Rank 0 **/
@@ -55,7 +72,8 @@ double GetPIMapReduce(const MPIProcessorInfo& Processor) {
  */
 
 double GetPISendRecv(const MPIProcessorInfo& Processor) {
-    double dPI, dPartialSum;
+    REGION_SCOPE("GetPISendRecv");
+    double dPI, dPartialSum = 0;
     const long long llN = CONFIG_PRECISION; // Avoid float computation
     const double delta = 1 / ((double)llN * (double)llN); //delta = (1 / ((double)N ) / ((double)N 
 
@@ -64,23 +82,36 @@ double GetPISendRecv(const MPIProcessorInfo& Processor) {
     auto begin = MPI_Wtime();
     MPI_Request* apRequests=new MPI_Request[Processor.iSize()-1];
 
-    /** Calculate sum, each calculate a 1 / Processor.iSize() part **/
-    for (int i = Processor.iRank(); i < llN; i += Processor.iSize()) {
-        dPartialSum += 4.0 / (1.0 + delta * i * i);
+    /** Calculate sum, each calculate a 1 / Processor.iSize() part, dealt cyclically **/
+    {
+        REGION_SCOPE("compute");
+        const auto Terms = mpimath::Partition<int64_t>::Cyclic(llN, Processor.iSize());
+        const int64_t lTerms = Terms.Size(Processor.iRank());
+        for (int64_t j = 0; j < lTerms; ++j) {
+            const int64_t i = Terms.Global(Processor.iRank(), j);
+            dPartialSum += 4.0 / (1.0 + delta * i * i);
+        }
     }
 
     /** Sync between processes **/
-    MPI_Barrier(MPI_COMM_WORLD);
+    {
+        REGION_SCOPE("barrier");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
     auto end = MPI_Wtime();
 
     if (Processor.iRank() != 0) {
+        REGION_SCOPE("send");
         MPI_Isend(&dPartialSum, 1, MPI_DOUBLE, 0, Processor.iRank(), MPI_COMM_WORLD, &apRequests[Processor.iRank()-1]);
+        REGION_BYTES(sizeof(double));
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
 
     /** Only output on Rank 0 **/
     if (Processor.iRank() == 0) {
+        REGION_SCOPE("gather");
+        REGION_BYTES((Processor.iSize() - 1) * sizeof(double));
         double dSum = dPartialSum;
         double dPartialSumFromOtherProc;
         for (int iSrcRank = 1 ; iSrcRank < Processor.iSize(); ++iSrcRank) {
@@ -98,19 +129,67 @@ double GetPISendRecv(const MPIProcessorInfo& Processor) {
     return dPI;
 }
 
+/**
+ * @brief Get Pi using trapezoid algorithm, as a MapReduce job
+ *
+ * Chunks of the terms map to one key, the combiner sums them on every
+ * process and the single reducer sums what arrives
+ * @param Processor MPIProcessorInfo
+ * @return double Result, equals to PI
+ */
+double GetPIMapReduceJob(const MPIProcessorInfo& Processor) {
+    REGION_SCOPE("GetPIMapReduceJob");
+    double dPI = 0;
+    const long long llN = CONFIG_PRECISION;
+    const double delta = 1 / ((double)llN * (double)llN);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto begin = MPI_Wtime();
+
+    mpimath::MapReduce<int, double> Job(Processor);
+    Job.Combiner([](double& dAcc, const double& dValue) { dAcc += dValue; });
+    {
+        REGION_SCOPE("map");
+        Job.MapRange(llN, 1 << 20, [&](int64_t lBegin, int64_t lEnd, auto& Emit) {
+            double dPartialSum = 0;
+            for (int64_t i = lBegin; i < lEnd; ++i) dPartialSum += 4.0 / (1.0 + delta * i * i);
+            Emit(0, dPartialSum);
+        });
+    }
+    auto vecSum = Job.Gather(Job.Reduce([](const int&, const std::vector<double>& vecValues) { return vecValues.front(); }));
+    auto end = MPI_Wtime();
+
+    if (Processor.iRank() == 0) {
+        dPI = vecSum.empty() ? 0 : vecSum.front().second / llN;
+        LOGI("NumProcesses=%2d;  Time(Second)=%fs;  PI=%0.15lf\n", Processor.iSize(), end - begin, dPI);
+    }
+    return dPI;
+}
+
+/**
+ * @brief ./GetPI [reduce|sendrecv|mapreduce]
+ *
+ * Without an argument CONFIG_USE_MAPREDUCE picks MPI_Reduce or MPI_Send/MPI_Recv
+ */
 int main(int argc, char** argv) {
     /** Init MPI framework **/
     MPI_Init(nullptr, nullptr);
 
-    /** Get Current Processor Name **/
+    /** Get Current Processor Name, bind as MPIMATH_BIND says **/
     MPIProcessorInfo Processor;
+    Processor.Bind(MPIProcessorInfo::BindPolicyFromEnv());
+
+    const std::string sMethod = argc >= 2 ? argv[1] : (CONFIG_USE_MAPREDUCE ? "reduce" : "sendrecv");
+    if (sMethod == "mapreduce") {
+        GetPIMapReduceJob(Processor);
+    } else if (sMethod == "reduce") {
+        GetPIMapReduce(Processor);
+    } else {
+        GetPISendRecv(Processor);
+    }
 
-#if CONFIG_USE_MAPREDUCE
-    GetPIMapReduce(Processor);
-#else
-    printf("%s","");
-    GetPISendRecv(Processor);
-#endif
+    MPIRegionFinalize();
+    LogFinalize();
 
 error:
     /** Release resources **/
@@ -0,0 +1,204 @@
+/**
+ * @file Partition.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Block, cyclic, block-cyclic and weighted partitions of an index range, constexpr and 64-bit
+ * @version 0.1
+ * @date 2022-06-19
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace mpimath {
+    enum class emPartitionKind {
+        BLOCK = 0,
+        CYCLIC,
+        BLOCK_CYCLIC,
+        WEIGHTED,
+    };
+
+    /**
+     * @brief The indices [0, N) dealt to P ranks
+     *
+     * - BLOCK: contiguous ranges whose sizes differ by at most one, the first
+     *   N % P ranks take the larger ones
+     * - CYCLIC: index i goes to rank i % P
+     * - BLOCK_CYCLIC: blocks of B indices go round robin, the last block may be short
+     * - WEIGHTED: contiguous ranges from a bound array, see WeightedBounds()
+     *
+     * Every query is constexpr, so a partition of constants folds into
+     * constants, and no intermediate exceeds N + P in TIndex: r * N / P style
+     * products are never formed. Owner() is O(1) except for WEIGHTED, which
+     * starts from the proportional guess and binary searches when the
+     * weights are far from even.
+     *
+     * Low() and High() are the first and last index of a rank (High() =
+     * Low() - 1 for a rank without any), contiguous ranges for BLOCK and
+     * WEIGHTED. Local() and Global() convert between an index and its
+     * position at its owner.
+     *
+     * @tparam TIndex signed integer type of the indices
+     */
+    template<typename TIndex = int64_t>
+    class Partition {
+        static_assert(std::is_integral<TIndex>::value and std::is_signed<TIndex>::value, "Partition needs a signed index");
+
+    public:
+        constexpr Partition() = default;
+
+        static constexpr Partition Block(TIndex lN, int iParts) {
+            return Partition(emPartitionKind::BLOCK, lN, iParts, 1, nullptr);
+        }
+
+        static constexpr Partition Cyclic(TIndex lN, int iParts) {
+            return Partition(emPartitionKind::CYCLIC, lN, iParts, 1, nullptr);
+        }
+
+        static constexpr Partition BlockCyclic(TIndex lN, int iParts, TIndex lBlock) {
+            return Partition(emPartitionKind::BLOCK_CYCLIC, lN, iParts, lBlock > 0 ? lBlock : 1, nullptr);
+        }
+
+        /** pBounds[r] is the first index of rank r, pBounds[iParts] = lN; the array must outlive the partition */
+        static constexpr Partition Weighted(TIndex lN, int iParts, const TIndex* pBounds) {
+            return Partition(emPartitionKind::WEIGHTED, lN, iParts, 1, pBounds);
+        }
+
+        constexpr emPartitionKind Kind() const { return _Kind; }
+        constexpr TIndex lN() const { return _lN; }
+        constexpr int iParts() const { return _iParts; }
+        constexpr TIndex lBlock() const { return _lBlock; }
+        constexpr bool bContiguous() const {
+            return _Kind == emPartitionKind::BLOCK or _Kind == emPartitionKind::WEIGHTED or _iParts == 1;
+        }
+
+        /** Number of indices of iRank */
+        constexpr TIndex Size(int iRank) const {
+            switch (_Kind) {
+                case emPartitionKind::BLOCK:
+                    return _lQuot + (iRank < _lRem ? 1 : 0);
+                case emPartitionKind::WEIGHTED:
+                    return _pBounds[iRank + 1] - _pBounds[iRank];
+                default: {
+                    const TIndex lBlocks = (_lN + _lBlock - 1) / _lBlock;
+                    const TIndex lMine = lBlocks / _iParts + (iRank < lBlocks % _iParts ? 1 : 0);
+                    if (lMine == 0) return 0;
+                    /** The short last block */
+                    const bool bLast = (lBlocks - 1) % _iParts == iRank;
+                    return lMine * _lBlock - (bLast ? lBlocks * _lBlock - _lN : 0);
+                }
+            }
+        }
+
+        constexpr TIndex Low(int iRank) const {
+            switch (_Kind) {
+                case emPartitionKind::BLOCK:
+                    return iRank * _lQuot + std::min<TIndex>(iRank, _lRem);
+                case emPartitionKind::WEIGHTED:
+                    return _pBounds[iRank];
+                default:
+                    return std::min<TIndex>((TIndex)iRank * _lBlock, _lN);
+            }
+        }
+
+        constexpr TIndex High(int iRank) const {
+            const TIndex lSize = Size(iRank);
+            return lSize == 0 ? Low(iRank) - 1 : Global(iRank, lSize - 1);
+        }
+
+        /** Rank holding lIndex */
+        constexpr int Owner(TIndex lIndex) const {
+            switch (_Kind) {
+                case emPartitionKind::BLOCK: {
+                    const TIndex lLarge = _lRem * (_lQuot + 1);
+                    return (int)(lIndex < lLarge ? lIndex / (_lQuot + 1) : _lRem + (lIndex - lLarge) / _lQuot);
+                }
+                case emPartitionKind::WEIGHTED: {
+                    int iGuess = (int)std::min<double>(_iParts - 1, (double)lIndex / (double)_lN * _iParts);
+                    /** One step either way covers near-even weights */
+                    if (_pBounds[iGuess] > lIndex and iGuess > 0 and _pBounds[iGuess - 1] <= lIndex) return iGuess - 1;
+                    if (_pBounds[iGuess + 1] <= lIndex and iGuess + 1 < _iParts and _pBounds[iGuess + 2] > lIndex) return iGuess + 1;
+                    if (_pBounds[iGuess] <= lIndex and _pBounds[iGuess + 1] > lIndex) return iGuess;
+                    int iLow = 0, iHigh = _iParts - 1;
+                    while (iLow < iHigh) {
+                        const int iMid = (iLow + iHigh + 1) / 2;
+                        if (_pBounds[iMid] <= lIndex) {
+                            iLow = iMid;
+                        } else {
+                            iHigh = iMid - 1;
+                        }
+                    }
+                    /** Empty ranks share their bound with the next one */
+                    return iLow;
+                }
+                default:
+                    return (int)((lIndex / _lBlock) % _iParts);
+            }
+        }
+
+        /** Position of lIndex at its owner */
+        constexpr TIndex Local(TIndex lIndex) const {
+            switch (_Kind) {
+                case emPartitionKind::BLOCK:
+                case emPartitionKind::WEIGHTED:
+                    return lIndex - Low(Owner(lIndex));
+                default:
+                    return lIndex / _lBlock / _iParts * _lBlock + lIndex % _lBlock;
+            }
+        }
+
+        /** Index of position lLocal of iRank */
+        constexpr TIndex Global(int iRank, TIndex lLocal) const {
+            switch (_Kind) {
+                case emPartitionKind::BLOCK:
+                case emPartitionKind::WEIGHTED:
+                    return Low(iRank) + lLocal;
+                default:
+                    return (lLocal / _lBlock * _iParts + iRank) * _lBlock + lLocal % _lBlock;
+            }
+        }
+
+    protected:
+        constexpr Partition(emPartitionKind Kind, TIndex lN, int iParts, TIndex lBlock, const TIndex* pBounds)
+            : _Kind(Kind), _lN(lN > 0 ? lN : 0), _iParts(iParts > 0 ? iParts : 1), _lBlock(lBlock), _pBounds(pBounds),
+              _lQuot(_lN / _iParts), _lRem(_lN % _iParts) {}
+
+        emPartitionKind _Kind = emPartitionKind::BLOCK;
+        TIndex _lN = 0;
+        int _iParts = 1;
+        TIndex _lBlock = 1;
+        const TIndex* _pBounds = nullptr;
+        TIndex _lQuot = 0;
+        TIndex _lRem = 0;
+    };
+
+    /**
+     * @brief Bounds for Partition::Weighted(): rank r gets a share of lN
+     * proportional to vecWeights[r] (a measured speed, say), rounded so that
+     * the shares add up to lN
+     *
+     * Non-positive weights get nothing; if every weight is, the split is even.
+     */
+    template<typename TIndex = int64_t>
+    std::vector<TIndex> WeightedBounds(TIndex lN, const std::vector<double>& vecWeights) {
+        const size_t ulParts = std::max<size_t>(1, vecWeights.size());
+        double dTotal = 0;
+        for (double dWeight : vecWeights) dTotal += std::max(0.0, dWeight);
+        std::vector<TIndex> vecBounds(ulParts + 1, 0);
+        double dPrefix = 0;
+        for (size_t idx = 0; idx < ulParts; ++idx) {
+            dPrefix += dTotal > 0 ? std::max(0.0, vecWeights[idx]) / dTotal : 1.0 / ulParts;
+            vecBounds[idx + 1] = idx + 1 == ulParts ? lN : std::min<TIndex>(lN, (TIndex)(dPrefix * (double)lN + 0.5));
+            vecBounds[idx + 1] = std::max(vecBounds[idx + 1], vecBounds[idx]);
+        }
+        return vecBounds;
+    }
+}
+
+#endif
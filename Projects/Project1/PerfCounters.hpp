@@ -0,0 +1,304 @@
+/**
+ * @file PerfCounters.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Hardware counters of the calling thread through perf_event_open,
+ * and the derived metrics: IPC, miss rates, bytes per flop and roofline
+ * @version 0.1
+ * @date 2022-06-15
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Counters need Linux and perf_event_paranoid <= 2. Where a counter can not
+ * be opened (containers, VMs without PMU, other systems) it is left out of
+ * the sample mask and the metrics that need it are reported as unknown;
+ * the roofline then falls back to the bytes the caller says the kernel moves.
+ *
+ *     PerfCounters Counters;
+ *     tPerfSample Begin = Counters.Read();
+ *     gemm(...);
+ *     tPerfMetrics Metrics = PerfMetrics(PerfDelta(Counters.Read(), Begin), dFlops, dBytes, dSeconds);
+ */
+#ifndef _PERFCOUNTERS_H
+#define _PERFCOUNTERS_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+
+/** Override the estimated peak of one core, in GFLOP/s of double precision */
+#define PERF_PEAK_GFLOPS_ENV "MPIMATH_PEAK_GFLOPS"
+/** Override the measured memory bandwidth, in GB/s */
+#define PERF_PEAK_GBYTES_ENV "MPIMATH_PEAK_GBS"
+/** Bytes moved from memory per last level cache miss */
+#define PERF_CACHE_LINE 64
+
+/**
+ * @brief Counted events
+ *
+ * @enum L1D_ACCESS, L1D_MISS  L1 data cache reads
+ * @enum LLC_ACCESS, LLC_MISS  last level cache references, misses go to memory
+ */
+enum class emPerfEvent {
+    CYCLES = 0,
+    INSTRUCTIONS = 1,
+    L1D_ACCESS = 2,
+    L1D_MISS = 3,
+    LLC_ACCESS = 4,
+    LLC_MISS = 5,
+    COUNT,
+};
+
+/**
+ * @brief Counter values, bit i of uMask is set when event i was counted
+ *
+ */
+typedef struct {
+    uint64_t aulValues[(int)emPerfEvent::COUNT];
+    uint32_t uMask;
+} tPerfSample;
+
+inline bool PerfHas(const tPerfSample& Sample, emPerfEvent emEvent) {
+    return (Sample.uMask >> (int)emEvent) & 1u;
+}
+
+inline const char* PerfEventName(emPerfEvent emEvent) {
+    static const char* asNames[] = { "cycles", "instructions", "l1d_access", "l1d_miss", "llc_access", "llc_miss" };
+    return asNames[(int)emEvent];
+}
+
+/**
+ * @brief Counters of the thread that creates it and of the threads it starts
+ * afterwards, counted once they have exited
+ *
+ */
+class PerfCounters {
+public:
+    PerfCounters() {
+        for (auto& iFd : aiFds) iFd = -1;
+#ifdef __linux__
+        static const uint64_t aulCache[] = {
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16),
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        };
+        const struct {
+            uint32_t uType;
+            uint64_t ulConfig;
+        } aEvents[(int)emPerfEvent::COUNT] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HW_CACHE, aulCache[0] },
+            { PERF_TYPE_HW_CACHE, aulCache[1] },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        };
+        int iErrno = 0;
+        for (int iEvent = 0; iEvent < (int)emPerfEvent::COUNT; ++iEvent) {
+            struct perf_event_attr Attr;
+            memset(&Attr, 0, sizeof(Attr));
+            Attr.size = sizeof(Attr);
+            Attr.type = aEvents[iEvent].uType;
+            Attr.config = aEvents[iEvent].ulConfig;
+            Attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            Attr.inherit = 1;
+            Attr.exclude_kernel = 1;
+            Attr.exclude_hv = 1;
+            /** Events are opened one by one so that a missing one does not take the others */
+            aiFds[iEvent] = (int)syscall(SYS_perf_event_open, &Attr, 0, -1, -1, 0);
+            if (aiFds[iEvent] < 0) iErrno = errno;
+        }
+        if (not bAvailable()) {
+            static bool bWarned = false;
+            if (not bWarned) {
+                LOGW("Hardware counters unavailable (%s)%s", strerror(iErrno),
+                     iErrno == EACCES or iErrno == EPERM ? ", check /proc/sys/kernel/perf_event_paranoid" : "");
+                bWarned = true;
+            }
+        }
+#endif
+    }
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int iFd : aiFds) {
+            if (iFd >= 0) close(iFd);
+        }
+#endif
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /** At least one event is counted */
+    bool bAvailable() const {
+        for (int iFd : aiFds) {
+            if (iFd >= 0) return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Totals since construction, scaled up when the kernel multiplexed
+     * the events
+     *
+     */
+    tPerfSample Read() const {
+        tPerfSample Sample = { { 0 }, 0 };
+#ifdef __linux__
+        for (int iEvent = 0; iEvent < (int)emPerfEvent::COUNT; ++iEvent) {
+            uint64_t aulRead[3];
+            if (aiFds[iEvent] < 0 or read(aiFds[iEvent], aulRead, sizeof(aulRead)) != (ssize_t)sizeof(aulRead)) continue;
+            if (aulRead[2] == 0) continue;
+            Sample.aulValues[iEvent] = aulRead[2] < aulRead[1] ? (uint64_t)((double)aulRead[0] * aulRead[1] / aulRead[2]) : aulRead[0];
+            Sample.uMask |= 1u << iEvent;
+        }
+#endif
+        return Sample;
+    }
+
+private:
+    int aiFds[(int)emPerfEvent::COUNT];
+};
+
+/** End - Begin, for the events counted in both */
+inline tPerfSample PerfDelta(const tPerfSample& End, const tPerfSample& Begin) {
+    tPerfSample Delta = { { 0 }, End.uMask & Begin.uMask };
+    for (int iEvent = 0; iEvent < (int)emPerfEvent::COUNT; ++iEvent) {
+        if ((Delta.uMask >> iEvent) & 1u) Delta.aulValues[iEvent] = End.aulValues[iEvent] - Begin.aulValues[iEvent];
+    }
+    return Delta;
+}
+
+/** Accumulate Add into Sum, a event stays counted only if it is in both */
+inline void PerfAccumulate(tPerfSample& Sum, const tPerfSample& Add) {
+    Sum.uMask = Sum.uMask & Add.uMask;
+    for (int iEvent = 0; iEvent < (int)emPerfEvent::COUNT; ++iEvent) Sum.aulValues[iEvent] += Add.aulValues[iEvent];
+}
+
+/**
+ * @brief Peak GFLOP/s of one core: clock from /proc/cpuinfo times the
+ * FMA throughput of the widest vector unit this binary is compiled for
+ *
+ * @param ulElemBytes 8 for double, 4 for float
+ */
+inline double PerfPeakGFlops(size_t ulElemBytes = 8) {
+    static double dPeak64 = [] {
+        const char* sPeak = getenv(PERF_PEAK_GFLOPS_ENV);
+        if (sPeak != nullptr and atof(sPeak) > 0) return atof(sPeak);
+        double dMHz = 0;
+        std::ifstream File("/proc/cpuinfo");
+        std::string sLine;
+        while (dMHz == 0 and std::getline(File, sLine)) {
+            if (sLine.compare(0, 7, "cpu MHz") == 0 and sLine.find(':') != std::string::npos) dMHz = atof(sLine.c_str() + sLine.find(':') + 1);
+        }
+        if (dMHz <= 0) dMHz = 2000;
+        /** Two FMA ports, lanes of 8 bytes */
+#if defined(__AVX512F__)
+        const double dFlopsPerCycle = 2 * 2 * 8;
+#elif defined(__AVX2__) && defined(__FMA__)
+        const double dFlopsPerCycle = 2 * 2 * 4;
+#elif defined(__AVX__)
+        const double dFlopsPerCycle = 2 * 4;
+#else
+        const double dFlopsPerCycle = 2 * 2;
+#endif
+        return dMHz * 1e-3 * dFlopsPerCycle;
+    }();
+    return dPeak64 * 8 / (double)(ulElemBytes < 4 ? 4 : ulElemBytes);
+}
+
+/**
+ * @brief Memory bandwidth of one core in GB/s, measured once by copying
+ * 32 MB buffers
+ *
+ */
+inline double PerfPeakGBytes() {
+    static double dPeak = [] {
+        const char* sPeak = getenv(PERF_PEAK_GBYTES_ENV);
+        if (sPeak != nullptr and atof(sPeak) > 0) return atof(sPeak);
+        const size_t ulSize = (size_t)32 << 20;
+        std::vector<char> vecSrc(ulSize, 1), vecDst(ulSize, 0);
+        double dBest = 1e30;
+        for (int iRun = 0; iRun < 5; ++iRun) {
+            auto Begin = std::chrono::steady_clock::now();
+            memcpy(vecDst.data(), vecSrc.data(), ulSize);
+            dBest = std::min(dBest, std::chrono::duration<double>(std::chrono::steady_clock::now() - Begin).count());
+            vecSrc[iRun] = vecDst[ulSize - 1 - iRun];
+        }
+        /** memcpy reads and writes every byte */
+        return 2.0 * ulSize / dBest / 1e9;
+    }();
+    return dPeak;
+}
+
+/**
+ * @brief What one kernel call achieved, negative where unknown
+ *
+ * @struct dIntensity  flops per byte from memory: LLC misses when counted,
+ *                     otherwise the bytes given by the caller
+ * @struct dRoofGFlops attainable GFLOP/s at dIntensity, min(peak, intensity * bandwidth)
+ * @struct sBound      "memory" or "compute", the roof under the kernel
+ */
+typedef struct {
+    double dIPC;
+    double dL1MissRate;
+    double dLLCMissRate;
+    double dGFlops;
+    double dPeakFraction;
+    double dBytesPerFlop;
+    double dIntensity;
+    double dRoofGFlops;
+    const char* sBound;
+} tPerfMetrics;
+
+/**
+ * @brief Derive the metrics of one call
+ *
+ * @param Delta counters over the call
+ * @param dFlops analytic floating point operations, there is no portable flop event
+ * @param dBytes analytic bytes moved, used when LLC misses are not counted
+ * @param dSeconds wall time of the call
+ * @param ulElemBytes element size for the peak
+ */
+inline tPerfMetrics PerfMetrics(const tPerfSample& Delta, double dFlops, double dBytes, double dSeconds, size_t ulElemBytes = 8) {
+    tPerfMetrics Metrics = { -1, -1, -1, -1, -1, -1, -1, -1, "n/a" };
+    auto Value = [&](emPerfEvent emEvent) { return (double)Delta.aulValues[(int)emEvent]; };
+    if (PerfHas(Delta, emPerfEvent::CYCLES) and PerfHas(Delta, emPerfEvent::INSTRUCTIONS) and Value(emPerfEvent::CYCLES) > 0) {
+        Metrics.dIPC = Value(emPerfEvent::INSTRUCTIONS) / Value(emPerfEvent::CYCLES);
+    }
+    if (PerfHas(Delta, emPerfEvent::L1D_ACCESS) and PerfHas(Delta, emPerfEvent::L1D_MISS) and Value(emPerfEvent::L1D_ACCESS) > 0) {
+        Metrics.dL1MissRate = Value(emPerfEvent::L1D_MISS) / Value(emPerfEvent::L1D_ACCESS);
+    }
+    if (PerfHas(Delta, emPerfEvent::LLC_ACCESS) and PerfHas(Delta, emPerfEvent::LLC_MISS) and Value(emPerfEvent::LLC_ACCESS) > 0) {
+        Metrics.dLLCMissRate = Value(emPerfEvent::LLC_MISS) / Value(emPerfEvent::LLC_ACCESS);
+    }
+    if (PerfHas(Delta, emPerfEvent::LLC_MISS)) dBytes = Value(emPerfEvent::LLC_MISS) * PERF_CACHE_LINE;
+    if (dFlops <= 0 or dSeconds <= 0) return Metrics;
+
+    Metrics.dGFlops = dFlops / dSeconds / 1e9;
+    Metrics.dPeakFraction = Metrics.dGFlops / PerfPeakGFlops(ulElemBytes);
+    if (dBytes > 0) {
+        Metrics.dBytesPerFlop = dBytes / dFlops;
+        Metrics.dIntensity = dFlops / dBytes;
+        const double dMemoryRoof = Metrics.dIntensity * PerfPeakGBytes();
+        Metrics.dRoofGFlops = std::min(PerfPeakGFlops(ulElemBytes), dMemoryRoof);
+        Metrics.sBound = dMemoryRoof < PerfPeakGFlops(ulElemBytes) ? "memory" : "compute";
+    } else {
+        Metrics.dRoofGFlops = PerfPeakGFlops(ulElemBytes);
+        Metrics.sBound = "compute";
+    }
+    return Metrics;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "MPIProcessorInfo.hpp"
+#include "MPIRegionTimer.hpp"
+#include "MapReduce.hpp"
+#include "debug.h"
+
+#ifndef CONFIG_SPLIT_BYTES
+#define CONFIG_SPLIT_BYTES (64 << 20)
+#endif
+
+/**
+ * @brief Emit (word, 1) for every run of characters between white space,
+ * like the StringTokenizer of Hadoop's WordCount
+ *
+ */
+template<typename FEmit>
+void MapWords(const char* pLine, size_t ulLength, FEmit& Emit) {
+    size_t ulBegin = 0;
+    for (size_t idx = 0; idx <= ulLength; ++idx) {
+        if (idx < ulLength and pLine[idx] != ' ' and pLine[idx] != '\t' and pLine[idx] != '\r' and pLine[idx] != '\f') continue;
+        if (idx > ulBegin) Emit(std::string(pLine + ulBegin, idx - ulBegin), (int64_t)1);
+        ulBegin = idx + 1;
+    }
+}
+
+/**
+ * @brief mpirun -n <N> ./WordCount OUTPUT FILE...
+ *
+ * Counts the words of local files (every process must see them, e.g. on NFS)
+ * and writes "word\tcount" lines sorted by word to OUTPUT, the same as
+ * part-r-00000 of hadoop-mapreduce-examples wordcount
+ */
+int main(int argc, char** argv) {
+    MPI_Init(nullptr, nullptr);
+    MPIProcessorInfo Processor;
+    Processor.Bind(MPIProcessorInfo::BindPolicyFromEnv());
+    if (argc < 3) {
+        ON_MAIN_PROC(Processor) {
+            LOGE("Usage: mpirun -n <N> %s OUTPUT FILE...", argv[0]);
+        }
+        LogFinalize();
+        MPI_Finalize();
+        return 1;
+    }
+    const std::vector<std::string> vecPaths(argv + 2, argv + argc);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto begin = MPI_Wtime();
+    mpimath::MapReduce<std::string, int64_t> Job(Processor);
+    Job.Combiner([](int64_t& lAcc, const int64_t& lValue) { lAcc += lValue; });
+    {
+        REGION_SCOPE("map");
+        Job.MapLines(mpimath::InputSplits(vecPaths, CONFIG_SPLIT_BYTES), [](const char* pLine, size_t ulLength, auto& Emit) { MapWords(pLine, ulLength, Emit); });
+    }
+    std::vector<std::pair<std::string, int64_t>> vecCounts;
+    {
+        REGION_SCOPE("reduce");
+        vecCounts = Job.Gather(Job.Reduce([](const std::string&, const std::vector<int64_t>& vecValues) { return vecValues.front(); }));
+    }
+    const mpimath::tMapReduceStats Stats = Job.TotalStats();
+    auto end = MPI_Wtime();
+
+    ON_MAIN_PROC(Processor) {
+        FILE* pOut = fopen(argv[1], "w");
+        if (pOut == nullptr) {
+            LOGE("Can not write %s", argv[1]);
+        } else {
+            for (const auto& Count : vecCounts) fprintf(pOut, "%s\t%lld\n", Count.first.c_str(), (long long)Count.second);
+            fclose(pOut);
+        }
+        LOGI("NumProcesses=%2d;  Time(Second)=%fs;  %llu bytes, %llu words, %llu distinct, %.1f MB/s", Processor.iSize(), end - begin,
+             (unsigned long long)Stats.ulInputBytes, (unsigned long long)Stats.ulEmitted, (unsigned long long)Stats.ulKeys,
+             Stats.ulInputBytes / (end - begin) / 1e6);
+        LOGI("map %fs, shuffle %fs (%llu bytes, %llu spilled), reduce %fs", Stats.dMap, Stats.dShuffle, (unsigned long long)Stats.ulShuffleBytes,
+             (unsigned long long)Stats.ulSpillBytes, Stats.dReduce);
+    }
+
+    MPIRegionFinalize();
+    LogFinalize();
+    MPI_Finalize();
+    return 0;
+}
@@ -5,3 +5,4 @@ cd build && cmake .. && make && cd ..
 
 mpirun -n 4 ./build/Helloworld
 mpirun -n 4 ./build/GetPI
+mpirun -n 4 ./build/GetPI mapreduce
@@ -4,9 +4,14 @@
 #include <numeric>
 #include <iostream>
 #include <math.h>
+#include <climits>
+#include <cstdlib>
+#include <string>
 #include "MPITimer.hpp"
+#include "MPIRegionTimer.hpp"
 #include "MPIProcessorInfo.hpp"
-#include "block.hpp"
+#include "Partition.hpp"
+#include "PrimeCount.hpp"
 #include "debug.h"
 
 static int iError = 0;
@@ -14,17 +19,25 @@ static int iError = 0;
         iError = E; \
         goto error
 
-#define SQUARE(x) ((x) * (x))
+#define SQUARE(x) ((int64_t)(x) * (x))
 
-int main(int argc, char** argv) {
-    /** Input Arguments variables**/
-    int   iN, iNCopy;      /* Sieving from 2, ..., 'n' */
+/**
+ * @brief Count the primes <= iNCopy by sieving the odd numbers, each process
+ * holding one block of them
+ *
+ * @param Processor
+ * @param iNCopy
+ * @param piGlobalCount number of primes, on process 0
+ * @return int MPI_SUCCESS, MPI_ERR_ARG for too many processes or MPI_ERR_NO_MEM
+ */
+int SieveCount(const MPIProcessorInfo& Processor, int iNCopy, int* piGlobalCount) {
+    int   iN;              /* Odd integers 3, 5, ... to test */
 
     /** Block information variables **/
     int   iBlockHighValue; /* Highest value to test (lcl) */
     int   iBlockLowValue;  /* Lowest value to test (lcl) */
     int   iBlockSize;      /* Elements in 'marked' (lcal)*/
-    char* pacMarked;       /* Array to apply mask (lcl)(alloc) */
+    char* pacMarked = NULL; /* Array to apply mask (lcl)(alloc) */
     int   iProc0Size;      /* Size of proc 0's array */
 
     /** Temporary variables **/
@@ -34,42 +47,28 @@ int main(int argc, char** argv) {
 
     /** Result variables **/
     int   iLocalCount;     /* Prime counter (lcl) */
-    int   iGlobalCount;    /* Prime counter (glb)*/
-
+    int   iGlobalCount = 0; /* Prime counter (glb)*/
 
-    /** Init MPI context, start timer **/
-    MPI_Init(&argc, &argv);
-    MPIProcessorInfo Processor;
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPITimer Timer;
-
-
-    /** Parse iN from command line args
-     * @arg argc
-     * @return iN, iNCopy
-     * **/
-    if (argc != 2) {
-        LOGE_S("Incorrect number of arguments. Correct usage: \n$ <EXECUTABLE> <LIMIT:int>");
-        EXIT_ON_ERROR(MPI_ERR_ARG);
-    }
-    std::istringstream(argv[1]) >> iN;
-    iN = std::abs(iN);
-    iNCopy = iN;  // Save a copy of original iN
-    iN = (iN % 2 == 0) ? (iN / 2 - 1) : ((iN - 1) / 2);
+    iError = MPI_SUCCESS;
+    iN = (iNCopy % 2 == 0) ? (iNCopy / 2 - 1) : ((iNCopy - 1) / 2);
     LOGI_S("Number of odd integers to test: %d, max()=%d", iN + 1, 3 + 2 * (iN - 1));
-    if (iN == 0) {
-        LOGI_S("There are 1 prime less than or equal to %d", iNCopy);
-        goto error;
+    if (iN <= 0) {
+        *piGlobalCount = iNCopy >= 2 ? 1 : 0;
+        return iError;
     }
 
-    /** Use BLOCK_* macros to calculate current process's share of
-     * the array
+    /** Block partition of the iN odd numbers 3, 5, ..., the index i
+     * stands for 3 + 2 * i
      * @arg Processor
      * @return iBlockLowValue, iBlockHighValue, iBlockSize**/
-    iBlockLowValue = BLOCK_LOW(Processor.iRank(), Processor.iSize(), iN);
-    iBlockHighValue = BLOCK_HIGH(Processor.iRank(), Processor.iSize(), iN);
-    iBlockSize = BLOCK_SIZE(Processor.iRank(), Processor.iSize(), iN);
-    // iBlockSize = (iBlockHighValue - iBlockLowValue) /2 + 1;
+    {
+        const auto Odds = mpimath::Partition<int64_t>::Block(iN, Processor.iSize());
+        iBlockLowValue = (int)(3 + 2 * Odds.Low(Processor.iRank()));
+        iBlockHighValue = (int)(3 + 2 * Odds.High(Processor.iRank()));
+        iBlockSize = (int)Odds.Size(Processor.iRank());
+        /** Rank 0 holds the largest block */
+        iProc0Size = (int)Odds.Size(0) - 1;
+    }
     LOGD("[%d]L=%d, H=%d, Sz=%d", Processor.iRank(), iBlockLowValue, iBlockHighValue, iBlockSize);
 
 
@@ -77,7 +76,6 @@ int main(int argc, char** argv) {
      * not `all` held by process 0, quit because their are too many
      * processes
      * @arg Processor, iNCopy**/
-    iProc0Size = (iN - 1) / Processor.iSize();
     if ((2 + iProc0Size) < (int)std::sqrt(iNCopy)) {//
         LOGE_S("Too many processes(%d) for problem %d\n", Processor.iSize(), iNCopy);
         EXIT_ON_ERROR(MPI_ERR_ARG);
@@ -86,7 +84,11 @@ int main(int argc, char** argv) {
     /** Allocate sieving array for current process
      * @arg Processor, iBlockSize, iBlockLowValue, iBlockHighValue
      * FIXME: Why use char not bool(bit array) **/
-    pacMarked = (char*)calloc(iBlockSize, 1);
+    {
+        REGION_SCOPE("alloc");
+        pacMarked = (char*)calloc(iBlockSize, 1);
+        REGION_BYTES(iBlockSize);
+    }
     if (pacMarked == NULL) {
         LOGE("[%d]Failed to allocate %d bytes of memory\n", iBlockSize, Processor.iRank());
         EXIT_ON_ERROR(MPI_ERR_NO_MEM);
@@ -95,44 +97,127 @@ int main(int argc, char** argv) {
     /** ----------- BEGIN SIEVING ----------- **/
     if (Processor.iRank() == 0) iIndex = 0; // Index
     iPrime = 3; // Skip 2, start from 3
-    do {
-        /** Find index of `first` multiple of odd number **/
-        if (SQUARE(iPrime) > iBlockLowValue)
-            iFirst = (SQUARE(iPrime) - iBlockLowValue) / 2;
-        else {
-            if (!(iBlockLowValue % iPrime))
-                iFirst = 0;
-            else
-                iFirst = ((iPrime - iBlockLowValue % iPrime) % 2 == 0) ? ((iPrime - iBlockLowValue % iPrime) / 2) : ((iPrime - iBlockLowValue % iPrime + iPrime) / 2);
-        }
-
-        /** Mark multiples of prime **/
-        for (auto i = iFirst; i < iBlockSize; i += iPrime) pacMarked[i] = 1;
-        if (Processor.iRank() == 0) {
-            while (pacMarked[++iIndex]);
-            iPrime = 2 * iIndex + 3; // Prime -> Next unmarked prime (not index)
-        }
-        /** Broadcast the found prime to other processes **/
-        if (Processor.iSize() > 1) MPI_Bcast(&iPrime, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    } while (SQUARE(iPrime) <= 3 + 2 * (iN - 1));
+    {
+        REGION_SCOPE("sieve");
+        do {
+            /** Find index of `first` multiple of odd number **/
+            if (SQUARE(iPrime) > iBlockLowValue)
+                iFirst = (SQUARE(iPrime) - iBlockLowValue) / 2;
+            else {
+                if (!(iBlockLowValue % iPrime))
+                    iFirst = 0;
+                else
+                    iFirst = ((iPrime - iBlockLowValue % iPrime) % 2 == 0) ? ((iPrime - iBlockLowValue % iPrime) / 2) : ((iPrime - iBlockLowValue % iPrime + iPrime) / 2);
+            }
+
+            /** Mark multiples of prime **/
+            {
+                REGION_SCOPE("mark");
+                for (auto i = iFirst; i < iBlockSize; i += iPrime) pacMarked[i] = 1;
+                if (Processor.iRank() == 0) {
+                    while (pacMarked[++iIndex]);
+                    iPrime = 2 * iIndex + 3; // Prime -> Next unmarked prime (not index)
+                }
+            }
+            /** Broadcast the found prime to other processes **/
+            if (Processor.iSize() > 1) {
+                REGION_SCOPE("bcast");
+                MPI_Bcast(&iPrime, 1, MPI_INT, 0, MPI_COMM_WORLD);
+                REGION_BYTES(sizeof(int));
+            }
+        } while (SQUARE(iPrime) <= 3 + 2 * (iN - 1));
+    }
     /** ------------ END SIEVING ------------ **/
 
     /** Summarize **/
-    iLocalCount = iBlockSize - std::accumulate(pacMarked, pacMarked + iBlockSize, 0);
+    {
+        REGION_SCOPE("count");
+        iLocalCount = iBlockSize - std::accumulate(pacMarked, pacMarked + iBlockSize, 0);
+    }
     LOGD("[%d]iLocalCount=%d, iBlockSize=%d", Processor.iRank(), iLocalCount, iBlockSize);
     if (Processor.iSize() > 1) {
-        /** Sum with reduce only when multiple processes **/
-        MPI_Reduce(&iLocalCount, &iGlobalCount, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+        /** Sum with reduce only when multiple processes, inside every node first **/
+        REGION_SCOPE("reduce");
+        Processor.NodeReduce(&iLocalCount, &iGlobalCount, 1, MPI_INT, MPI_SUM);
+        REGION_BYTES(sizeof(int));
     } else {
         iGlobalCount = iLocalCount;
     }
 
-    /** Print the results **/
-    LOGI_S("There are %d primes <= %d\n", iGlobalCount + 1, iNCopy);
-    /*** `+1` since we ignored the prime number 2    ~~^ **/
-    LOGI_S("Duration with (%d) procs=%.6fs\n", Processor.iSize(), Timer.TimeDelta());
+    /*** `+1` since we ignored the prime number 2 **/
+    *piGlobalCount = iGlobalCount + 1;
+
+error:
+    free(pacMarked);
+    return iError;
+}
+
+/**
+ * @brief mpirun -n <N> ./GetPrime <LIMIT> [sieve|lmo|check]
+ *
+ * sieve (the default) marks the multiples of every prime in blocks of the
+ * odd numbers up to LIMIT (< 2^31); lmo counts with the Lagarias-Miller-Odlyzko
+ * method of PrimeCount.hpp in about LIMIT^(2/3) time, for LIMIT up to about
+ * 1e18 (1e13 style input is accepted); check runs both and fails on a
+ * mismatch
+ */
+int main(int argc, char** argv) {
+    int64_t lN;                /* Counting the primes of 2, ..., 'n' */
+    std::string sMode = "sieve";
+    int iSieveCount = 0;
+    int64_t lLMOCount = 0;
+
+    /** Init MPI context, start timer **/
+    MPI_Init(&argc, &argv);
+    MPIProcessorInfo Processor;
+    Processor.Bind(MPIProcessorInfo::BindPolicyFromEnv());
+
+    /** Parse lN and the mode from command line args **/
+    if (argc != 2 and argc != 3) {
+        LOGE_S("Incorrect number of arguments. Correct usage: \n$ <EXECUTABLE> <LIMIT:int> [sieve|lmo|check]");
+        EXIT_ON_ERROR(MPI_ERR_ARG);
+    }
+    lN = std::llabs((long long)strtold(argv[1], nullptr));
+    if (argc == 3) sMode = argv[2];
+    if (sMode != "sieve" and sMode != "lmo" and sMode != "check") {
+        LOGE_S("Unknown mode %s, use sieve, lmo or check", sMode.c_str());
+        EXIT_ON_ERROR(MPI_ERR_ARG);
+    }
+    if (sMode != "lmo" and lN > INT_MAX) {
+        LOGE_S("The sieve counts up to %d, use lmo for %lld", INT_MAX, (long long)lN);
+        EXIT_ON_ERROR(MPI_ERR_ARG);
+    }
+
+    if (sMode != "lmo") {
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPITimer Timer;
+        {
+            REGION_SCOPE("sieve");
+            iError = SieveCount(Processor, (int)lN, &iSieveCount);
+        }
+        if (iError != MPI_SUCCESS) goto error;
+        LOGI_S("There are %d primes <= %lld\n", iSieveCount, (long long)lN);
+        LOGI_S("Duration with (%d) procs=%.6fs\n", Processor.iSize(), Timer.TimeDelta());
+    }
+    if (sMode != "sieve") {
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPITimer Timer;
+        {
+            REGION_SCOPE("lmo");
+            lLMOCount = mpimath::PrimeCountLMO(lN, Processor);
+        }
+        LOGI_S("There are %lld primes <= %lld (LMO)\n", (long long)lLMOCount, (long long)lN);
+        LOGI_S("Duration with (%d) procs x (%u) threads=%.6fs\n", Processor.iSize(), mpimath::PrimeCountThreads(Processor), Timer.TimeDelta());
+    }
+    if (sMode == "check") MPI_Bcast(&iSieveCount, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (sMode == "check" and lLMOCount != iSieveCount) {
+        LOGE_S("LMO counts %lld primes, the sieve %d", (long long)lLMOCount, iSieveCount);
+        EXIT_ON_ERROR(MPI_ERR_OTHER);
+    }
+    MPIRegionFinalize();
+    LogFinalize();
 
 error:
     MPI_Finalize();
     exit(iError);
-}
\ No newline at end of file
+}
@@ -0,0 +1,537 @@
+/**
+ * @file Logger.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Asynchronous backend of the LOGx macros in debug.h
+ * @version 0.1
+ * @date 2022-06-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * A LOGx call that passes the level check formats its line into a lock-free
+ * ring of the calling thread and returns; a background thread drains the
+ * rings in time order and writes them out. Errors wait until they are
+ * written, so nothing is lost before an abort.
+ *
+ * The level is read at run time, LOG_LEVEL only removes the calls above it:
+ *
+ *     MPIMATH_LOG_LEVEL=error|warning|info|debug (or 0-4), default info
+ *     MPIMATH_LOG_SYNC=1      write at the call site, as before
+ *     MPIMATH_LOG_FORWARD=1   ranks other than 0 send their lines to rank 0
+ *
+ * Forwarded lines are sent by the background thread when MPI runs with
+ * MPI_THREAD_MULTIPLE, otherwise they are kept until LogFinalize(), which is
+ * collective and goes before MPI_Finalize. Lines still held at exit are
+ * written locally. The background thread sleeps until there is work, so rank
+ * 0 prints what arrived on its next pass, by LogFinalize() at the latest.
+ */
+#ifndef _LOGGER_H
+#define _LOGGER_H
+
+#include <mpi.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LEVEL_DISABLE 0
+#define LEVEL_ERROR 1
+#define LEVEL_WARNING 2
+#define LEVEL_INFO 3
+#define LEVEL_DEBUG 4
+
+/** Records kept per thread, a full ring makes its thread wait */
+#ifndef CONFIG_LOG_RING_SIZE
+#define CONFIG_LOG_RING_SIZE 256
+#endif
+
+/** Yields of the background thread before it sleeps until the next line */
+#ifndef CONFIG_LOG_IDLE_SPINS
+#define CONFIG_LOG_IDLE_SPINS 64
+#endif
+
+/** Longer lines are cut and end with "..." */
+#ifndef CONFIG_LOG_RECORD_BYTES
+#define CONFIG_LOG_RECORD_BYTES 256
+#endif
+
+#define LOG_LEVEL_ENV "MPIMATH_LOG_LEVEL"
+#define LOG_SYNC_ENV "MPIMATH_LOG_SYNC"
+#define LOG_FORWARD_ENV "MPIMATH_LOG_FORWARD"
+/** Tag of forwarded lines on MPI_COMM_WORLD, the first byte says if more follow */
+#define LOG_FORWARD_TAG 32101
+
+typedef struct {
+    uint64_t ulTime;
+    int iLength;
+    char acText[CONFIG_LOG_RECORD_BYTES];
+} tLogRecord;
+
+/**
+ * @brief Lines of one thread: the owner writes at ulHead, the background
+ * thread reads from ulTail
+ *
+ * A ring is never freed; when its thread exits it goes back to the pool and
+ * the next new thread takes it over.
+ */
+typedef struct tLogRing {
+    tLogRecord aRecords[CONFIG_LOG_RING_SIZE];
+    std::atomic<uint64_t> ulHead;
+    std::atomic<uint64_t> ulTail;
+    std::atomic<bool> bOwned;
+    struct tLogRing* pNext;
+} tLogRing;
+
+inline int _LogLevelFromEnv() {
+    const char* sLevel = getenv(LOG_LEVEL_ENV);
+    int iLevel = LEVEL_INFO;
+    if (sLevel != nullptr) {
+        const char* asNames[] = { "disable", "error", "warning", "info", "debug" };
+        iLevel = sLevel[0] >= '0' and sLevel[0] <= '9' ? atoi(sLevel) : -1;
+        for (int idx = 0; idx <= LEVEL_DEBUG; ++idx) {
+            if (strcasecmp(sLevel, asNames[idx]) == 0) iLevel = idx;
+        }
+        if (iLevel < 0) iLevel = LEVEL_INFO;
+    }
+    return std::min(std::max(iLevel, (int)LEVEL_DISABLE), (int)LEVEL_DEBUG);
+}
+
+inline bool _LogFlagFromEnv(const char* sName) {
+    const char* sValue = getenv(sName);
+    return sValue != nullptr and atoi(sValue) != 0;
+}
+
+/** Current level, the only thing a LOGx call reads before it knows it has to print */
+inline std::atomic<int> _iLogLevel{ _LogLevelFromEnv() };
+inline std::atomic<bool> _bLogSync{ _LogFlagFromEnv(LOG_SYNC_ENV) };
+inline std::atomic<bool> _bLogForward{ _LogFlagFromEnv(LOG_FORWARD_ENV) };
+/** Rank and size in MPI_COMM_WORLD, -1 until MPI is up */
+inline std::atomic<int> _iLogRank{ -1 };
+inline std::atomic<int> _iLogSize{ -1 };
+inline std::atomic<bool> _bLogThreadMultiple{ false };
+inline std::atomic<FILE*> _pLogOutput{ nullptr };
+
+inline int LogGetLevel() {
+    return _iLogLevel.load(std::memory_order_relaxed);
+}
+
+inline void LogSetLevel(int iLevel) {
+    _iLogLevel.store(std::min(std::max(iLevel, (int)LEVEL_DISABLE), (int)LEVEL_DEBUG), std::memory_order_relaxed);
+}
+
+/** Where the lines go, stderr if nullptr */
+inline void LogSetOutput(FILE* pFile) {
+    _pLogOutput.store(pFile, std::memory_order_release);
+}
+
+inline FILE* LogOutput() {
+    FILE* pFile = _pLogOutput.load(std::memory_order_acquire);
+    return pFile == nullptr ? stderr : pFile;
+}
+
+/** Same on every rank, before the first line that should be forwarded */
+inline void LogSetForward(bool bForward) {
+    _bLogForward.store(bForward, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Rank in MPI_COMM_WORLD, asked from MPI once
+ *
+ * @return int -1 before MPI_Init and after MPI_Finalize
+ */
+inline int LogRank() {
+    int iRank = _iLogRank.load(std::memory_order_relaxed);
+    if (iRank < 0) {
+        int bInit = 0, bFinal = 0;
+        MPI_Initialized(&bInit);
+        MPI_Finalized(&bFinal);
+        if (bInit and not bFinal) {
+            int iSize = 1, iThreadLevel = MPI_THREAD_SINGLE;
+            MPI_Comm_rank(MPI_COMM_WORLD, &iRank);
+            MPI_Comm_size(MPI_COMM_WORLD, &iSize);
+            MPI_Query_thread(&iThreadLevel);
+            _iLogSize.store(iSize, std::memory_order_relaxed);
+            _bLogThreadMultiple.store(iThreadLevel == MPI_THREAD_MULTIPLE, std::memory_order_relaxed);
+            _iLogRank.store(iRank, std::memory_order_release);
+        }
+    }
+    return iRank;
+}
+
+/** Lines of this rank go to rank 0 */
+inline bool _LogForwarding() {
+    return _bLogForward.load(std::memory_order_relaxed) and _iLogRank.load(std::memory_order_acquire) > 0 and
+           _iLogSize.load(std::memory_order_relaxed) > 1;
+}
+
+inline uint64_t _LogNow() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Rings of all threads that ever logged, a push only list */
+inline std::atomic<tLogRing*>& LogRings() {
+    static std::atomic<tLogRing*> pRings{ nullptr };
+    return pRings;
+}
+
+inline tLogRing* LogThreadRing() {
+    /** Gives the ring back when the thread exits */
+    struct tOwner {
+        tLogRing* pRing = nullptr;
+        ~tOwner() {
+            if (pRing != nullptr) pRing->bOwned.store(false, std::memory_order_release);
+        }
+    };
+    thread_local tOwner Owner;
+    if (Owner.pRing == nullptr) {
+        for (tLogRing* pRing = LogRings().load(std::memory_order_acquire); pRing != nullptr; pRing = pRing->pNext) {
+            bool bFree = false;
+            if (pRing->bOwned.compare_exchange_strong(bFree, true, std::memory_order_acquire)) {
+                Owner.pRing = pRing;
+                return pRing;
+            }
+        }
+        tLogRing* pNew = new tLogRing;
+        pNew->ulHead.store(0, std::memory_order_relaxed);
+        pNew->ulTail.store(0, std::memory_order_relaxed);
+        pNew->bOwned.store(true, std::memory_order_relaxed);
+        pNew->pNext = LogRings().load(std::memory_order_relaxed);
+        while (not LogRings().compare_exchange_weak(pNew->pNext, pNew, std::memory_order_release, std::memory_order_relaxed));
+        Owner.pRing = pNew;
+    }
+    return Owner.pRing;
+}
+
+/**
+ * @brief The background thread, started by the first asynchronous line and
+ * stopped at exit after writing everything left
+ *
+ */
+class LogBackend {
+public:
+    /** Never destroyed, an atexit handler stops the thread and writes the rest */
+    static LogBackend& Get() {
+        static LogBackend* pBackend = [] {
+            LogBackend* pNew = new LogBackend;
+            std::atexit([] { LogBackend::Get().Stop(); });
+            return pNew;
+        }();
+        return *pBackend;
+    }
+
+    /** Ask for a pass over the rings without waiting for it, cheap unless the thread sleeps */
+    void Wake() {
+        /** Pairs with the fence in _Run: either it sees the new line or we see it asleep */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (not bIdle.load(std::memory_order_relaxed)) return;
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            bIdle.store(false, std::memory_order_relaxed);
+        }
+        CondWork.notify_one();
+    }
+
+    /** Returns when every line logged before the call has been handled */
+    void Flush() {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        if (bStop) {
+            _Drain();
+            return;
+        }
+        const uint64_t ulWant = ++ulRequested;
+        CondWork.notify_one();
+        CondDone.wait(Lock, [&] { return ulDone >= ulWant; });
+    }
+
+    /**
+     * @brief Stop using MPI from the background thread and hand over the
+     * lines not yet sent
+     *
+     * @param iEnded on rank 0, ranks whose last message already arrived
+     */
+    std::string TakeForwarded(int& iEnded) {
+        bForwardClosed.store(true, std::memory_order_release);
+        Flush();
+        std::lock_guard<std::mutex> Lock(Mutex);
+        std::string sText;
+        sText.swap(sOutbox);
+        iEnded = iForwardEnded;
+        return sText;
+    }
+
+    /** Later lines are written at the call site */
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            if (bStop) return;
+            bStop = true;
+        }
+        CondWork.notify_one();
+        if (Thread.joinable()) Thread.join();
+        std::lock_guard<std::mutex> Lock(Mutex);
+        _bLogSync.store(true, std::memory_order_relaxed);
+        _Drain();
+        /** MPI may be gone, whatever was meant for rank 0 is written here */
+        if (not sOutbox.empty()) _Write(sOutbox);
+        sOutbox.clear();
+    }
+
+    LogBackend(const LogBackend&) = delete;
+    LogBackend& operator=(const LogBackend&) = delete;
+
+private:
+    LogBackend() : Thread([this] { _Run(); }) {}
+
+    void _Run() {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        while (true) {
+            const uint64_t ulWant = ulRequested;
+            _Drain();
+            if (bForwardLive or not dequeSending.empty()) {
+                Lock.unlock();
+                _Exchange();
+                Lock.lock();
+            }
+            ulDone = ulWant;
+            CondDone.notify_all();
+            if (bStop) break;
+            if (ulRequested != ulWant) continue;
+            /** A burst keeps coming, a few yields let it fill the rings instead of waking us per line */
+            Lock.unlock();
+            for (int iSpin = 0; iSpin < CONFIG_LOG_IDLE_SPINS and not _Pending(); ++iSpin) std::this_thread::yield();
+            Lock.lock();
+            if (bStop or ulRequested != ulWant or _Pending()) continue;
+            /** Sleep until a producer, Flush or Stop wakes us */
+            bIdle.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (not _Pending()) {
+                CondWork.wait(Lock, [&] { return not bIdle.load(std::memory_order_relaxed) or bStop or ulRequested != ulWant; });
+            }
+            bIdle.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    /** Some ring holds a line not taken yet */
+    bool _Pending() const {
+        for (tLogRing* pRing = LogRings().load(std::memory_order_acquire); pRing != nullptr; pRing = pRing->pNext) {
+            if (pRing->ulHead.load(std::memory_order_acquire) != pRing->ulTail.load(std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+
+    /** Take the lines of every ring, merged in time order, with Mutex held */
+    void _Drain() {
+        const bool bForward = _LogForwarding();
+        const bool bOpen = _bLogThreadMultiple.load(std::memory_order_relaxed) and not bForwardClosed.load(std::memory_order_acquire);
+        bForwardLive = bOpen and (bForward or (_bLogForward.load(std::memory_order_relaxed) and _iLogRank.load(std::memory_order_acquire) == 0 and
+                                               _iLogSize.load(std::memory_order_relaxed) > 1));
+
+        vecBatch.clear();
+        vecTaken.clear();
+        for (tLogRing* pRing = LogRings().load(std::memory_order_acquire); pRing != nullptr; pRing = pRing->pNext) {
+            const uint64_t ulTail = pRing->ulTail.load(std::memory_order_relaxed);
+            const uint64_t ulHead = pRing->ulHead.load(std::memory_order_acquire);
+            for (uint64_t ulPos = ulTail; ulPos < ulHead; ++ulPos) vecBatch.push_back(&pRing->aRecords[ulPos % CONFIG_LOG_RING_SIZE]);
+            if (ulHead != ulTail) vecTaken.emplace_back(pRing, ulHead);
+        }
+        if (vecBatch.empty()) return;
+
+        /** Each ring is in order already, the sort only interleaves them */
+        std::stable_sort(vecBatch.begin(), vecBatch.end(), [](const tLogRecord* pA, const tLogRecord* pB) { return pA->ulTime < pB->ulTime; });
+        std::string sText;
+        const std::string sPrefix = bForward ? "[" + std::to_string(_iLogRank.load(std::memory_order_relaxed)) + "] " : "";
+        for (const tLogRecord* pRecord : vecBatch) {
+            sText += sPrefix;
+            sText.append(pRecord->acText, pRecord->iLength);
+        }
+        /** Copied, the owners may reuse the slots */
+        for (const auto& Taken : vecTaken) Taken.first->ulTail.store(Taken.second, std::memory_order_release);
+
+        if (bForward) {
+            sOutbox += sText;
+        } else {
+            _Write(sText);
+        }
+    }
+
+    void _Write(const std::string& sText) {
+        FILE* pFile = LogOutput();
+        fwrite(sText.data(), 1, sText.size(), pFile);
+        fflush(pFile);
+    }
+
+    /**
+     * @brief Send the outbox to rank 0, or on rank 0 print what arrived;
+     * only with MPI_THREAD_MULTIPLE
+     *
+     * A message starts with '+', or with '.' if it is the last one of its
+     * rank (sent by LogFinalize).
+     */
+    void _Exchange() {
+        int bFinal = 0;
+        MPI_Finalized(&bFinal);
+        if (bFinal) {
+            /** LogFinalize was skipped, the lines are written at exit */
+            bForwardClosed.store(true, std::memory_order_release);
+            dequeSending.clear();
+            return;
+        }
+        const bool bClosing = bForwardClosed.load(std::memory_order_acquire);
+        if (_iLogRank.load(std::memory_order_relaxed) == 0) {
+            int bFlag = 0;
+            MPI_Status Status;
+            while (not bClosing and MPI_Iprobe(MPI_ANY_SOURCE, LOG_FORWARD_TAG, MPI_COMM_WORLD, &bFlag, &Status) == MPI_SUCCESS and bFlag) {
+                int iCount = 0;
+                MPI_Get_count(&Status, MPI_CHAR, &iCount);
+                std::string sMessage(iCount, '\0');
+                MPI_Recv(&sMessage[0], iCount, MPI_CHAR, Status.MPI_SOURCE, LOG_FORWARD_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                _Write(sMessage.substr(1));
+                std::lock_guard<std::mutex> Lock(Mutex);
+                iForwardEnded += sMessage[0] == '.';
+            }
+        } else if (not bClosing) {
+            std::string sText;
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                sText.swap(sOutbox);
+            }
+            if (not sText.empty()) {
+                dequeSending.emplace_back("+" + sText, MPI_REQUEST_NULL);
+                auto& Sending = dequeSending.back();
+                MPI_Isend(&Sending.first[0], (int)Sending.first.size(), MPI_CHAR, 0, LOG_FORWARD_TAG, MPI_COMM_WORLD, &Sending.second);
+            }
+        }
+        /** Every send completes before forwarding closes, so the last message comes last */
+        while (not dequeSending.empty()) {
+            int bFlag = 1;
+            if (bClosing) {
+                MPI_Wait(&dequeSending.front().second, MPI_STATUS_IGNORE);
+            } else {
+                MPI_Test(&dequeSending.front().second, &bFlag, MPI_STATUS_IGNORE);
+            }
+            if (not bFlag) break;
+            dequeSending.pop_front();
+        }
+    }
+
+    std::mutex Mutex;
+    std::condition_variable CondWork;
+    std::condition_variable CondDone;
+    uint64_t ulRequested = 0;
+    uint64_t ulDone = 0;
+    bool bStop = false;
+    /** The background thread waits on CondWork, set and cleared with Mutex held */
+    std::atomic<bool> bIdle{ false };
+    bool bForwardLive = false;
+    int iForwardEnded = 0;
+    std::atomic<bool> bForwardClosed{ false };
+    std::vector<const tLogRecord*> vecBatch;
+    std::vector<std::pair<tLogRing*, uint64_t>> vecTaken;
+    std::string sOutbox;
+    /** Touched by the background thread only */
+    std::deque<std::pair<std::string, MPI_Request>> dequeSending;
+    std::thread Thread;
+};
+
+/** Write every line logged so far before returning */
+inline void LogFlush() {
+    if (not _bLogSync.load(std::memory_order_relaxed)) LogBackend::Get().Flush();
+}
+
+/** Switch between writing at the call site and the background thread */
+inline void LogSetSync(bool bSync) {
+    if (bSync) LogFlush();
+    _bLogSync.store(bSync, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Format one line, the level check is done by the caller
+ *
+ * The line is cut to CONFIG_LOG_RECORD_BYTES. Errors are flushed before
+ * returning.
+ */
+inline void LogWrite(int iLevel, const char* sFormat, ...) __attribute__((format(printf, 2, 3)));
+inline void LogWrite(int iLevel, const char* sFormat, ...) {
+    va_list Args;
+    va_start(Args, sFormat);
+    if (_bLogSync.load(std::memory_order_relaxed)) {
+        vfprintf(LogOutput(), sFormat, Args);
+        va_end(Args);
+        return;
+    }
+    /** The background thread needs the rank to know where forwarded lines go */
+    if (_bLogForward.load(std::memory_order_relaxed)) LogRank();
+    LogBackend& Backend = LogBackend::Get();
+    tLogRing* pRing = LogThreadRing();
+    const uint64_t ulHead = pRing->ulHead.load(std::memory_order_relaxed);
+    while (ulHead - pRing->ulTail.load(std::memory_order_acquire) >= CONFIG_LOG_RING_SIZE) {
+        Backend.Wake();
+        std::this_thread::yield();
+    }
+    tLogRecord& Record = pRing->aRecords[ulHead % CONFIG_LOG_RING_SIZE];
+    const int iLength = vsnprintf(Record.acText, CONFIG_LOG_RECORD_BYTES, sFormat, Args);
+    va_end(Args);
+    if (iLength < 0) {
+        Record.iLength = 0;
+    } else if (iLength >= CONFIG_LOG_RECORD_BYTES) {
+        memcpy(Record.acText + CONFIG_LOG_RECORD_BYTES - 5, "...\n", 5);
+        Record.iLength = CONFIG_LOG_RECORD_BYTES - 1;
+    } else {
+        Record.iLength = iLength;
+    }
+    Record.ulTime = _LogNow();
+    pRing->ulHead.store(ulHead + 1, std::memory_order_release);
+    if (iLevel <= LEVEL_ERROR) {
+        Backend.Flush();
+    } else {
+        Backend.Wake();
+    }
+}
+
+/**
+ * @brief Collective: every line forwarded so far is printed by rank 0,
+ * later lines are written by their own rank
+ *
+ * Call before MPI_Finalize; without MPIMATH_LOG_FORWARD it only flushes.
+ */
+inline void LogFinalize() {
+    LogRank();
+    if (_bLogSync.load(std::memory_order_relaxed)) return;
+    LogBackend& Backend = LogBackend::Get();
+    if (not _bLogForward.load(std::memory_order_relaxed) or _iLogSize.load(std::memory_order_relaxed) <= 1) {
+        _bLogForward.store(false, std::memory_order_relaxed);
+        Backend.Flush();
+        return;
+    }
+    const int iRank = _iLogRank.load(std::memory_order_relaxed);
+    int iEnded = 0;
+    std::string sText = "." + Backend.TakeForwarded(iEnded);
+    if (iRank != 0) {
+        MPI_Send(&sText[0], (int)sText.size(), MPI_CHAR, 0, LOG_FORWARD_TAG, MPI_COMM_WORLD);
+    } else {
+        FILE* pFile = LogOutput();
+        for (int iLeft = _iLogSize.load(std::memory_order_relaxed) - 1 - iEnded; iLeft > 0;) {
+            MPI_Status Status;
+            int iCount = 0;
+            MPI_Probe(MPI_ANY_SOURCE, LOG_FORWARD_TAG, MPI_COMM_WORLD, &Status);
+            MPI_Get_count(&Status, MPI_CHAR, &iCount);
+            std::string sMessage(iCount, '\0');
+            MPI_Recv(&sMessage[0], iCount, MPI_CHAR, Status.MPI_SOURCE, LOG_FORWARD_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (sMessage[0] == '.') iLeft--;
+            fwrite(sMessage.data() + 1, 1, sMessage.size() - 1, pFile);
+        }
+        fflush(pFile);
+    }
+    _bLogForward.store(false, std::memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,483 @@
+/**
+ * @file MPIRegionTimer.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Scoped, nested timing regions per rank and thread, merged across
+ * ranks at the end of the run and exported as a Chrome trace
+ * @version 0.1
+ * @date 2022-06-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Build with -DCONFIG_ENABLE_TRACE=1 to record, otherwise REGION_SCOPE and
+ * REGION_BYTES compile to nothing.
+ *
+ *     {
+ *         REGION_SCOPE("bcast_n");
+ *         MPI_Bcast(...);
+ *         REGION_BYTES(ulSize * sizeof(double));
+ *     }
+ *     ...
+ *     MPIRegionFinalize();   // collective, before MPI_Finalize
+ *
+ * MPIRegionFinalize logs min / avg / max time per rank of every region path,
+ * and writes a trace for chrome://tracing or ui.perfetto.dev to the file
+ * named by $MPI_TRACE_FILE. With $MPI_TRACE_COUNTERS=1 every region also
+ * reads the hardware counters of PerfCounters.hpp at both ends.
+ */
+#ifndef _MPIREGIONTIMER_H
+#define _MPIREGIONTIMER_H
+
+#include <mpi.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include "MPITimer.hpp"
+#include "PerfCounters.hpp"
+#include "debug.h"
+
+#ifndef CONFIG_ENABLE_TRACE
+#define CONFIG_ENABLE_TRACE 0
+#endif
+
+/** Events kept per thread, the oldest are overwritten */
+#ifndef CONFIG_TRACE_RING_SIZE
+#define CONFIG_TRACE_RING_SIZE 16384
+#endif
+
+/** Chrome trace written by MPIRegionFinalize, none if unset */
+#define REGION_TRACE_ENV "MPI_TRACE_FILE"
+/** Set to 1 to count hardware events per region */
+#define REGION_COUNTERS_ENV "MPI_TRACE_COUNTERS"
+
+/**
+ * @brief One closed region
+ *
+ * @struct sName    leaf name, a string literal
+ * @struct iDepth   number of enclosing regions on the same thread
+ * @struct Counters hardware events inside the region, uMask is 0 if not counted
+ */
+typedef struct {
+    const char* sName;
+    double dBegin;
+    double dEnd;
+    uint64_t ulBytes;
+    int iDepth;
+    tPerfSample Counters;
+} tRegionEvent;
+
+/**
+ * @brief Events of one thread, written by that thread only
+ *
+ * ulHead is published with release order after the event is complete, the
+ * reader takes [ulTail, ulHead).
+ */
+typedef struct tRegionRing {
+    tRegionEvent aEvents[CONFIG_TRACE_RING_SIZE];
+    std::atomic<uint64_t> ulHead;
+    uint64_t ulTail;
+    int iThread;
+    PerfCounters* pCounters;
+    struct tRegionRing* pNext;
+} tRegionRing;
+
+/**
+ * @brief Merged statistics of one region path, times in seconds
+ *
+ * @struct iRanks       ranks that entered the region
+ * @struct ulCalls      calls over all ranks
+ * @struct dMin, dAvg, dMax  total time per rank, over iRanks
+ * @struct dImbalance   dMax / dAvg
+ * @struct ulBytes      bytes over all ranks
+ * @struct Counters     hardware events over all ranks
+ */
+typedef struct {
+    std::string sPath;
+    int iRanks;
+    uint64_t ulCalls;
+    double dMin;
+    double dAvg;
+    double dMax;
+    double dImbalance;
+    uint64_t ulBytes;
+    tPerfSample Counters;
+} tRegionSummary;
+
+/** Rings of all threads that ever recorded, a push only list */
+inline std::atomic<tRegionRing*>& RegionRings() {
+    static std::atomic<tRegionRing*> pRings{ nullptr };
+    return pRings;
+}
+
+inline tRegionRing* RegionThreadRing() {
+    static std::atomic<int> iThreads{ 0 };
+    /** Never freed: the thread may be gone when the events are collected */
+    thread_local tRegionRing* pRing = [] {
+        tRegionRing* pNew = new tRegionRing;
+        pNew->ulHead.store(0, std::memory_order_relaxed);
+        pNew->ulTail = 0;
+        pNew->iThread = iThreads.fetch_add(1);
+        pNew->pCounters = nullptr;
+        const char* sCounters = getenv(REGION_COUNTERS_ENV);
+        if (sCounters != nullptr and atoi(sCounters) != 0) {
+            pNew->pCounters = new PerfCounters;
+            if (not pNew->pCounters->bAvailable()) {
+                delete pNew->pCounters;
+                pNew->pCounters = nullptr;
+            }
+        }
+        pNew->pNext = RegionRings().load(std::memory_order_relaxed);
+        while (not RegionRings().compare_exchange_weak(pNew->pNext, pNew, std::memory_order_release,
+                                                       std::memory_order_relaxed));
+        return pNew;
+    }();
+    return pRing;
+}
+
+/**
+ * @brief Times its own lifetime as a region nested in the innermost open
+ * region of the thread
+ *
+ */
+class MPIRegionTimer : public MPITimer {
+public:
+    explicit MPIRegionTimer(const char* sName) : sName(sName), pParent(Current()), pRing(RegionThreadRing()) {
+        iDepth = pParent == nullptr ? 0 : pParent->iDepth + 1;
+        Current() = this;
+        if (pRing->pCounters != nullptr) Begin = pRing->pCounters->Read();
+    }
+    ~MPIRegionTimer() {
+        double dEnd = MPI_Wtime();
+        tPerfSample Counters = { { 0 }, 0 };
+        if (pRing->pCounters != nullptr) Counters = PerfDelta(pRing->pCounters->Read(), Begin);
+        Current() = pParent;
+        uint64_t ulHead = pRing->ulHead.load(std::memory_order_relaxed);
+        pRing->aEvents[ulHead % CONFIG_TRACE_RING_SIZE] = { sName, start, dEnd, ulBytes, iDepth, Counters };
+        pRing->ulHead.store(ulHead + 1, std::memory_order_release);
+    }
+    MPIRegionTimer(const MPIRegionTimer&) = delete;
+    MPIRegionTimer& operator=(const MPIRegionTimer&) = delete;
+
+    void AddBytes(uint64_t ulMoved) {
+        ulBytes += ulMoved;
+    }
+
+    /** Innermost open region of this thread */
+    static MPIRegionTimer*& Current() {
+        thread_local MPIRegionTimer* pCurrent = nullptr;
+        return pCurrent;
+    }
+
+private:
+    const char* sName;
+    MPIRegionTimer* pParent;
+    tRegionRing* pRing;
+    int iDepth;
+    uint64_t ulBytes = 0;
+    tPerfSample Begin = { { 0 }, 0 };
+};
+
+#if CONFIG_ENABLE_TRACE
+#define _REGION_CAT2(A, B) A##B
+#define _REGION_CAT(A, B) _REGION_CAT2(A, B)
+/** Time the rest of the enclosing block as region NAME */
+#define REGION_SCOPE(NAME) MPIRegionTimer _REGION_CAT(_Region, __LINE__)(NAME)
+/** Count BYTES moved by the innermost open region */
+#define REGION_BYTES(BYTES) \
+        do { \
+            if (MPIRegionTimer::Current() != nullptr) MPIRegionTimer::Current()->AddBytes((uint64_t)(BYTES)); \
+        } while (0)
+#else
+#define REGION_SCOPE(NAME) do {} while (0)
+#define REGION_BYTES(BYTES) do {} while (0)
+#endif
+
+/**
+ * @brief A closed region with its full path, as collected from the rings
+ *
+ */
+typedef struct {
+    std::string sPath;
+    const char* sName;
+    int iThread;
+    double dBegin;
+    double dEnd;
+    uint64_t ulBytes;
+    tPerfSample Counters;
+} tRegionRecord;
+
+/**
+ * @brief Take the events recorded since the last call, with their paths
+ *
+ * No region may be closed meanwhile by another thread. A parent that is
+ * still open or was overwritten shows as "?" in the path.
+ *
+ * @return uint64_t events lost to ring overflow
+ */
+inline uint64_t _RegionCollect(std::vector<tRegionRecord>& vecRecords) {
+    uint64_t ulDropped = 0;
+    for (tRegionRing* pRing = RegionRings().load(std::memory_order_acquire); pRing != nullptr; pRing = pRing->pNext) {
+        const uint64_t ulHead = pRing->ulHead.load(std::memory_order_acquire);
+        uint64_t ulTail = pRing->ulTail;
+        if (ulHead - ulTail > CONFIG_TRACE_RING_SIZE) {
+            ulDropped += ulHead - ulTail - CONFIG_TRACE_RING_SIZE;
+            ulTail = ulHead - CONFIG_TRACE_RING_SIZE;
+        }
+        std::vector<tRegionEvent> vecEvents;
+        for (uint64_t ulIdx = ulTail; ulIdx < ulHead; ++ulIdx) {
+            vecEvents.push_back(pRing->aEvents[ulIdx % CONFIG_TRACE_RING_SIZE]);
+        }
+        pRing->ulTail = ulHead;
+
+        /** A parent begins before its children: replay in begin order */
+        std::sort(vecEvents.begin(), vecEvents.end(), [](const tRegionEvent& A, const tRegionEvent& B) {
+            return A.dBegin < B.dBegin or (A.dBegin == B.dBegin and A.iDepth < B.iDepth);
+        });
+        std::vector<const char*> vecStack;
+        for (const auto& Event : vecEvents) {
+            vecStack.resize(std::min((size_t)Event.iDepth, vecStack.size()));
+            while ((int)vecStack.size() < Event.iDepth) vecStack.push_back("?");
+            vecStack.push_back(Event.sName);
+            std::string sPath;
+            for (const char* sPart : vecStack) {
+                if (not sPath.empty()) sPath += '/';
+                sPath += sPart;
+            }
+            vecRecords.push_back({ sPath, Event.sName, pRing->iThread, Event.dBegin, Event.dEnd, Event.ulBytes, Event.Counters });
+        }
+    }
+    return ulDropped;
+}
+
+/** uMask and every value, separated by spaces */
+inline std::string _RegionFormatCounters(const tPerfSample& Counters) {
+    std::string sText = std::to_string(Counters.uMask);
+    for (uint64_t ulValue : Counters.aulValues) sText += ' ' + std::to_string(ulValue);
+    return sText;
+}
+
+/** Parse _RegionFormatCounters at sText, return the characters consumed, 0 on error */
+inline int _RegionParseCounters(const char* sText, tPerfSample& Counters) {
+    unsigned long long aullValues[(int)emPerfEvent::COUNT];
+    unsigned uMask = 0;
+    int iUsed = 0;
+    static_assert((int)emPerfEvent::COUNT == 6, "update the format below");
+    if (sscanf(sText, "%u %llu %llu %llu %llu %llu %llu%n", &uMask, &aullValues[0], &aullValues[1], &aullValues[2],
+               &aullValues[3], &aullValues[4], &aullValues[5], &iUsed) != 7) {
+        return 0;
+    }
+    Counters.uMask = uMask;
+    for (int iEvent = 0; iEvent < (int)emPerfEvent::COUNT; ++iEvent) Counters.aulValues[iEvent] = aullValues[iEvent];
+    return iUsed;
+}
+
+/** The strings of every rank on rank 0 */
+inline std::vector<std::string> _RegionGatherText(const std::string& sText, MPI_Comm Comm) {
+    int iRank = 0, iSize = 1;
+    MPI_Comm_rank(Comm, &iRank);
+    MPI_Comm_size(Comm, &iSize);
+    int iLength = (int)sText.size();
+    std::vector<int> vecLengths(iSize), vecOffsets(iSize, 0);
+    MPI_Gather(&iLength, 1, MPI_INT, vecLengths.data(), 1, MPI_INT, 0, Comm);
+    for (int idx = 1; idx < iSize; ++idx) vecOffsets[idx] = vecOffsets[idx - 1] + vecLengths[idx - 1];
+    std::vector<char> vecAll(iRank == 0 ? (size_t)vecOffsets.back() + vecLengths.back() : 0);
+    MPI_Gatherv(sText.data(), iLength, MPI_CHAR, vecAll.data(), vecLengths.data(), vecOffsets.data(), MPI_CHAR, 0, Comm);
+    std::vector<std::string> vecTexts;
+    if (iRank == 0) {
+        for (int idx = 0; idx < iSize; ++idx) vecTexts.emplace_back(vecAll.data() + vecOffsets[idx], vecLengths[idx]);
+    }
+    return vecTexts;
+}
+
+/**
+ * @brief Merge the regions recorded since the last call across the ranks of
+ * Comm, collective
+ *
+ * @param vecSummary filled on rank 0, in path order
+ * @param sTracePath Chrome trace written by rank 0, nullptr for none
+ * @return int MPI_ERR_FILE on rank 0 if the trace can not be written
+ */
+inline int MPIRegionMerge(MPI_Comm Comm, std::vector<tRegionSummary>& vecSummary, const char* sTracePath = nullptr) {
+    int iRank = 0;
+    MPI_Comm_rank(Comm, &iRank);
+    /** Clocks are aligned at the barrier exit */
+    MPI_Barrier(Comm);
+    const double dEpoch = MPI_Wtime();
+
+    std::vector<tRegionRecord> vecRecords;
+    uint64_t ulDropped = _RegionCollect(vecRecords);
+    if (ulDropped > 0) {
+        LOGW("[%d] %llu regions lost, raise CONFIG_TRACE_RING_SIZE", iRank, (unsigned long long)ulDropped);
+    }
+
+    /** path \t calls \t seconds \t bytes \t counters, one line per path of this rank */
+    const tPerfSample AllCounted = { { 0 }, ~0u };
+    std::map<std::string, tRegionSummary> mapLocal;
+    for (const auto& Record : vecRecords) {
+        auto& Local = mapLocal.emplace(Record.sPath, tRegionSummary{ Record.sPath, 1, 0, 0, 0, 0, 0, 0, AllCounted }).first->second;
+        Local.ulCalls++;
+        Local.dAvg += Record.dEnd - Record.dBegin;
+        Local.ulBytes += Record.ulBytes;
+        PerfAccumulate(Local.Counters, Record.Counters);
+    }
+    std::string sLocal;
+    char acLine[64];
+    for (const auto& Item : mapLocal) {
+        snprintf(acLine, sizeof(acLine), "\t%llu\t%.9e\t%llu\t", (unsigned long long)Item.second.ulCalls, Item.second.dAvg,
+                 (unsigned long long)Item.second.ulBytes);
+        sLocal += Item.first + acLine + _RegionFormatCounters(Item.second.Counters) + '\n';
+    }
+    std::vector<std::string> vecTexts = _RegionGatherText(sLocal, Comm);
+
+    std::map<std::string, tRegionSummary> mapMerged;
+    for (const auto& sText : vecTexts) {
+        size_t ulBegin = 0, ulEnd;
+        while ((ulEnd = sText.find('\n', ulBegin)) != std::string::npos) {
+            const std::string sLine = sText.substr(ulBegin, ulEnd - ulBegin);
+            ulBegin = ulEnd + 1;
+            size_t ulTab = sLine.find('\t');
+            unsigned long long ullCalls = 0, ullBytes = 0;
+            double dTime = 0;
+            int iUsed = 0;
+            tPerfSample Counters;
+            if (ulTab == std::string::npos or
+                sscanf(sLine.c_str() + ulTab, "%llu %lf %llu%n", &ullCalls, &dTime, &ullBytes, &iUsed) != 3 or
+                _RegionParseCounters(sLine.c_str() + ulTab + iUsed, Counters) == 0) {
+                continue;
+            }
+            const std::string sPath = sLine.substr(0, ulTab);
+            auto It = mapMerged.find(sPath);
+            if (It == mapMerged.end()) {
+                mapMerged[sPath] = { sPath, 1, ullCalls, dTime, dTime, dTime, 0, ullBytes, Counters };
+                continue;
+            }
+            auto& Merged = It->second;
+            Merged.iRanks++;
+            Merged.ulCalls += ullCalls;
+            Merged.dMin = std::min(Merged.dMin, dTime);
+            Merged.dMax = std::max(Merged.dMax, dTime);
+            Merged.dAvg += dTime;
+            Merged.ulBytes += ullBytes;
+            PerfAccumulate(Merged.Counters, Counters);
+        }
+    }
+    vecSummary.clear();
+    for (auto& Item : mapMerged) {
+        Item.second.dAvg /= Item.second.iRanks;
+        Item.second.dImbalance = Item.second.dAvg > 0 ? Item.second.dMax / Item.second.dAvg : 1;
+        vecSummary.push_back(Item.second);
+    }
+
+    /** Every rank takes part whether or not a trace is written */
+    int iWrite = sTracePath != nullptr;
+    MPI_Bcast(&iWrite, 1, MPI_INT, 0, Comm);
+    if (not iWrite) return MPI_SUCCESS;
+
+    /** thread \t begin \t end \t bytes \t counters \t name \t path, relative to dEpoch */
+    std::string sEvents;
+    char acEvent[128];
+    for (const auto& Record : vecRecords) {
+        snprintf(acEvent, sizeof(acEvent), "%d\t%.9f\t%.9f\t%llu\t", Record.iThread, Record.dBegin - dEpoch,
+                 Record.dEnd - dEpoch, (unsigned long long)Record.ulBytes);
+        sEvents += acEvent;
+        sEvents += _RegionFormatCounters(Record.Counters) + '\t';
+        sEvents += Record.sName;
+        sEvents += '\t' + Record.sPath + '\n';
+    }
+    vecTexts = _RegionGatherText(sEvents, Comm);
+    if (iRank != 0) return MPI_SUCCESS;
+
+    FILE* pFile = fopen(sTracePath, "w");
+    if (pFile == nullptr) return MPI_ERR_FILE;
+    /** Start the trace at the first event of any rank */
+    double dOrigin = 0;
+    for (const auto& sText : vecTexts) {
+        for (size_t ulBegin = 0; ulBegin < sText.size(); ulBegin = sText.find('\n', ulBegin) + 1) {
+            dOrigin = std::min(dOrigin, atof(sText.c_str() + sText.find('\t', ulBegin) + 1));
+        }
+    }
+    fprintf(pFile, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool bFirst = true;
+    for (int iProc = 0; iProc < (int)vecTexts.size(); ++iProc) {
+        fprintf(pFile, "%s{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"rank %d\"}}",
+                bFirst ? "" : ",\n", iProc, iProc);
+        bFirst = false;
+        const std::string& sText = vecTexts[iProc];
+        size_t ulBegin = 0, ulEnd;
+        while ((ulEnd = sText.find('\n', ulBegin)) != std::string::npos) {
+            const std::string sLine = sText.substr(ulBegin, ulEnd - ulBegin);
+            ulBegin = ulEnd + 1;
+            int iThread = 0;
+            double dBegin = 0, dEnd = 0;
+            unsigned long long ullBytes = 0;
+            int iCountersAt = 0, iUsed = 0;
+            tPerfSample Counters;
+            if (sscanf(sLine.c_str(), "%d\t%lf\t%lf\t%llu\t%n", &iThread, &dBegin, &dEnd, &ullBytes, &iCountersAt) != 4 or
+                (iUsed = _RegionParseCounters(sLine.c_str() + iCountersAt, Counters)) == 0) {
+                continue;
+            }
+            const std::string sRest = sLine.substr(iCountersAt + iUsed + 1);
+            const size_t ulTab = sRest.find('\t');
+            std::string sCounters;
+            for (int iEvent = 0; iEvent < (int)emPerfEvent::COUNT; ++iEvent) {
+                if (not PerfHas(Counters, (emPerfEvent)iEvent)) continue;
+                sCounters += std::string(", \"") + PerfEventName((emPerfEvent)iEvent) + "\": " + std::to_string(Counters.aulValues[iEvent]);
+            }
+            fprintf(pFile, ",\n{\"name\": \"%s\", \"cat\": \"region\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                           "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"path\": \"%s\", \"bytes\": %llu%s}}",
+                    sRest.substr(0, ulTab).c_str(), iProc, iThread, (dBegin - dOrigin) * 1e6, (dEnd - dBegin) * 1e6,
+                    sRest.substr(ulTab + 1).c_str(), ullBytes, sCounters.c_str());
+        }
+    }
+    fprintf(pFile, "\n]}\n");
+    return fclose(pFile) == 0 ? MPI_SUCCESS : MPI_ERR_FILE;
+}
+
+/**
+ * @brief Log the merged regions on rank 0 and write the trace named by
+ * $MPI_TRACE_FILE, collective, does nothing without CONFIG_ENABLE_TRACE
+ *
+ */
+inline int MPIRegionFinalize(MPI_Comm Comm = MPI_COMM_WORLD) {
+#if CONFIG_ENABLE_TRACE
+    int iRank = 0;
+    MPI_Comm_rank(Comm, &iRank);
+    const char* sTracePath = getenv(REGION_TRACE_ENV);
+    std::vector<tRegionSummary> vecSummary;
+    int iRet = MPIRegionMerge(Comm, vecSummary, sTracePath);
+    if (iRank == 0) {
+        LOGI("%-40s %5s %8s %11s %11s %11s %9s %12s", "region", "ranks", "calls", "min(s)", "avg(s)", "max(s)", "imbalance", "MB");
+        for (const auto& Summary : vecSummary) {
+            LOGI("%-40s %5d %8llu %11.6f %11.6f %11.6f %9.3f %12.3f", Summary.sPath.c_str(), Summary.iRanks,
+                 (unsigned long long)Summary.ulCalls, Summary.dMin, Summary.dAvg, Summary.dMax, Summary.dImbalance,
+                 Summary.ulBytes / 1e6);
+        }
+        bool bCounted = false;
+        for (const auto& Summary : vecSummary) bCounted |= Summary.Counters.uMask != 0;
+        if (bCounted) {
+            LOGI("%-40s %8s %9s %9s", "region", "ipc", "l1_miss", "llc_miss");
+            for (const auto& Summary : vecSummary) {
+                tPerfMetrics Metrics = PerfMetrics(Summary.Counters, 0, 0, 0);
+                LOGI("%-40s %8.3f %9.4f %9.4f", Summary.sPath.c_str(), Metrics.dIPC, Metrics.dL1MissRate, Metrics.dLLCMissRate);
+            }
+        }
+        if (sTracePath != nullptr) {
+            if (iRet == MPI_SUCCESS) {
+                LOGI("Trace written to %s", sTracePath);
+            } else {
+                LOGE("Can not write trace %s", sTracePath);
+            }
+        }
+    }
+    return iRet;
+#else
+    (void)Comm;
+    return MPI_SUCCESS;
+#endif
+}
+
+#endif
@@ -0,0 +1,397 @@
+/**
+ * @file PrimeCount.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief pi(x) without sieving up to x: the Lagarias-Miller-Odlyzko method,
+ * special leaves and P2 spread over MPI ranks and threads
+ * @version 0.1
+ * @date 2022-06-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * With y = alpha * x^(1/3) and a = pi(y)
+ *
+ *     pi(x) = phi(x, a) + a - 1 - P2(x, y),  phi(x, a) = S1 + S2
+ *
+ * S1 are the ordinary leaves mu(n) phi(x / n, c), n <= y, computed from a
+ * table of the first c primes. S2 are the special leaves
+ * -mu(m) phi(x / (p_b m), b - 1) with m <= y < p_b m, found by sieving
+ * [1, x / y] in segments with a Fenwick tree of the numbers not yet crossed
+ * off. P2 counts the n <= x with two prime factors above y, from pi(x / p)
+ * for y < p <= sqrt(x), again by a segmented sieve up to x / y.
+ *
+ * Both segmented parts are cut into chunks of segments. A chunk only knows
+ * what lies inside it, so it also returns per prime how many numbers
+ * survived in it and how its leaves weigh what lies before; rank 0 adds the
+ * chunks up in order. Work is O(x^(2/3) / log x), memory is mostly the
+ * primes up to sqrt(x).
+ */
+#ifndef _PRIMECOUNT_H
+#define _PRIMECOUNT_H
+
+#include <mpi.h>
+#include <sched.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "MPIProcessorInfo.hpp"
+#include "MPIRegionTimer.hpp"
+#include "Partition.hpp"
+#include "debug.h"
+
+/** Overrides y = alpha * x^(1/3) */
+#define PRIMECOUNT_ALPHA_ENV "MPIMATH_LMO_ALPHA"
+/** Below this pi(x) is counted with a plain sieve */
+#define PRIMECOUNT_SIEVE_LIMIT 100000
+/** phi(x, c) comes from a table over the primorial of the first c primes */
+#define PRIMECOUNT_PHI_TINY 6
+/** Chunks of segments per thread, for balance */
+#ifndef PRIMECOUNT_CHUNKS_PER_THREAD
+#define PRIMECOUNT_CHUNKS_PER_THREAD 32
+#endif
+
+namespace mpimath {
+    /** Primes <= lN, 1-indexed: vecPrimes[0] = 0, vecPrimes[1] = 2 */
+    inline std::vector<int64_t> SmallPrimes(int64_t lN) {
+        std::vector<int64_t> vecPrimes = { 0 };
+        if (lN < 2) return vecPrimes;
+        std::vector<char> vecComposite(lN + 1, 0);
+        for (int64_t i = 2; i <= lN; ++i) {
+            if (vecComposite[i]) continue;
+            vecPrimes.push_back(i);
+            for (int64_t j = i * i; j <= lN; j += i) vecComposite[j] = 1;
+        }
+        return vecPrimes;
+    }
+
+    /** Least prime factor and Moebius function of 0..lN, vecLpf[1] is larger than every prime */
+    inline void LpfMu(int64_t lN, std::vector<int32_t>& vecLpf, std::vector<int8_t>& vecMu) {
+        vecLpf.assign(lN + 1, 0);
+        vecMu.assign(lN + 1, 1);
+        for (int64_t i = 2; i <= lN; ++i) {
+            if (vecLpf[i] != 0) continue;
+            for (int64_t j = i; j <= lN; j += i) {
+                if (vecLpf[j] == 0) vecLpf[j] = (int32_t)i;
+                vecMu[j] = (int8_t)-vecMu[j];
+            }
+            for (int64_t j = i * i; j <= lN; j += i * i) vecMu[j] = 0;
+        }
+        if (lN >= 1) vecLpf[1] = INT32_MAX;
+    }
+
+    /** Floor of the k-th root, exact for 64-bit x */
+    inline int64_t IRoot(int64_t lX, int iK) {
+        int64_t lR = (int64_t)std::pow((double)lX, 1.0 / iK);
+        auto Pow = [&](int64_t lB) {
+            double dP = 1;
+            for (int i = 0; i < iK; ++i) dP *= (double)lB;
+            return dP;
+        };
+        while (lR > 0 and Pow(lR) > (double)lX) lR--;
+        while (Pow(lR + 1) <= (double)lX) lR++;
+        return lR;
+    }
+
+    /**
+     * @brief phi(x, c) for c <= PRIMECOUNT_PHI_TINY: numbers <= x free of the
+     * first c primes, periodic in their product
+     *
+     */
+    class tPhiTiny {
+    public:
+        tPhiTiny(const std::vector<int64_t>& vecPrimes, int iC) : _lProduct(1) {
+            for (int b = 1; b <= iC; ++b) _lProduct *= vecPrimes[b];
+            _vecCount.assign(_lProduct, 0);
+            for (int64_t i = 1; i < _lProduct; ++i) {
+                bool bFree = true;
+                for (int b = 1; b <= iC; ++b) bFree = bFree and i % vecPrimes[b] != 0;
+                _vecCount[i] = _vecCount[i - 1] + bFree;
+            }
+            _lPeriod = _lProduct == 1 ? 1 : _vecCount[_lProduct - 1];
+        }
+
+        int64_t operator()(int64_t lX) const {
+            return (lX / _lProduct) * _lPeriod + _vecCount[lX % _lProduct];
+        }
+
+    private:
+        int64_t _lProduct;
+        int64_t _lPeriod;
+        std::vector<int64_t> _vecCount;
+    };
+
+    /** Threads per rank: MPIMATH_NUM_THREADS, else the cores this rank may run on, shared with the ranks of the node when unbound */
+    inline unsigned PrimeCountThreads(const MPIProcessorInfo& Processor) {
+        const char* sEnv = getenv("MPIMATH_NUM_THREADS");
+        if (sEnv != nullptr and atoi(sEnv) > 0) return (unsigned)atoi(sEnv);
+        cpu_set_t Mask;
+        int iAllowed = sched_getaffinity(0, sizeof(Mask), &Mask) == 0 ? CPU_COUNT(&Mask) : (int)std::thread::hardware_concurrency();
+        if (iAllowed >= (int)std::thread::hardware_concurrency()) iAllowed /= std::max(1, Processor.iNodeSize());
+        return (unsigned)std::max(1, iAllowed);
+    }
+
+    /**
+     * @brief Run fnChunk(lChunk) on every chunk of this rank (dealt
+     * cyclically, threads take them in turn) and collect the returned
+     * vectors on rank 0 in chunk order
+     *
+     * @return std::vector<std::vector<int64_t>> empty on other ranks
+     */
+    template<typename F>
+    std::vector<std::vector<int64_t>> _ForChunks(const MPIProcessorInfo& Processor, unsigned uThreads, int64_t lChunks, F&& fnChunk) {
+        const auto Owned = Partition<int64_t>::Cyclic(lChunks, Processor.iSize());
+        const int64_t lOwned = Owned.Size(Processor.iRank());
+        std::vector<std::vector<int64_t>> vecLocal(lOwned);
+        std::atomic<int64_t> lNext(0);
+        auto Work = [&]() {
+            for (int64_t j; (j = lNext++) < lOwned;) vecLocal[j] = fnChunk(Owned.Global(Processor.iRank(), j));
+        };
+        std::vector<std::thread> vecThreads;
+        for (unsigned uID = 1; uID < std::min<int64_t>(uThreads, lOwned); ++uID) vecThreads.emplace_back(Work);
+        Work();
+        for (auto& Thread : vecThreads) Thread.join();
+
+        /** Every chunk as its length and its values */
+        std::vector<int64_t> vecSend;
+        for (const auto& vecChunk : vecLocal) {
+            vecSend.push_back((int64_t)vecChunk.size());
+            vecSend.insert(vecSend.end(), vecChunk.begin(), vecChunk.end());
+        }
+        int iSend = (int)vecSend.size();
+        std::vector<int> vecCounts(Processor.iSize()), vecDispls(Processor.iSize());
+        MPI_Gather(&iSend, 1, MPI_INT, vecCounts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        std::vector<int64_t> vecRecv;
+        if (Processor.iRank() == 0) {
+            for (int iSrc = 1; iSrc < Processor.iSize(); ++iSrc) vecDispls[iSrc] = vecDispls[iSrc - 1] + vecCounts[iSrc - 1];
+            vecRecv.resize((size_t)vecDispls.back() + vecCounts.back());
+        }
+        MPI_Gatherv(vecSend.data(), iSend, MPI_INT64_T, vecRecv.data(), vecCounts.data(), vecDispls.data(), MPI_INT64_T, 0, MPI_COMM_WORLD);
+        std::vector<std::vector<int64_t>> vecChunks;
+        if (Processor.iRank() != 0) return vecChunks;
+        vecChunks.resize(lChunks);
+        for (int iSrc = 0; iSrc < Processor.iSize(); ++iSrc) {
+            const int64_t* pIn = vecRecv.data() + vecDispls[iSrc];
+            for (int64_t j = 0; j < Owned.Size(iSrc); ++j) {
+                vecChunks[Owned.Global(iSrc, j)].assign(pIn + 1, pIn + 1 + pIn[0]);
+                pIn += 1 + pIn[0];
+            }
+        }
+        return vecChunks;
+    }
+
+    /** Segment length for sieving [1, lLimit), a power of two near its square root */
+    inline int64_t _SegmentSize(int64_t lLimit) {
+        int64_t lSize = 1 << 12;
+        while (lSize * lSize < lLimit) lSize <<= 1;
+        return lSize;
+    }
+
+    /**
+     * @brief Special leaves whose x / n lies in the segments [lLow, lHigh)
+     *
+     * @return std::vector<int64_t> S2 of the chunk as if nothing were before
+     * it, then for b = c + 1, ... the numbers of the chunk free of the first
+     * b - 1 primes and the sum of -mu(m) over the leaves of b
+     */
+    inline std::vector<int64_t> _SpecialLeaves(int64_t lX, int64_t lY, int iC, int64_t lPiY, int64_t lLow, int64_t lHigh, int64_t lSegment,
+                                               const std::vector<int64_t>& vecPrimes, const std::vector<int32_t>& vecLpf, const std::vector<int8_t>& vecMu) {
+        std::vector<int64_t> vecOut = { 0 };
+        std::vector<char> vecSieve(lSegment);
+        std::vector<int32_t> vecTree(lSegment);
+        for (int64_t lSegLow = lLow; lSegLow < lHigh; lSegLow += lSegment) {
+            const int64_t lSegHigh = std::min(lSegLow + lSegment, lHigh), lSize = lSegHigh - lSegLow;
+            std::fill(vecSieve.begin(), vecSieve.begin() + lSize, 1);
+            for (int b = 1; b <= iC; ++b) {
+                const int64_t lP = vecPrimes[b];
+                for (int64_t k = (lSegLow + lP - 1) / lP * lP - lSegLow; k < lSize; k += lP) vecSieve[k] = 0;
+            }
+            /** Fenwick tree over the survivors, built in linear time */
+            int64_t lAlive = 0;
+            for (int64_t k = 0; k < lSize; ++k) vecTree[k] = vecSieve[k];
+            for (int64_t k = 0; k < lSize; ++k) {
+                lAlive += vecSieve[k];
+                const int64_t lUp = k | (k + 1);
+                if (lUp < lSize) vecTree[lUp] += vecTree[k];
+            }
+            for (int64_t b = iC + 1; b < lPiY; ++b) {
+                const int64_t lP = vecPrimes[b];
+                const int64_t lMinM = std::max(lX / (lP * lSegHigh), lY / lP);
+                const int64_t lMaxM = std::min(lX / (lP * lSegLow), lY);
+                /** Later b and later segments have no leaves either */
+                if (lP >= lMaxM) break;
+                const size_t ulAt = 1 + 2 * (size_t)(b - iC - 1);
+                if (vecOut.size() <= ulAt) vecOut.resize(ulAt + 2, 0);
+                for (int64_t lM = lMaxM; lM > lMinM; --lM) {
+                    if (vecMu[lM] == 0 or lP >= vecLpf[lM]) continue;
+                    /** phi(x / n, b - 1) within the chunk: earlier segments, then the tree */
+                    int64_t lCount = vecOut[ulAt];
+                    for (int64_t k = lX / (lP * lM) - lSegLow; k >= 0; k = (k & (k + 1)) - 1) lCount += vecTree[k];
+                    vecOut[0] -= vecMu[lM] * lCount;
+                    vecOut[ulAt + 1] -= vecMu[lM];
+                }
+                vecOut[ulAt] += lAlive;
+                for (int64_t k = (lSegLow + lP - 1) / lP * lP - lSegLow; k < lSize; k += lP) {
+                    if (not vecSieve[k]) continue;
+                    vecSieve[k] = 0;
+                    lAlive--;
+                    for (int64_t lUp = k; lUp < lSize; lUp |= lUp + 1) vecTree[lUp]--;
+                }
+            }
+        }
+        return vecOut;
+    }
+
+    /** Primes of [lLow, lHigh) as bytes, odd numbers only: entry k is lLow' + 2k with lLow' the first odd >= lLow */
+    inline void _SieveOdd(int64_t lLow, int64_t lHigh, const std::vector<int64_t>& vecPrimes, std::vector<char>& vecSieve) {
+        lLow |= 1;
+        vecSieve.assign(lHigh > lLow ? (lHigh - lLow + 1) / 2 : 0, 1);
+        for (size_t b = 2; b < vecPrimes.size() and vecPrimes[b] * vecPrimes[b] < lHigh; ++b) {
+            const int64_t lP = vecPrimes[b];
+            int64_t lFirst = std::max(lP * lP, (lLow + lP - 1) / lP * lP);
+            if (lFirst % 2 == 0) lFirst += lP;
+            for (int64_t k = (lFirst - lLow) / 2; k < (int64_t)vecSieve.size(); k += lP) vecSieve[k] = 0;
+        }
+        if (lLow == 1 and not vecSieve.empty()) vecSieve[0] = 0;
+    }
+
+    /**
+     * @brief pi(x / p) for the primes y < p <= sqrt(x) whose x / p lies in
+     * [lLow, lHigh)
+     *
+     * @return std::vector<int64_t> primes in the chunk, sum of the primes in
+     * [lLow, x / p] over those p, and their number
+     */
+    inline std::vector<int64_t> _P2Chunk(int64_t lX, int64_t lY, int64_t lSqrtX, int64_t lLow, int64_t lHigh, int64_t lSegment,
+                                         const std::vector<int64_t>& vecPrimes) {
+        std::vector<int64_t> vecOut = { 0, 0, 0 };
+        /** p from the largest down, so x / p goes up */
+        const int64_t lPMax = std::min(lSqrtX, lX / lLow), lPMin = std::max(lY, lX / lHigh);
+        int64_t idx = std::upper_bound(vecPrimes.begin() + 1, vecPrimes.end(), lPMax) - vecPrimes.begin() - 1;
+        std::vector<char> vecSieve;
+        for (int64_t lSegLow = lLow; lSegLow < lHigh; lSegLow += lSegment) {
+            const int64_t lSegHigh = std::min(lSegLow + lSegment, lHigh);
+            _SieveOdd(lSegLow, lSegHigh, vecPrimes, vecSieve);
+            const int64_t lOdd = lSegLow | 1;
+            int64_t lCount = vecOut[0] + (lSegLow <= 2 and lSegHigh > 2);
+            int64_t k = 0;
+            for (; idx >= 1 and vecPrimes[idx] > lPMin and lX / vecPrimes[idx] < lSegHigh; --idx) {
+                const int64_t lQ = lX / vecPrimes[idx];
+                for (; k < (int64_t)vecSieve.size() and lOdd + 2 * k <= lQ; ++k) lCount += vecSieve[k];
+                vecOut[1] += lCount;
+                vecOut[2]++;
+            }
+            for (; k < (int64_t)vecSieve.size(); ++k) lCount += vecSieve[k];
+            vecOut[0] = lCount;
+        }
+        return vecOut;
+    }
+
+    /**
+     * @brief pi(x) with the Lagarias-Miller-Odlyzko method, collective over
+     * MPI_COMM_WORLD
+     *
+     * @param lX up to about 1e18
+     * @param uThreads threads per rank, 0 for PrimeCountThreads()
+     * @return int64_t pi(x) on every rank
+     */
+    inline int64_t PrimeCountLMO(int64_t lX, const MPIProcessorInfo& Processor, unsigned uThreads = 0) {
+        if (lX < PRIMECOUNT_SIEVE_LIMIT) return (int64_t)SmallPrimes(lX).size() - 1;
+        if (uThreads == 0) uThreads = PrimeCountThreads(Processor);
+        unsigned uWorkers = 0;
+        MPI_Allreduce(&uThreads, &uWorkers, 1, MPI_UNSIGNED, MPI_SUM, MPI_COMM_WORLD);
+
+        /** alpha grows with log(x) as in the LMO paper, within x^(1/3) <= y <= x^(1/2) */
+        const double dLog = std::log((double)lX);
+        double dAlpha = std::max(1.0, dLog * dLog / 500);
+        const char* sAlpha = getenv(PRIMECOUNT_ALPHA_ENV);
+        if (sAlpha != nullptr and atof(sAlpha) > 0) dAlpha = atof(sAlpha);
+        const int64_t lCbrtX = IRoot(lX, 3), lSqrtX = IRoot(lX, 2);
+        const int64_t lY = std::min(lSqrtX, std::max(lCbrtX, (int64_t)(dAlpha * lCbrtX)));
+
+        std::vector<int64_t> vecPrimes;
+        std::vector<int32_t> vecLpf;
+        std::vector<int8_t> vecMu;
+        {
+            REGION_SCOPE("tables");
+            vecPrimes = SmallPrimes(lSqrtX);
+            LpfMu(lY, vecLpf, vecMu);
+        }
+        const int64_t lPiY = std::upper_bound(vecPrimes.begin() + 1, vecPrimes.end(), lY) - vecPrimes.begin() - 1;
+        const int64_t lPiSqrtX = (int64_t)vecPrimes.size() - 1;
+        const int iC = (int)std::min<int64_t>(lPiY, PRIMECOUNT_PHI_TINY);
+        LOGD_S("LMO x=%lld y=%lld alpha=%.2f pi(y)=%lld c=%d, %u threads in all", (long long)lX, (long long)lY, dAlpha, (long long)lPiY, iC, uWorkers);
+
+        /** Ordinary leaves, cyclic over ranks */
+        int64_t lS1 = 0;
+        {
+            REGION_SCOPE("ordinary");
+            const tPhiTiny PhiTiny(vecPrimes, iC);
+            const auto Terms = Partition<int64_t>::Cyclic(lY, Processor.iSize());
+            for (int64_t j = 0; j < Terms.Size(Processor.iRank()); ++j) {
+                const int64_t lN = Terms.Global(Processor.iRank(), j) + 1;
+                if (vecMu[lN] != 0 and vecLpf[lN] > vecPrimes[iC]) lS1 += vecMu[lN] * PhiTiny(lX / lN);
+            }
+            MPI_Allreduce(MPI_IN_PLACE, &lS1, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+        }
+
+        /** Special leaves in [1, x / y], chunks growing quadratically as leaves get sparse */
+        int64_t lS2 = 0;
+        {
+            REGION_SCOPE("special");
+            const int64_t lLimit = lX / lY + 1, lSegment = _SegmentSize(lLimit);
+            const int64_t lSegments = (lLimit - 1 + lSegment - 1) / lSegment;
+            std::vector<int64_t> vecBounds = { 0 };
+            const int64_t lWanted = std::min<int64_t>(lSegments, (int64_t)uWorkers * PRIMECOUNT_CHUNKS_PER_THREAD);
+            for (int64_t i = 1; i <= lWanted; ++i) {
+                const int64_t lBound = (int64_t)((double)lSegments * i / lWanted * i / lWanted);
+                if (lBound > vecBounds.back()) vecBounds.push_back(lBound);
+            }
+            vecBounds.back() = lSegments;
+            auto vecChunks = _ForChunks(Processor, uThreads, (int64_t)vecBounds.size() - 1, [&](int64_t lChunk) {
+                REGION_SCOPE("chunk");
+                return _SpecialLeaves(lX, lY, iC, lPiY, 1 + vecBounds[lChunk] * lSegment, std::min(lLimit, 1 + vecBounds[lChunk + 1] * lSegment),
+                                      lSegment, vecPrimes, vecLpf, vecMu);
+            });
+            /** phi of everything before the chunk, per b */
+            std::vector<int64_t> vecBefore;
+            for (const auto& vecChunk : vecChunks) {
+                const size_t ulPairs = (vecChunk.size() - 1) / 2;
+                if (vecBefore.size() < ulPairs) vecBefore.resize(ulPairs, 0);
+                lS2 += vecChunk[0];
+                for (size_t j = 0; j < ulPairs; ++j) {
+                    lS2 += vecChunk[2 + 2 * j] * vecBefore[j];
+                    vecBefore[j] += vecChunk[1 + 2 * j];
+                }
+            }
+        }
+
+        /** P2 from pi(x / p) for y < p <= sqrt(x), x / p in [sqrt(x), x / y] */
+        int64_t lP2 = 0;
+        if (lPiSqrtX > lPiY) {
+            REGION_SCOPE("p2");
+            const int64_t lLow = lSqrtX, lHigh = lX / lY + 1, lSegment = _SegmentSize(lHigh);
+            const int64_t lChunks = std::max<int64_t>(1, std::min<int64_t>((lHigh - lLow) / lSegment, (int64_t)uWorkers * 4));
+            const auto Range = Partition<int64_t>::Block(lHigh - lLow, (int)lChunks);
+            auto vecChunks = _ForChunks(Processor, uThreads, lChunks, [&](int64_t lChunk) {
+                return _P2Chunk(lX, lY, lSqrtX, lLow + Range.Low((int)lChunk), lLow + Range.High((int)lChunk) + 1, lSegment, vecPrimes);
+            });
+            /** pi(sqrt(x) - 1), then the chunks in order */
+            int64_t lPiBefore = std::lower_bound(vecPrimes.begin() + 1, vecPrimes.end(), lSqrtX) - vecPrimes.begin() - 1;
+            for (const auto& vecChunk : vecChunks) {
+                lP2 += vecChunk[1] + vecChunk[2] * lPiBefore;
+                lPiBefore += vecChunk[0];
+            }
+            lP2 -= (lPiSqrtX * (lPiSqrtX - 1) - lPiY * (lPiY - 1)) / 2;
+        }
+
+        int64_t lPi = lS1 + lS2 + lPiY - 1 - lP2;
+        MPI_Bcast(&lPi, 1, MPI_INT64_T, 0, MPI_COMM_WORLD);
+        LOGD_S("LMO S1=%lld S2=%lld P2=%lld", (long long)lS1, (long long)lS2, (long long)lP2);
+        return lPi;
+    }
+}
+
+#endif
@@ -8,74 +8,60 @@
 #include <cstdio>
 #include <cstring>
 #include <mpi.h>
+#include "Logger.hpp"
 
-#define LEVEL_DISABLE 0
-#define LEVEL_ERROR 1
-#define LEVEL_WARNING 2
-#define LEVEL_INFO 3
-#define LEVEL_DEBUG 4
-
-/** Set log level **/
+/** Calls above LOG_LEVEL are compiled out, the rest are checked against
+ * the run time level (MPIMATH_LOG_LEVEL, see Logger.hpp) **/
+#ifndef CONFIG_LOG_LEVEL
 #define LOG_LEVEL LEVEL_DEBUG
+#else
+#define LOG_LEVEL CONFIG_LOG_LEVEL
+#endif
 
-#if LOG_LEVEL >= LEVEL_ERROR
-#define LOGE(M, ...) fprintf(stderr, "\033[31;1m[ERROR]\033[0m (%s:%d: errno: %d) " M "\n", __FILE__, __LINE__, errno, ##__VA_ARGS__)
-#define LOGE_S(M, ...) \
-        { \
-            int __iRank = -1; \
-            MPI_Comm_rank((MPI_COMM_WORLD), &__iRank); \
-            if (__iRank == 0) { \
-                LOGE(M, ##__VA_ARGS__); \
+#define LOG_AT(LEVEL, M, ...) \
+        do { \
+            if ((LEVEL) <= _iLogLevel.load(std::memory_order_relaxed)) { \
+                LogWrite((LEVEL), M, ##__VA_ARGS__); \
+            } \
+        } while (0)
+/** Only rank 0 prints, the rank is asked from MPI once **/
+#define LOG_AT_S(LEVEL, M, ...) \
+        do { \
+            if ((LEVEL) <= _iLogLevel.load(std::memory_order_relaxed) and LogRank() == 0) { \
+                LogWrite((LEVEL), M, ##__VA_ARGS__); \
             } \
-        }
+        } while (0)
+
+#if LOG_LEVEL >= LEVEL_ERROR
+#define LOGE(M, ...) LOG_AT(LEVEL_ERROR, "\033[31;1m[ERROR]\033[0m (%s:%d: errno: %d) " M "\n", __FILE__, __LINE__, errno, ##__VA_ARGS__)
+#define LOGE_S(M, ...) LOG_AT_S(LEVEL_ERROR, "\033[31;1m[ERROR]\033[0m (%s:%d: errno: %d) " M "\n", __FILE__, __LINE__, errno, ##__VA_ARGS__)
 #else
-#define LOGE(M, ...)
-#define LOGE_S(M, ...)
+#define LOGE(M, ...) do {} while (0)
+#define LOGE_S(M, ...) do {} while (0)
 #endif
 
 #if LOG_LEVEL >= LEVEL_WARNING
-#define LOGW(M, ...) fprintf(stderr, "\033[33;1m[WARNING]\033[0m (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
-#define LOGW_S(M, ...) \
-        { \
-            int __iRank = -1; \
-            MPI_Comm_rank((MPI_COMM_WORLD), &__iRank); \
-            if (__iRank == 0) { \
-                LOGW(M, ##__VA_ARGS__); \
-            } \
-        }
+#define LOGW(M, ...) LOG_AT(LEVEL_WARNING, "\033[33;1m[WARNING]\033[0m (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define LOGW_S(M, ...) LOG_AT_S(LEVEL_WARNING, "\033[33;1m[WARNING]\033[0m (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
 #else
-#define LOGW(M, ...)
-#define LOGW_S(M, ...)
+#define LOGW(M, ...) do {} while (0)
+#define LOGW_S(M, ...) do {} while (0)
 #endif
 
 #if LOG_LEVEL >= LEVEL_INFO
-#define LOGI(M, ...) fprintf(stderr, "\033[32;1m[INFO]\033[0m (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
-#define LOGI_S(M, ...) \
-        { \
-            int __iRank = -1; \
-            MPI_Comm_rank((MPI_COMM_WORLD), &__iRank); \
-            if (__iRank == 0) { \
-                LOGI(M, ##__VA_ARGS__); \
-            } \
-        }
+#define LOGI(M, ...) LOG_AT(LEVEL_INFO, "\033[32;1m[INFO]\033[0m (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define LOGI_S(M, ...) LOG_AT_S(LEVEL_INFO, "\033[32;1m[INFO]\033[0m (%s:%d) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
 #else
-#define LOGI(M, ...)
-#define LOGI_S(M, ...)
+#define LOGI(M, ...) do {} while (0)
+#define LOGI_S(M, ...) do {} while (0)
 #endif
 
 #if LOG_LEVEL >= LEVEL_DEBUG
-#define LOGD(M, ...) fprintf(stderr, "\033[2m[DEBUG] (%s:%d) " M "\n\033[0m", __FILE__, __LINE__, ##__VA_ARGS__)
-#define LOGD_S(M, ...) \
-        { \
-            int __iRank = -1; \
-            MPI_Comm_rank((MPI_COMM_WORLD), &__iRank); \
-            if (__iRank == 0) { \
-                LOGD(M, ##__VA_ARGS__); \
-            } \
-        }
+#define LOGD(M, ...) LOG_AT(LEVEL_DEBUG, "\033[2m[DEBUG] (%s:%d) " M "\033[0m\n", __FILE__, __LINE__, ##__VA_ARGS__)
+#define LOGD_S(M, ...) LOG_AT_S(LEVEL_DEBUG, "\033[2m[DEBUG] (%s:%d) " M "\033[0m\n", __FILE__, __LINE__, ##__VA_ARGS__)
 #else
-#define LOGD(M, ...)
-#define LOGD_S(M, ...)
+#define LOGD(M, ...) do {} while (0)
+#define LOGD_S(M, ...) do {} while (0)
 #endif
 
 
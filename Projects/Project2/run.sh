@@ -4,3 +4,4 @@ fi
 cd build && cmake .. && make && cd ..
 
 mpirun -n 4 ./build/GetPrime 100000
+mpirun -n 4 ./build/GetPrime 100000 check
@@ -0,0 +1,203 @@
+/**
+ * @file Allocator.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Buffer allocators for Matrix2D: plain aligned and pooled
+ * @version 0.1
+ * @date 2022-06-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef ALLOCATOR_HPP
+#define ALLOCATOR_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/** Buffers at least this large are 2 MB aligned and advised to use huge pages */
+#define MATRIX_POOL_HUGE_PAGE (2UL << 20)
+/** Bytes the pool may keep cached before frees go back to the system, MPIMATH_POOL_MAX_CACHED overrides */
+#define MATRIX_POOL_MAX_CACHED (1UL << 30)
+
+namespace mpimath {
+    /**
+     * @brief Allocator policy of Matrix2D: one allocation per buffer
+     *
+     * A policy provides static Allocate(ulBytes) and Deallocate(p, ulBytes),
+     * ulBytes is the same in both calls.
+     */
+    struct tAlignedAllocator {
+        static inline void* Allocate(size_t ulBytes) {
+#ifdef __AVX__
+            return _mm_malloc(ulBytes, 32);
+#else
+            return malloc(ulBytes);
+#endif
+        }
+
+        static inline void Deallocate(void* p, size_t) {
+#ifdef __AVX__
+            _mm_free(p);
+#else
+            free(p);
+#endif
+        }
+    };
+
+    /**
+     * @brief Statistics of a MatrixPool
+     *
+     * @struct ulHits        allocations served from the cache
+     * @struct ulMisses      allocations that went to the system
+     * @struct ulBytesInUse  bytes handed out and not yet returned
+     * @struct ulPeakBytes   maximum of ulBytesInUse
+     * @struct ulBytesCached bytes kept in the free lists
+     */
+    typedef struct {
+        size_t ulHits;
+        size_t ulMisses;
+        size_t ulBytesInUse;
+        size_t ulPeakBytes;
+        size_t ulBytesCached;
+    } tPoolStats;
+
+    /**
+     * @brief Process wide size-class arena
+     *
+     * Sizes are rounded up to one of four classes per power of two, so a
+     * buffer freed by one multiply is reused by the next one of about the
+     * same shape. Buffers are 64 byte aligned, large ones 2 MB aligned and
+     * backed by transparent huge pages, so a recycled buffer is already
+     * faulted in.
+     */
+    class MatrixPool {
+    public:
+        static MatrixPool& Instance() {
+            /** Never destroyed: static matrices may release buffers after main returns */
+            static MatrixPool* pPool = new MatrixPool();
+            return *pPool;
+        }
+
+        /**
+         * @brief Size actually reserved for a request of ulBytes
+         *
+         * @param ulBytes
+         * @return size_t
+         */
+        static size_t SizeClass(size_t ulBytes) {
+            if (ulBytes <= 256) {
+                return (ulBytes + 63) & ~(size_t)63;
+            }
+            /** 4 classes between 2^p and 2^(p+1) */
+            const size_t ulStep = (size_t)1 << (63 - __builtin_clzl(ulBytes - 1) - 2);
+            return (ulBytes + ulStep - 1) / ulStep * ulStep;
+        }
+
+        void* Allocate(size_t ulBytes) {
+            if (ulBytes == 0) return nullptr;
+            const size_t ulClass = SizeClass(ulBytes);
+            {
+                std::lock_guard<std::mutex> Lock(_Mutex);
+                _Stats.ulBytesInUse += ulClass;
+                if (_Stats.ulBytesInUse > _Stats.ulPeakBytes) _Stats.ulPeakBytes = _Stats.ulBytesInUse;
+                auto it = _mapFree.find(ulClass);
+                if (it != _mapFree.end() and not it->second.empty()) {
+                    void* p = it->second.back();
+                    it->second.pop_back();
+                    _Stats.ulBytesCached -= ulClass;
+                    _Stats.ulHits++;
+                    return p;
+                }
+                _Stats.ulMisses++;
+            }
+
+            void* p = nullptr;
+            const size_t ulAlign = ulClass >= MATRIX_POOL_HUGE_PAGE ? MATRIX_POOL_HUGE_PAGE : 64;
+            if (posix_memalign(&p, ulAlign, ulClass) != 0) {
+                std::lock_guard<std::mutex> Lock(_Mutex);
+                _Stats.ulBytesInUse -= ulClass;
+                return nullptr;
+            }
+#ifdef MADV_HUGEPAGE
+            if (ulClass >= MATRIX_POOL_HUGE_PAGE) {
+                madvise(p, ulClass, MADV_HUGEPAGE);
+            }
+#endif
+            return p;
+        }
+
+        void Deallocate(void* p, size_t ulBytes) {
+            if (p == nullptr) return;
+            const size_t ulClass = SizeClass(ulBytes);
+            {
+                std::lock_guard<std::mutex> Lock(_Mutex);
+                _Stats.ulBytesInUse -= ulClass;
+                if (_Stats.ulBytesCached + ulClass <= _ulMaxCached) {
+                    _mapFree[ulClass].push_back(p);
+                    _Stats.ulBytesCached += ulClass;
+                    return;
+                }
+            }
+            free(p);
+        }
+
+        /**
+         * @brief Give every cached buffer back to the system
+         *
+         */
+        void Trim() {
+            std::lock_guard<std::mutex> Lock(_Mutex);
+            for (auto& Entry : _mapFree) {
+                for (void* p : Entry.second) free(p);
+                Entry.second.clear();
+            }
+            _Stats.ulBytesCached = 0;
+        }
+
+        tPoolStats Stats() {
+            std::lock_guard<std::mutex> Lock(_Mutex);
+            return _Stats;
+        }
+
+        void ResetStats() {
+            std::lock_guard<std::mutex> Lock(_Mutex);
+            _Stats.ulHits = 0;
+            _Stats.ulMisses = 0;
+            _Stats.ulPeakBytes = _Stats.ulBytesInUse;
+        }
+
+    protected:
+        MatrixPool() {
+            const char* sEnv = getenv("MPIMATH_POOL_MAX_CACHED");
+            _ulMaxCached = sEnv != nullptr ? strtoull(sEnv, nullptr, 10) : MATRIX_POOL_MAX_CACHED;
+        }
+        MatrixPool(const MatrixPool&) = delete;
+        MatrixPool& operator=(const MatrixPool&) = delete;
+
+        std::mutex _Mutex;
+        std::unordered_map<size_t, std::vector<void*>> _mapFree; /** size class -> free buffers */
+        tPoolStats _Stats = { 0, 0, 0, 0, 0 };
+        size_t _ulMaxCached = MATRIX_POOL_MAX_CACHED;
+    };
+
+    /**
+     * @brief Allocator policy of Matrix2D backed by MatrixPool::Instance()
+     *
+     */
+    struct tPoolAllocator {
+        static inline void* Allocate(size_t ulBytes) { return MatrixPool::Instance().Allocate(ulBytes); }
+        static inline void Deallocate(void* p, size_t ulBytes) { MatrixPool::Instance().Deallocate(p, ulBytes); }
+    };
+}
+
+#endif
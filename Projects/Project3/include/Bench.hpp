@@ -0,0 +1,267 @@
+/**
+ * @file Bench.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Repeated measurements, their statistics, JSON / CSV reports and baseline comparison
+ * @version 0.1
+ * @date 2022-06-13
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Matrix.hpp"
+#include "PerfCounters.hpp"
+#include "debug.h"
+
+/** A result is a regression when its median exceeds the baseline median by this fraction */
+#define BENCH_DEFAULT_THRESHOLD 0.10
+
+namespace mpimath {
+    /**
+     * @brief How one case is measured
+     *
+     * @struct iWarmups     runs thrown away before measuring
+     * @struct iReps        measured runs, at least
+     * @struct dMinSeconds  keep measuring until this much time is spent
+     * @struct bPerf        count hardware events, report the derived metrics
+     */
+    typedef struct {
+        int iWarmups;
+        int iReps;
+        double dMinSeconds;
+        bool bPerf;
+    } tBenchConfig;
+
+    /**
+     * @brief Statistics of one case, times in seconds
+     *
+     * @struct sName    unique key, e.g. "gemm/f64/unroll/512x512x512"
+     * @struct dFlops   floating point operations of one run, 0 if not meaningful
+     * @struct dBytes   bytes moved by one run, 0 if not meaningful
+     * @struct bPerf    report PerfMetrics of Perf, an average run
+     * @struct ulElemBytes  element size for the peak GFLOP/s, 8 unless set
+     */
+    typedef struct {
+        std::string sName;
+        size_t ulReps;
+        double dMedian;
+        double dP95;
+        double dMin;
+        double dMean;
+        double dFlops;
+        double dBytes;
+        bool bPerf;
+        size_t ulElemBytes;
+        tPerfSample Perf;
+    } tBenchResult;
+
+    inline double BenchNow() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Median, nearest rank p95, min and mean of vecSamples (reordered)
+     *
+     */
+    inline tBenchResult BenchSummarize(const std::string& sName, std::vector<double>& vecSamples, double dFlops, double dBytes) {
+        tBenchResult Res = { sName, vecSamples.size(), 0, 0, 0, 0, dFlops, dBytes, false, 8, { { 0 }, 0 } };
+        if (vecSamples.empty()) return Res;
+        std::sort(vecSamples.begin(), vecSamples.end());
+        const size_t ulN = vecSamples.size();
+        Res.dMedian = ulN % 2 ? vecSamples[ulN / 2] : (vecSamples[ulN / 2 - 1] + vecSamples[ulN / 2]) / 2;
+        Res.dP95 = vecSamples[std::min(ulN - 1, (size_t)std::ceil(0.95 * (double)ulN) - 1)];
+        Res.dMin = vecSamples.front();
+        for (double dSample : vecSamples) Res.dMean += dSample;
+        Res.dMean /= (double)ulN;
+        return Res;
+    }
+
+    /**
+     * @brief Time fnRun after Config.iWarmups unmeasured runs
+     *
+     */
+    template<typename Fn>
+    tBenchResult BenchRun(const std::string& sName, const tBenchConfig& Config, double dFlops, double dBytes, Fn&& fnRun) {
+        for (int iRun = 0; iRun < Config.iWarmups; ++iRun) fnRun();
+        std::unique_ptr<PerfCounters> pCounters(Config.bPerf ? new PerfCounters : nullptr);
+        tPerfSample Begin = { { 0 }, 0 };
+        if (pCounters) Begin = pCounters->Read();
+        std::vector<double> vecSamples;
+        double dSpent = 0;
+        while ((int)vecSamples.size() < Config.iReps or dSpent < Config.dMinSeconds) {
+            double dBegin = BenchNow();
+            fnRun();
+            vecSamples.push_back(BenchNow() - dBegin);
+            dSpent += vecSamples.back();
+        }
+        tBenchResult Res = BenchSummarize(sName, vecSamples, dFlops, dBytes);
+        if (pCounters) {
+            Res.bPerf = true;
+            Res.Perf = PerfDelta(pCounters->Read(), Begin);
+            for (auto& ulValue : Res.Perf.aulValues) ulValue /= Res.ulReps;
+        }
+        return Res;
+    }
+
+    /**
+     * @brief Wall time of `sh -c sCommand`
+     *
+     * @return double seconds, negative if the command could not run or failed
+     */
+    inline double BenchExec(const std::string& sCommand) {
+        double dBegin = BenchNow();
+        pid_t Pid = fork();
+        if (Pid < 0) return -1;
+        if (Pid == 0) {
+            execl("/bin/sh", "sh", "-c", sCommand.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        int iStatus = 0;
+        if (waitpid(Pid, &iStatus, 0) < 0) return -1;
+        double dTime = BenchNow() - dBegin;
+        return WIFEXITED(iStatus) and WEXITSTATUS(iStatus) == 0 ? dTime : -1;
+    }
+
+    inline double BenchGFlops(const tBenchResult& Res) {
+        return Res.dFlops > 0 and Res.dMedian > 0 ? Res.dFlops / Res.dMedian / 1e9 : 0;
+    }
+
+    inline double BenchGBytes(const tBenchResult& Res) {
+        return Res.dBytes > 0 and Res.dMedian > 0 ? Res.dBytes / Res.dMedian / 1e9 : 0;
+    }
+
+    /** Unknown metrics are null in JSON and empty in CSV */
+    inline std::string _BenchMetric(double dValue, bool bJson) {
+        if (dValue < 0) return bJson ? "null" : "";
+        char acValue[32];
+        snprintf(acValue, sizeof(acValue), "%.4f", dValue);
+        return acValue;
+    }
+
+    /** The PerfMetrics columns of one result, each preceded by a separator */
+    inline std::string _BenchPerfFields(const tBenchResult& Res, bool bJson) {
+        const tPerfMetrics Metrics = PerfMetrics(Res.Perf, Res.dFlops, Res.dBytes, Res.dMedian, Res.ulElemBytes);
+        const std::pair<const char*, double> aFields[] = {
+            { "ipc", Metrics.dIPC }, { "l1_miss_rate", Metrics.dL1MissRate }, { "llc_miss_rate", Metrics.dLLCMissRate },
+            { "peak_fraction", Metrics.dPeakFraction }, { "bytes_per_flop", Metrics.dBytesPerFlop },
+            { "intensity", Metrics.dIntensity }, { "roof_gflops", Metrics.dRoofGFlops },
+        };
+        std::string sFields;
+        for (const auto& Field : aFields) {
+            sFields += bJson ? std::string(", \"") + Field.first + "\": " : std::string(",");
+            sFields += _BenchMetric(Field.second, bJson);
+        }
+        sFields += bJson ? std::string(", \"bound\": \"") + Metrics.sBound + "\"" : std::string(",") + Metrics.sBound;
+        return sFields;
+    }
+
+    /**
+     * @brief Write the results as "json" (one object per line in "results") or "csv"
+     *
+     * Results measured with bPerf also carry the PerfMetrics fields: ipc,
+     * miss rates, fraction of peak, bytes per flop and the roofline.
+     *
+     * @param sPath "-" for stdout
+     * @return int MATRIX_ERR_IO if the file can not be written
+     */
+    inline int BenchWrite(const std::string& sPath, const std::string& sFormat, const std::vector<tBenchResult>& vecResults) {
+        FILE* pFile = sPath == "-" ? stdout : fopen(sPath.c_str(), "w");
+        if (pFile == nullptr) return MATRIX_ERR_IO;
+        if (sFormat == "csv") {
+            bool bPerf = false;
+            for (const auto& Res : vecResults) bPerf |= Res.bPerf;
+            fprintf(pFile, "name,reps,median_s,p95_s,min_s,mean_s,gflops,gbytes_per_s%s\n",
+                    bPerf ? ",ipc,l1_miss_rate,llc_miss_rate,peak_fraction,bytes_per_flop,intensity,roof_gflops,bound" : "");
+            for (const auto& Res : vecResults) {
+                fprintf(pFile, "%s,%zu,%.9g,%.9g,%.9g,%.9g,%.4f,%.4f%s\n", Res.sName.c_str(), Res.ulReps, Res.dMedian,
+                        Res.dP95, Res.dMin, Res.dMean, BenchGFlops(Res), BenchGBytes(Res),
+                        Res.bPerf ? _BenchPerfFields(Res, false).c_str() : bPerf ? ",,,,,,,," : "");
+            }
+        } else {
+            fprintf(pFile, "{\"results\": [\n");
+            for (size_t idx = 0; idx < vecResults.size(); ++idx) {
+                const auto& Res = vecResults[idx];
+                fprintf(pFile, "{\"name\": \"%s\", \"reps\": %zu, \"median_s\": %.9g, \"p95_s\": %.9g, \"min_s\": %.9g, "
+                               "\"mean_s\": %.9g, \"gflops\": %.4f, \"gbytes_per_s\": %.4f%s}%s\n",
+                        Res.sName.c_str(), Res.ulReps, Res.dMedian, Res.dP95, Res.dMin, Res.dMean, BenchGFlops(Res),
+                        BenchGBytes(Res), Res.bPerf ? _BenchPerfFields(Res, true).c_str() : "",
+                        idx + 1 < vecResults.size() ? "," : "");
+            }
+            fprintf(pFile, "]}\n");
+        }
+        if (pFile == stdout) return fflush(stdout) == 0 ? MATRIX_OK : MATRIX_ERR_IO;
+        return fclose(pFile) == 0 ? MATRIX_OK : MATRIX_ERR_IO;
+    }
+
+    /**
+     * @brief Median of every case of a report written by BenchWrite, either format
+     *
+     * @return int MATRIX_ERR_IO if the file can not be read, MATRIX_ERR_DATA if nothing was found
+     */
+    inline int BenchLoadBaseline(const std::string& sPath, std::map<std::string, double>& mapMedian) {
+        std::ifstream File(sPath);
+        if (not File.is_open()) return MATRIX_ERR_IO;
+        std::string sLine;
+        while (std::getline(File, sLine)) {
+            size_t ulName = sLine.find("\"name\": \"");
+            if (ulName != std::string::npos) {
+                ulName += 9;
+                size_t ulEnd = sLine.find('"', ulName);
+                size_t ulMedian = sLine.find("\"median_s\": ");
+                if (ulEnd == std::string::npos or ulMedian == std::string::npos) continue;
+                mapMedian[sLine.substr(ulName, ulEnd - ulName)] = atof(sLine.c_str() + ulMedian + 12);
+            } else if (sLine.find(',') != std::string::npos and sLine.compare(0, 5, "name,") != 0 and sLine[0] != '{') {
+                /** name,reps,median_s,... */
+                size_t ulComma = sLine.find(',');
+                size_t ulReps = sLine.find(',', ulComma + 1);
+                if (ulReps == std::string::npos) continue;
+                mapMedian[sLine.substr(0, ulComma)] = atof(sLine.c_str() + ulReps + 1);
+            }
+        }
+        return mapMedian.empty() ? MATRIX_ERR_DATA : MATRIX_OK;
+    }
+
+    /**
+     * @brief Log every case slower than the baseline by more than dThreshold
+     *
+     * Cases missing from the baseline are reported but do not count.
+     *
+     * @return int number of regressions
+     */
+    inline int BenchCompare(const std::vector<tBenchResult>& vecResults, const std::map<std::string, double>& mapBaseline, double dThreshold) {
+        int iRegressions = 0;
+        for (const auto& Res : vecResults) {
+            auto It = mapBaseline.find(Res.sName);
+            if (It == mapBaseline.end() or It->second <= 0) {
+                LOGI("%-40s new, no baseline", Res.sName.c_str());
+                continue;
+            }
+            const double dRatio = Res.dMedian / It->second;
+            if (dRatio > 1 + dThreshold) {
+                LOGE("%-40s REGRESSION %.3fx (%.6fs -> %.6fs)", Res.sName.c_str(), dRatio, It->second, Res.dMedian);
+                iRegressions++;
+            } else {
+                LOGI("%-40s %.3fx", Res.sName.c_str(), dRatio);
+            }
+        }
+        return iRegressions;
+    }
+}
+
+#endif
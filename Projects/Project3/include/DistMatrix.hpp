@@ -0,0 +1,586 @@
+/**
+ * @file DistMatrix.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief A matrix that stays partitioned over the processes of a communicator
+ * @version 0.1
+ * @date 2022-06-15
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Every operation here is collective over the communicator of its operands
+ * and moves data rank to rank: the full matrix only exists on one process
+ * between Scatter() and Gather(), both of which the caller asks for.
+ *
+ */
+#ifndef DISTMATRIX_HPP
+#define DISTMATRIX_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+#include "Allocator.hpp"
+#include "MatMul.hpp"
+#include "Matrix.hpp"
+#include "gemm.hpp"
+
+/** Default block edge of DistLayoutBlockCyclic() */
+#define DIST_DEFAULT_BLOCK 64
+
+namespace mpimath {
+    /**
+     * @brief How a DistMatrix is cut
+     *
+     * @enum ROW            contiguous row blocks, one per process
+     * @enum COL            contiguous column blocks, one per process
+     * @enum BLOCK_CYCLIC   blocks dealt round robin over a 2D process grid
+     */
+    enum class emDistKind {
+        ROW,
+        COL,
+        BLOCK_CYCLIC,
+    };
+
+    /**
+     * @brief Layout descriptor, every kind is a 2D block cyclic layout
+     *
+     * Global row i lives on process row (i / ulBlockRow) % iProcRow, column j
+     * on process column (j / ulBlockCol) % iProcCol, and the process at grid
+     * position (r, c) is rank r * iProcCol + c of the communicator. ROW is the
+     * iSize x 1 grid with one block of rows per process, COL is its transpose.
+     *
+     * @struct Kind         informative, DistLayoutSame() ignores it
+     * @struct ulRow        global rows
+     * @struct ulCol        global columns
+     * @struct iProcRow     rows of the process grid
+     * @struct iProcCol     columns of the process grid
+     * @struct ulBlockRow   rows of a block
+     * @struct ulBlockCol   columns of a block
+     */
+    typedef struct {
+        emDistKind Kind;
+        size_t ulRow;
+        size_t ulCol;
+        int iProcRow;
+        int iProcCol;
+        size_t ulBlockRow;
+        size_t ulBlockCol;
+    } tDistLayout;
+
+    inline tDistLayout DistLayoutRow(size_t ulRow, size_t ulCol, int iSize) {
+        return { emDistKind::ROW, ulRow, ulCol, iSize, 1,
+                 std::max<size_t>(1, (ulRow + (size_t)iSize - 1) / (size_t)iSize), std::max<size_t>(1, ulCol) };
+    }
+
+    inline tDistLayout DistLayoutCol(size_t ulRow, size_t ulCol, int iSize) {
+        return { emDistKind::COL, ulRow, ulCol, 1, iSize,
+                 std::max<size_t>(1, ulRow), std::max<size_t>(1, (ulCol + (size_t)iSize - 1) / (size_t)iSize) };
+    }
+
+    /**
+     * @brief ulBlock x ulBlock blocks on an iProcRow x (iSize / iProcRow) grid
+     *
+     * @param iProcRow 0 for the most square grid, see MPI_Dims_create
+     */
+    inline tDistLayout DistLayoutBlockCyclic(size_t ulRow, size_t ulCol, int iSize, size_t ulBlock = DIST_DEFAULT_BLOCK, int iProcRow = 0) {
+        int aiDims[2] = { iProcRow, 0 };
+        if (iProcRow <= 0 or iSize % iProcRow != 0) {
+            aiDims[0] = 0;
+            MPI_Dims_create(iSize, 2, aiDims);
+        } else {
+            aiDims[1] = iSize / iProcRow;
+        }
+        ulBlock = std::max<size_t>(1, ulBlock);
+        return { emDistKind::BLOCK_CYCLIC, ulRow, ulCol, aiDims[0], aiDims[1], ulBlock, ulBlock };
+    }
+
+    /** Same owner and local position for every element */
+    inline bool DistLayoutSame(const tDistLayout& A, const tDistLayout& B) {
+        return A.ulRow == B.ulRow and A.ulCol == B.ulCol and A.iProcRow == B.iProcRow and A.iProcCol == B.iProcCol and
+               A.ulBlockRow == B.ulBlockRow and A.ulBlockCol == B.ulBlockCol;
+    }
+
+    /** The Kind a layout reduces to, e.g. a block cyclic layout on an iSize x 1 grid with one block per process is ROW */
+    inline emDistKind DistLayoutKind(const tDistLayout& Layout) {
+        if (Layout.iProcCol == 1 and Layout.ulBlockCol >= Layout.ulCol and
+            Layout.ulBlockRow * (size_t)Layout.iProcRow >= Layout.ulRow) {
+            return emDistKind::ROW;
+        }
+        if (Layout.iProcRow == 1 and Layout.ulBlockRow >= Layout.ulRow and
+            Layout.ulBlockCol * (size_t)Layout.iProcCol >= Layout.ulCol) {
+            return emDistKind::COL;
+        }
+        return emDistKind::BLOCK_CYCLIC;
+    }
+
+    /** Rows (or columns) of an ulN long dimension held by process iProc of iProcs, ScaLAPACK numroc */
+    inline size_t DistLocalCount(size_t ulN, size_t ulBlock, int iProc, int iProcs) {
+        const size_t ulBlocks = ulN / ulBlock, ulExtra = ulBlocks % (size_t)iProcs;
+        size_t ulCount = ulBlocks / (size_t)iProcs * ulBlock;
+        if ((size_t)iProc < ulExtra) {
+            ulCount += ulBlock;
+        } else if ((size_t)iProc == ulExtra) {
+            ulCount += ulN % ulBlock;
+        }
+        return ulCount;
+    }
+
+    inline int DistOwner(size_t ulIdx, size_t ulBlock, int iProcs) {
+        return (int)(ulIdx / ulBlock % (size_t)iProcs);
+    }
+
+    inline size_t DistLocalIndex(size_t ulIdx, size_t ulBlock, int iProcs) {
+        return ulIdx / ulBlock / (size_t)iProcs * ulBlock + ulIdx % ulBlock;
+    }
+
+    inline size_t DistGlobalIndex(size_t ulLocal, size_t ulBlock, int iProc, int iProcs) {
+        return (ulLocal / ulBlock * (size_t)iProcs + (size_t)iProc) * ulBlock + ulLocal % ulBlock;
+    }
+
+    /**
+     * @brief Matrix partitioned over the processes of a communicator
+     *
+     * Each process keeps its elements as a row major Matrix2D of the local
+     * rows and columns, in global order. Every method but the accessors is
+     * collective.
+     *
+     * @tparam T element type
+     */
+    template<typename T>
+    class DistMatrix {
+    public:
+        DistMatrix() {};
+
+        /**
+         * @brief Allocate the local part of a Layout matrix
+         *
+         * @throw MATRIX_ERR_SHAPE if the process grid does not cover Comm exactly
+         */
+        DistMatrix(const tDistLayout& Layout, MPI_Comm Comm = MPI_COMM_WORLD, bool bFillZero = false) {
+            Init(Layout, Comm, bFillZero);
+        }
+
+        void Init(const tDistLayout& Layout, MPI_Comm Comm = MPI_COMM_WORLD, bool bFillZero = false) {
+            int iRank = 0, iSize = 1;
+            MPI_Comm_rank(Comm, &iRank);
+            MPI_Comm_size(Comm, &iSize);
+            if (Layout.iProcRow * Layout.iProcCol != iSize or Layout.ulBlockRow == 0 or Layout.ulBlockCol == 0) {
+                throw MATRIX_ERR_SHAPE;
+            }
+            _Layout = Layout;
+            _Layout.Kind = DistLayoutKind(Layout);
+            _Comm = Comm;
+            _iRank = iRank;
+            _iGridRow = iRank / Layout.iProcCol;
+            _iGridCol = iRank % Layout.iProcCol;
+            _MatLocal.Init(DistLocalCount(Layout.ulRow, Layout.ulBlockRow, _iGridRow, Layout.iProcRow),
+                           DistLocalCount(Layout.ulCol, Layout.ulBlockCol, _iGridCol, Layout.iProcCol), bFillZero);
+        }
+
+        inline const tDistLayout& Layout() const { return _Layout; };
+
+        inline MPI_Comm Comm() const { return _Comm; };
+
+        inline size_t ulRow() const { return _Layout.ulRow; };
+
+        inline size_t ulCol() const { return _Layout.ulCol; };
+
+        /** Rows and columns of this process, row major */
+        inline Matrix2D<T, tPoolAllocator>& Local() { return _MatLocal; };
+
+        inline const Matrix2D<T, tPoolAllocator>& Local() const { return _MatLocal; };
+
+        inline size_t GlobalRow(size_t ulLocalRow) const {
+            return DistGlobalIndex(ulLocalRow, _Layout.ulBlockRow, _iGridRow, _Layout.iProcRow);
+        }
+
+        inline size_t GlobalCol(size_t ulLocalCol) const {
+            return DistGlobalIndex(ulLocalCol, _Layout.ulBlockCol, _iGridCol, _Layout.iProcCol);
+        }
+
+        /** Rank of Comm that holds element (ulRow, ulCol) */
+        inline int Owner(size_t ulRow, size_t ulCol) const {
+            return DistOwner(ulRow, _Layout.ulBlockRow, _Layout.iProcRow) * _Layout.iProcCol +
+                   DistOwner(ulCol, _Layout.ulBlockCol, _Layout.iProcCol);
+        }
+
+        /**
+         * @brief Cut MatFull, significant on iRoot only, into Layout
+         *
+         * @throw MATRIX_ERR_SHAPE on iRoot if MatFull is not Layout.ulRow x Layout.ulCol
+         */
+        static DistMatrix<T> Scatter(const Matrix2D<T>& MatFull, const tDistLayout& Layout, int iRoot = 0, MPI_Comm Comm = MPI_COMM_WORLD) {
+            DistMatrix<T> Res(Layout, Comm);
+            int iSize = 1;
+            MPI_Comm_size(Comm, &iSize);
+            std::vector<T> vecSend;
+            std::vector<int> vecCounts(iSize), vecDispls(iSize);
+            if (Res._iRank == iRoot) {
+                if (MatFull.ulRow() != Layout.ulRow or MatFull.ulCol() != Layout.ulCol) throw MATRIX_ERR_SHAPE;
+                vecSend.resize(MatFull.Size());
+                size_t ulOffset = 0;
+                for (int iProc = 0; iProc < iSize; ++iProc) {
+                    vecDispls[iProc] = (int)ulOffset;
+                    ulOffset += Res._CopyBlocks(MatFull.pData(), vecSend.data() + ulOffset, iProc, true);
+                    vecCounts[iProc] = (int)ulOffset - vecDispls[iProc];
+                }
+            }
+            MPI_Scatterv(vecSend.data(), vecCounts.data(), vecDispls.data(), tMPIType<T>::Get(), Res._MatLocal.pData(),
+                         (int)Res._MatLocal.Size(), tMPIType<T>::Get(), iRoot, Comm);
+            return Res;
+        }
+
+        /**
+         * @brief Assemble the full matrix on iRoot
+         *
+         * @return Matrix2D<T> the matrix on iRoot, empty on the other processes
+         */
+        Matrix2D<T> Gather(int iRoot = 0) const {
+            int iSize = 1;
+            MPI_Comm_size(_Comm, &iSize);
+            Matrix2D<T> MatFull;
+            std::vector<T> vecRecv;
+            std::vector<int> vecCounts(iSize), vecDispls(iSize);
+            if (_iRank == iRoot) {
+                MatFull.Init(_Layout.ulRow, _Layout.ulCol);
+                vecRecv.resize(MatFull.Size());
+                for (int iProc = 0, iOffset = 0; iProc < iSize; ++iProc) {
+                    vecDispls[iProc] = iOffset;
+                    vecCounts[iProc] = (int)(_LocalRows(iProc) * _LocalCols(iProc));
+                    iOffset += vecCounts[iProc];
+                }
+            }
+            MPI_Gatherv(_MatLocal.pData(), (int)_MatLocal.Size(), tMPIType<T>::Get(), vecRecv.data(), vecCounts.data(),
+                        vecDispls.data(), tMPIType<T>::Get(), iRoot, _Comm);
+            if (_iRank == iRoot) {
+                for (int iProc = 0; iProc < iSize; ++iProc) {
+                    _CopyBlocks(MatFull.pData(), vecRecv.data() + vecDispls[iProc], iProc, false);
+                }
+            }
+            return MatFull;
+        }
+
+        /**
+         * @brief The same matrix in Layout, one MPI_Alltoallv
+         *
+         * Both sides walk their elements in global row major order, so the
+         * counts and the order of every message are known without asking.
+         * A copy when the layouts already match.
+         *
+         * @throw MATRIX_ERR_SHAPE if Layout has another shape
+         */
+        DistMatrix<T> Redistribute(const tDistLayout& Layout) const {
+            if (Layout.ulRow != _Layout.ulRow or Layout.ulCol != _Layout.ulCol) throw MATRIX_ERR_SHAPE;
+            if (DistLayoutSame(Layout, _Layout)) return *this;
+            DistMatrix<T> Res(Layout, _Comm);
+            int iSize = 1;
+            MPI_Comm_size(_Comm, &iSize);
+
+            /** Owner of every local row / column in the layout on the other side */
+            auto OwnerMap = [](const DistMatrix<T>& Mat, const tDistLayout& Other) {
+                std::vector<int> vecRow(Mat._MatLocal.ulRow()), vecCol(Mat._MatLocal.ulCol());
+                for (size_t i = 0; i < vecRow.size(); ++i) {
+                    vecRow[i] = DistOwner(Mat.GlobalRow(i), Other.ulBlockRow, Other.iProcRow) * Other.iProcCol;
+                }
+                for (size_t j = 0; j < vecCol.size(); ++j) vecCol[j] = DistOwner(Mat.GlobalCol(j), Other.ulBlockCol, Other.iProcCol);
+                return std::make_pair(vecRow, vecCol);
+            };
+            auto Counts = [iSize](const std::pair<std::vector<int>, std::vector<int>>& Map, std::vector<int>& vecCounts,
+                                  std::vector<int>& vecDispls) {
+                vecCounts.assign(iSize, 0);
+                vecDispls.assign(iSize, 0);
+                for (int iRowOwner : Map.first) {
+                    for (int iColOwner : Map.second) vecCounts[iRowOwner + iColOwner]++;
+                }
+                for (int iProc = 1; iProc < iSize; ++iProc) vecDispls[iProc] = vecDispls[iProc - 1] + vecCounts[iProc - 1];
+            };
+
+            const auto SendMap = OwnerMap(*this, Layout), RecvMap = OwnerMap(Res, _Layout);
+            std::vector<int> vecSendCounts, vecSendDispls, vecRecvCounts, vecRecvDispls;
+            Counts(SendMap, vecSendCounts, vecSendDispls);
+            Counts(RecvMap, vecRecvCounts, vecRecvDispls);
+
+            std::vector<T> vecSend(_MatLocal.Size()), vecRecv(Res._MatLocal.Size());
+            std::vector<int> vecCursor = vecSendDispls;
+            const size_t ulCols = _MatLocal.ulCol();
+            for (size_t i = 0; i < SendMap.first.size(); ++i) {
+                for (size_t j = 0; j < ulCols; ++j) {
+                    vecSend[vecCursor[SendMap.first[i] + SendMap.second[j]]++] = _MatLocal.pData()[i * ulCols + j];
+                }
+            }
+            MPI_Alltoallv(vecSend.data(), vecSendCounts.data(), vecSendDispls.data(), tMPIType<T>::Get(), vecRecv.data(),
+                          vecRecvCounts.data(), vecRecvDispls.data(), tMPIType<T>::Get(), _Comm);
+            vecCursor = vecRecvDispls;
+            const size_t ulResCols = Res._MatLocal.ulCol();
+            for (size_t i = 0; i < RecvMap.first.size(); ++i) {
+                for (size_t j = 0; j < ulResCols; ++j) {
+                    Res._MatLocal.pData()[i * ulResCols + j] = vecRecv[vecCursor[RecvMap.first[i] + RecvMap.second[j]]++];
+                }
+            }
+            return Res;
+        }
+
+        /**
+         * @brief The transpose, in the transposed layout
+         *
+         * The local part of the result is the transposed local part, it only
+         * changes process when the grid is 2D: grid position (r, c) becomes
+         * (c, r), one MPI_Sendrecv.
+         */
+        DistMatrix<T> Transposed() const {
+            const tDistLayout Layout = { _Layout.Kind, _Layout.ulCol, _Layout.ulRow, _Layout.iProcCol, _Layout.iProcRow,
+                                         _Layout.ulBlockCol, _Layout.ulBlockRow };
+            DistMatrix<T> Res(Layout, _Comm);
+            Matrix2D<T, tPoolAllocator> MatLocalT = _MatLocal;
+            MatLocalT.Transpose();
+            const int iDest = _iGridCol * _Layout.iProcRow + _iGridRow;
+            const int iSource = Res._iGridCol * _Layout.iProcCol + Res._iGridRow;
+            if (iDest == _iRank) {
+                if (Res._MatLocal.Size() > 0) memcpy(Res._MatLocal.pData(), MatLocalT.pData(), Res._MatLocal.ulDataSize());
+            } else {
+                MPI_Sendrecv(MatLocalT.pData(), (int)MatLocalT.Size(), tMPIType<T>::Get(), iDest, 0, Res._MatLocal.pData(),
+                             (int)Res._MatLocal.Size(), tMPIType<T>::Get(), iSource, 0, _Comm, MPI_STATUS_IGNORE);
+            }
+            return Res;
+        }
+
+        /**
+         * @brief Element-wise fnOp(this, Other), Other is redistributed first if its layout differs
+         *
+         * @throw MATRIX_ERR_SHAPE
+         */
+        template<typename Fn>
+        DistMatrix<T>& Combine(const DistMatrix<T>& Other, Fn&& fnOp) {
+            if (Other.ulRow() != ulRow() or Other.ulCol() != ulCol()) throw MATRIX_ERR_SHAPE;
+            DistMatrix<T> Tmp;
+            const DistMatrix<T>* pOther = &Other;
+            if (not DistLayoutSame(Other._Layout, _Layout)) {
+                Tmp = Other.Redistribute(_Layout);
+                pOther = &Tmp;
+            }
+            T* pData = _MatLocal.pData();
+            const T* pOtherData = pOther->_MatLocal.pData();
+            for (size_t idx = 0; idx < _MatLocal.Size(); ++idx) pData[idx] = fnOp(pData[idx], pOtherData[idx]);
+            return *this;
+        }
+
+        /** Element-wise fnOp on the local part, no communication */
+        template<typename Fn>
+        DistMatrix<T>& Apply(Fn&& fnOp) {
+            T* pData = _MatLocal.pData();
+            for (size_t idx = 0; idx < _MatLocal.Size(); ++idx) pData[idx] = fnOp(pData[idx]);
+            return *this;
+        }
+
+        DistMatrix<T>& operator+=(const DistMatrix<T>& Other) {
+            return Combine(Other, [](const T& A, const T& B) { return T(A + B); });
+        }
+
+        DistMatrix<T>& operator-=(const DistMatrix<T>& Other) {
+            return Combine(Other, [](const T& A, const T& B) { return T(A - B); });
+        }
+
+        DistMatrix<T>& operator*=(const T& Scalar) {
+            return Apply([Scalar](const T& A) { return T(A * Scalar); });
+        }
+
+    protected:
+        tDistLayout _Layout = { emDistKind::ROW, 0, 0, 1, 1, 1, 1 };
+        MPI_Comm _Comm = MPI_COMM_WORLD;
+        int _iRank = 0, _iGridRow = 0, _iGridCol = 0;
+        /** Pooled: the temporaries of chains and powers reuse each other's buffers */
+        Matrix2D<T, tPoolAllocator> _MatLocal;
+
+        inline size_t _LocalRows(int iProc) const {
+            return DistLocalCount(_Layout.ulRow, _Layout.ulBlockRow, iProc / _Layout.iProcCol, _Layout.iProcRow);
+        }
+
+        inline size_t _LocalCols(int iProc) const {
+            return DistLocalCount(_Layout.ulCol, _Layout.ulBlockCol, iProc % _Layout.iProcCol, _Layout.iProcCol);
+        }
+
+        /**
+         * @brief Copy the elements of process iProc out of (bPack) or back into
+         * the row major full matrix, one memcpy per row of a block
+         *
+         * @return size_t elements copied
+         */
+        size_t _CopyBlocks(T* pFull, T* pPacked, int iProc, bool bPack) const {
+            const int iGridRow = iProc / _Layout.iProcCol, iGridCol = iProc % _Layout.iProcCol;
+            const size_t ulRows = _LocalRows(iProc), ulCols = _LocalCols(iProc), ulBlock = _Layout.ulBlockCol;
+            for (size_t i = 0; i < ulRows; ++i) {
+                T* pFullRow = pFull + DistGlobalIndex(i, _Layout.ulBlockRow, iGridRow, _Layout.iProcRow) * _Layout.ulCol;
+                T* pPackedRow = pPacked + i * ulCols;
+                for (size_t j = 0; j < ulCols; j += ulBlock) {
+                    const size_t ulWidth = std::min(ulBlock, ulCols - j);
+                    T* pFullRun = pFullRow + DistGlobalIndex(j, ulBlock, iGridCol, _Layout.iProcCol);
+                    if (bPack) {
+                        memcpy(pPackedRow + j, pFullRun, ulWidth * sizeof(T));
+                    } else {
+                        memcpy(pFullRun, pPackedRow + j, ulWidth * sizeof(T));
+                    }
+                }
+            }
+            return ulRows * ulCols;
+        }
+
+        template<typename U>
+        friend void DistMultiplyInto(DistMatrix<U>& MatC, const DistMatrix<U>& MatA, const DistMatrix<U>& MatB);
+    };
+
+    /**
+     * @brief The layout DistMultiply wants for the right operand of a LayoutA
+     * matrix: the grid of LayoutA, row blocks as wide as its column blocks
+     *
+     * Column blocks of LayoutB are kept when the grids have as many columns.
+     * Redistribute a matrix that is multiplied many times into it once.
+     */
+    inline tDistLayout DistOperandLayout(const tDistLayout& LayoutA, const tDistLayout& LayoutB) {
+        tDistLayout Layout = {
+            emDistKind::BLOCK_CYCLIC, LayoutB.ulRow, LayoutB.ulCol, LayoutA.iProcRow, LayoutA.iProcCol, LayoutA.ulBlockCol,
+            LayoutB.iProcCol == LayoutA.iProcCol ? LayoutB.ulBlockCol
+                                                 : std::max<size_t>(1, (LayoutB.ulCol + LayoutA.iProcCol - 1) / LayoutA.iProcCol),
+        };
+        Layout.Kind = DistLayoutKind(Layout);
+        return Layout;
+    }
+
+    /**
+     * @brief MatC = MatA @ MatB with SUMMA on the process grid of MatA
+     *
+     * MatB is redistributed only if it is not in DistOperandLayout(). For
+     * every column block k of MatA, its owners broadcast the block along their
+     * process row, the owners of row block k of MatB broadcast along their
+     * process column, and every process adds the product to its part of the
+     * result. The result has the row blocks of MatA and the column blocks of
+     * MatB, so A = A * B in a loop stays put: a ROW matrix times anything on
+     * one process column is ROW again.
+     *
+     * The local buffer of MatC is kept when it already has the result layout.
+     * Reduced precision types accumulate in tGemmTraits<T>::AccType.
+     *
+     * @throw MATRIX_ERR_SHAPE
+     */
+    template<typename T>
+    void DistMultiplyInto(DistMatrix<T>& MatC, const DistMatrix<T>& MatA, const DistMatrix<T>& MatB) {
+        typedef typename tGemmTraits<T>::AccType TAcc;
+        if (MatA.ulCol() != MatB.ulRow()) throw MATRIX_ERR_SHAPE;
+        if (&MatC == &MatA or &MatC == &MatB) {
+            DistMatrix<T> MatTmp;
+            DistMultiplyInto(MatTmp, MatA, MatB);
+            MatC = std::move(MatTmp);
+            return;
+        }
+        const tDistLayout& LayoutA = MatA.Layout();
+        const tDistLayout LayoutB = DistOperandLayout(LayoutA, MatB.Layout());
+        DistMatrix<T> MatBTmp;
+        const DistMatrix<T>* pMatB = &MatB;
+        if (not DistLayoutSame(LayoutB, MatB.Layout())) {
+            MatBTmp = MatB.Redistribute(LayoutB);
+            pMatB = &MatBTmp;
+        }
+
+        const tDistLayout LayoutC = { emDistKind::BLOCK_CYCLIC, MatA.ulRow(), MatB.ulCol(), LayoutA.iProcRow,
+                                      LayoutA.iProcCol, LayoutA.ulBlockRow, LayoutB.ulBlockCol };
+        if (not DistLayoutSame(MatC.Layout(), LayoutC) or MatC.Comm() != MatA.Comm() or
+            MatC._MatLocal.Size() != MatA._MatLocal.ulRow() * pMatB->_MatLocal.ulCol()) {
+            MatC.Init(LayoutC, MatA.Comm());
+        }
+        const size_t ulLocRow = MatA._MatLocal.ulRow(), ulLocCol = pMatB->_MatLocal.ulCol();
+        const size_t ulLocInnerA = MatA._MatLocal.ulCol();
+        const size_t ulInner = MatA.ulCol(), ulKB = LayoutA.ulBlockCol;
+
+        MPI_Comm RowComm = MPI_COMM_NULL, ColComm = MPI_COMM_NULL;
+        if (LayoutA.iProcCol > 1) MPI_Comm_split(MatA.Comm(), MatA._iGridRow, MatA._iGridCol, &RowComm);
+        if (LayoutA.iProcRow > 1) MPI_Comm_split(MatA.Comm(), MatA._iGridCol, MatA._iGridRow, &ColComm);
+
+        /** T accumulates straight into MatC, narrower types go through MatAcc */
+        Matrix2D<T, tPoolAllocator> MatPanelA(ulLocRow, ulKB), MatPanelB(ulKB, ulLocCol);
+        Matrix2D<TAcc, tPoolAllocator> MatAcc, MatProd(ulLocRow, ulLocCol);
+        TAcc* pAcc = nullptr;
+        if constexpr (std::is_same<T, TAcc>::value) {
+            pAcc = MatC._MatLocal.pData();
+        } else {
+            MatAcc.Init(ulLocRow, ulLocCol);
+            pAcc = MatAcc.pData();
+        }
+        bool bFirst = true;
+        for (size_t ulK0 = 0; ulK0 < ulInner; ulK0 += ulKB) {
+            const size_t ulWidth = std::min(ulKB, ulInner - ulK0);
+            const int iOwnerCol = DistOwner(ulK0, ulKB, LayoutA.iProcCol);
+            const int iOwnerRow = DistOwner(ulK0, ulKB, LayoutA.iProcRow);
+
+            /** Columns [ulK0, ulK0 + ulWidth) of my rows of A, used in place when they are all of them */
+            const T* pPanelA = MatPanelA.pData();
+            if (MatA._iGridCol == iOwnerCol) {
+                const size_t ulLocK0 = DistLocalIndex(ulK0, ulKB, LayoutA.iProcCol);
+                if (ulWidth == ulLocInnerA) {
+                    pPanelA = MatA._MatLocal.pData();
+                } else {
+                    for (size_t i = 0; i < ulLocRow; ++i) {
+                        memcpy(MatPanelA.pData() + i * ulWidth, MatA._MatLocal.pData() + i * ulLocInnerA + ulLocK0,
+                               ulWidth * sizeof(T));
+                    }
+                }
+            }
+            if (RowComm != MPI_COMM_NULL and ulLocRow > 0) {
+                MPI_Bcast((void*)pPanelA, (int)(ulLocRow * ulWidth), tMPIType<T>::Get(), iOwnerCol, RowComm);
+            }
+
+            /** Rows of B are contiguous */
+            const T* pPanelB = MatPanelB.pData();
+            if (MatA._iGridRow == iOwnerRow) {
+                pPanelB = pMatB->_MatLocal.pData() + DistLocalIndex(ulK0, ulKB, LayoutA.iProcRow) * ulLocCol;
+            }
+            if (ColComm != MPI_COMM_NULL and ulLocCol > 0) {
+                MPI_Bcast((void*)pPanelB, (int)(ulWidth * ulLocCol), tMPIType<T>::Get(), iOwnerRow, ColComm);
+            }
+
+            if (ulLocRow == 0 or ulLocCol == 0) continue;
+            gemm(bFirst ? pAcc : MatProd.pData(), pPanelA, pPanelB, ulLocRow, ulWidth, ulWidth, ulLocCol);
+            if (not bFirst) {
+                for (size_t idx = 0; idx < MatProd.Size(); ++idx) pAcc[idx] += MatProd.pData()[idx];
+            }
+            bFirst = false;
+        }
+        if (bFirst and pAcc != nullptr) memset(pAcc, 0, ulLocRow * ulLocCol * sizeof(TAcc));
+        if constexpr (not std::is_same<T, TAcc>::value) {
+            for (size_t idx = 0; idx < MatAcc.Size(); ++idx) MatC._MatLocal.pData()[idx] = tGemmTraits<T>::FromAcc(pAcc[idx]);
+        }
+
+        if (RowComm != MPI_COMM_NULL) MPI_Comm_free(&RowComm);
+        if (ColComm != MPI_COMM_NULL) MPI_Comm_free(&ColComm);
+    }
+
+    template<typename T>
+    DistMatrix<T> DistMultiply(const DistMatrix<T>& MatA, const DistMatrix<T>& MatB) {
+        DistMatrix<T> MatC;
+        DistMultiplyInto(MatC, MatA, MatB);
+        return MatC;
+    }
+
+    template<typename T>
+    DistMatrix<T> operator*(const DistMatrix<T>& MatA, const DistMatrix<T>& MatB) {
+        return DistMultiply(MatA, MatB);
+    }
+
+    template<typename T>
+    DistMatrix<T> operator+(const DistMatrix<T>& MatA, const DistMatrix<T>& MatB) {
+        DistMatrix<T> Res = MatA;
+        Res += MatB;
+        return Res;
+    }
+
+    template<typename T>
+    DistMatrix<T> operator-(const DistMatrix<T>& MatA, const DistMatrix<T>& MatB) {
+        DistMatrix<T> Res = MatA;
+        Res -= MatB;
+        return Res;
+    }
+}
+
+#endif
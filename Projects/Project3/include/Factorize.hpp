@@ -0,0 +1,516 @@
+/**
+ * @file Factorize.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Blocked LU / Cholesky factorization and linear solve, local or over MPI
+ * @version 0.1
+ * @date 2022-06-11
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef FACTORIZE_HPP
+#define FACTORIZE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <mpi.h>
+
+#include "Allocator.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MatMul.hpp"
+#include "Matrix.hpp"
+#include "gemm.hpp"
+
+/** Width of a column panel, the inner dimension of every trailing update */
+#define FACTOR_DEFAULT_BLOCK 64
+
+namespace mpimath {
+    /**
+     * @brief Columns of an ulN wide matrix held by iRank when column blocks of
+     * ulBlock are dealt round robin over iSize processes
+     *
+     */
+    inline size_t FactorLocalCols(size_t ulN, size_t ulBlock, int iRank, int iSize) {
+        size_t ulCols = 0;
+        for (size_t ulLow = (size_t)iRank * ulBlock; ulLow < ulN; ulLow += (size_t)iSize * ulBlock) {
+            ulCols += std::min(ulBlock, ulN - ulLow);
+        }
+        return ulCols;
+    }
+
+    /**
+     * @brief Copy the columns owned by iRank out of (bPack) or back into the
+     * full row major ulN x ulN matrix pFull
+     *
+     */
+    inline void _FactorPackCols(double* pFull, double* pLocal, size_t ulN, size_t ulBlock, int iRank, int iSize, bool bPack) {
+        const size_t ulLocCols = FactorLocalCols(ulN, ulBlock, iRank, iSize);
+        for (size_t ulRow = 0; ulRow < ulN; ++ulRow) {
+            double* pLocalRow = pLocal + ulRow * ulLocCols;
+            for (size_t ulLow = (size_t)iRank * ulBlock; ulLow < ulN; ulLow += (size_t)iSize * ulBlock) {
+                const size_t ulWidth = std::min(ulBlock, ulN - ulLow);
+                if (bPack) {
+                    memcpy(pLocalRow, pFull + ulRow * ulN + ulLow, ulWidth * sizeof(double));
+                } else {
+                    memcpy(pFull + ulRow * ulN + ulLow, pLocalRow, ulWidth * sizeof(double));
+                }
+                pLocalRow += ulWidth;
+            }
+        }
+    }
+
+    /**
+     * @brief Unblocked LU with partial pivoting of a ulRows x ulCols panel
+     *
+     * Rows are swapped inside the panel only, the caller applies the pivots to
+     * the other columns.
+     *
+     * @param pA    panel, leading dimension ulLd
+     * @param pPiv  pivot row of every column, relative to the panel
+     * @return bool false on an exactly singular column
+     */
+    inline bool _LUPanel(double* pA, size_t ulLd, size_t ulRows, size_t ulCols, int* pPiv) {
+        for (size_t j = 0; j < ulCols; ++j) {
+            size_t ulPivot = j;
+            double dMax = std::fabs(pA[j * ulLd + j]);
+            for (size_t i = j + 1; i < ulRows; ++i) {
+                if (std::fabs(pA[i * ulLd + j]) > dMax) {
+                    dMax = std::fabs(pA[i * ulLd + j]);
+                    ulPivot = i;
+                }
+            }
+            pPiv[j] = (int)ulPivot;
+            if (dMax == 0) return false;
+            if (ulPivot != j) {
+                std::swap_ranges(pA + j * ulLd, pA + j * ulLd + ulCols, pA + ulPivot * ulLd);
+            }
+            const double dInv = 1.0 / pA[j * ulLd + j];
+            const double* pRowJ = pA + j * ulLd;
+            for (size_t i = j + 1; i < ulRows; ++i) {
+                double* pRowI = pA + i * ulLd;
+                const double dL = (pRowI[j] *= dInv);
+                for (size_t c = j + 1; c < ulCols; ++c) pRowI[c] -= dL * pRowJ[c];
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Unblocked left looking Cholesky of a ulRows x ulCols panel whose
+     * top ulCols rows are the diagonal block, lower triangle only
+     *
+     * @return bool false when the block is not positive definite
+     */
+    inline bool _CholeskyPanel(double* pA, size_t ulLd, size_t ulRows, size_t ulCols) {
+        for (size_t j = 0; j < ulCols; ++j) {
+            const double* pRowJ = pA + j * ulLd;
+            double dDiag = pRowJ[j];
+            for (size_t s = 0; s < j; ++s) dDiag -= pRowJ[s] * pRowJ[s];
+            if (not(dDiag > 0) or not std::isfinite(dDiag)) return false;
+            dDiag = std::sqrt(dDiag);
+            pA[j * ulLd + j] = dDiag;
+            for (size_t i = j + 1; i < ulRows; ++i) {
+                double* pRowI = pA + i * ulLd;
+                double dSum = pRowI[j];
+                for (size_t s = 0; s < j; ++s) dSum -= pRowI[s] * pRowJ[s];
+                pRowI[j] = dSum / dDiag;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Blocked right looking LU with partial pivoting, columns in a 1D
+     * block cyclic layout
+     *
+     * Step k: the owner of column block k factors the panel and broadcasts it
+     * with its pivots, every process swaps rows of its own columns, solves for
+     * its part of the U row block and updates its trailing columns with one
+     * gemm, A22 -= L21 * U12. On return pA holds the local columns of L\U.
+     *
+     * @param pA        local columns, row major ulN x FactorLocalCols(...)
+     * @param ulN
+     * @param ulBlock
+     * @param pPiv      ulN global pivot rows, LAPACK style (row i swapped with pPiv[i])
+     * @param Comm      MPI_COMM_NULL for a purely local factorization
+     * @return emMatrixError MATRIX_ERR_DATA on every process when A is singular
+     */
+    inline emMatrixError _LUBlockCyclic(double* pA, size_t ulN, size_t ulBlock, int* pPiv, MPI_Comm Comm) {
+        int iRank = 0, iSize = 1;
+        if (Comm != MPI_COMM_NULL) {
+            MPI_Comm_rank(Comm, &iRank);
+            MPI_Comm_size(Comm, &iSize);
+        }
+        const size_t ulLd = FactorLocalCols(ulN, ulBlock, iRank, iSize);
+        const size_t ulBlocks = (ulN + ulBlock - 1) / ulBlock;
+        std::vector<double> vecPanel;
+        std::vector<int> vecPivMsg(ulBlock + 1);
+        Matrix2D<double, tPoolAllocator> MatU, MatProd;
+
+        for (size_t k = 0; k < ulBlocks; ++k) {
+            const size_t ulRow0 = k * ulBlock, ulKB = std::min(ulBlock, ulN - ulRow0), ulRows = ulN - ulRow0;
+            const int iOwner = (int)(k % (size_t)iSize);
+            const size_t ulCol0 = (k / (size_t)iSize) * ulBlock;
+            vecPanel.resize(ulRows * ulKB);
+
+            if (iRank == iOwner) {
+                double* pPanel = pA + ulRow0 * ulLd + ulCol0;
+                vecPivMsg[ulKB] = _LUPanel(pPanel, ulLd, ulRows, ulKB, vecPivMsg.data()) ? MATRIX_OK : MATRIX_ERR_DATA;
+                for (size_t i = 0; i < ulRows; ++i) {
+                    memcpy(&vecPanel[i * ulKB], pPanel + i * ulLd, ulKB * sizeof(double));
+                }
+            }
+            if (iSize > 1) {
+                MPI_Bcast(vecPivMsg.data(), (int)ulKB + 1, MPI_INT, iOwner, Comm);
+                MPI_Bcast(vecPanel.data(), (int)vecPanel.size(), MPI_DOUBLE, iOwner, Comm);
+            }
+            if (vecPivMsg[ulKB] != MATRIX_OK) return (emMatrixError)vecPivMsg[ulKB];
+
+            /** Same swaps on the columns left and right of the panel */
+            for (size_t jj = 0; jj < ulKB; ++jj) {
+                const size_t ulRowA = ulRow0 + jj, ulRowB = ulRow0 + (size_t)vecPivMsg[jj];
+                pPiv[ulRowA] = (int)ulRowB;
+                if (ulRowA == ulRowB) continue;
+                double* pRowA = pA + ulRowA * ulLd;
+                double* pRowB = pA + ulRowB * ulLd;
+                if (iRank == iOwner) {
+                    std::swap_ranges(pRowA, pRowA + ulCol0, pRowB);
+                    std::swap_ranges(pRowA + ulCol0 + ulKB, pRowA + ulLd, pRowB + ulCol0 + ulKB);
+                } else {
+                    std::swap_ranges(pRowA, pRowA + ulLd, pRowB);
+                }
+            }
+
+            /** Local blocks after k are a suffix of the local columns */
+            const size_t ulDone = k >= (size_t)iRank ? (k - (size_t)iRank) / (size_t)iSize + 1 : 0;
+            const size_t ulTrail = std::min(ulDone * ulBlock, ulLd), ulWidth = ulLd - ulTrail;
+            if (ulWidth == 0) continue;
+
+            /** U12 = L11^-1 A12, L11 unit lower */
+            for (size_t i = 1; i < ulKB; ++i) {
+                double* pRowI = pA + (ulRow0 + i) * ulLd + ulTrail;
+                for (size_t t = 0; t < i; ++t) {
+                    const double dL = vecPanel[i * ulKB + t];
+                    const double* pRowT = pA + (ulRow0 + t) * ulLd + ulTrail;
+                    for (size_t c = 0; c < ulWidth; ++c) pRowI[c] -= dL * pRowT[c];
+                }
+            }
+
+            const size_t ulRest = ulRows - ulKB;
+            if (ulRest == 0) continue;
+            MatU.Init(ulKB, ulWidth);
+            for (size_t i = 0; i < ulKB; ++i) {
+                memcpy(MatU.pData() + i * ulWidth, pA + (ulRow0 + i) * ulLd + ulTrail, ulWidth * sizeof(double));
+            }
+            MatProd.Init(ulRest, ulWidth);
+            mpimath::gemm(MatProd.pData(), &vecPanel[ulKB * ulKB], MatU.pData(), ulRest, ulKB, ulKB, ulWidth);
+            for (size_t i = 0; i < ulRest; ++i) {
+                double* pRow = pA + (ulRow0 + ulKB + i) * ulLd + ulTrail;
+                const double* pProd = MatProd.pData() + i * ulWidth;
+                for (size_t c = 0; c < ulWidth; ++c) pRow[c] -= pProd[c];
+            }
+        }
+        return MATRIX_OK;
+    }
+
+    /**
+     * @brief Blocked right looking Cholesky A = L L^T, columns in a 1D block
+     * cyclic layout
+     *
+     * Step k: the owner of column block k factors the diagonal block, solves
+     * for L21 and broadcasts the panel, every process then updates the lower
+     * part of each of its trailing column blocks j with one gemm,
+     * A[j:, j] -= L[j:, k] * L[j, k]^T. Only the lower triangle is read;
+     * on return it holds L, the strict upper triangle is left unspecified.
+     *
+     * @return emMatrixError MATRIX_ERR_DATA on every process when A is not positive definite
+     */
+    inline emMatrixError _CholeskyBlockCyclic(double* pA, size_t ulN, size_t ulBlock, MPI_Comm Comm) {
+        int iRank = 0, iSize = 1;
+        if (Comm != MPI_COMM_NULL) {
+            MPI_Comm_rank(Comm, &iRank);
+            MPI_Comm_size(Comm, &iSize);
+        }
+        const size_t ulLd = FactorLocalCols(ulN, ulBlock, iRank, iSize);
+        const size_t ulBlocks = (ulN + ulBlock - 1) / ulBlock;
+        std::vector<double> vecPanel;
+        Matrix2D<double, tPoolAllocator> MatLT, MatProd;
+
+        for (size_t k = 0; k < ulBlocks; ++k) {
+            const size_t ulRow0 = k * ulBlock, ulKB = std::min(ulBlock, ulN - ulRow0), ulRows = ulN - ulRow0;
+            const int iOwner = (int)(k % (size_t)iSize);
+            vecPanel.resize(ulRows * ulKB);
+
+            int iStatus = MATRIX_OK;
+            if (iRank == iOwner) {
+                double* pPanel = pA + ulRow0 * ulLd + (k / (size_t)iSize) * ulBlock;
+                iStatus = _CholeskyPanel(pPanel, ulLd, ulRows, ulKB) ? MATRIX_OK : MATRIX_ERR_DATA;
+                for (size_t i = 0; i < ulRows; ++i) {
+                    memcpy(&vecPanel[i * ulKB], pPanel + i * ulLd, ulKB * sizeof(double));
+                }
+            }
+            if (iSize > 1) {
+                MPI_Bcast(&iStatus, 1, MPI_INT, iOwner, Comm);
+                MPI_Bcast(vecPanel.data(), (int)vecPanel.size(), MPI_DOUBLE, iOwner, Comm);
+            }
+            if (iStatus != MATRIX_OK) return (emMatrixError)iStatus;
+
+            for (size_t j = k + 1; j < ulBlocks; ++j) {
+                if ((int)(j % (size_t)iSize) != iRank) continue;
+                const size_t ulRowJ = j * ulBlock, ulJB = std::min(ulBlock, ulN - ulRowJ), ulRest = ulN - ulRowJ;
+                const size_t ulColJ = (j / (size_t)iSize) * ulBlock;
+                const double* pL = &vecPanel[(ulRowJ - ulRow0) * ulKB];
+                MatLT.Init(ulKB, ulJB);
+                for (size_t t = 0; t < ulKB; ++t) {
+                    for (size_t c = 0; c < ulJB; ++c) MatLT.pData()[t * ulJB + c] = pL[c * ulKB + t];
+                }
+                MatProd.Init(ulRest, ulJB);
+                mpimath::gemm(MatProd.pData(), pL, MatLT.pData(), ulRest, ulKB, ulKB, ulJB);
+                for (size_t i = 0; i < ulRest; ++i) {
+                    double* pRow = pA + (ulRowJ + i) * ulLd + ulColJ;
+                    const double* pProd = MatProd.pData() + i * ulJB;
+                    for (size_t c = 0; c < ulJB; ++c) pRow[c] -= pProd[c];
+                }
+            }
+        }
+        return MATRIX_OK;
+    }
+
+    /**
+     * @brief In place A = P L U, L unit lower and U upper share A
+     *
+     * @param A         square
+     * @param vecPiv    row i was swapped with vecPiv[i], in order
+     * @param ulBlock   panel width
+     * @return emMatrixError MATRIX_ERR_DATA when A is singular
+     */
+    inline emMatrixError LUFactor(Matrix2D<double>& A, std::vector<int>& vecPiv, size_t ulBlock = FACTOR_DEFAULT_BLOCK) {
+        if (not A.IsValid()) return MATRIX_ERR_NULL;
+        if (A.ulRow() != A.ulCol()) return MATRIX_ERR_SHAPE;
+        vecPiv.resize(A.ulRow());
+        return _LUBlockCyclic(A.pData(), A.ulRow(), std::max<size_t>(ulBlock, 1), vecPiv.data(), MPI_COMM_NULL);
+    }
+
+    /**
+     * @brief In place A = L L^T for symmetric positive definite A, the upper
+     * triangle is zeroed
+     *
+     * @return emMatrixError MATRIX_ERR_DATA when A is not positive definite
+     */
+    inline emMatrixError CholeskyFactor(Matrix2D<double>& A, size_t ulBlock = FACTOR_DEFAULT_BLOCK) {
+        if (not A.IsValid()) return MATRIX_ERR_NULL;
+        if (A.ulRow() != A.ulCol()) return MATRIX_ERR_SHAPE;
+        emMatrixError Ret = _CholeskyBlockCyclic(A.pData(), A.ulRow(), std::max<size_t>(ulBlock, 1), MPI_COMM_NULL);
+        for (size_t i = 0; i < A.ulRow(); ++i) {
+            std::fill(A.pData() + i * A.ulCol() + i + 1, A.pData() + (i + 1) * A.ulCol(), 0.0);
+        }
+        return Ret;
+    }
+
+    /**
+     * @brief B <- A^-1 B from the output of LUFactor
+     *
+     */
+    inline emMatrixError LUSolve(const Matrix2D<double>& LU, const std::vector<int>& vecPiv, Matrix2D<double>& B) {
+        if (not LU.IsValid() or not B.IsValid()) return MATRIX_ERR_NULL;
+        const size_t ulN = LU.ulRow(), ulRHS = B.ulCol();
+        if (LU.ulCol() != ulN or B.ulRow() != ulN or vecPiv.size() != ulN) return MATRIX_ERR_SHAPE;
+        double* pB = B.pData();
+        const double* pLU = LU.pData();
+        for (size_t i = 0; i < ulN; ++i) {
+            if ((size_t)vecPiv[i] != i) std::swap_ranges(pB + i * ulRHS, pB + (i + 1) * ulRHS, pB + vecPiv[i] * ulRHS);
+        }
+        for (size_t i = 1; i < ulN; ++i) {
+            double* pRowI = pB + i * ulRHS;
+            for (size_t t = 0; t < i; ++t) {
+                const double dL = pLU[i * ulN + t];
+                const double* pRowT = pB + t * ulRHS;
+                for (size_t c = 0; c < ulRHS; ++c) pRowI[c] -= dL * pRowT[c];
+            }
+        }
+        for (size_t i = ulN; i-- > 0;) {
+            double* pRowI = pB + i * ulRHS;
+            for (size_t t = i + 1; t < ulN; ++t) {
+                const double dU = pLU[i * ulN + t];
+                const double* pRowT = pB + t * ulRHS;
+                for (size_t c = 0; c < ulRHS; ++c) pRowI[c] -= dU * pRowT[c];
+            }
+            const double dInv = 1.0 / pLU[i * ulN + i];
+            for (size_t c = 0; c < ulRHS; ++c) pRowI[c] *= dInv;
+        }
+        return MATRIX_OK;
+    }
+
+    /**
+     * @brief B <- (L L^T)^-1 B from the output of CholeskyFactor
+     *
+     */
+    inline emMatrixError CholeskySolve(const Matrix2D<double>& L, Matrix2D<double>& B) {
+        if (not L.IsValid() or not B.IsValid()) return MATRIX_ERR_NULL;
+        const size_t ulN = L.ulRow(), ulRHS = B.ulCol();
+        if (L.ulCol() != ulN or B.ulRow() != ulN) return MATRIX_ERR_SHAPE;
+        double* pB = B.pData();
+        const double* pL = L.pData();
+        for (size_t i = 0; i < ulN; ++i) {
+            double* pRowI = pB + i * ulRHS;
+            for (size_t t = 0; t < i; ++t) {
+                const double dL = pL[i * ulN + t];
+                const double* pRowT = pB + t * ulRHS;
+                for (size_t c = 0; c < ulRHS; ++c) pRowI[c] -= dL * pRowT[c];
+            }
+            const double dInv = 1.0 / pL[i * ulN + i];
+            for (size_t c = 0; c < ulRHS; ++c) pRowI[c] *= dInv;
+        }
+        for (size_t i = ulN; i-- > 0;) {
+            double* pRowI = pB + i * ulRHS;
+            for (size_t t = i + 1; t < ulN; ++t) {
+                const double dL = pL[t * ulN + i];
+                const double* pRowT = pB + t * ulRHS;
+                for (size_t c = 0; c < ulRHS; ++c) pRowI[c] -= dL * pRowT[c];
+            }
+            const double dInv = 1.0 / pL[i * ulN + i];
+            for (size_t c = 0; c < ulRHS; ++c) pRowI[c] *= dInv;
+        }
+        return MATRIX_OK;
+    }
+
+    /**
+     * @brief X = A^-1 B, A is left untouched
+     *
+     * @param bSPD  A is symmetric positive definite, use Cholesky instead of LU
+     * @return emMatrixError MATRIX_ERR_DATA when A is singular (or not positive definite)
+     */
+    inline emMatrixError Solve(const Matrix2D<double>& A, const Matrix2D<double>& B, Matrix2D<double>& X,
+                               bool bSPD = false, size_t ulBlock = FACTOR_DEFAULT_BLOCK) {
+        if (not A.IsValid() or not B.IsValid()) return MATRIX_ERR_NULL;
+        if (A.ulRow() != A.ulCol() or B.ulRow() != A.ulRow()) return MATRIX_ERR_SHAPE;
+        Matrix2D<double> F = A;
+        X = B;
+        if (bSPD) {
+            emMatrixError Ret = CholeskyFactor(F, ulBlock);
+            return Ret != MATRIX_OK ? Ret : CholeskySolve(F, X);
+        }
+        std::vector<int> vecPiv;
+        emMatrixError Ret = LUFactor(F, vecPiv, ulBlock);
+        return Ret != MATRIX_OK ? Ret : LUSolve(F, vecPiv, X);
+    }
+
+    /**
+     * @brief The context of a distributed solve
+     *
+     * @struct lN       order of A
+     * @struct lRHS     columns of B
+     * @struct lBlock   panel width of the block cyclic layout
+     * @struct bSPD     Cholesky instead of LU
+     */
+    typedef struct {
+        long lN;
+        long lRHS;
+        long lBlock;
+        bool bSPD;
+        bool bValid;
+    } tFactorCtx;
+
+    /**
+     * @brief Factor A over every process of MPI_COMM_WORLD, then solve on
+     * process 0, paired with MPISolveWorker
+     *
+     * Column blocks of A are dealt round robin, the main process keeps its
+     * share. The factors are gathered back to process 0 for the O(n^2)
+     * triangular solves.
+     *
+     * @param A
+     * @param B
+     * @param X         A^-1 B on return
+     * @param Processor
+     * @param bSPD      A is symmetric positive definite, use Cholesky
+     * @param ulBlock
+     * @return emMatrixError the same on every process
+     */
+    inline emMatrixError MPISolveMain(const Matrix2D<double>& A, const Matrix2D<double>& B, Matrix2D<double>& X,
+                                      MPIProcessorInfo Processor, bool bSPD = false, size_t ulBlock = FACTOR_DEFAULT_BLOCK) {
+        tFactorCtx Ctx = {
+            .lN = (long)A.ulRow(),
+            .lRHS = (long)B.ulCol(),
+            .lBlock = (long)std::max<size_t>(ulBlock, 1),
+            .bSPD = bSPD,
+            .bValid = A.IsValid() and B.IsValid() and A.ulRow() == A.ulCol() and B.ulRow() == A.ulRow(),
+        };
+        MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (not Ctx.bValid) return A.IsValid() and B.IsValid() ? MATRIX_ERR_SHAPE : MATRIX_ERR_NULL;
+
+        const size_t ulN = (size_t)Ctx.lN, ulBlk = (size_t)Ctx.lBlock;
+        Matrix2D<double> F = A;
+        FOR_ALL_SUB_PROC(Processor) {
+            const size_t ulCols = FactorLocalCols(ulN, ulBlk, iProcID, Processor.iSize());
+            if (ulCols == 0) continue;
+            Matrix2D<double, tPoolAllocator> MatCols(ulN, ulCols);
+            _FactorPackCols(F.pData(), MatCols.pData(), ulN, ulBlk, iProcID, Processor.iSize(), true);
+            MPI_Datatype MTypeRow;
+            MPI_Type_contiguous((int)ulCols, MPI_DOUBLE, &MTypeRow);
+            MPI_Type_commit(&MTypeRow);
+            MPI_Send(MatCols.pData(), (int)ulN, MTypeRow, iProcID, (int)emMsgType::BLOCK, MPI_COMM_WORLD);
+            MPI_Type_free(&MTypeRow);
+        }
+
+        const size_t ulLocCols = FactorLocalCols(ulN, ulBlk, 0, Processor.iSize());
+        Matrix2D<double, tPoolAllocator> MatLocal(ulN, ulLocCols);
+        _FactorPackCols(F.pData(), MatLocal.pData(), ulN, ulBlk, 0, Processor.iSize(), true);
+        std::vector<int> vecPiv(ulN);
+        emMatrixError Ret = Ctx.bSPD ? _CholeskyBlockCyclic(MatLocal.pData(), ulN, ulBlk, MPI_COMM_WORLD)
+                                     : _LUBlockCyclic(MatLocal.pData(), ulN, ulBlk, vecPiv.data(), MPI_COMM_WORLD);
+        if (Ret != MATRIX_OK) return Ret;
+
+        _FactorPackCols(F.pData(), MatLocal.pData(), ulN, ulBlk, 0, Processor.iSize(), false);
+        FOR_ALL_SUB_PROC(Processor) {
+            const size_t ulCols = FactorLocalCols(ulN, ulBlk, iProcID, Processor.iSize());
+            if (ulCols == 0) continue;
+            Matrix2D<double, tPoolAllocator> MatCols(ulN, ulCols);
+            MPI_Datatype MTypeRow;
+            MPI_Type_contiguous((int)ulCols, MPI_DOUBLE, &MTypeRow);
+            MPI_Type_commit(&MTypeRow);
+            MPI_Recv(MatCols.pData(), (int)ulN, MTypeRow, iProcID, (int)emMsgType::RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Type_free(&MTypeRow);
+            _FactorPackCols(F.pData(), MatCols.pData(), ulN, ulBlk, iProcID, Processor.iSize(), false);
+        }
+
+        X = B;
+        return Ctx.bSPD ? CholeskySolve(F, X) : LUSolve(F, vecPiv, X);
+    }
+
+    /**
+     * @brief Worker side of MPISolveMain
+     *
+     * @param Processor
+     * @return emMatrixError the same as MPISolveMain, MATRIX_ERR_SHAPE for any invalid input
+     */
+    inline emMatrixError MPISolveWorker(MPIProcessorInfo Processor) {
+        tFactorCtx Ctx;
+        MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (not Ctx.bValid) return MATRIX_ERR_SHAPE;
+
+        const size_t ulN = (size_t)Ctx.lN, ulBlk = (size_t)Ctx.lBlock;
+        const size_t ulCols = FactorLocalCols(ulN, ulBlk, Processor.iRank(), Processor.iSize());
+        Matrix2D<double, tPoolAllocator> MatLocal(ulN, ulCols);
+        MPI_Datatype MTypeRow;
+        MPI_Type_contiguous((int)ulCols, MPI_DOUBLE, &MTypeRow);
+        MPI_Type_commit(&MTypeRow);
+        if (ulCols > 0) {
+            MPI_Recv(MatLocal.pData(), (int)ulN, MTypeRow, 0, (int)emMsgType::BLOCK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+
+        std::vector<int> vecPiv(ulN);
+        emMatrixError Ret = Ctx.bSPD ? _CholeskyBlockCyclic(MatLocal.pData(), ulN, ulBlk, MPI_COMM_WORLD)
+                                     : _LUBlockCyclic(MatLocal.pData(), ulN, ulBlk, vecPiv.data(), MPI_COMM_WORLD);
+        if (Ret == MATRIX_OK and ulCols > 0) {
+            MPI_Send(MatLocal.pData(), (int)ulN, MTypeRow, 0, (int)emMsgType::RESULT, MPI_COMM_WORLD);
+        }
+        MPI_Type_free(&MTypeRow);
+        return Ret;
+    }
+}
+
+#endif
@@ -2,7 +2,198 @@
 #define _PROCESSORINFO_HPP
 
 #include <mpi.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <string>
+#include <vector>
+
+/** set_mempolicy MPOL_PREFERRED, as in <linux/mempolicy.h> */
+#define MPOL_PREFERRED_MODE 1
+
+/**
+ * @brief The CPUs of this node as sysfs describes them
+ *
+ * @struct vecCpus          online logical CPUs
+ * @struct vecCpuPackage    socket of each entry of vecCpus
+ * @struct vecCpuNuma       NUMA node of each entry of vecCpus, 0 without NUMA
+ * @struct vecCpuCore       physical core of each entry, hyperthreads share it
+ * @struct iPackages        sockets
+ * @struct iNumaNodes       NUMA nodes, 1 without NUMA
+ * @struct ulL1D, ulL2, ulL3 cache sizes seen from the first CPU in bytes, 0 if unknown
+ */
+typedef struct {
+    std::vector<int> vecCpus;
+    std::vector<int> vecCpuPackage;
+    std::vector<int> vecCpuNuma;
+    std::vector<int> vecCpuCore;
+    int iPackages;
+    int iNumaNodes;
+    size_t ulL1D;
+    size_t ulL2;
+    size_t ulL3;
+} tCpuTopology;
+
+/**
+ * @brief Where the processes of MPI_COMM_WORLD run
+ *
+ * @struct NodeComm     processes sharing memory with this one, ordered by world rank
+ * @struct LeaderComm   rank 0 of every NodeComm, MPI_COMM_NULL elsewhere; world rank 0 is leader 0
+ * @struct iNodeId      rank of this node's leader in LeaderComm
+ * @struct vecNodeOf    node of every world rank
+ * @struct vecNodeMajor world ranks grouped by node, node 0 first, by world rank within a node
+ * @struct Cpu          sysfs view of this node
+ */
+typedef struct {
+    MPI_Comm NodeComm;
+    MPI_Comm LeaderComm;
+    int iNodeRank;
+    int iNodeSize;
+    int iNodeId;
+    int iNodeCount;
+    std::vector<int> vecNodeOf;
+    std::vector<int> vecNodeMajor;
+    tCpuTopology Cpu;
+} tMPITopology;
+
+/**
+ * @brief Binding of a process, chosen by its rank on the node
+ *
+ * CORE pins it to one logical CPU, filling cores before their hyperthreads,
+ * and prefers the memory of that CPU's NUMA node. NUMA pins it to all CPUs
+ * of one NUMA node, round robin over the nodes, with its memory.
+ */
+enum class emBindPolicy {
+    NONE = 0,
+    CORE,
+    NUMA,
+};
+
+inline std::string _ReadSysfsLine(const std::string& sPath) {
+    std::ifstream File(sPath);
+    std::string sLine;
+    if (File) std::getline(File, sLine);
+    return sLine;
+}
+
+/** "0-3,8,10-11" */
+inline std::vector<int> _ParseCpuList(const std::string& sList) {
+    std::vector<int> vecRes;
+    size_t ulPos = 0;
+    while (ulPos < sList.size()) {
+        size_t ulEnd = sList.find(',', ulPos);
+        if (ulEnd == std::string::npos) ulEnd = sList.size();
+        const std::string sRange = sList.substr(ulPos, ulEnd - ulPos);
+        const size_t ulDash = sRange.find('-');
+        if (not sRange.empty() and isdigit(sRange[0])) {
+            const int iLow = atoi(sRange.c_str());
+            const int iHigh = ulDash == std::string::npos ? iLow : atoi(sRange.c_str() + ulDash + 1);
+            for (int iCpu = iLow; iCpu <= iHigh; ++iCpu) vecRes.push_back(iCpu);
+        }
+        ulPos = ulEnd + 1;
+    }
+    return vecRes;
+}
+
+/** "48K", "2048K", "32M" */
+inline size_t _ParseCacheSize(const std::string& sSize) {
+    if (sSize.empty()) return 0;
+    size_t ulSize = strtoul(sSize.c_str(), nullptr, 10);
+    switch (sSize.back()) {
+        case 'K': return ulSize << 10;
+        case 'M': return ulSize << 20;
+        case 'G': return ulSize << 30;
+        default: return ulSize;
+    }
+}
+
+/**
+ * @brief Read cpu/online, the topology and cache of every CPU and
+ * node/node*\/cpulist under sRoot
+ *
+ * Without sysfs the CPUs are 0 .. _SC_NPROCESSORS_ONLN - 1 on one socket and
+ * one NUMA node.
+ */
+inline tCpuTopology ProbeCpuTopology(const std::string& sRoot = "/sys/devices/system") {
+    tCpuTopology Topo = {};
+    Topo.vecCpus = _ParseCpuList(_ReadSysfsLine(sRoot + "/cpu/online"));
+    if (Topo.vecCpus.empty()) {
+        for (long lCpu = 0; lCpu < std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)); ++lCpu) Topo.vecCpus.push_back((int)lCpu);
+    }
+    const size_t ulCpus = Topo.vecCpus.size();
+    Topo.vecCpuPackage.assign(ulCpus, 0);
+    Topo.vecCpuNuma.assign(ulCpus, 0);
+    Topo.vecCpuCore.assign(ulCpus, 0);
+    for (size_t idx = 0; idx < ulCpus; ++idx) {
+        const std::string sCpu = sRoot + "/cpu/cpu" + std::to_string(Topo.vecCpus[idx]) + "/topology/";
+        Topo.vecCpuPackage[idx] = atoi(_ReadSysfsLine(sCpu + "physical_package_id").c_str());
+        /** Core ids repeat across sockets */
+        const std::string sCore = _ReadSysfsLine(sCpu + "core_id");
+        Topo.vecCpuCore[idx] = sCore.empty() ? Topo.vecCpus[idx] : Topo.vecCpuPackage[idx] * 65536 + atoi(sCore.c_str());
+    }
+    Topo.iNumaNodes = 0;
+    for (int iNode : _ParseCpuList(_ReadSysfsLine(sRoot + "/node/online"))) {
+        for (int iCpu : _ParseCpuList(_ReadSysfsLine(sRoot + "/node/node" + std::to_string(iNode) + "/cpulist"))) {
+            auto Iter = std::find(Topo.vecCpus.begin(), Topo.vecCpus.end(), iCpu);
+            if (Iter != Topo.vecCpus.end()) Topo.vecCpuNuma[Iter - Topo.vecCpus.begin()] = iNode;
+        }
+        Topo.iNumaNodes = std::max(Topo.iNumaNodes, iNode + 1);
+    }
+    Topo.iNumaNodes = std::max(1, Topo.iNumaNodes);
+    Topo.iPackages = 1 + *std::max_element(Topo.vecCpuPackage.begin(), Topo.vecCpuPackage.end());
+
+    for (int iIndex = 0;; ++iIndex) {
+        const std::string sCache = sRoot + "/cpu/cpu" + std::to_string(Topo.vecCpus[0]) + "/cache/index" + std::to_string(iIndex) + "/";
+        const std::string sLevel = _ReadSysfsLine(sCache + "level");
+        if (sLevel.empty()) break;
+        const std::string sType = _ReadSysfsLine(sCache + "type");
+        const size_t ulSize = _ParseCacheSize(_ReadSysfsLine(sCache + "size"));
+        if (sLevel == "1" and sType == "Data") Topo.ulL1D = ulSize;
+        if (sLevel == "2") Topo.ulL2 = ulSize;
+        if (sLevel == "3") Topo.ulL3 = ulSize;
+    }
+    return Topo;
+}
+
+/**
+ * @brief The topology of MPI_COMM_WORLD, built on first use and collective then
+ *
+ */
+inline const tMPITopology& MPITopology() {
+    static tMPITopology Topo = [] {
+        tMPITopology Res;
+        int iWorldRank, iWorldSize;
+        MPI_Comm_rank(MPI_COMM_WORLD, &iWorldRank);
+        MPI_Comm_size(MPI_COMM_WORLD, &iWorldSize);
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, iWorldRank, MPI_INFO_NULL, &Res.NodeComm);
+        MPI_Comm_rank(Res.NodeComm, &Res.iNodeRank);
+        MPI_Comm_size(Res.NodeComm, &Res.iNodeSize);
+        MPI_Comm_split(MPI_COMM_WORLD, Res.iNodeRank == 0 ? 0 : MPI_UNDEFINED, iWorldRank, &Res.LeaderComm);
+
+        int aiNode[2] = { 0, 1 };
+        if (Res.LeaderComm != MPI_COMM_NULL) {
+            MPI_Comm_rank(Res.LeaderComm, &aiNode[0]);
+            MPI_Comm_size(Res.LeaderComm, &aiNode[1]);
+        }
+        MPI_Bcast(aiNode, 2, MPI_INT, 0, Res.NodeComm);
+        Res.iNodeId = aiNode[0];
+        Res.iNodeCount = aiNode[1];
+        Res.vecNodeOf.resize(iWorldSize);
+        MPI_Allgather(&Res.iNodeId, 1, MPI_INT, Res.vecNodeOf.data(), 1, MPI_INT, MPI_COMM_WORLD);
+        Res.vecNodeMajor.resize(iWorldSize);
+        for (int iRank = 0; iRank < iWorldSize; ++iRank) Res.vecNodeMajor[iRank] = iRank;
+        std::stable_sort(Res.vecNodeMajor.begin(), Res.vecNodeMajor.end(),
+                         [&](int iA, int iB) { return Res.vecNodeOf[iA] < Res.vecNodeOf[iB]; });
+        Res.Cpu = ProbeCpuTopology();
+        return Res;
+    }();
+    return Topo;
+}
 
 class MPIProcessorInfo {
 public:
@@ -31,6 +222,109 @@ public:
         return _iWorldRank;
     }
 
+    /** Node and CPU layout, collective the first time any process asks */
+    const tMPITopology& Topology() const {
+        return MPITopology();
+    }
+    MPI_Comm NodeComm() const {
+        return Topology().NodeComm;
+    }
+    MPI_Comm LeaderComm() const {
+        return Topology().LeaderComm;
+    }
+    int iNodeRank() const {
+        return Topology().iNodeRank;
+    }
+    int iNodeSize() const {
+        return Topology().iNodeSize;
+    }
+    int iNodeId() const {
+        return Topology().iNodeId;
+    }
+    int iNodeCount() const {
+        return Topology().iNodeCount;
+    }
+    int iNodeOf(int iWorldRank) const {
+        return Topology().vecNodeOf[iWorldRank];
+    }
+    bool bSameNode(int iWorldRank) const {
+        return iNodeOf(iWorldRank) == iNodeId();
+    }
+
+    /**
+     * @brief Bind this process by its node rank, collective on first use of
+     * the topology; NONE returns at once without touching it
+     *
+     * @return int the CPU (CORE) or NUMA node (NUMA) bound to, -1 for NONE
+     * or if the kernel refused
+     */
+    int Bind(emBindPolicy Policy) const {
+        if (Policy == emBindPolicy::NONE) return -1;
+        const tMPITopology& Topo = Topology();
+        const tCpuTopology& Cpu = Topo.Cpu;
+        if (Cpu.vecCpus.empty()) return -1;
+        cpu_set_t Set;
+        CPU_ZERO(&Set);
+        int iTarget = -1, iNuma = 0;
+        if (Policy == emBindPolicy::CORE) {
+            /** One CPU of every core first, then the second hyperthreads */
+            std::vector<size_t> vecOrder, vecSiblings;
+            std::vector<int> vecSeen;
+            for (size_t idx = 0; idx < Cpu.vecCpus.size(); ++idx) {
+                const bool bSeen = std::find(vecSeen.begin(), vecSeen.end(), Cpu.vecCpuCore[idx]) != vecSeen.end();
+                (bSeen ? vecSiblings : vecOrder).push_back(idx);
+                if (not bSeen) vecSeen.push_back(Cpu.vecCpuCore[idx]);
+            }
+            vecOrder.insert(vecOrder.end(), vecSiblings.begin(), vecSiblings.end());
+            const size_t idx = vecOrder[Topo.iNodeRank % vecOrder.size()];
+            iTarget = Cpu.vecCpus[idx];
+            iNuma = Cpu.vecCpuNuma[idx];
+            CPU_SET(iTarget, &Set);
+        } else {
+            /** NUMA nodes with CPUs, their ids may have gaps */
+            std::vector<int> vecNuma(Cpu.vecCpuNuma);
+            std::sort(vecNuma.begin(), vecNuma.end());
+            vecNuma.erase(std::unique(vecNuma.begin(), vecNuma.end()), vecNuma.end());
+            iTarget = iNuma = vecNuma[Topo.iNodeRank % vecNuma.size()];
+            for (size_t idx = 0; idx < Cpu.vecCpus.size(); ++idx) {
+                if (Cpu.vecCpuNuma[idx] == iNuma) CPU_SET(Cpu.vecCpus[idx], &Set);
+            }
+        }
+        if (sched_setaffinity(0, sizeof(Set), &Set) != 0) return -1;
+        /** Memory follows where it can; a kernel without NUMA support refuses, which is harmless */
+        if (Cpu.iNumaNodes > 1 and iNuma < (int)(8 * sizeof(unsigned long))) {
+            unsigned long ulMask = 1UL << iNuma;
+            syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &ulMask, 8 * sizeof(unsigned long));
+        }
+        return iTarget;
+    }
+
+    /**
+     * @brief MPI_Reduce to world rank 0 in two steps, within every node and
+     * then between the node leaders, so that one message per node leaves it
+     *
+     */
+    int NodeReduce(const void* pSend, void* pRecv, int iCount, MPI_Datatype Type, MPI_Op Op) const {
+        const tMPITopology& Topo = Topology();
+        int iTypeSize;
+        MPI_Type_size(Type, &iTypeSize);
+        std::vector<char> vecNode(Topo.iNodeRank == 0 ? (size_t)iCount * iTypeSize : 0);
+        int iRet = MPI_Reduce(pSend, vecNode.data(), iCount, Type, Op, 0, Topo.NodeComm);
+        if (iRet == MPI_SUCCESS and Topo.LeaderComm != MPI_COMM_NULL) {
+            iRet = MPI_Reduce(vecNode.data(), pRecv, iCount, Type, Op, 0, Topo.LeaderComm);
+        }
+        return iRet;
+    }
+
+    /** MPIMATH_BIND=core|numa, anything else is NONE */
+    static emBindPolicy BindPolicyFromEnv() {
+        const char* sEnv = getenv("MPIMATH_BIND");
+        if (sEnv == nullptr) return emBindPolicy::NONE;
+        if (strcmp(sEnv, "core") == 0) return emBindPolicy::CORE;
+        if (strcmp(sEnv, "numa") == 0) return emBindPolicy::NUMA;
+        return emBindPolicy::NONE;
+    }
+
 
 protected:
     int _iWorldSize = 0;
@@ -48,4 +342,4 @@ protected:
         for (auto iProcID = 1; iProcID < Processor.iSize(); ++iProcID)
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,618 @@
+/**
+ * @file MapReduce.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief A small MapReduce runtime over MPI: typed map / combine / reduce,
+ * hash partitioned shuffle with MPI_Alltoallv, spill to disk, and line
+ * aligned splits of local files
+ * @version 0.1
+ * @date 2022-06-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ *     MapReduce<std::string, int64_t> Job(Processor);
+ *     Job.Combiner([](int64_t& lAcc, const int64_t& lValue) { lAcc += lValue; });
+ *     Job.MapLines(InputSplits(vecPaths, 64 << 20), [](const char* pLine, size_t ulLength, auto& Emit) { ... });
+ *     auto vecLocal = Job.Reduce([](const std::string& sKey, const std::vector<int64_t>& vecValues) { ... });
+ *     auto vecAll = Job.Gather(vecLocal);   // on rank 0, sorted by key
+ *
+ * Every call is collective. A key goes to rank hash(key) % P. With a
+ * combiner the values of a key are folded on the map side before the
+ * shuffle and again as they arrive, so the reducer sees one value per key;
+ * without one it sees all of them.
+ *
+ * Map output beyond tMapReduceConfig::ulMemBytes is written to spill files,
+ * and the shuffle sends it in rounds of at most ulRoundBytes per
+ * destination. Received data beyond ulMemBytes is spilled into buckets by
+ * a second hash and reduced one bucket at a time.
+ */
+#ifndef _MAPREDUCE_H
+#define _MAPREDUCE_H
+
+#include <mpi.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "MPIProcessorInfo.hpp"
+#include "Partition.hpp"
+#include "debug.h"
+
+#define MAPREDUCE_MEMORY_ENV "MPIMATH_MR_MEMORY"
+#define MAPREDUCE_SPILL_DIR_ENV "MPIMATH_MR_SPILL_DIR"
+/** Guess of the bytes a hash map entry costs besides its key and value */
+#define MAPREDUCE_ENTRY_OVERHEAD 64
+
+namespace mpimath {
+    /**
+     * @brief Byte encoding of keys and values for the shuffle and the spill
+     * files; specialize it for other types
+     *
+     */
+    template<typename T, typename Enable = void>
+    struct tMRCodec;
+
+    template<typename T>
+    struct tMRCodec<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type> {
+        static void Encode(std::string& sOut, const T& Value) {
+            sOut.append((const char*)&Value, sizeof(T));
+        }
+        static T Decode(const char*& pIn) {
+            T Value;
+            memcpy(&Value, pIn, sizeof(T));
+            pIn += sizeof(T);
+            return Value;
+        }
+    };
+
+    template<>
+    struct tMRCodec<std::string> {
+        static void Encode(std::string& sOut, const std::string& sValue) {
+            tMRCodec<uint32_t>::Encode(sOut, (uint32_t)sValue.size());
+            sOut += sValue;
+        }
+        static std::string Decode(const char*& pIn) {
+            const uint32_t uLength = tMRCodec<uint32_t>::Decode(pIn);
+            std::string sValue(pIn, uLength);
+            pIn += uLength;
+            return sValue;
+        }
+    };
+
+    template<typename A, typename B>
+    struct tMRCodec<std::pair<A, B>, typename std::enable_if<not std::is_trivially_copyable<std::pair<A, B>>::value>::type> {
+        static void Encode(std::string& sOut, const std::pair<A, B>& Value) {
+            tMRCodec<A>::Encode(sOut, Value.first);
+            tMRCodec<B>::Encode(sOut, Value.second);
+        }
+        static std::pair<A, B> Decode(const char*& pIn) {
+            A First = tMRCodec<A>::Decode(pIn);
+            return { std::move(First), tMRCodec<B>::Decode(pIn) };
+        }
+    };
+
+    /**
+     * @brief Limits of one job
+     *
+     * @struct ulMemBytes    intermediate data a rank keeps in memory on each side of the shuffle
+     * @struct ulRoundBytes  bytes sent to one destination in one MPI_Alltoallv
+     * @struct iSpillBuckets buckets of the reduce side spill
+     * @struct sSpillDir     where spill files are created (and unlinked at once)
+     */
+    typedef struct {
+        size_t ulMemBytes;
+        size_t ulRoundBytes;
+        int iSpillBuckets;
+        std::string sSpillDir;
+    } tMapReduceConfig;
+
+    /** 256 MB in memory unless MPIMATH_MR_MEMORY gives MB, spill files in MPIMATH_MR_SPILL_DIR or /tmp */
+    inline tMapReduceConfig MapReduceConfigFromEnv() {
+        tMapReduceConfig Config = { 256UL << 20, 16UL << 20, 16, "/tmp" };
+        const char* sMemory = getenv(MAPREDUCE_MEMORY_ENV);
+        if (sMemory != nullptr and atol(sMemory) > 0) Config.ulMemBytes = (size_t)atol(sMemory) << 20;
+        const char* sDir = getenv(MAPREDUCE_SPILL_DIR_ENV);
+        if (sDir != nullptr and sDir[0] != '\0') Config.sSpillDir = sDir;
+        return Config;
+    }
+
+    /**
+     * @brief What one rank did in the last job, times in seconds
+     *
+     */
+    typedef struct {
+        uint64_t ulInputBytes;
+        uint64_t ulMapRecords;
+        uint64_t ulEmitted;
+        uint64_t ulShuffleBytes;
+        uint64_t ulSpillBytes;
+        uint64_t ulKeys;
+        int iRounds;
+        double dMap;
+        double dShuffle;
+        double dReduce;
+    } tMapReduceStats;
+
+    /** A byte range of a file, its lines are those that start inside it */
+    typedef struct {
+        std::string sPath;
+        size_t ulBegin;
+        size_t ulEnd;
+    } tInputSplit;
+
+    /**
+     * @brief Cut local files into splits of about ulSplitBytes; every rank
+     * computes the same list, MapLines deals them out
+     *
+     */
+    inline std::vector<tInputSplit> InputSplits(const std::vector<std::string>& vecPaths, size_t ulSplitBytes) {
+        std::vector<tInputSplit> vecSplits;
+        ulSplitBytes = std::max<size_t>(ulSplitBytes, 1);
+        for (const auto& sPath : vecPaths) {
+            struct stat Stat;
+            if (stat(sPath.c_str(), &Stat) != 0) {
+                LOGE("Can not stat %s", sPath.c_str());
+                continue;
+            }
+            for (size_t ulBegin = 0; ulBegin < (size_t)Stat.st_size; ulBegin += ulSplitBytes) {
+                vecSplits.push_back({ sPath, ulBegin, std::min((size_t)Stat.st_size, ulBegin + ulSplitBytes) });
+            }
+        }
+        return vecSplits;
+    }
+
+    /** A temporary file that is gone once closed */
+    inline FILE* _MRSpillFile(const std::string& sDir) {
+        std::string sTemplate = sDir + "/mpimath_spill_XXXXXX";
+        const int iFd = mkstemp(&sTemplate[0]);
+        if (iFd < 0) {
+            LOGE("Can not create a spill file in %s", sDir.c_str());
+            return nullptr;
+        }
+        unlink(sTemplate.c_str());
+        return fdopen(iFd, "w+b");
+    }
+
+    /** Spread a hash, for the reduce side buckets */
+    inline uint64_t _MRMix(uint64_t ulHash) {
+        ulHash ^= ulHash >> 33;
+        ulHash *= 0xff51afd7ed558ccdULL;
+        ulHash ^= ulHash >> 33;
+        return ulHash;
+    }
+
+    template<typename K, typename V, typename Hash = std::hash<K>>
+    class MapReduce {
+    public:
+        /** What a mapper gets to emit its pairs */
+        class tEmitter {
+        public:
+            explicit tEmitter(MapReduce& Job) : _Job(Job) {}
+            void operator()(const K& Key, const V& Value) {
+                _Job._Emit(Key, Value);
+            }
+
+        private:
+            MapReduce& _Job;
+        };
+
+        explicit MapReduce(const MPIProcessorInfo& Processor, const tMapReduceConfig& Config = MapReduceConfigFromEnv(),
+                           MPI_Comm Comm = MPI_COMM_WORLD)
+            : _Config(Config), _Comm(Comm), _iRank(Processor.iRank()), _iSize(Processor.iSize()) {
+            if (Comm != MPI_COMM_WORLD) {
+                MPI_Comm_rank(Comm, &_iRank);
+                MPI_Comm_size(Comm, &_iSize);
+            }
+            _Reset();
+        }
+
+        ~MapReduce() {
+            _CloseSpills();
+        }
+
+        MapReduce(const MapReduce&) = delete;
+        MapReduce& operator=(const MapReduce&) = delete;
+
+        /** fnCombine(V& Acc, const V& Value) folds Value into Acc; it must be associative and commutative */
+        template<typename FCombine>
+        void Combiner(FCombine&& fnCombine) {
+            _fnCombine = std::forward<FCombine>(fnCombine);
+        }
+
+        /**
+         * @brief Run fnMap(lBegin, lEnd, Emit) over chunks of [0, lN), the
+         * chunks dealt in blocks
+         *
+         * @param lChunk indices per call
+         */
+        template<typename FMap>
+        void MapRange(int64_t lN, int64_t lChunk, FMap&& fnMap) {
+            _BeginJob();
+            const double dBegin = MPI_Wtime();
+            tEmitter Emit(*this);
+            lChunk = std::max<int64_t>(lChunk, 1);
+            const auto Chunks = Partition<int64_t>::Block((lN + lChunk - 1) / lChunk, _iSize);
+            for (int64_t lChunkIdx = Chunks.Low(_iRank); lChunkIdx <= Chunks.High(_iRank); ++lChunkIdx) {
+                const int64_t lBegin = lChunkIdx * lChunk;
+                fnMap(lBegin, std::min(lN, lBegin + lChunk), Emit);
+                _Stats.ulMapRecords++;
+            }
+            _Stats.dMap += MPI_Wtime() - dBegin;
+        }
+
+        /**
+         * @brief Run fnMap(pLine, ulLength, Emit) over every line of the
+         * splits of this rank (dealt cyclically), without the newline
+         *
+         */
+        template<typename FMap>
+        void MapLines(const std::vector<tInputSplit>& vecSplits, FMap&& fnMap) {
+            _BeginJob();
+            const double dBegin = MPI_Wtime();
+            tEmitter Emit(*this);
+            const auto Owned = Partition<int64_t>::Cyclic((int64_t)vecSplits.size(), _iSize);
+            for (int64_t j = 0; j < Owned.Size(_iRank); ++j) {
+                const tInputSplit& Split = vecSplits[Owned.Global(_iRank, j)];
+                const int iFd = open(Split.sPath.c_str(), O_RDONLY);
+                struct stat Stat;
+                if (iFd < 0 or fstat(iFd, &Stat) != 0) {
+                    LOGE("Can not read %s", Split.sPath.c_str());
+                    if (iFd >= 0) close(iFd);
+                    continue;
+                }
+                const size_t ulFile = (size_t)Stat.st_size;
+                if (ulFile == 0 or Split.ulBegin >= ulFile) {
+                    close(iFd);
+                    continue;
+                }
+                const char* pFile = (const char*)mmap(nullptr, ulFile, PROT_READ, MAP_PRIVATE, iFd, 0);
+                close(iFd);
+                if (pFile == MAP_FAILED) {
+                    LOGE("Can not map %s", Split.sPath.c_str());
+                    continue;
+                }
+                madvise((void*)pFile, ulFile, MADV_SEQUENTIAL);
+                /** A line that starts before the split belongs to the previous one */
+                const char* pLine = pFile + Split.ulBegin;
+                if (Split.ulBegin > 0 and pLine[-1] != '\n') {
+                    pLine = (const char*)memchr(pLine, '\n', ulFile - Split.ulBegin);
+                    pLine = pLine == nullptr ? pFile + ulFile : pLine + 1;
+                }
+                const char* pEnd = pFile + std::min(ulFile, Split.ulEnd);
+                while (pLine < pEnd) {
+                    const char* pNewline = (const char*)memchr(pLine, '\n', pFile + ulFile - pLine);
+                    const char* pStop = pNewline == nullptr ? pFile + ulFile : pNewline;
+                    fnMap(pLine, (size_t)(pStop - pLine), Emit);
+                    _Stats.ulMapRecords++;
+                    pLine = pStop + 1;
+                }
+                _Stats.ulInputBytes += (size_t)(std::min(pLine, pFile + ulFile) - (pFile + Split.ulBegin));
+                munmap((void*)pFile, ulFile);
+            }
+            _Stats.dMap += MPI_Wtime() - dBegin;
+        }
+
+        /**
+         * @brief Shuffle what was emitted and call fnReduce(const K&, const
+         * std::vector<V>&) once for every key of this rank
+         *
+         * @return std::vector<std::pair<K, R>> the keys of this rank and their results, in no order
+         */
+        template<typename FReduce>
+        auto Reduce(FReduce&& fnReduce) -> std::vector<std::pair<K, decltype(fnReduce(std::declval<const K&>(), std::declval<const std::vector<V>&>()))>> {
+            using R = decltype(fnReduce(std::declval<const K&>(), std::declval<const std::vector<V>&>()));
+            _BeginJob();
+            _Shuffle();
+            const double dBegin = MPI_Wtime();
+            std::vector<std::pair<K, R>> vecResult;
+            auto ReduceGroups = [&]() {
+                for (auto& Group : _mapGroups) vecResult.emplace_back(Group.first, fnReduce(Group.first, Group.second));
+                _mapGroups.clear();
+                _ulGroupBytes = 0;
+            };
+            if (_vecBuckets.empty()) {
+                ReduceGroups();
+            } else {
+                _SpillGroups();
+                for (FILE*& pBucket : _vecBuckets) {
+                    std::string sData = _ReadAll(pBucket);
+                    for (const char* pIn = sData.data(); pIn < sData.data() + sData.size();) _Group(pIn);
+                    ReduceGroups();
+                }
+            }
+            _Stats.ulKeys = vecResult.size();
+            _Stats.dReduce += MPI_Wtime() - dBegin;
+            _CloseSpills();
+            _Reset();
+            _bJobDone = true;
+            return vecResult;
+        }
+
+        /**
+         * @brief Collect the results of every rank on rank 0, sorted by key
+         *
+         * @return std::vector<std::pair<K, R>> empty on other ranks
+         */
+        template<typename R>
+        std::vector<std::pair<K, R>> Gather(const std::vector<std::pair<K, R>>& vecLocal) {
+            std::string sLocal;
+            for (const auto& Item : vecLocal) {
+                tMRCodec<K>::Encode(sLocal, Item.first);
+                tMRCodec<R>::Encode(sLocal, Item.second);
+            }
+            int iLocal = (int)sLocal.size();
+            std::vector<int> vecCounts(_iRank == 0 ? _iSize : 0), vecDispls(_iRank == 0 ? _iSize : 0);
+            MPI_Gather(&iLocal, 1, MPI_INT, vecCounts.data(), 1, MPI_INT, 0, _Comm);
+            std::string sAll;
+            if (_iRank == 0) {
+                for (int iSrc = 0; iSrc < _iSize; ++iSrc) vecDispls[iSrc] = iSrc == 0 ? 0 : vecDispls[iSrc - 1] + vecCounts[iSrc - 1];
+                sAll.resize((size_t)vecDispls.back() + vecCounts.back());
+            }
+            MPI_Gatherv(sLocal.data(), iLocal, MPI_CHAR, &sAll[0], vecCounts.data(), vecDispls.data(), MPI_CHAR, 0, _Comm);
+            std::vector<std::pair<K, R>> vecAll;
+            for (const char* pIn = sAll.data(); pIn < sAll.data() + sAll.size();) {
+                K Key = tMRCodec<K>::Decode(pIn);
+                vecAll.emplace_back(std::move(Key), tMRCodec<R>::Decode(pIn));
+            }
+            std::sort(vecAll.begin(), vecAll.end(), [](const std::pair<K, R>& A, const std::pair<K, R>& B) { return A.first < B.first; });
+            return vecAll;
+        }
+
+        /** Of the current or last job on this rank */
+        const tMapReduceStats& Stats() const {
+            return _Stats;
+        }
+
+        /** Stats summed over all ranks, times are the maximum */
+        tMapReduceStats TotalStats() const {
+            uint64_t aulCounts[] = { _Stats.ulInputBytes, _Stats.ulMapRecords, _Stats.ulEmitted, _Stats.ulShuffleBytes, _Stats.ulSpillBytes, _Stats.ulKeys };
+            double adTimes[] = { _Stats.dMap, _Stats.dShuffle, _Stats.dReduce };
+            MPI_Allreduce(MPI_IN_PLACE, aulCounts, 6, MPI_UINT64_T, MPI_SUM, _Comm);
+            MPI_Allreduce(MPI_IN_PLACE, adTimes, 3, MPI_DOUBLE, MPI_MAX, _Comm);
+            tMapReduceStats Total = { aulCounts[0], aulCounts[1], aulCounts[2], aulCounts[3], aulCounts[4], aulCounts[5], _Stats.iRounds, adTimes[0], adTimes[1], adTimes[2] };
+            return Total;
+        }
+
+    private:
+        /** The first Map after a Reduce starts a new job */
+        void _BeginJob() {
+            if (_bJobDone) _Stats = {};
+            _bJobDone = false;
+        }
+
+        void _Reset() {
+            _vecOut.assign(_iSize, std::string());
+            _vecOutSpills.assign(_iSize, nullptr);
+            _ulOutBytes = 0;
+        }
+
+        int _Owner(const K& Key) const {
+            return (int)(Hash()(Key) % (size_t)_iSize);
+        }
+
+        void _Emit(const K& Key, const V& Value) {
+            _Stats.ulEmitted++;
+            if (_fnCombine) {
+                auto It = _mapCombined.find(Key);
+                if (It == _mapCombined.end()) {
+                    std::string sSize;
+                    tMRCodec<K>::Encode(sSize, Key);
+                    tMRCodec<V>::Encode(sSize, Value);
+                    _ulOutBytes += sSize.size() + MAPREDUCE_ENTRY_OVERHEAD;
+                    _mapCombined.emplace(Key, Value);
+                } else {
+                    _fnCombine(It->second, Value);
+                }
+            } else {
+                std::string& sOut = _vecOut[_Owner(Key)];
+                const size_t ulBefore = sOut.size();
+                _EncodeRecord(sOut, Key, Value);
+                _ulOutBytes += sOut.size() - ulBefore;
+            }
+            if (_ulOutBytes > _Config.ulMemBytes) _SpillOut();
+        }
+
+        /** A record is its length, then the key and the value */
+        static void _EncodeRecord(std::string& sOut, const K& Key, const V& Value) {
+            const size_t ulAt = sOut.size();
+            sOut.append(sizeof(uint32_t), '\0');
+            tMRCodec<K>::Encode(sOut, Key);
+            tMRCodec<V>::Encode(sOut, Value);
+            const uint32_t uLength = (uint32_t)(sOut.size() - ulAt - sizeof(uint32_t));
+            memcpy(&sOut[ulAt], &uLength, sizeof(uLength));
+        }
+
+        /** Move the combined pairs to the per destination buffers */
+        void _FlushCombined() {
+            for (const auto& Item : _mapCombined) _EncodeRecord(_vecOut[_Owner(Item.first)], Item.first, Item.second);
+            _mapCombined.clear();
+        }
+
+        /** Map output to the spill files, one per destination */
+        void _SpillOut() {
+            _FlushCombined();
+            for (int iDst = 0; iDst < _iSize; ++iDst) {
+                if (_vecOut[iDst].empty()) continue;
+                if (_vecOutSpills[iDst] == nullptr) _vecOutSpills[iDst] = _MRSpillFile(_Config.sSpillDir);
+                if (_vecOutSpills[iDst] == nullptr) return;
+                fwrite(_vecOut[iDst].data(), 1, _vecOut[iDst].size(), _vecOutSpills[iDst]);
+                _Stats.ulSpillBytes += _vecOut[iDst].size();
+                std::string().swap(_vecOut[iDst]);
+            }
+            _ulOutBytes = 0;
+        }
+
+        /** Whole records of iDst, at most ulRoundBytes unless one record is larger */
+        void _NextChunk(int iDst, std::string& sChunk) {
+            sChunk.clear();
+            FILE* pSpill = _vecOutSpills[iDst];
+            while (pSpill != nullptr and sChunk.size() < _Config.ulRoundBytes) {
+                uint32_t uLength = 0;
+                if (fread(&uLength, sizeof(uLength), 1, pSpill) != 1) {
+                    fclose(pSpill);
+                    pSpill = _vecOutSpills[iDst] = nullptr;
+                    break;
+                }
+                if (not sChunk.empty() and sChunk.size() + sizeof(uLength) + uLength > _Config.ulRoundBytes) {
+                    fseek(pSpill, -(long)sizeof(uLength), SEEK_CUR);
+                    return;
+                }
+                const size_t ulAt = sChunk.size();
+                sChunk.append((const char*)&uLength, sizeof(uLength));
+                sChunk.resize(ulAt + sizeof(uLength) + uLength);
+                if (fread(&sChunk[ulAt + sizeof(uLength)], 1, uLength, pSpill) != uLength) LOGE("Short read from a spill file");
+            }
+            std::string& sOut = _vecOut[iDst];
+            size_t& ulSent = _vecOutSent[iDst];
+            while (sChunk.size() < _Config.ulRoundBytes and ulSent < sOut.size()) {
+                uint32_t uLength = 0;
+                memcpy(&uLength, sOut.data() + ulSent, sizeof(uLength));
+                if (not sChunk.empty() and sChunk.size() + sizeof(uLength) + uLength > _Config.ulRoundBytes) break;
+                sChunk.append(sOut, ulSent, sizeof(uLength) + uLength);
+                ulSent += sizeof(uLength) + uLength;
+            }
+            if (ulSent == sOut.size()) std::string().swap(sOut);
+        }
+
+        /**
+         * @brief Rounds of MPI_Alltoallv until no rank has anything left to
+         * send, received records grouped (and spilled) as they come
+         *
+         */
+        void _Shuffle() {
+            const double dBegin = MPI_Wtime();
+            _FlushCombined();
+            _vecOutSent.assign(_iSize, 0);
+            for (FILE* pSpill : _vecOutSpills) {
+                if (pSpill != nullptr) rewind(pSpill);
+            }
+            std::vector<std::string> vecChunks(_iSize);
+            std::vector<int> vecSendCounts(_iSize), vecSendDispls(_iSize), vecRecvCounts(_iSize), vecRecvDispls(_iSize);
+            std::string sSend, sRecv;
+            _Stats.iRounds = 0;
+            while (true) {
+                int bMore = 0;
+                sSend.clear();
+                for (int iDst = 0; iDst < _iSize; ++iDst) {
+                    _NextChunk(iDst, vecChunks[iDst]);
+                    vecSendDispls[iDst] = (int)sSend.size();
+                    vecSendCounts[iDst] = (int)vecChunks[iDst].size();
+                    sSend += vecChunks[iDst];
+                    bMore |= _vecOutSpills[iDst] != nullptr or not _vecOut[iDst].empty();
+                }
+                MPI_Alltoall(vecSendCounts.data(), 1, MPI_INT, vecRecvCounts.data(), 1, MPI_INT, _Comm);
+                size_t ulRecv = 0;
+                for (int iSrc = 0; iSrc < _iSize; ++iSrc) {
+                    vecRecvDispls[iSrc] = (int)ulRecv;
+                    ulRecv += (size_t)vecRecvCounts[iSrc];
+                }
+                sRecv.resize(ulRecv);
+                MPI_Alltoallv(sSend.data(), vecSendCounts.data(), vecSendDispls.data(), MPI_CHAR, &sRecv[0], vecRecvCounts.data(),
+                              vecRecvDispls.data(), MPI_CHAR, _Comm);
+                _Stats.ulShuffleBytes += sSend.size();
+                _Stats.iRounds++;
+                for (const char* pIn = sRecv.data(); pIn < sRecv.data() + sRecv.size();) {
+                    pIn += sizeof(uint32_t);
+                    _Group(pIn);
+                }
+                if (_ulGroupBytes > _Config.ulMemBytes) _SpillGroups();
+                MPI_Allreduce(MPI_IN_PLACE, &bMore, 1, MPI_INT, MPI_LOR, _Comm);
+                if (not bMore) break;
+            }
+            _Stats.dShuffle += MPI_Wtime() - dBegin;
+        }
+
+        /** Add one received key and value to its group */
+        void _Group(const char*& pIn) {
+            const char* pKey = pIn;
+            K Key = tMRCodec<K>::Decode(pIn);
+            const char* pValue = pIn;
+            V Value = tMRCodec<V>::Decode(pIn);
+            auto It = _mapGroups.find(Key);
+            if (It == _mapGroups.end()) {
+                _ulGroupBytes += (size_t)(pIn - pKey) + MAPREDUCE_ENTRY_OVERHEAD;
+                _mapGroups.emplace(std::move(Key), std::vector<V>{ std::move(Value) });
+            } else if (_fnCombine) {
+                _fnCombine(It->second.front(), Value);
+            } else {
+                _ulGroupBytes += (size_t)(pIn - pValue);
+                It->second.push_back(std::move(Value));
+            }
+        }
+
+        /** Received groups to the bucket files, by a second hash so a key always lands in one bucket */
+        void _SpillGroups() {
+            if (_vecBuckets.empty()) {
+                _vecBuckets.assign(std::max(1, _Config.iSpillBuckets), nullptr);
+                for (FILE*& pBucket : _vecBuckets) pBucket = _MRSpillFile(_Config.sSpillDir);
+            }
+            std::vector<std::string> vecData(_vecBuckets.size());
+            for (const auto& Group : _mapGroups) {
+                std::string& sData = vecData[_MRMix(Hash()(Group.first)) % _vecBuckets.size()];
+                for (const V& Value : Group.second) {
+                    tMRCodec<K>::Encode(sData, Group.first);
+                    tMRCodec<V>::Encode(sData, Value);
+                }
+            }
+            for (size_t idx = 0; idx < _vecBuckets.size(); ++idx) {
+                if (_vecBuckets[idx] == nullptr) continue;
+                fwrite(vecData[idx].data(), 1, vecData[idx].size(), _vecBuckets[idx]);
+                _Stats.ulSpillBytes += vecData[idx].size();
+            }
+            _mapGroups.clear();
+            _ulGroupBytes = 0;
+        }
+
+        static std::string _ReadAll(FILE* pFile) {
+            std::string sData;
+            if (pFile == nullptr) return sData;
+            fflush(pFile);
+            const long lSize = ftell(pFile);
+            rewind(pFile);
+            sData.resize((size_t)std::max(0L, lSize));
+            if (fread(&sData[0], 1, sData.size(), pFile) != sData.size()) LOGE("Short read from a spill file");
+            return sData;
+        }
+
+        void _CloseSpills() {
+            for (FILE*& pSpill : _vecOutSpills) {
+                if (pSpill != nullptr) fclose(pSpill);
+                pSpill = nullptr;
+            }
+            for (FILE* pBucket : _vecBuckets) {
+                if (pBucket != nullptr) fclose(pBucket);
+            }
+            _vecBuckets.clear();
+        }
+
+        tMapReduceConfig _Config;
+        MPI_Comm _Comm;
+        int _iRank;
+        int _iSize;
+        std::function<void(V&, const V&)> _fnCombine;
+        tMapReduceStats _Stats = {};
+        bool _bJobDone = false;
+        /** Map side: combined pairs, encoded records per destination, their spill files */
+        std::unordered_map<K, V, Hash> _mapCombined;
+        std::vector<std::string> _vecOut;
+        std::vector<size_t> _vecOutSent;
+        std::vector<FILE*> _vecOutSpills;
+        size_t _ulOutBytes = 0;
+        /** Reduce side: values per key, the bucket files */
+        std::unordered_map<K, std::vector<V>, Hash> _mapGroups;
+        size_t _ulGroupBytes = 0;
+        std::vector<FILE*> _vecBuckets;
+    };
+}
+
+#endif
@@ -0,0 +1,425 @@
+/**
+ * @file MatCodec.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Compressed / reduced precision transfer of matrix blocks over MPI
+ * @version 0.1
+ * @date 2022-06-09
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef MATCODEC_HPP
+#define MATCODEC_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "dtype.hpp"
+
+/** Elements per chunk are chosen to give this many raw bytes */
+#define CODEC_DEFAULT_CHUNK_BYTES (1u << 20)
+/** Chunks in flight per transfer */
+#define CODEC_SLOTS 2
+
+namespace mpimath {
+    /**
+     * @brief Codec used for the block messages
+     *
+     * @enum NONE     raw MPI datatypes, the historical path
+     * @enum LOSSLESS byte shuffle + LZ, exact
+     * @enum LOSSY    per chunk, the narrowest of bf16 / fp32 that keeps every
+     *                element within dMaxRelError (full width when none does),
+     *                then byte shuffle + LZ
+     */
+    enum class emCodecMode {
+        NONE = 0,
+        LOSSLESS = 1,
+        LOSSY = 2,
+    };
+
+    /**
+     * @brief Element encoding of one chunk, CODEC_CHUNK_LZ is or-ed in when
+     * the elements were byte shuffled and LZ compressed on top
+     *
+     */
+    enum class emChunkFormat {
+        RAW = 0,
+        FLOAT32 = 1,
+        BFLOAT16 = 2,
+    };
+
+#define CODEC_CHUNK_LZ 0x100u
+
+    /**
+     * @brief Codec configuration, broadcast with the MatMul context
+     *
+     * @struct emMode
+     * @struct dMaxRelError bound of |x - decode(encode(x))| / |x| for LOSSY
+     * @struct uChunkBytes raw bytes per chunk
+     */
+    typedef struct {
+        emCodecMode emMode;
+        double dMaxRelError;
+        uint32_t uChunkBytes;
+    } tCodecConfig;
+
+    /**
+     * @brief Header in front of every chunk on the wire
+     *
+     * @struct ulOffset first element of the chunk in the transferred buffer
+     */
+    typedef struct {
+        uint32_t uFormat;
+        uint32_t uElemSize;
+        uint64_t ulOffset;
+        uint64_t ulCount;
+    } tCodecChunkHeader;
+
+    /**
+     * @brief Counters of the encoded transfers of one process
+     *
+     */
+    typedef struct {
+        size_t ulRawBytes;
+        size_t ulWireBytes;
+        size_t ulChunks;
+        size_t ulLossyChunks;
+        double dEncodeTime;
+        double dDecodeTime;
+    } tCodecStats;
+
+    inline double CodecRatio(const tCodecStats& Stats) {
+        return Stats.ulWireBytes > 0 ? (double)Stats.ulRawBytes / (double)Stats.ulWireBytes : 1.0;
+    }
+
+    /**
+     * @brief MPIMATH_CODEC=none|lossless|lossy, MPIMATH_CODEC_ERROR (default 1e-3),
+     * MPIMATH_CODEC_CHUNK in KB
+     *
+     */
+    inline tCodecConfig CodecConfigFromEnv() {
+        tCodecConfig Cfg = { emCodecMode::NONE, 1e-3, CODEC_DEFAULT_CHUNK_BYTES };
+        const char* sMode = getenv("MPIMATH_CODEC");
+        if (sMode != nullptr) {
+            std::string s(sMode);
+            if (s == "lossless") Cfg.emMode = emCodecMode::LOSSLESS;
+            if (s == "lossy") Cfg.emMode = emCodecMode::LOSSY;
+        }
+        const char* sError = getenv("MPIMATH_CODEC_ERROR");
+        if (sError != nullptr and atof(sError) > 0) Cfg.dMaxRelError = atof(sError);
+        const char* sChunk = getenv("MPIMATH_CODEC_CHUNK");
+        if (sChunk != nullptr and atoi(sChunk) > 0) Cfg.uChunkBytes = (uint32_t)atoi(sChunk) << 10;
+        return Cfg;
+    }
+
+    /**
+     * @brief Byte planes: byte b of element i goes to pDst[b * ulCount + i],
+     * the exponent bytes of similar numbers then form long runs
+     *
+     */
+    void ByteShuffle(const uint8_t* pSrc, size_t ulCount, size_t ulElemSize, uint8_t* pDst);
+    void ByteUnshuffle(const uint8_t* pSrc, size_t ulCount, size_t ulElemSize, uint8_t* pDst);
+
+    /**
+     * @brief LZ4 style block compression, 64 KB window, greedy hash matching
+     *
+     * @return size_t bytes written to pDst, which must hold LZCompressBound(ulSize)
+     */
+    size_t LZCompress(const uint8_t* pSrc, size_t ulSize, uint8_t* pDst);
+    size_t LZCompressBound(size_t ulSize);
+
+    /**
+     * @return size_t bytes written to pDst, (size_t)-1 on corrupt input or overflow of ulCapacity
+     */
+    size_t LZDecompress(const uint8_t* pSrc, size_t ulSize, uint8_t* pDst, size_t ulCapacity);
+
+    /**
+     * @brief Down-convert p into pOut as TNarrow if every element stays within dBound
+     *
+     */
+    template<typename TNarrow, typename T>
+    inline bool _CodecNarrow(const T* p, size_t ulCount, double dBound, uint8_t* pOut) {
+        TNarrow* pNarrow = (TNarrow*)pOut;
+        for (size_t idx = 0; idx < ulCount; ++idx) {
+            const double dValue = (double)p[idx];
+            const TNarrow Narrow = TNarrow((float)p[idx]);
+            if (not (std::fabs(dValue - (double)(float)Narrow) <= dBound * std::fabs(dValue))) {
+                return false;
+            }
+            memcpy(pNarrow + idx, &Narrow, sizeof(TNarrow));
+        }
+        return true;
+    }
+
+    /** Only double and float have lossy formats */
+    template<typename T>
+    inline emChunkFormat _CodecTryLossy(const T*, size_t, double, uint8_t*) { return emChunkFormat::RAW; }
+
+    inline emChunkFormat _CodecTryLossy(const double* p, size_t ulCount, double dBound, uint8_t* pOut) {
+        if (_CodecNarrow<bf16_t>(p, ulCount, dBound, pOut)) return emChunkFormat::BFLOAT16;
+        if (_CodecNarrow<float>(p, ulCount, dBound, pOut)) return emChunkFormat::FLOAT32;
+        return emChunkFormat::RAW;
+    }
+
+    inline emChunkFormat _CodecTryLossy(const float* p, size_t ulCount, double dBound, uint8_t* pOut) {
+        if (_CodecNarrow<bf16_t>(p, ulCount, dBound, pOut)) return emChunkFormat::BFLOAT16;
+        return emChunkFormat::RAW;
+    }
+
+    template<typename T>
+    inline size_t _CodecFormatElemSize(emChunkFormat emFormat) {
+        switch (emFormat) {
+            case emChunkFormat::FLOAT32: return sizeof(float);
+            case emChunkFormat::BFLOAT16: return sizeof(bf16_t);
+            default: return sizeof(T);
+        }
+    }
+
+    /**
+     * @brief Encode p[0, ulCount) as one chunk (header + payload) into vecOut
+     *
+     * LOSSY first narrows the elements when the bound allows it, then the
+     * elements are byte shuffled and LZ compressed whenever that is smaller.
+     */
+    template<typename T>
+    void CodecEncodeChunk(const T* p, size_t ulCount, size_t ulOffset, const tCodecConfig& Cfg, std::vector<uint8_t>& vecOut,
+                          tCodecStats* pStats = nullptr) {
+        const double dStart = MPI_Wtime();
+        const size_t ulRaw = ulCount * sizeof(T);
+        /** [header][payload, up to LZCompressBound][narrowed elements][shuffled elements] */
+        vecOut.resize(sizeof(tCodecChunkHeader) + LZCompressBound(ulRaw) + 2 * ulRaw);
+        uint8_t* pPayload = vecOut.data() + sizeof(tCodecChunkHeader);
+        uint8_t* pNarrow = pPayload + LZCompressBound(ulRaw);
+        uint8_t* pShuffled = pNarrow + ulRaw;
+
+        emChunkFormat emFormat = emChunkFormat::RAW;
+        const uint8_t* pElems = (const uint8_t*)p;
+        if (Cfg.emMode == emCodecMode::LOSSY) {
+            emFormat = _CodecTryLossy(p, ulCount, Cfg.dMaxRelError, pNarrow);
+            if (emFormat != emChunkFormat::RAW) {
+                pElems = pNarrow;
+                if (pStats != nullptr) pStats->ulLossyChunks++;
+            }
+        }
+        const size_t ulElemSize = _CodecFormatElemSize<T>(emFormat);
+        const size_t ulElemBytes = ulCount * ulElemSize;
+
+        uint32_t uFormat = (uint32_t)emFormat;
+        ByteShuffle(pElems, ulCount, ulElemSize, pShuffled);
+        size_t ulPayload = LZCompress(pShuffled, ulElemBytes, pPayload);
+        if (ulPayload < ulElemBytes) {
+            uFormat |= CODEC_CHUNK_LZ;
+        } else {
+            memcpy(pPayload, pElems, ulElemBytes);
+            ulPayload = ulElemBytes;
+        }
+        tCodecChunkHeader Header = { uFormat, (uint32_t)sizeof(T), ulOffset, ulCount };
+        memcpy(vecOut.data(), &Header, sizeof(Header));
+        vecOut.resize(sizeof(Header) + ulPayload);
+        if (pStats != nullptr) {
+            pStats->ulRawBytes += ulRaw;
+            pStats->ulWireBytes += vecOut.size();
+            pStats->ulChunks++;
+            pStats->dEncodeTime += MPI_Wtime() - dStart;
+        }
+    }
+
+    /**
+     * @brief Decode one chunk into pBase[ulOffset, ulOffset + ulCount)
+     *
+     * @param ulCapacity elements available at pBase
+     * @return long ulCount, -1 on a corrupt or misplaced chunk
+     */
+    template<typename T>
+    long CodecDecodeChunk(const uint8_t* pChunk, size_t ulBytes, T* pBase, size_t ulCapacity, tCodecStats* pStats = nullptr) {
+        const double dStart = MPI_Wtime();
+        tCodecChunkHeader Header;
+        if (ulBytes < sizeof(Header)) return -1;
+        memcpy(&Header, pChunk, sizeof(Header));
+        const emChunkFormat emFormat = (emChunkFormat)(Header.uFormat & ~CODEC_CHUNK_LZ);
+        if (Header.uElemSize != sizeof(T) or Header.ulOffset > ulCapacity or Header.ulCount > ulCapacity - Header.ulOffset or
+            (emFormat != emChunkFormat::RAW and emFormat != emChunkFormat::FLOAT32 and emFormat != emChunkFormat::BFLOAT16)) {
+            return -1;
+        }
+        const uint8_t* pPayload = pChunk + sizeof(Header);
+        const size_t ulPayload = ulBytes - sizeof(Header);
+        T* pOut = pBase + Header.ulOffset;
+        const size_t ulCount = Header.ulCount;
+        const size_t ulElemSize = _CodecFormatElemSize<T>(emFormat);
+        const size_t ulElemBytes = ulCount * ulElemSize;
+
+        /** Undo LZ + shuffle into the elements, straight into pOut for full width */
+        std::vector<uint8_t> vecElems;
+        const uint8_t* pElems = pPayload;
+        if (Header.uFormat & CODEC_CHUNK_LZ) {
+            std::vector<uint8_t> vecShuffled(ulElemBytes);
+            if (LZDecompress(pPayload, ulPayload, vecShuffled.data(), ulElemBytes) != ulElemBytes) return -1;
+            if (emFormat == emChunkFormat::RAW) {
+                ByteUnshuffle(vecShuffled.data(), ulCount, ulElemSize, (uint8_t*)pOut);
+                pElems = nullptr;
+            } else {
+                vecElems.resize(ulElemBytes);
+                ByteUnshuffle(vecShuffled.data(), ulCount, ulElemSize, vecElems.data());
+                pElems = vecElems.data();
+            }
+        } else if (ulPayload != ulElemBytes) {
+            return -1;
+        }
+
+        if (pElems != nullptr) {
+            switch (emFormat) {
+                case emChunkFormat::FLOAT32:
+                    for (size_t idx = 0; idx < ulCount; ++idx) {
+                        float fValue;
+                        memcpy(&fValue, pElems + idx * sizeof(float), sizeof(float));
+                        pOut[idx] = (T)fValue;
+                    }
+                    break;
+                case emChunkFormat::BFLOAT16:
+                    for (size_t idx = 0; idx < ulCount; ++idx) {
+                        uint16_t uBits;
+                        memcpy(&uBits, pElems + idx * sizeof(uint16_t), sizeof(uint16_t));
+                        pOut[idx] = (T)bf16_t::ToFloat(uBits);
+                    }
+                    break;
+                default:
+                    memcpy(pOut, pElems, ulElemBytes);
+                    break;
+            }
+        }
+        if (pStats != nullptr) pStats->dDecodeTime += MPI_Wtime() - dStart;
+        return (long)ulCount;
+    }
+
+    inline size_t _CodecChunkCount(const tCodecConfig& Cfg, size_t ulElemSize) {
+        return std::max<size_t>(1, Cfg.uChunkBytes / ulElemSize);
+    }
+
+    /**
+     * @brief Send p[0, ulCount) to iDest as encoded chunks, chunk i + 1 is
+     * encoded while chunk i is on the wire
+     *
+     */
+    template<typename T>
+    int CodecSend(const T* p, size_t ulCount, int iDest, int iTag, MPI_Comm Comm, const tCodecConfig& Cfg, tCodecStats* pStats = nullptr) {
+        const size_t ulChunk = _CodecChunkCount(Cfg, sizeof(T));
+        std::vector<uint8_t> aBuf[CODEC_SLOTS];
+        MPI_Request aRequests[CODEC_SLOTS];
+        for (auto& Request : aRequests) Request = MPI_REQUEST_NULL;
+        size_t c = 0;
+        for (size_t ulLow = 0; ulLow < ulCount; ulLow += ulChunk, ++c) {
+            const int iSlot = (int)(c % CODEC_SLOTS);
+            MPI_Wait(&aRequests[iSlot], MPI_STATUS_IGNORE);
+            CodecEncodeChunk(p + ulLow, std::min(ulChunk, ulCount - ulLow), ulLow, Cfg, aBuf[iSlot], pStats);
+            MPI_Isend(aBuf[iSlot].data(), (int)aBuf[iSlot].size(), MPI_BYTE, iDest, iTag, Comm, &aRequests[iSlot]);
+        }
+        return MPI_Waitall(CODEC_SLOTS, aRequests, MPI_STATUSES_IGNORE);
+    }
+
+    /**
+     * @brief Receive one chunk of whatever size from iSrc (MPI_ANY_SOURCE
+     * allowed after a probe) and decode it into pBase
+     *
+     * @param pulCount elements decoded
+     * @param piSource the sender
+     * @return int MPI_SUCCESS, MPI_ERR_TRUNCATE on a corrupt chunk
+     */
+    template<typename T>
+    int CodecRecvChunk(T* pBase, size_t ulCapacity, int iSrc, int iTag, MPI_Comm Comm, size_t* pulCount,
+                       tCodecStats* pStats = nullptr, int* piSource = nullptr) {
+        MPI_Status Status;
+        MPI_Probe(iSrc, iTag, Comm, &Status);
+        int iBytes = 0;
+        MPI_Get_count(&Status, MPI_BYTE, &iBytes);
+        std::vector<uint8_t> vecBuf((size_t)iBytes);
+        MPI_Recv(vecBuf.data(), iBytes, MPI_BYTE, Status.MPI_SOURCE, iTag, Comm, MPI_STATUS_IGNORE);
+        if (piSource != nullptr) *piSource = Status.MPI_SOURCE;
+        long lCount = CodecDecodeChunk(vecBuf.data(), vecBuf.size(), pBase, ulCapacity, pStats);
+        *pulCount = lCount < 0 ? 0 : (size_t)lCount;
+        return lCount < 0 ? MPI_ERR_TRUNCATE : MPI_SUCCESS;
+    }
+
+    /**
+     * @brief Receive what CodecSend sent, the receives of the next chunks
+     * are posted before the current one is decoded
+     *
+     */
+    template<typename T>
+    int CodecRecv(T* p, size_t ulCount, int iSrc, int iTag, MPI_Comm Comm, const tCodecConfig& Cfg, tCodecStats* pStats = nullptr) {
+        const size_t ulChunk = _CodecChunkCount(Cfg, sizeof(T));
+        const size_t ulChunks = (ulCount + ulChunk - 1) / ulChunk;
+        /** LZ payloads are only kept when smaller than the elements */
+        const size_t ulMaxBytes = sizeof(tCodecChunkHeader) + ulChunk * sizeof(T);
+        std::vector<uint8_t> aBuf[CODEC_SLOTS];
+        MPI_Request aRequests[CODEC_SLOTS];
+        auto Post = [&](size_t c) {
+            const int iSlot = (int)(c % CODEC_SLOTS);
+            aBuf[iSlot].resize(ulMaxBytes);
+            MPI_Irecv(aBuf[iSlot].data(), (int)ulMaxBytes, MPI_BYTE, iSrc, iTag, Comm, &aRequests[iSlot]);
+        };
+        for (size_t c = 0; c < std::min<size_t>(CODEC_SLOTS, ulChunks); ++c) Post(c);
+
+        int iRet = MPI_SUCCESS;
+        for (size_t c = 0; c < ulChunks; ++c) {
+            const int iSlot = (int)(c % CODEC_SLOTS);
+            MPI_Status Status;
+            MPI_Wait(&aRequests[iSlot], &Status);
+            int iBytes = 0;
+            MPI_Get_count(&Status, MPI_BYTE, &iBytes);
+            if (CodecDecodeChunk(aBuf[iSlot].data(), (size_t)iBytes, p, ulCount, pStats) < 0) iRet = MPI_ERR_TRUNCATE;
+            if (c + CODEC_SLOTS < ulChunks) Post(c + CODEC_SLOTS);
+        }
+        return iRet;
+    }
+
+    /**
+     * @brief Encoded broadcast: per chunk the root broadcasts the encoded
+     * size, then the bytes with MPI_Ibcast while it encodes the next chunk
+     *
+     */
+    template<typename T>
+    int CodecBcast(T* p, size_t ulCount, int iRoot, MPI_Comm Comm, const tCodecConfig& Cfg, tCodecStats* pStats = nullptr) {
+        int iRank;
+        MPI_Comm_rank(Comm, &iRank);
+        const size_t ulChunk = _CodecChunkCount(Cfg, sizeof(T));
+        const size_t ulChunks = (ulCount + ulChunk - 1) / ulChunk;
+        std::vector<uint8_t> aBuf[CODEC_SLOTS];
+        MPI_Request aRequests[CODEC_SLOTS];
+        for (auto& Request : aRequests) Request = MPI_REQUEST_NULL;
+        int iRet = MPI_SUCCESS;
+        auto Complete = [&](int iSlot) {
+            if (aRequests[iSlot] == MPI_REQUEST_NULL) return;
+            MPI_Wait(&aRequests[iSlot], MPI_STATUS_IGNORE);
+            if (iRank != iRoot and CodecDecodeChunk(aBuf[iSlot].data(), aBuf[iSlot].size(), p, ulCount, pStats) < 0) {
+                iRet = MPI_ERR_TRUNCATE;
+            }
+        };
+
+        for (size_t c = 0; c < ulChunks; ++c) {
+            const int iSlot = (int)(c % CODEC_SLOTS);
+            Complete(iSlot);
+            uint64_t ulBytes = 0;
+            if (iRank == iRoot) {
+                const size_t ulLow = c * ulChunk;
+                CodecEncodeChunk(p + ulLow, std::min(ulChunk, ulCount - ulLow), ulLow, Cfg, aBuf[iSlot], pStats);
+                ulBytes = aBuf[iSlot].size();
+            }
+            MPI_Bcast(&ulBytes, 1, MPI_UINT64_T, iRoot, Comm);
+            aBuf[iSlot].resize(ulBytes);
+            MPI_Ibcast(aBuf[iSlot].data(), (int)ulBytes, MPI_BYTE, iRoot, Comm, &aRequests[iSlot]);
+        }
+        for (size_t c = ulChunks; c < ulChunks + CODEC_SLOTS; ++c) {
+            Complete((int)(c % CODEC_SLOTS));
+        }
+        return iRet;
+    }
+}
+
+#endif
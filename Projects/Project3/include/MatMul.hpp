@@ -13,9 +13,16 @@
 #define MATMUL_HPP
 
 #include "Matrix.hpp"
+#include "MatCodec.hpp"
+#include "SharedMatrix.hpp"
+#include "SparseMatrix.hpp"
+#include "Tuning.hpp"
 #include "MPIProcessorInfo.hpp"
+#include "MPIRegionTimer.hpp"
+#include <climits>
+#include <memory>
 #include <vector>
-#include "block.hpp"
+#include "Partition.hpp"
  // #include "debug.h"
 
 namespace mpimath {
@@ -27,9 +34,40 @@ namespace mpimath {
         INT32 = 0,
         INT64 = 1,
         FLOAT64 = 2,
+        FLOAT32 = 3,
+        BFLOAT16 = 4,
+        FLOAT16 = 5,
+        INT8 = 6,
         INVALID = -1,
     };
 
+    /**
+     * @brief Map element type T to its emMatrixType and MPI datatype
+     *
+     * 16 bit storage types travel as MPI_UINT16_T, they are never reduced by MPI
+     */
+    template<typename T>
+    struct tMPIType {
+        static constexpr emMatrixType emType = emMatrixType::INVALID;
+        static MPI_Datatype Get() { return MPI_DATATYPE_NULL; }
+    };
+
+#define MPIMATH_DECLARE_MPI_TYPE(T, EM, MPI_T) \
+    template<> \
+    struct tMPIType<T> { \
+        static constexpr emMatrixType emType = EM; \
+        static MPI_Datatype Get() { return MPI_T; } \
+    }
+
+    MPIMATH_DECLARE_MPI_TYPE(double, emMatrixType::FLOAT64, MPI_DOUBLE);
+    MPIMATH_DECLARE_MPI_TYPE(float, emMatrixType::FLOAT32, MPI_FLOAT);
+    MPIMATH_DECLARE_MPI_TYPE(bf16_t, emMatrixType::BFLOAT16, MPI_UINT16_T);
+    MPIMATH_DECLARE_MPI_TYPE(fp16_t, emMatrixType::FLOAT16, MPI_UINT16_T);
+    MPIMATH_DECLARE_MPI_TYPE(int8_t, emMatrixType::INT8, MPI_INT8_T);
+    MPIMATH_DECLARE_MPI_TYPE(int32_t, emMatrixType::INT32, MPI_INT32_T);
+    MPIMATH_DECLARE_MPI_TYPE(int64_t, emMatrixType::INT64, MPI_INT64_T);
+#undef MPIMATH_DECLARE_MPI_TYPE
+
     /**
      * @brief Message tag used in MPI
      *
@@ -53,6 +91,11 @@ namespace mpimath {
      * @struct lNCol col of N
      * @struct lMRow row of M
      * @struct lMCol col of M
+     * @struct emType element type of M and N
+     * @struct Codec encoding of MAT_N, BLOCK and RESULT
+     * @struct bSharedN N is received once per node into a SharedMatrix
+     * @struct lTileRows rows of M per BLOCK / RESULT message, 0 for one block per worker
+     * @struct bRMA workers pull tiles from windows on the main process, see _MPIMatMulMainRMA
      *
      */
     typedef struct {
@@ -61,19 +104,196 @@ namespace mpimath {
         long lMRow;
         long lMCol;
         bool bValid;
+        emMatrixType emType;
+        tCodecConfig Codec;
+        bool bSharedN;
+        long lTileRows;
+        bool bRMA;
     }tMatMulCtx;
 
+    /** Tiles per worker of the RMA mode when the tile rows are not tuned: enough to even out slow workers */
+#define MATMUL_RMA_TILES_PER_WORKER 4
+
+    /** Flops one element received by a process is worth, shared by the cost models of MatMul25D and MatrixChain */
+#define MATMUL_WORD_COST 16.0
+
+    /** MPIMATH_MATMUL_RMA=1 selects the one-sided mode of MPIMatMulMain */
+    inline bool MatMulRMAFromEnv() {
+        const char* sEnv = getenv("MPIMATH_MATMUL_RMA");
+        return sEnv != nullptr and atoi(sEnv) != 0;
+    }
+
+    /** Rows of M of every worker: the BLOCK partition over processes 1 .. iSize - 1 */
+    inline Partition<long> MatMulRows(const tMatMulCtx& Ctx, int iSize) {
+        return Partition<long>::Block(Ctx.lMRow, iSize - 1);
+    }
+
+    /** Rows of M per tile of the RMA mode */
+    inline long MatMulRMATileRows(const tMatMulCtx& Ctx, int iWorkers) {
+        if (Ctx.lTileRows > 0) return Ctx.lTileRows;
+        const long lTiles = std::max(1L, (long)iWorkers * MATMUL_RMA_TILES_PER_WORKER);
+        return std::max(1L, (Ctx.lMRow + lTiles - 1) / lTiles);
+    }
+
+    /**
+     * @brief Number of BLOCK / RESULT messages for a worker of lLineNum rows
+     *
+     */
+    inline long MatMulTileCount(const tMatMulCtx& Ctx, long lLineNum) {
+        if (Ctx.lTileRows <= 0 or lLineNum <= Ctx.lTileRows) return 1;
+        return (lLineNum + Ctx.lTileRows - 1) / Ctx.lTileRows;
+    }
+
+    /**
+     * @brief Rows [lTileLow, lTileLow + lTileNum) of the worker's block travel in message lTile
+     *
+     */
+    inline void MatMulTile(const tMatMulCtx& Ctx, long lLineNum, long lTile, long& lTileLow, long& lTileNum) {
+        if (MatMulTileCount(Ctx, lLineNum) == 1) {
+            lTileLow = 0;
+            lTileNum = lLineNum;
+            return;
+        }
+        lTileLow = lTile * Ctx.lTileRows;
+        lTileNum = std::min(Ctx.lTileRows, lLineNum - lTileLow);
+    }
+
+    /**
+     * @brief MPIMatMulMain with encoded block messages, after the context is broadcast
+     *
+     * Results are taken in arrival order: every chunk says where it goes.
+     */
+    template<typename T>
+    Matrix2D<typename tGemmTraits<T>::AccType> _MPIMatMulMainCodec(const Matrix2D<T>& MatM,
+                                                                   const Matrix2D<T>& MatN,
+                                                                   const tMatMulCtx& Ctx,
+                                                                   MPIProcessorInfo Processor,
+                                                                   tCodecStats* pStats) {
+        typedef typename tGemmTraits<T>::AccType TAcc;
+        if (not Ctx.bSharedN) {
+            REGION_SCOPE("bcast_n");
+            CodecBcast(MatN.pData(), MatN.Size(), 0, MPI_COMM_WORLD, Ctx.Codec, pStats);
+            REGION_BYTES(MatN.Size() * sizeof(T));
+        }
+
+        Matrix2D<TAcc> MatRes(Ctx.lMRow, Ctx.lNCol);
+        const Partition<long> Rows = MatMulRows(Ctx, Processor.iSize());
+        size_t ulPending = 0;
+        {
+            REGION_SCOPE("scatter");
+            FOR_ALL_SUB_PROC(Processor) {
+                long lLineIndex = Rows.Low(iProcID - 1);
+                long lLineNum = Rows.Size(iProcID - 1);
+                CodecSend(&MatM.pData()[lLineIndex * Ctx.lMCol], (size_t)(lLineNum * Ctx.lMCol),
+                          iProcID, (int)emMsgType::BLOCK, MPI_COMM_WORLD, Ctx.Codec, pStats);
+                REGION_BYTES(lLineNum * Ctx.lMCol * sizeof(T));
+                ulPending += (size_t)(lLineNum * Ctx.lNCol);
+            }
+        }
+
+        REGION_SCOPE("gather");
+        REGION_BYTES(ulPending * sizeof(TAcc));
+        while (ulPending > 0) {
+            MPI_Status Status;
+            MPI_Probe(MPI_ANY_SOURCE, (int)emMsgType::RESULT, MPI_COMM_WORLD, &Status);
+            const int iProcID = Status.MPI_SOURCE;
+            long lLineIndex = Rows.Low(iProcID - 1);
+            long lLineNum = Rows.Size(iProcID - 1);
+            size_t ulCount = 0;
+            if (CodecRecvChunk(&MatRes.pData()[lLineIndex * Ctx.lNCol], (size_t)(lLineNum * Ctx.lNCol), iProcID,
+                               (int)emMsgType::RESULT, MPI_COMM_WORLD, &ulCount, pStats) != MPI_SUCCESS) {
+                MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_DATA);
+            }
+            ulPending -= ulCount;
+        }
+        return MatRes;
+    }
+
+    /**
+     * @brief The windows of the RMA mode, created and freed collectively in this order
+     *
+     */
+    typedef struct {
+        MPI_Win WinM;
+        MPI_Win WinN;
+        MPI_Win WinRes;
+        MPI_Win WinNext;
+    } tMatMulWindows;
+
+    inline void _MatMulWindowsFree(tMatMulWindows& Wins) {
+        MPI_Win_free(&Wins.WinM);
+        MPI_Win_free(&Wins.WinN);
+        MPI_Win_free(&Wins.WinRes);
+        MPI_Win_free(&Wins.WinNext);
+    }
+
+    /**
+     * @brief MPIMatMulMain with one-sided transfers, after the context is broadcast
+     *
+     * M, N (unless shared) and the result are exposed as windows, next to a
+     * tile counter. The workers fetch-and-add the counter to pick their next
+     * tile, MPI_Rget it, and MPI_Rput its rows of the result straight into
+     * MatRes, all in passive target epochs: the main process posts no send or
+     * receive, and a fast worker simply takes more tiles. Freeing the windows
+     * waits for the last worker to unlock.
+     */
+    template<typename T>
+    Matrix2D<typename tGemmTraits<T>::AccType> _MPIMatMulMainRMA(const Matrix2D<T>& MatM,
+                                                                 const Matrix2D<T>& MatN,
+                                                                 const tMatMulCtx& Ctx,
+                                                                 MPIProcessorInfo Processor) {
+        typedef typename tGemmTraits<T>::AccType TAcc;
+        Matrix2D<TAcc> MatRes(Ctx.lMRow, Ctx.lNCol);
+        if (Processor.iSize() == 1) {
+            REGION_SCOPE("compute");
+            gemm(MatRes.pData(), MatM.pData(), MatN.pData(), Ctx.lMRow, Ctx.lMCol, Ctx.lNRow, Ctx.lNCol);
+            return MatRes;
+        }
+
+        long lNext = 0;
+        tMatMulWindows Wins;
+        {
+            REGION_SCOPE("expose");
+            MPI_Win_create((void*)MatM.pData(), (MPI_Aint)MatM.ulDataSize(), sizeof(T), MPI_INFO_NULL, MPI_COMM_WORLD, &Wins.WinM);
+            MPI_Win_create(Ctx.bSharedN ? nullptr : (void*)MatN.pData(), Ctx.bSharedN ? 0 : (MPI_Aint)MatN.ulDataSize(),
+                           sizeof(T), MPI_INFO_NULL, MPI_COMM_WORLD, &Wins.WinN);
+            MPI_Win_create(MatRes.pData(), (MPI_Aint)MatRes.ulDataSize(), sizeof(TAcc), MPI_INFO_NULL, MPI_COMM_WORLD, &Wins.WinRes);
+            MPI_Win_create(&lNext, sizeof(long), sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &Wins.WinNext);
+        }
+        {
+            REGION_SCOPE("wait");
+            _MatMulWindowsFree(Wins);
+            REGION_BYTES(MatM.ulDataSize() + MatRes.ulDataSize());
+        }
+        return MatRes;
+    }
+
     /**
      * @brief Calculate M @ N, the main process (process 0)
      *
+     * M and N are sent as T, the result comes back in tGemmTraits<T>::AccType.
+     * With a codec every block message travels as encoded chunks instead.
+     * With MPIMATH_SHARED_N=1 N goes to one SharedMatrix per node: the node
+     * leaders receive it and the other processes of the node read their copy.
+     * With MPIMATH_MATMUL_RMA=1 (and no codec) the workers pull their tiles
+     * through MPI_Get / MPI_Put instead, see _MPIMatMulMainRMA.
+     *
+     * @tparam T element type
      * @param MatM
      * @param MatN
      * @param Processor
-     * @return Matrix2D<double>
+     * @param Codec defaults to CodecConfigFromEnv(), NONE unless MPIMATH_CODEC is set
+     * @param pStats optional, encode / decode counters of the main process
+     * @return Matrix2D<typename tGemmTraits<T>::AccType>
      */
-    Matrix2D<double> MPIMatMulMain(const Matrix2D<double>& MatM,
-                                   const Matrix2D<double>& MatN,
-                                   MPIProcessorInfo Processor) {
+    template<typename T>
+    Matrix2D<typename tGemmTraits<T>::AccType> MPIMatMulMain(const Matrix2D<T>& MatM,
+                                                             const Matrix2D<T>& MatN,
+                                                             MPIProcessorInfo Processor,
+                                                             const tCodecConfig& Codec = CodecConfigFromEnv(),
+                                                             tCodecStats* pStats = nullptr) {
+        typedef typename tGemmTraits<T>::AccType TAcc;
+        REGION_SCOPE("MatMulMain");
 
         /** Initiate MatMulCtx */
         tMatMulCtx Ctx = {
@@ -81,7 +301,448 @@ namespace mpimath {
             .lNCol = (long)(MatN.ulCol()),
             .lMRow = (long)(MatM.ulRow()),
             .lMCol = (long)(MatM.ulCol()),
-            .bValid = (MatM.ulCol() == MatN.ulRow()) ? true : false
+            .bValid = (MatM.ulCol() == MatN.ulRow()) ? true : false,
+            .emType = tMPIType<T>::emType,
+            .Codec = Codec,
+            .bSharedN = SharedNFromEnv(),
+            .lTileRows = Codec.emMode == emCodecMode::NONE ? MatMulTileRows(MatM.ulRow(), MatM.ulCol(), MatN.ulCol()) : 0,
+            .bRMA = Codec.emMode == emCodecMode::NONE and MatMulRMAFromEnv(),
+        };
+        /** Broadcast process context*/
+        {
+            REGION_SCOPE("bcast_ctx");
+            MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
+        }
+        if (not Ctx.bValid) {
+            return { 0, 0 };
+        }
+
+        /** Kept until the results are in: freeing the window waits for the node */
+        std::unique_ptr<SharedMatrix<T>> pSharedN;
+        if (Ctx.bSharedN) {
+            REGION_SCOPE("bcast_n");
+            pSharedN.reset(new SharedMatrix<T>(Ctx.lNRow, Ctx.lNCol));
+            pSharedN->Bcast(MatN.pData(), Ctx.Codec);
+            REGION_BYTES(MatN.Size() * sizeof(T));
+        }
+        if (Ctx.Codec.emMode != emCodecMode::NONE) {
+            return _MPIMatMulMainCodec(MatM, MatN, Ctx, Processor, pStats);
+        }
+        if (Ctx.bRMA) {
+            return _MPIMatMulMainRMA(MatM, MatN, Ctx, Processor);
+        }
+
+        /** Broadcast Matrix N */
+        if (not Ctx.bSharedN) {
+            REGION_SCOPE("bcast_n");
+            MPI_Bcast(MatN.pData(), (int)MatN.Size(), tMPIType<T>::Get(), 0, MPI_COMM_WORLD);
+            REGION_BYTES(MatN.Size() * sizeof(T));
+        }
+
+        Matrix2D<TAcc> MatRes(Ctx.lMRow, Ctx.lNCol);/** Store Result */
+        std::vector<MPI_Request> vecRequests;/** Store Requests */
+
+        /**
+         * Tile t of every worker before tile t + 1 of any, so that all workers
+         * start computing after their first tile
+         */
+        const Partition<long> Rows = MatMulRows(Ctx, Processor.iSize());
+        long lMaxTiles = 1;
+        FOR_ALL_SUB_PROC(Processor) {
+            lMaxTiles = std::max(lMaxTiles, MatMulTileCount(Ctx, Rows.Size(iProcID - 1)));
+        }
+        {
+            /** Posting the sends and receives, the transfers overlap with gather */
+            REGION_SCOPE("scatter");
+            for (long lTile = 0; lTile < lMaxTiles; ++lTile) {
+                FOR_ALL_SUB_PROC(Processor) {
+                    /** Compute line index and number of lines to send for each proc */
+                    long lLineIndex = Rows.Low(iProcID - 1);
+                    long lLineNum = Rows.Size(iProcID - 1);
+                    if (lTile >= MatMulTileCount(Ctx, lLineNum)) continue;
+                    long lTileLow, lTileNum;
+                    MatMulTile(Ctx, lLineNum, lTile, lTileLow, lTileNum);
+                    lLineIndex += lTileLow;
+                    REGION_BYTES(lTileNum * Ctx.lMCol * sizeof(T));
+
+                    /** Send slice */
+                    vecRequests.emplace_back();
+                    MPI_Isend(&MatM.pData()[lLineIndex * Ctx.lMCol],
+                              lTileNum * Ctx.lMCol,
+                              tMPIType<T>::Get(),
+                              iProcID,
+                              (int)emMsgType::BLOCK,
+                              MPI_COMM_WORLD,
+                              &vecRequests.back());
+
+                    /** Receive from workers */
+                    vecRequests.emplace_back();
+                    MPI_Irecv(&MatRes.pData()[lLineIndex * Ctx.lNCol],
+                              lTileNum * Ctx.lNCol,
+                              tMPIType<TAcc>::Get(),
+                              iProcID,
+                              (int)emMsgType::RESULT,
+                              MPI_COMM_WORLD,
+                              &vecRequests.back());
+                }
+            }
+        }
+
+        /** Make sure all blocks are received */
+        {
+            REGION_SCOPE("gather");
+            MPI_Waitall((int)vecRequests.size(), vecRequests.data(), MPI_STATUSES_IGNORE);
+            REGION_BYTES(MatRes.Size() * sizeof(TAcc));
+        }
+
+        return MatRes;
+    }
+
+    /**
+     * @brief The worker side of _MPIMatMulMainRMA
+     *
+     * Claiming tile t + 1 and getting its rows overlaps the product of tile
+     * t; each result tile is put while the other buffer is computed.
+     *
+     * @param pSharedN the node's copy of N, nullptr to get it from the main process
+     */
+    template<typename T>
+    int _MPIMatMulWorkerRMA(const tMatMulCtx& Ctx, const T* pSharedN, MPIProcessorInfo Processor) {
+        typedef typename tGemmTraits<T>::AccType TAcc;
+        tMatMulWindows Wins;
+        MPI_Win_create(nullptr, 0, sizeof(T), MPI_INFO_NULL, MPI_COMM_WORLD, &Wins.WinM);
+        MPI_Win_create(nullptr, 0, sizeof(T), MPI_INFO_NULL, MPI_COMM_WORLD, &Wins.WinN);
+        MPI_Win_create(nullptr, 0, sizeof(TAcc), MPI_INFO_NULL, MPI_COMM_WORLD, &Wins.WinRes);
+        MPI_Win_create(nullptr, 0, sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &Wins.WinNext);
+        for (MPI_Win Win : { Wins.WinM, Wins.WinN, Wins.WinRes, Wins.WinNext }) {
+            MPI_Win_lock_all(MPI_MODE_NOCHECK, Win);
+        }
+
+        Matrix2D<T, tPoolAllocator> MatN;
+        const T* pN = pSharedN;
+        if (pN == nullptr) {
+            REGION_SCOPE("get_n");
+            MatN.Init(Ctx.lNRow, Ctx.lNCol);
+            MPI_Get(MatN.pData(), (int)MatN.Size(), tMPIType<T>::Get(), 0, 0, (int)MatN.Size(), tMPIType<T>::Get(), Wins.WinN);
+            MPI_Win_flush(0, Wins.WinN);
+            REGION_BYTES(MatN.ulDataSize());
+            pN = MatN.pData();
+        }
+
+        const long lTileRows = MatMulRMATileRows(Ctx, Processor.iSize() - 1);
+        const long lTiles = (Ctx.lMRow + lTileRows - 1) / lTileRows;
+        Matrix2D<T, tPoolAllocator> aMatM[2];
+        Matrix2D<TAcc, tPoolAllocator> aMatRes[2];
+        MPI_Request aGets[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL }, aPuts[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL };
+        long aTile[2] = { 0, 0 };
+
+        /** Take the next unclaimed tile from the counter and start getting its rows into buffer iBuf */
+        auto Claim = [&](int iBuf) -> bool {
+            REGION_SCOPE("get");
+            const long lOne = 1;
+            MPI_Fetch_and_op(&lOne, &aTile[iBuf], MPI_LONG, 0, 0, MPI_SUM, Wins.WinNext);
+            MPI_Win_flush(0, Wins.WinNext);
+            if (aTile[iBuf] >= lTiles) return false;
+            const long lLow = aTile[iBuf] * lTileRows;
+            const long lNum = std::min(lTileRows, Ctx.lMRow - lLow);
+            if (not aMatM[iBuf].IsValid()) aMatM[iBuf].Init(lTileRows, Ctx.lMCol);
+            MPI_Rget(aMatM[iBuf].pData(), (int)(lNum * Ctx.lMCol), tMPIType<T>::Get(), 0, lLow * Ctx.lMCol,
+                     (int)(lNum * Ctx.lMCol), tMPIType<T>::Get(), Wins.WinM, &aGets[iBuf]);
+            REGION_BYTES(lNum * Ctx.lMCol * sizeof(T));
+            return true;
+        };
+
+        int iBuf = 0;
+        bool bHave = Claim(iBuf);
+        while (bHave) {
+            const bool bNext = Claim(1 - iBuf);
+            const long lLow = aTile[iBuf] * lTileRows;
+            const long lNum = std::min(lTileRows, Ctx.lMRow - lLow);
+            {
+                REGION_SCOPE("get");
+                MPI_Wait(&aGets[iBuf], MPI_STATUS_IGNORE);
+            }
+            {
+                REGION_SCOPE("put");
+                MPI_Wait(&aPuts[iBuf], MPI_STATUS_IGNORE);
+            }
+            if (not aMatRes[iBuf].IsValid()) aMatRes[iBuf].Init(lTileRows, Ctx.lNCol);
+            {
+                REGION_SCOPE("compute");
+                gemm(aMatRes[iBuf].pData(), aMatM[iBuf].pData(), pN, lNum, Ctx.lMCol, Ctx.lNRow, Ctx.lNCol);
+            }
+            {
+                REGION_SCOPE("put");
+                MPI_Rput(aMatRes[iBuf].pData(), (int)(lNum * Ctx.lNCol), tMPIType<TAcc>::Get(), 0, lLow * Ctx.lNCol,
+                         (int)(lNum * Ctx.lNCol), tMPIType<TAcc>::Get(), Wins.WinRes, &aPuts[iBuf]);
+                REGION_BYTES(lNum * Ctx.lNCol * sizeof(TAcc));
+            }
+            iBuf = 1 - iBuf;
+            bHave = bNext;
+        }
+
+        /** Unlocking completes the puts at the main process */
+        REGION_SCOPE("put");
+        MPI_Waitall(2, aPuts, MPI_STATUSES_IGNORE);
+        for (MPI_Win Win : { Wins.WinM, Wins.WinN, Wins.WinRes, Wins.WinNext }) {
+            MPI_Win_unlock_all(Win);
+        }
+        _MatMulWindowsFree(Wins);
+        return 0;
+    }
+
+    /**
+     * @brief Calculate M @ N, the worker processes (process != 0)
+     *
+     * @tparam T element type, must match the one used by MPIMatMulMain
+     * @param Processor
+     * @return int
+     */
+    template<typename T = double>
+    int MPIMatMulWorker(MPIProcessorInfo Processor) {
+        REGION_SCOPE("MatMulWorker");
+
+        tMatMulCtx Ctx = { 0 };
+        /** Broadcast process context */
+        {
+            REGION_SCOPE("bcast_ctx");
+            MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
+        }
+        if (not Ctx.bValid) {
+            return MATRIX_ERR_SHAPE;
+        }
+        if (Ctx.emType != tMPIType<T>::emType) {
+            /** Main would wait forever for our result */
+            MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_DATA);
+        }
+
+        /** Compute Number of lines in block */
+        long lLineNum = MatMulRows(Ctx, Processor.iSize()).Size(Processor.iRank() - 1);
+
+        const bool bCodec = (Ctx.Codec.emMode != emCodecMode::NONE);
+        int iRet = MPI_SUCCESS;
+
+        /** MatN: the node's shared copy, or a private one */
+        std::unique_ptr<SharedMatrix<T>> pSharedN;
+        Matrix2D<T, tPoolAllocator> MatN;
+        const T* pN = nullptr;
+        if (Ctx.bSharedN) {
+            REGION_SCOPE("bcast_n");
+            pSharedN.reset(new SharedMatrix<T>(Ctx.lNRow, Ctx.lNCol));
+            iRet = pSharedN->Bcast(nullptr, Ctx.Codec);
+            REGION_BYTES(Ctx.lNRow * Ctx.lNCol * sizeof(T));
+            pN = pSharedN->pData();
+        } else if (not Ctx.bRMA) {
+            REGION_SCOPE("bcast_n");
+            MatN.Init(Ctx.lNRow, Ctx.lNCol);
+            if (bCodec) {
+                iRet = CodecBcast(MatN.pData(), MatN.Size(), 0, MPI_COMM_WORLD, Ctx.Codec);
+            } else {
+                MPI_Bcast(MatN.pData(),
+                          (int)MatN.Size(),
+                          tMPIType<T>::Get(),
+                          0,
+                          MPI_COMM_WORLD);
+            }
+            REGION_BYTES(MatN.Size() * sizeof(T));
+            pN = MatN.pData();
+        }
+
+        if (Ctx.bRMA) {
+            if (iRet != MPI_SUCCESS) {
+                MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_DATA);
+            }
+            return _MPIMatMulWorkerRMA<T>(Ctx, pN, Processor);
+        }
+
+        /** Create Buffer for MatM's slice, recycled across calls by the pool */
+        Matrix2D<T, tPoolAllocator> MatMSlice(lLineNum, Ctx.lMCol);
+        Matrix2D<typename tGemmTraits<T>::AccType, tPoolAllocator> MatRes(lLineNum, Ctx.lNCol);
+        if (bCodec) {
+            /** Receive slice */
+            if (iRet == MPI_SUCCESS) {
+                REGION_SCOPE("recv");
+                iRet = CodecRecv(MatMSlice.pData(), MatMSlice.Size(), 0, (int)emMsgType::BLOCK, MPI_COMM_WORLD, Ctx.Codec);
+                REGION_BYTES(MatMSlice.Size() * sizeof(T));
+            }
+            if (iRet != MPI_SUCCESS) {
+                MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_DATA);
+            }
+
+            /** Compute */
+            {
+                REGION_SCOPE("compute");
+                gemm(MatRes.pData(), MatMSlice.pData(), pN, lLineNum, Ctx.lMCol, Ctx.lNRow, Ctx.lNCol);
+            }
+            REGION_SCOPE("send");
+            CodecSend(MatRes.pData(), MatRes.Size(), 0, (int)emMsgType::RESULT, MPI_COMM_WORLD, Ctx.Codec);
+            REGION_BYTES(MatRes.Size() * sizeof(typename tGemmTraits<T>::AccType));
+            return 0;
+        }
+        if (iRet != MPI_SUCCESS) {
+            MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_DATA);
+        }
+
+        /** Every tile is posted up front: later tiles arrive while earlier ones are computed */
+        const long lTiles = MatMulTileCount(Ctx, lLineNum);
+        std::vector<MPI_Request> vecRecvs(lTiles), vecSends(lTiles);
+        for (long lTile = 0; lTile < lTiles; ++lTile) {
+            long lTileLow, lTileNum;
+            MatMulTile(Ctx, lLineNum, lTile, lTileLow, lTileNum);
+            MPI_Irecv(&MatMSlice.pData()[lTileLow * Ctx.lMCol],
+                      lTileNum * Ctx.lMCol,
+                      tMPIType<T>::Get(), 0,
+                      (int)emMsgType::BLOCK,
+                      MPI_COMM_WORLD,
+                      &vecRecvs[lTile]);
+        }
+        for (long lTile = 0; lTile < lTiles; ++lTile) {
+            long lTileLow, lTileNum;
+            MatMulTile(Ctx, lLineNum, lTile, lTileLow, lTileNum);
+            {
+                REGION_SCOPE("recv");
+                MPI_Wait(&vecRecvs[lTile], MPI_STATUS_IGNORE);
+                REGION_BYTES(lTileNum * Ctx.lMCol * sizeof(T));
+            }
+
+            /** Compute */
+            {
+                REGION_SCOPE("compute");
+                gemm(&MatRes.pData()[lTileLow * Ctx.lNCol], &MatMSlice.pData()[lTileLow * Ctx.lMCol], pN,
+                     lTileNum, Ctx.lMCol, Ctx.lNRow, Ctx.lNCol);
+            }
+
+            /** Send result to proc 0 */
+            MPI_Isend(&MatRes.pData()[lTileLow * Ctx.lNCol],
+                      lTileNum * Ctx.lNCol,
+                      tMPIType<typename tGemmTraits<T>::AccType>::Get(),
+                      0,
+                      (int)emMsgType::RESULT,
+                      MPI_COMM_WORLD,
+                      &vecSends[lTile]);
+        }
+        {
+            REGION_SCOPE("send");
+            MPI_Waitall((int)lTiles, vecSends.data(), MPI_STATUSES_IGNORE);
+            REGION_BYTES(MatRes.Size() * sizeof(typename tGemmTraits<T>::AccType));
+        }
+
+        return 0;
+    }
+
+    /**
+     * @brief The context of a batched M[b] @ N[b]
+     *
+     * @struct lBatch number of products
+     * @struct lM, lK, lN shape of a single product
+     * @struct bShareN one N is used for the whole batch
+     */
+    typedef struct {
+        long lBatch;
+        long lM;
+        long lK;
+        long lN;
+        bool bShareN;
+        bool bValid;
+        emMatrixType emType;
+    }tGemmBatchedCtx;
+
+    /**
+     * @brief Scatter the batch, run gemm_batched on every rank, gather
+     *
+     * Unlike MPIMatMulMain the main process keeps a share of the batch: a small
+     * product is too cheap to leave a core idle for. Every message counts whole
+     * matrices through a contiguous datatype, so counts stay far below INT_MAX.
+     *
+     * @param Ctx
+     * @param pM        stacked M on process 0, ignored elsewhere
+     * @param pN        stacked N (or the shared N) on process 0, ignored elsewhere
+     * @param pRes      stacked result on process 0, ignored elsewhere
+     * @param Processor
+     */
+    template<typename T>
+    void _MPIGemmBatched(const tGemmBatchedCtx& Ctx, const T* pM, const T* pN, T* pRes, MPIProcessorInfo Processor) {
+        const long lMSize = Ctx.lM * Ctx.lK, lNSize = Ctx.lK * Ctx.lN, lResSize = Ctx.lM * Ctx.lN;
+        const Partition<long> Batches = Partition<long>::Block(Ctx.lBatch, Processor.iSize());
+        std::vector<int> vecCounts(Processor.iSize()), vecDispls(Processor.iSize());
+        for (auto iProcID = 0; iProcID < Processor.iSize(); ++iProcID) {
+            vecCounts[iProcID] = (int)Batches.Size(iProcID);
+            vecDispls[iProcID] = (int)Batches.Low(iProcID);
+        }
+        const long lLocalBatch = vecCounts[Processor.iRank()];
+
+        /** One element = one matrix */
+        MPI_Datatype MTypeM, MTypeN, MTypeRes;
+        MPI_Type_contiguous((int)lMSize, tMPIType<T>::Get(), &MTypeM);
+        MPI_Type_contiguous((int)lNSize, tMPIType<T>::Get(), &MTypeN);
+        MPI_Type_contiguous((int)lResSize, tMPIType<T>::Get(), &MTypeRes);
+        MPI_Type_commit(&MTypeM);
+        MPI_Type_commit(&MTypeN);
+        MPI_Type_commit(&MTypeRes);
+
+        Matrix2D<T, tPoolAllocator> MatMLocal(lLocalBatch, lMSize);
+        Matrix2D<T, tPoolAllocator> MatNLocal(Ctx.bShareN ? 1 : lLocalBatch, lNSize);
+        Matrix2D<T, tPoolAllocator> MatResLocal(lLocalBatch, lResSize);
+
+        MPI_Scatterv(pM, vecCounts.data(), vecDispls.data(), MTypeM,
+                     MatMLocal.pData(), (int)lLocalBatch, MTypeM,
+                     0, MPI_COMM_WORLD);
+        if (Ctx.bShareN) {
+            if (Processor.iRank() == 0) memcpy(MatNLocal.pData(), pN, MatNLocal.ulDataSize());
+            MPI_Bcast(MatNLocal.pData(), 1, MTypeN, 0, MPI_COMM_WORLD);
+        } else {
+            MPI_Scatterv(pN, vecCounts.data(), vecDispls.data(), MTypeN,
+                         MatNLocal.pData(), (int)lLocalBatch, MTypeN,
+                         0, MPI_COMM_WORLD);
+        }
+
+        /** Compute */
+        mpimath::gemm_batched(MatResLocal.pData(), MatMLocal.pData(), MatNLocal.pData(),
+                              lLocalBatch, Ctx.lM, Ctx.lK, Ctx.lN,
+                              lMSize, Ctx.bShareN ? 0 : lNSize, lResSize);
+
+        MPI_Gatherv(MatResLocal.pData(), (int)lLocalBatch, MTypeRes,
+                    pRes, vecCounts.data(), vecDispls.data(), MTypeRes,
+                    0, MPI_COMM_WORLD);
+
+        MPI_Type_free(&MTypeM);
+        MPI_Type_free(&MTypeN);
+        MPI_Type_free(&MTypeRes);
+    }
+
+    /**
+     * @brief Calculate M[b] @ N[b] for a batch of small matrices, the main process (process 0)
+     *
+     * Matrices are stacked one per row: MatM is batch x (M * K), MatN is
+     * batch x (K * N), or 1 x (K * N) to multiply every M by the same N.
+     *
+     * @param MatM
+     * @param MatN
+     * @param ulM
+     * @param ulK
+     * @param ulN
+     * @param Processor
+     * @return Matrix2D<T> batch x (M * N)
+     */
+    template<typename T>
+    Matrix2D<T> MPIGemmBatchedMain(const Matrix2D<T>& MatM,
+                                   const Matrix2D<T>& MatN,
+                                   size_t ulM,
+                                   size_t ulK,
+                                   size_t ulN,
+                                   MPIProcessorInfo Processor) {
+        tGemmBatchedCtx Ctx = {
+            .lBatch = (long)MatM.ulRow(),
+            .lM = (long)ulM,
+            .lK = (long)ulK,
+            .lN = (long)ulN,
+            .bShareN = (MatN.ulRow() == 1),
+            .bValid = (MatM.ulCol() == ulM * ulK) and (MatN.ulCol() == ulK * ulN) and
+                      (MatN.ulRow() == 1 or MatN.ulRow() == MatM.ulRow()) and
+                      /** Counts and displacements are in matrices, sizes in elements */
+                      (MatM.ulRow() <= INT_MAX) and (ulM * ulK <= INT_MAX) and
+                      (ulK * ulN <= INT_MAX) and (ulM * ulN <= INT_MAX),
+            .emType = tMPIType<T>::emType
         };
         /** Broadcast process context*/
         MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
@@ -89,39 +750,119 @@ namespace mpimath {
             return { 0, 0 };
         }
 
+        Matrix2D<T> MatRes(Ctx.lBatch, ulM * ulN);/** Store Result */
+        _MPIGemmBatched(Ctx, MatM.pData(), MatN.pData(), MatRes.pData(), Processor);
+        return MatRes;
+    }
+
+    /**
+     * @brief Calculate M[b] @ N[b] for a batch of small matrices, the worker processes (process != 0)
+     *
+     * @tparam T element type, must match the one used by MPIGemmBatchedMain
+     * @param Processor
+     * @return int
+     */
+    template<typename T = double>
+    int MPIGemmBatchedWorker(MPIProcessorInfo Processor) {
+        tGemmBatchedCtx Ctx = { 0 };
+        /** Broadcast process context */
+        MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (not Ctx.bValid) {
+            return MATRIX_ERR_SHAPE;
+        }
+        if (Ctx.emType != tMPIType<T>::emType) {
+            MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_DATA);
+        }
+
+        _MPIGemmBatched<T>(Ctx, nullptr, nullptr, nullptr, Processor);
+        return 0;
+    }
+
+    /**
+     * @brief The SpMM context for A @ N, A sparse and N dense
+     *
+     * @struct lARow row of A
+     * @struct lACol col of A
+     * @struct lNnz  nonzeros of A
+     * @struct lNCol col of N
+     */
+    typedef struct {
+        long lARow;
+        long lACol;
+        long lNnz;
+        long lNCol;
+        bool bValid;
+        emMatrixType emType;
+    }tSpMMCtx;
+
+    /**
+     * @brief Calculate A @ N for a CSR matrix A, the main process (process 0)
+     *
+     * Same layout as MPIMatMulMain, except that the rows of A are cut so that
+     * every worker receives about the same number of nonzeros: with skewed
+     * rows an equal row count leaves most ranks waiting for the densest one.
+     *
+     * @tparam T element type
+     * @param MatA
+     * @param MatN
+     * @param Processor
+     * @return Matrix2D<T>
+     */
+    template<typename T>
+    Matrix2D<T> MPISpMMMain(const CSRMatrix<T>& MatA,
+                            const Matrix2D<T>& MatN,
+                            MPIProcessorInfo Processor) {
+        /** Initiate SpMMCtx */
+        tSpMMCtx Ctx = {
+            .lARow = (long)(MatA.ulRow()),
+            .lACol = (long)(MatA.ulCol()),
+            .lNnz = (long)(MatA.ulNnz()),
+            .lNCol = (long)(MatN.ulCol()),
+            .bValid = (MatA.ulCol() == MatN.ulRow()) and
+                      (MatA.ulNnz() <= INT_MAX) and (MatN.Size() <= INT_MAX) and
+                      (MatA.ulRow() * MatN.ulCol() <= INT_MAX),
+            .emType = tMPIType<T>::emType
+        };
+        /** Broadcast process context*/
+        MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (not Ctx.bValid) {
+            return { 0, 0 };
+        }
+        if (Processor.iSize() < 2) {
+            return MatA * MatN;
+        }
+
         /** Broadcast Matrix N */
-        MPI_Bcast(MatN.pData(), (int)MatN.Size(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Bcast(MatN.pData(), (int)MatN.Size(), tMPIType<T>::Get(), 0, MPI_COMM_WORLD);
 
         auto aRequests = new MPI_Request[Processor.iSize()];/** Store Requests */
-        Matrix2D<double> MatRes(Ctx.lMRow, Ctx.lNCol);/** Store Result */
+        Matrix2D<T> MatRes(Ctx.lARow, Ctx.lNCol);/** Store Result */
+        std::vector<size_t> vecRowPtr(Ctx.lARow + 1);
 
         FOR_ALL_SUB_PROC(Processor) {
-            /** Compute line index and number of lines to send for each proc */
-            long lLineIndex = BLOCK_LOW(iProcID - 1,
-                                        Processor.iSize() - 1,
-                                        Ctx.lMRow);
-            long lLineNum = BLOCK_SIZE(iProcID - 1,
-                                       Processor.iSize() - 1,
-                                       Ctx.lMRow);
-
-            /** Send slice */
-            MPI_Send(&MatM.pData()[lLineIndex * Ctx.lMCol],
-                     lLineNum * Ctx.lMCol,
-                     MPI_DOUBLE,
-                     iProcID,
-                     (int)emMsgType::BLOCK,
-                     MPI_COMM_WORLD);
+            /** Rows [lLineIndex, lLineIndex + lLineNum) hold about lNnz / (size - 1) nonzeros */
+            long lLineIndex = (long)NnzBalancedRowLow(MatA.pRowPtr(), MatA.ulRow(), iProcID - 1, Processor.iSize() - 1);
+            long lLineNum = (long)NnzBalancedRowLow(MatA.pRowPtr(), MatA.ulRow(), iProcID, Processor.iSize() - 1) - lLineIndex;
+            const size_t ulNnzLow = MatA.pRowPtr()[lLineIndex];
+            long alSize[2] = { lLineNum, (long)(MatA.pRowPtr()[lLineIndex + lLineNum] - ulNnzLow) };
+
+            /** Send slice: sizes, then rebased row pointers, column indices and values */
+            for (long row = 0; row <= lLineNum; ++row) {
+                vecRowPtr[lLineIndex + row] = MatA.pRowPtr()[lLineIndex + row] - ulNnzLow;
+            }
+            MPI_Send(alSize, 2, MPI_LONG, iProcID, (int)emMsgType::BLOCK_SZ, MPI_COMM_WORLD);
+            MPI_Send(&vecRowPtr[lLineIndex], (int)lLineNum + 1, MPI_UINT64_T, iProcID, (int)emMsgType::BLOCK, MPI_COMM_WORLD);
+            MPI_Send(MatA.pColIdx() + ulNnzLow, (int)alSize[1], MPI_INT32_T, iProcID, (int)emMsgType::BLOCK, MPI_COMM_WORLD);
+            MPI_Send(MatA.pValues() + ulNnzLow, (int)alSize[1], tMPIType<T>::Get(), iProcID, (int)emMsgType::BLOCK, MPI_COMM_WORLD);
 
             /** Receive from workers */
-            // LOGD("[%d] Receiving {RESULT} size=%ld", Processor.iRank(), lLineNum * Ctx.lNCol);
             MPI_Irecv(&MatRes.pData()[lLineIndex * Ctx.lNCol],
                       lLineNum * Ctx.lNCol,
-                      MPI_DOUBLE,
+                      tMPIType<T>::Get(),
                       iProcID,
                       (int)emMsgType::RESULT,
                       MPI_COMM_WORLD,
                       &aRequests[iProcID]);
-
         }
 
         /** Make sure all blocks are received */
@@ -130,7 +871,6 @@ namespace mpimath {
         }
 
         /** Free Requests **/
-        // LOGD("[%d] Freeing {aRequests} %p", Processor.iRank(), aRequests);
         if (aRequests != nullptr) {
             delete[] aRequests;
             aRequests = nullptr;
@@ -140,53 +880,51 @@ namespace mpimath {
     }
 
     /**
-     * @brief Calculate M @ N, the worker processes (process != 0)
+     * @brief Calculate A @ N for a CSR matrix A, the worker processes (process != 0)
      *
+     * @tparam T element type, must match the one used by MPISpMMMain
      * @param Processor
      * @return int
      */
-    int MPIMatMulWorker(MPIProcessorInfo Processor) {
-
-        tMatMulCtx Ctx = { 0 };
+    template<typename T = double>
+    int MPISpMMWorker(MPIProcessorInfo Processor) {
+        tSpMMCtx Ctx = { 0 };
         /** Broadcast process context */
         MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
-
-        /** Compute Number of lines in block */
-        long lLineNum = BLOCK_SIZE(Processor.iRank() - 1,
-                                   Processor.iSize() - 1,
-                                   Ctx.lMRow);
-
-        /** Create Buffer for MatN and MatM's slice */
-        Matrix2D<double> MatMSlice(lLineNum, Ctx.lMCol);
-        Matrix2D<double> MatN(Ctx.lNRow, Ctx.lNCol); /** MatN */
+        if (not Ctx.bValid) {
+            return MATRIX_ERR_SHAPE;
+        }
+        if (Ctx.emType != tMPIType<T>::emType) {
+            MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_DATA);
+        }
 
         /** Broadcast Matrix N */
-        MPI_Bcast(MatN.pData(),
-                  (int)MatN.Size(),
-                  MPI_DOUBLE,
-                  0,
-                  MPI_COMM_WORLD);
+        Matrix2D<T, tPoolAllocator> MatN(Ctx.lACol, Ctx.lNCol);
+        MPI_Bcast(MatN.pData(), (int)MatN.Size(), tMPIType<T>::Get(), 0, MPI_COMM_WORLD);
 
         /** Receive slice */
-        MPI_Recv(MatMSlice.pData(),
-                 MatMSlice.Size(),
-                 MPI_DOUBLE, 0,
-                 (int)emMsgType::BLOCK,
-                 MPI_COMM_WORLD,
-                 MPI_STATUS_IGNORE);
+        long alSize[2] = { 0, 0 };
+        MPI_Recv(alSize, 2, MPI_LONG, 0, (int)emMsgType::BLOCK_SZ, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        std::vector<uint64_t> vecRowPtr(alSize[0] + 1);
+        std::vector<int32_t> vecColIdx(alSize[1]);
+        std::vector<T> vecValues(alSize[1]);
+        MPI_Recv(vecRowPtr.data(), (int)alSize[0] + 1, MPI_UINT64_T, 0, (int)emMsgType::BLOCK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(vecColIdx.data(), (int)alSize[1], MPI_INT32_T, 0, (int)emMsgType::BLOCK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(vecValues.data(), (int)alSize[1], tMPIType<T>::Get(), 0, (int)emMsgType::BLOCK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
         /** Compute */
-        auto MatRes = MatMSlice * MatN;
+        std::vector<size_t> vecOffsets(vecRowPtr.begin(), vecRowPtr.end());
+        CSRMatrix<T> MatASlice(alSize[0], Ctx.lACol, vecOffsets.data(), vecColIdx.data(), vecValues.data());
+        Matrix2D<T, tPoolAllocator> MatRes(alSize[0], Ctx.lNCol);
+        MatASlice.SpMM(MatN, MatRes);
 
         /** Send result to proc 0 */
-        // LOGD("[%d] Sending {RESULT} size=%ld", Processor.iRank(), MatRes.Size());
         MPI_Send(MatRes.pData(),
-                 MatRes.Size(),
-                 MPI_DOUBLE,
+                 (int)MatRes.Size(),
+                 tMPIType<T>::Get(),
                  0,
                  (int)emMsgType::RESULT,
                  MPI_COMM_WORLD);
-
         return 0;
     }
 }
@@ -0,0 +1,307 @@
+/**
+ * @file MatMul25D.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Communication-avoiding 2.5D matrix multiplication on a q x q x c process grid
+ * @version 0.1
+ * @date 2022-06-18
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef MATMUL25D_HPP
+#define MATMUL25D_HPP
+
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include <mpi.h>
+#include <unistd.h>
+
+#include "Allocator.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPIRegionTimer.hpp"
+#include "MatMul.hpp"
+#include "Matrix.hpp"
+#include "SharedMatrix.hpp"
+#include "Partition.hpp"
+#include "gemm.hpp"
+
+/** Share of the free memory of a process the replicas may take */
+#define MATMUL25D_MEMORY_SHARE 0.5
+
+namespace mpimath {
+    /**
+     * @brief A q x q x c process grid: c layers, each with a q x q copy of the operands
+     *
+     * @struct iSide        q
+     * @struct iReplicas    c, 1 for plain 2D SUMMA
+     */
+    typedef struct {
+        int iSide;
+        int iReplicas;
+    } tGrid25D;
+
+    /** MPIMATH_25D_REPLICAS=c fixes the replication factor, 0 or unset chooses it */
+    inline int Replicas25DFromEnv() {
+        const char* sEnv = getenv("MPIMATH_25D_REPLICAS");
+        return sEnv == nullptr ? 0 : std::max(0, atoi(sEnv));
+    }
+
+    /**
+     * @brief Bytes one process holds for lM x lK @ lK x lN on a grid of side
+     * iSide: its blocks of M and N, one panel of each, the partial result and
+     * one product
+     *
+     */
+    inline size_t MatMul25DBytes(long lM, long lK, long lN, int iSide, size_t ulElemBytes, size_t ulAccBytes) {
+        const size_t ulM = (lM + iSide - 1) / iSide, ulK = (lK + iSide - 1) / iSide, ulN = (lN + iSide - 1) / iSide;
+        return 2 * (ulM * ulK + ulK * ulN) * ulElemBytes + 2 * ulM * ulN * ulAccBytes;
+    }
+
+    /**
+     * @brief Cost of the product on a grid, in flops per process
+     *
+     * Every layer runs ceil(q / c) of the q SUMMA steps, each receiving a
+     * block of M along the process row and one of N along the column; the
+     * replicas cost one broadcast of the blocks down the layers and one
+     * reduction of the result back up. With P = q^2 c the SUMMA steps move
+     * 2n^2 / sqrt(Pc) words per process instead of 2n^2 / sqrt(P); the
+     * replication and reduction terms make that pay off only on large grids.
+     */
+    inline double MatMul25DCost(long lM, long lK, long lN, tGrid25D Grid, double dWordCost = MATMUL_WORD_COST) {
+        const double dQ = Grid.iSide, dC = Grid.iReplicas;
+        const double dBlockM = (double)lM * (double)lK / (dQ * dQ), dBlockN = (double)lK * (double)lN / (dQ * dQ);
+        const double dFlops = 2.0 * (double)lM * (double)lK * (double)lN / (dQ * dQ * dC);
+        double dWords = std::ceil(dQ / dC) * (dBlockM + dBlockN) * (dQ - 1) / dQ;
+        if (Grid.iReplicas > 1) dWords += dBlockM + dBlockN + (double)lM * (double)lN / (dQ * dQ);
+        return dFlops + dWordCost * dWords;
+    }
+
+    /**
+     * @brief Free memory per process, the smallest over MPI_COMM_WORLD, collective
+     *
+     * The available pages of the node shared by the processes on it.
+     */
+    inline size_t MatMul25DAvailBytes() {
+        const long lPages = sysconf(_SC_AVPHYS_PAGES), lPageSize = sysconf(_SC_PAGESIZE);
+        unsigned long ulBytes = std::numeric_limits<unsigned long>::max();
+        if (lPages > 0 and lPageSize > 0) ulBytes = (unsigned long)lPages * (unsigned long)lPageSize / NodeComms().iNodeSize;
+        unsigned long ulMin = ulBytes;
+        MPI_Allreduce(&ulBytes, &ulMin, 1, MPI_UNSIGNED_LONG, MPI_MIN, MPI_COMM_WORLD);
+        return (size_t)ulMin;
+    }
+
+    /**
+     * @brief The cheapest grid on at most iSize processes whose blocks fit in
+     * MATMUL25D_MEMORY_SHARE of ulAvailBytes
+     *
+     * c runs up to q: more layers than that would have no SUMMA step to do.
+     * When no replicated grid fits, c = 1.
+     *
+     * @param iReplicas c to use (the largest q for it), 0 to choose
+     */
+    inline tGrid25D MatMul25DGrid(long lM, long lK, long lN, int iSize, size_t ulElemBytes, size_t ulAccBytes,
+                                  size_t ulAvailBytes, int iReplicas = 0) {
+        auto Side = [iSize](int iC) { return std::max(1, (int)std::floor(std::sqrt((double)iSize / iC + 1e-9))); };
+        if (iReplicas > 0) {
+            iReplicas = std::min(iReplicas, iSize);
+            return { Side(iReplicas), iReplicas };
+        }
+        tGrid25D Best = { Side(1), 1 };
+        double dBest = MatMul25DCost(lM, lK, lN, Best);
+        for (int iC = 2; iC <= iSize; ++iC) {
+            const tGrid25D Grid = { Side(iC), iC };
+            if (Grid.iReplicas > Grid.iSide) break;
+            if (MatMul25DBytes(lM, lK, lN, Grid.iSide, ulElemBytes, ulAccBytes) > MATMUL25D_MEMORY_SHARE * ulAvailBytes) continue;
+            const double dCost = MatMul25DCost(lM, lK, lN, Grid);
+            if (dCost < dBest) {
+                dBest = dCost;
+                Best = Grid;
+            }
+        }
+        return Best;
+    }
+
+    /**
+     * @brief Move the q x q blocks of a lRow x lCol matrix between the main
+     * process and layer 0 of the grid, Scatterv / Gatherv over CartComm
+     *
+     * Block (i, j) is part i of the rows and part j of the columns in the
+     * BLOCK partition over q, and belongs to cartesian rank (i q + j) c.
+     */
+    template<typename T>
+    void _Blocks25D(T* pFull, T* pBlock, long lRow, long lCol, tGrid25D Grid, MPI_Comm CartComm, bool bScatter) {
+        const int iSide = Grid.iSide, iSize = Grid.iSide * Grid.iSide * Grid.iReplicas;
+        const Partition<long> Rows = Partition<long>::Block(lRow, iSide), Cols = Partition<long>::Block(lCol, iSide);
+        int iRank;
+        MPI_Comm_rank(CartComm, &iRank);
+        std::vector<int> vecCounts, vecDispls;
+        Matrix2D<T, tPoolAllocator> MatPack;
+        if (iRank == 0) {
+            vecCounts.assign(iSize, 0);
+            vecDispls.assign(iSize, 0);
+            MatPack.Init(lRow, lCol);
+            long lOffset = 0;
+            for (int i = 0; i < iSide; ++i) {
+                for (int j = 0; j < iSide; ++j) {
+                    const int iDest = (i * iSide + j) * Grid.iReplicas;
+                    vecCounts[iDest] = (int)(Rows.Size(i) * Cols.Size(j));
+                    vecDispls[iDest] = (int)lOffset;
+                    lOffset += vecCounts[iDest];
+                }
+            }
+        }
+        auto Pack = [&](bool bToBlocks) {
+            long lOffset = 0;
+            for (int i = 0; i < iSide; ++i) {
+                for (int j = 0; j < iSide; ++j) {
+                    const long lCol0 = Cols.Low(j), lWidth = Cols.Size(j);
+                    for (long r = Rows.Low(i); r <= Rows.High(i); ++r, lOffset += lWidth) {
+                        T* pRow = pFull + r * lCol + lCol0;
+                        if (bToBlocks) {
+                            memcpy(MatPack.pData() + lOffset, pRow, lWidth * sizeof(T));
+                        } else {
+                            memcpy(pRow, MatPack.pData() + lOffset, lWidth * sizeof(T));
+                        }
+                    }
+                }
+            }
+        };
+        int iCoords[3];
+        MPI_Cart_coords(CartComm, iRank, 3, iCoords);
+        const int iCount = iCoords[2] == 0 ? (int)(Rows.Size(iCoords[0]) * Cols.Size(iCoords[1])) : 0;
+        if (bScatter) {
+            if (iRank == 0) Pack(true);
+            MPI_Scatterv(MatPack.pData(), vecCounts.data(), vecDispls.data(), tMPIType<T>::Get(), pBlock, iCount,
+                         tMPIType<T>::Get(), 0, CartComm);
+        } else {
+            MPI_Gatherv(pBlock, iCount, tMPIType<T>::Get(), MatPack.pData(), vecCounts.data(), vecDispls.data(),
+                        tMPIType<T>::Get(), 0, CartComm);
+            if (iRank == 0) Pack(false);
+        }
+    }
+
+    /**
+     * @brief M @ N with the 2.5D algorithm, collective over MPI_COMM_WORLD
+     *
+     * The processes, taken node by node from MPITopology(), form a q x q x c
+     * grid (MPI_Cart_create, the rest idle). Layer 0 receives the q x q
+     * blocks of M and N, broadcasts them down the layers, and layer l runs
+     * SUMMA steps l, l + c, ... (MPI_Cart_sub gives the row, column and layer
+     * communicators). The partial results are summed back into layer 0 and
+     * gathered. Replicating the operands c times cuts the words each process
+     * receives by sqrt(c) against 2D SUMMA.
+     *
+     * MatM and MatN are read on the main process only, like MPIMatMulMain;
+     * the result lands there and is empty elsewhere.
+     *
+     * @param iReplicas c, 0 for MPIMATH_25D_REPLICAS or else the cheapest
+     * grid that fits in memory (MatMul25DGrid)
+     * @param pGrid if not null, the grid that was used
+     */
+    template<typename T>
+    Matrix2D<typename tGemmTraits<T>::AccType> MPIMatMul25D(const Matrix2D<T>& MatM,
+                                                            const Matrix2D<T>& MatN,
+                                                            MPIProcessorInfo Processor,
+                                                            int iReplicas = 0,
+                                                            tGrid25D* pGrid = nullptr) {
+        typedef typename tGemmTraits<T>::AccType TAcc;
+        REGION_SCOPE("MatMul25D");
+        /** Shape, validity and replication factor as the main process sees them */
+        long alShape[5] = { (long)MatM.ulRow(), (long)MatM.ulCol(), (long)MatN.ulCol(), MatM.ulCol() == MatN.ulRow(),
+                            iReplicas > 0 ? iReplicas : Replicas25DFromEnv() };
+        MPI_Bcast(alShape, 5, MPI_LONG, 0, MPI_COMM_WORLD);
+        if (not alShape[3]) return { 0, 0 };
+        const long lM = alShape[0], lK = alShape[1], lN = alShape[2];
+        iReplicas = (int)alShape[4];
+        const size_t ulAvail = iReplicas > 0 ? 0 : MatMul25DAvailBytes();
+        const tGrid25D Grid = MatMul25DGrid(lM, lK, lN, Processor.iSize(), sizeof(T), sizeof(TAcc), ulAvail, iReplicas);
+        if (pGrid != nullptr) *pGrid = Grid;
+        const int iSide = Grid.iSide, iUsed = Grid.iSide * Grid.iSide * Grid.iReplicas;
+
+        Matrix2D<TAcc> MatRes;
+        ON_MAIN_PROC(Processor) {
+            MatRes.Init(lM, lN);
+        }
+        /**
+         * Grid ranks follow the nodes: the layers of one block, which exchange
+         * whole blocks, are neighbours and so share a node whenever c divides
+         * the processes per node, whatever the rank placement of mpirun
+         */
+        const std::vector<int>& vecNodeMajor = Processor.Topology().vecNodeMajor;
+        const int iPlace = (int)(std::find(vecNodeMajor.begin(), vecNodeMajor.end(), Processor.iRank()) - vecNodeMajor.begin());
+        MPI_Comm ActiveComm, CartComm, RowComm, ColComm, LayerComm;
+        MPI_Comm_split(MPI_COMM_WORLD, iPlace < iUsed ? 0 : MPI_UNDEFINED, iPlace, &ActiveComm);
+        if (ActiveComm == MPI_COMM_NULL) return MatRes;
+
+        /** No reordering: world rank 0 stays at (0, 0, 0) */
+        int aiDims[3] = { iSide, iSide, Grid.iReplicas }, aiPeriods[3] = { 0, 0, 0 }, aiCoords[3];
+        MPI_Cart_create(ActiveComm, 3, aiDims, aiPeriods, 0, &CartComm);
+        int iCartRank;
+        MPI_Comm_rank(CartComm, &iCartRank);
+        MPI_Cart_coords(CartComm, iCartRank, 3, aiCoords);
+        const int aiRow[3] = { 0, 1, 0 }, aiCol[3] = { 1, 0, 0 }, aiLayer[3] = { 0, 0, 1 };
+        MPI_Cart_sub(CartComm, aiRow, &RowComm);
+        MPI_Cart_sub(CartComm, aiCol, &ColComm);
+        MPI_Cart_sub(CartComm, aiLayer, &LayerComm);
+        const int i = aiCoords[0], j = aiCoords[1], l = aiCoords[2];
+
+        const Partition<long> RowsM = Partition<long>::Block(lM, iSide), Inner = Partition<long>::Block(lK, iSide),
+                              ColsN = Partition<long>::Block(lN, iSide);
+        const long lLocRow = RowsM.Size(i), lLocCol = ColsN.Size(j);
+        Matrix2D<T, tPoolAllocator> MatA(lLocRow, Inner.Size(j)), MatB(Inner.Size(i), lLocCol);
+        {
+            REGION_SCOPE("scatter");
+            _Blocks25D((T*)MatM.pData(), MatA.pData(), lM, lK, Grid, CartComm, true);
+            _Blocks25D((T*)MatN.pData(), MatB.pData(), lK, lN, Grid, CartComm, true);
+        }
+        if (Grid.iReplicas > 1) {
+            REGION_SCOPE("replicate");
+            MPI_Bcast(MatA.pData(), (int)MatA.Size(), tMPIType<T>::Get(), 0, LayerComm);
+            MPI_Bcast(MatB.pData(), (int)MatB.Size(), tMPIType<T>::Get(), 0, LayerComm);
+            REGION_BYTES(MatA.ulDataSize() + MatB.ulDataSize());
+        }
+
+        /** Steps l, l + c, ...: block column p of M along the row, block row p of N down the column */
+        const long lMaxInner = (lK + iSide - 1) / iSide;
+        Matrix2D<T, tPoolAllocator> MatPanelA(lLocRow, lMaxInner), MatPanelB(lMaxInner, lLocCol);
+        Matrix2D<TAcc, tPoolAllocator> MatAcc(lLocRow, lLocCol, true), MatProd(lLocRow, lLocCol);
+        bool bFirst = true;
+        for (int p = l; p < iSide; p += Grid.iReplicas) {
+            const long lInner = Inner.Size(p);
+            const T* pPanelA = j == p ? MatA.pData() : MatPanelA.pData();
+            const T* pPanelB = i == p ? MatB.pData() : MatPanelB.pData();
+            {
+                REGION_SCOPE("bcast");
+                MPI_Bcast((void*)pPanelA, (int)(lLocRow * lInner), tMPIType<T>::Get(), p, RowComm);
+                MPI_Bcast((void*)pPanelB, (int)(lInner * lLocCol), tMPIType<T>::Get(), p, ColComm);
+                REGION_BYTES((lLocRow + lLocCol) * lInner * sizeof(T));
+            }
+            if (lLocRow == 0 or lLocCol == 0) continue;
+            REGION_SCOPE("compute");
+            gemm(bFirst ? MatAcc.pData() : MatProd.pData(), pPanelA, pPanelB, lLocRow, lInner, lInner, lLocCol);
+            if (not bFirst) {
+                for (size_t idx = 0; idx < MatProd.Size(); ++idx) MatAcc.pData()[idx] += MatProd.pData()[idx];
+            }
+            bFirst = false;
+        }
+        if (Grid.iReplicas > 1) {
+            REGION_SCOPE("reduce");
+            MPI_Reduce(l == 0 ? MPI_IN_PLACE : MatAcc.pData(), MatAcc.pData(), (int)MatAcc.Size(), tMPIType<TAcc>::Get(),
+                       MPI_SUM, 0, LayerComm);
+            REGION_BYTES(MatAcc.ulDataSize());
+        }
+        {
+            REGION_SCOPE("gather");
+            _Blocks25D(MatRes.pData(), MatAcc.pData(), lM, lN, Grid, CartComm, false);
+        }
+
+        for (MPI_Comm* pComm : { &RowComm, &ColComm, &LayerComm, &CartComm, &ActiveComm }) MPI_Comm_free(pComm);
+        return MatRes;
+    }
+}
+
+#endif
@@ -0,0 +1,240 @@
+/**
+ * @file MatMulPlan.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief MPIMatMulMain for many products of one shape: persistent requests,
+ * committed datatypes and buffers set up once
+ * @version 0.1
+ * @date 2022-06-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef MATMULPLAN_HPP
+#define MATMULPLAN_HPP
+
+#include <vector>
+
+#include <mpi.h>
+
+#include "Allocator.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPIRegionTimer.hpp"
+#include "MatMul.hpp"
+#include "Matrix.hpp"
+#include "Partition.hpp"
+#include "gemm.hpp"
+
+namespace mpimath {
+    /**
+     * @brief M @ N with the row blocks and tiles of MPIMatMulMain, prepared once
+     *
+     * The constructor is collective: the main process broadcasts the shape,
+     * every process commits one row datatype per matrix, allocates its
+     * buffers and binds them to MPI_Send_init / MPI_Recv_init requests, one
+     * per tile. Execute() is then MPI_Startall / MPI_Waitall on the main
+     * process and a start per tile on the workers, with no context broadcast
+     * and no request allocation. N is broadcast on every Execute(), as a
+     * persistent collective when the library implements MPI 4.
+     *
+     * Every process calls Execute() the same number of times. The plan must
+     * be destroyed before MPI_Finalize. Codec and shared N are not used.
+     *
+     * @tparam T element type
+     */
+    template<typename T>
+    class MatMulPlan {
+    public:
+        typedef typename tGemmTraits<T>::AccType TAcc;
+
+        /**
+         * @brief Plan lMRow x lMCol @ lMCol x lNCol, the shape counts on the main process only
+         *
+         * @param lTileRows rows per message, -1 for MatMulTileRows(), 0 for one message per worker
+         */
+        MatMulPlan(long lMRow, long lMCol, long lNCol, MPIProcessorInfo Processor, long lTileRows = -1)
+            : _Processor(Processor) {
+            REGION_SCOPE("MatMulPlan");
+            ON_MAIN_PROC(Processor) {
+                _Ctx = {
+                    .lNRow = lMCol,
+                    .lNCol = lNCol,
+                    .lMRow = lMRow,
+                    .lMCol = lMCol,
+                    .bValid = lMRow >= 0 and lMCol >= 0 and lNCol >= 0,
+                    .emType = tMPIType<T>::emType,
+                    .Codec = { emCodecMode::NONE },
+                    .bSharedN = false,
+                    .lTileRows = lTileRows >= 0 ? lTileRows : MatMulTileRows(lMRow, lMCol, lNCol),
+                };
+            }
+            MPI_Bcast(&_Ctx, sizeof(_Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
+            if (not _Ctx.bValid) return;
+            if (_Ctx.emType != tMPIType<T>::emType) {
+                MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_DATA);
+            }
+
+            /** Counts are rows, far below INT_MAX for any matrix that fits */
+            MPI_Type_contiguous((int)_Ctx.lMCol, tMPIType<T>::Get(), &_MRowType);
+            MPI_Type_contiguous((int)_Ctx.lNCol, tMPIType<T>::Get(), &_NRowType);
+            MPI_Type_contiguous((int)_Ctx.lNCol, tMPIType<TAcc>::Get(), &_ResRowType);
+            MPI_Type_commit(&_MRowType);
+            MPI_Type_commit(&_NRowType);
+            MPI_Type_commit(&_ResRowType);
+
+            _MatN.Init(_Ctx.lNRow, _Ctx.lNCol);
+            const Partition<long> Rows = MatMulRows(_Ctx, Processor.iSize());
+            ON_MAIN_PROC(Processor) {
+                _MatM.Init(_Ctx.lMRow, _Ctx.lMCol);
+                _MatRes.Init(_Ctx.lMRow, _Ctx.lNCol);
+
+                /** Tile t of every worker before tile t + 1 of any, as in MPIMatMulMain */
+                long lMaxTiles = 1;
+                FOR_ALL_SUB_PROC(Processor) {
+                    lMaxTiles = std::max(lMaxTiles, MatMulTileCount(_Ctx, Rows.Size(iProcID - 1)));
+                }
+                for (long lTile = 0; lTile < lMaxTiles; ++lTile) {
+                    FOR_ALL_SUB_PROC(Processor) {
+                        long lLineIndex = Rows.Low(iProcID - 1);
+                        long lLineNum = Rows.Size(iProcID - 1);
+                        if (lTile >= MatMulTileCount(_Ctx, lLineNum)) continue;
+                        long lTileLow, lTileNum;
+                        MatMulTile(_Ctx, lLineNum, lTile, lTileLow, lTileNum);
+                        lLineIndex += lTileLow;
+                        _vecRequests.emplace_back();
+                        MPI_Send_init(_MatM.pData() + lLineIndex * _Ctx.lMCol, (int)lTileNum, _MRowType, iProcID,
+                                      (int)emMsgType::BLOCK, MPI_COMM_WORLD, &_vecRequests.back());
+                        _vecRequests.emplace_back();
+                        MPI_Recv_init(_MatRes.pData() + lLineIndex * _Ctx.lNCol, (int)lTileNum, _ResRowType, iProcID,
+                                      (int)emMsgType::RESULT, MPI_COMM_WORLD, &_vecRequests.back());
+                    }
+                }
+            } else {
+                _lLineNum = Rows.Size(Processor.iRank() - 1);
+                _MatM.Init(_lLineNum, _Ctx.lMCol);
+                _MatRes.Init(_lLineNum, _Ctx.lNCol);
+                const long lTiles = MatMulTileCount(_Ctx, _lLineNum);
+                _vecRequests.resize(2 * lTiles);
+                for (long lTile = 0; lTile < lTiles; ++lTile) {
+                    long lTileLow, lTileNum;
+                    MatMulTile(_Ctx, _lLineNum, lTile, lTileLow, lTileNum);
+                    MPI_Recv_init(_MatM.pData() + lTileLow * _Ctx.lMCol, (int)lTileNum, _MRowType, 0,
+                                  (int)emMsgType::BLOCK, MPI_COMM_WORLD, &_vecRequests[lTile]);
+                    MPI_Send_init(_MatRes.pData() + lTileLow * _Ctx.lNCol, (int)lTileNum, _ResRowType, 0,
+                                  (int)emMsgType::RESULT, MPI_COMM_WORLD, &_vecRequests[lTiles + lTile]);
+                }
+            }
+#if MPI_VERSION >= 4
+            MPI_Bcast_init(_MatN.pData(), (int)_Ctx.lNRow, _NRowType, 0, MPI_COMM_WORLD, MPI_INFO_NULL, &_BcastRequest);
+#endif
+        }
+
+        MatMulPlan(const MatMulPlan&) = delete;
+        MatMulPlan& operator=(const MatMulPlan&) = delete;
+
+        ~MatMulPlan() {
+            for (auto& Request : _vecRequests) MPI_Request_free(&Request);
+#if MPI_VERSION >= 4
+            if (_BcastRequest != MPI_REQUEST_NULL) MPI_Request_free(&_BcastRequest);
+#endif
+            for (MPI_Datatype* pType : { &_MRowType, &_NRowType, &_ResRowType }) {
+                if (*pType != MPI_DATATYPE_NULL) MPI_Type_free(pType);
+            }
+        }
+
+        inline bool IsValid() const { return _Ctx.bValid; }
+
+        /** The operands, on the main process; filling them in place saves the copy of Execute(MatM, MatN) */
+        inline Matrix2D<T, tPoolAllocator>& M() { return _MatM; }
+
+        inline Matrix2D<T, tPoolAllocator>& N() { return _MatN; }
+
+        /** The product of the last Execute(), on the main process */
+        inline const Matrix2D<TAcc, tPoolAllocator>& Result() const { return _MatRes; }
+
+        /**
+         * @brief M() @ N() into Result(), collective
+         *
+         * @return int MATRIX_ERR_SHAPE if the planned shape was invalid
+         */
+        int Execute() {
+            if (not _Ctx.bValid) return MATRIX_ERR_SHAPE;
+            REGION_SCOPE("MatMulPlan");
+            {
+                REGION_SCOPE("bcast_n");
+#if MPI_VERSION >= 4
+                MPI_Start(&_BcastRequest);
+                MPI_Wait(&_BcastRequest, MPI_STATUS_IGNORE);
+#else
+                MPI_Bcast(_MatN.pData(), (int)_Ctx.lNRow, _NRowType, 0, MPI_COMM_WORLD);
+#endif
+                REGION_BYTES(_MatN.ulDataSize());
+            }
+            ON_MAIN_PROC(_Processor) {
+                if (_Processor.iSize() == 1) {
+                    REGION_SCOPE("compute");
+                    gemm(_MatRes.pData(), _MatM.pData(), _MatN.pData(), _Ctx.lMRow, _Ctx.lMCol, _Ctx.lNRow, _Ctx.lNCol);
+                    return MATRIX_OK;
+                }
+                REGION_SCOPE("scatter_gather");
+                MPI_Startall((int)_vecRequests.size(), _vecRequests.data());
+                MPI_Waitall((int)_vecRequests.size(), _vecRequests.data(), MPI_STATUSES_IGNORE);
+                REGION_BYTES(_MatM.ulDataSize() + _MatRes.ulDataSize());
+                return MATRIX_OK;
+            }
+
+            /** Receives first: later tiles arrive while earlier ones are computed */
+            const long lTiles = (long)_vecRequests.size() / 2;
+            MPI_Startall((int)lTiles, _vecRequests.data());
+            for (long lTile = 0; lTile < lTiles; ++lTile) {
+                long lTileLow, lTileNum;
+                MatMulTile(_Ctx, _lLineNum, lTile, lTileLow, lTileNum);
+                {
+                    REGION_SCOPE("recv");
+                    MPI_Wait(&_vecRequests[lTile], MPI_STATUS_IGNORE);
+                }
+                {
+                    REGION_SCOPE("compute");
+                    gemm(_MatRes.pData() + lTileLow * _Ctx.lNCol, _MatM.pData() + lTileLow * _Ctx.lMCol, _MatN.pData(),
+                         lTileNum, _Ctx.lMCol, _Ctx.lNRow, _Ctx.lNCol);
+                }
+                MPI_Start(&_vecRequests[lTiles + lTile]);
+            }
+            REGION_SCOPE("send");
+            MPI_Waitall((int)lTiles, _vecRequests.data() + lTiles, MPI_STATUSES_IGNORE);
+            return MATRIX_OK;
+        }
+
+        /**
+         * @brief Copy MatM and MatN (main process only, ignored elsewhere) into the plan and Execute()
+         *
+         * Aborts if they do not have the planned shape: the workers are already
+         * waiting for N and can not back out.
+         */
+        int Execute(const Matrix2D<T>& MatM, const Matrix2D<T>& MatN) {
+            ON_MAIN_PROC(_Processor) {
+                if ((long)MatM.ulRow() != _Ctx.lMRow or (long)MatM.ulCol() != _Ctx.lMCol or
+                    (long)MatN.ulRow() != _Ctx.lNRow or (long)MatN.ulCol() != _Ctx.lNCol) {
+                    MPI_Abort(MPI_COMM_WORLD, MATRIX_ERR_SHAPE);
+                }
+                if (MatM.Size() > 0) memcpy(_MatM.pData(), MatM.pData(), MatM.ulDataSize());
+                if (MatN.Size() > 0) memcpy(_MatN.pData(), MatN.pData(), MatN.ulDataSize());
+            }
+            return Execute();
+        }
+
+    protected:
+        MPIProcessorInfo _Processor;
+        tMatMulCtx _Ctx = {};
+        long _lLineNum = 0;
+        MPI_Datatype _MRowType = MPI_DATATYPE_NULL, _NRowType = MPI_DATATYPE_NULL, _ResRowType = MPI_DATATYPE_NULL;
+        /** Main: send M, receive result per tile of every worker; worker: receives of its tiles, then sends */
+        std::vector<MPI_Request> _vecRequests;
+#if MPI_VERSION >= 4
+        MPI_Request _BcastRequest = MPI_REQUEST_NULL;
+#endif
+        Matrix2D<T, tPoolAllocator> _MatM, _MatN;
+        Matrix2D<TAcc, tPoolAllocator> _MatRes;
+    };
+}
+
+#endif
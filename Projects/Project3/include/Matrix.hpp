@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <type_traits>
 #include <vector>
 
 
@@ -27,6 +28,8 @@
 #include <emmintrin.h>
 #endif
 
+#include "Allocator.hpp"
+#include "csv.hpp"
 #include "gemm.hpp"
 
 namespace mpimath {
@@ -51,12 +54,16 @@ namespace mpimath {
     template<typename T>
     class Matrix2DRow;
 
+    template<typename E>
+    struct tMatExpr;
+
     /**
      * @brief Matrix 2D class, stores 2D matrix
      *
      * @tparam T data type
+     * @tparam Alloc buffer allocator policy, see Allocator.hpp
      */
-    template<typename T>
+    template<typename T, typename Alloc = tAlignedAllocator>
     class Matrix2D {
     public:
         /**
@@ -70,13 +77,22 @@ namespace mpimath {
          *
          * @param Src
          */
-        Matrix2D(const Matrix2D<T>& Src) {
+        Matrix2D(const Matrix2D<T, Alloc>& Src) {
             Init(Src._ulRow, Src._ulCol, false);
             if (_pData != nullptr) {
                 memcpy(_pData, Src._pData, Src._ulDataSize);
             }
         }
 
+        /**
+         * @brief Take the buffer of Src, which is left empty
+         *
+         * @param Src
+         */
+        Matrix2D(Matrix2D<T, Alloc>&& Src) noexcept {
+            _Swap(Src);
+        }
+
         /**
          * @brief Construct a new Matrix 2D object with parames
          *
@@ -88,6 +104,18 @@ namespace mpimath {
             Init(ulRow, ulCol, bFillZero);
         }
 
+        /**
+         * @brief Construct a new Matrix 2D object by evaluating an expression,
+         * see MatrixExpr.hpp
+         *
+         * @param Expr
+         */
+        template<typename E>
+        Matrix2D(const tMatExpr<E>& Expr) {
+            Init(Expr.Derived().ulRow(), Expr.Derived().ulCol(), false);
+            Expr.EvalInto(_pData);
+        }
+
         /**
          * @brief Init the matrix
          *
@@ -96,23 +124,13 @@ namespace mpimath {
          * @param bFillZero
          */
         void Init(size_t ulRow, size_t ulCol, bool bFillZero = false) {
-            if (_pData) {
-                delete[] _pData;
-            }
+            _Free();
             this->_ulRow = ulRow;
             this->_ulCol = ulCol;
             this->_ulDataSize = sizeof(T) * ulRow * ulCol;
-            if (this->_ulDataSize > 0) {
-#ifdef __AVX__
-                _pData = (T*)_mm_malloc(sizeof(T) * _ulDataSize, 32);
-#else
-                _pData = (T*)malloc(sizeof(T) * _ulDataSize);
-#endif
-                if (_pData != nullptr and bFillZero) {
-                    bzero(_pData, _ulDataSize);
-                }
-            } else {
-                _pData = nullptr;
+            _pData = _Alloc(_ulDataSize);
+            if (_pData != nullptr and bFillZero) {
+                bzero(_pData, _ulDataSize);
             }
         }
 
@@ -121,14 +139,7 @@ namespace mpimath {
          *
          */
         ~Matrix2D() {
-            if (_pData != nullptr) {
-#ifdef __AVX__
-                _mm_free(_pData);
-#else
-                free(_pData);
-#endif
-                _pData = nullptr;
-            }
+            _Free();
         }
 
         inline T* pData() const { return _pData; };
@@ -162,28 +173,57 @@ namespace mpimath {
          * @param Src
          * @return Matrix2D<T>&
          */
-        Matrix2D<T>& operator=(const Matrix2D<T>& Src) {
+        Matrix2D<T, Alloc>& operator=(const Matrix2D<T, Alloc>& Src) {
             if (this != &Src) {
-                if (_pData != nullptr) {
-#ifdef __AVX__
-                _mm_free(_pData);
-#else
-                free(_pData);
-#endif
-                    _pData = nullptr;
+                /** Same size: keep the buffer */
+                if (_ulDataSize != Src._ulDataSize) {
+                    _Free();
+                    _ulDataSize = Src._ulDataSize;
+                    _pData = _Alloc(_ulDataSize);
                 }
                 _ulCol = Src._ulCol;
                 _ulRow = Src._ulRow;
-                _ulDataSize = Src._ulDataSize;
+                if (_pData != nullptr) {
+                    memcpy(_pData, Src._pData, Src._ulDataSize);
+                }
+            }
 
-#ifdef __AVX__
-                _pData = (T*)_mm_malloc(sizeof(T) * Src._ulDataSize, 32);
-#else
-                _pData = (T*)malloc(sizeof(T) * Src._ulDataSize);
-#endif
-                memcpy(_pData, Src._pData, Src._ulDataSize);
+            return *this;
+        }
+
+        /**
+         * @brief Move assignment, the old buffer goes away with Src
+         *
+         * @param Src
+         * @return Matrix2D<T>&
+         */
+        Matrix2D<T, Alloc>& operator=(Matrix2D<T, Alloc>&& Src) noexcept {
+            if (this != &Src) {
+                _Swap(Src);
             }
+            return *this;
+        }
 
+        /**
+         * @brief Evaluate an expression into the matrix in a single pass
+         *
+         * The expression may read the matrix itself element-wise (C = a * C + B).
+         * If the shape changes or the matrix is an operand of a Prod() node,
+         * the result goes to a new buffer first.
+         *
+         * @param Expr
+         * @return Matrix2D<T>&
+         */
+        template<typename E>
+        Matrix2D<T, Alloc>& operator=(const tMatExpr<E>& Expr) {
+            const E& Derived = Expr.Derived();
+            if (_pData != nullptr and _ulRow == Derived.ulRow() and _ulCol == Derived.ulCol() and
+                not Derived.ProdReads(_pData)) {
+                Expr.EvalInto(_pData);
+            } else {
+                Matrix2D<T, Alloc> Tmp(Expr);
+                _Swap(Tmp);
+            }
             return *this;
         }
 
@@ -204,7 +244,7 @@ namespace mpimath {
          * @param Src
          * @return std::ostream&
          */
-        friend std::ostream& operator<<(std::ostream& OutStream, const Matrix2D<T>& Src) {
+        friend std::ostream& operator<<(std::ostream& OutStream, const Matrix2D<T, Alloc>& Src) {
             int row = 0, col = 0;
             OutStream << "array([";
             for (auto row = 0; row < Src._ulRow; ++row) {
@@ -241,11 +281,7 @@ namespace mpimath {
             /** If the matrix is valid */
             if (IsValid()) {
                 /** Make new place for data */
-#ifdef __AVX__
-                auto pNewData = (T*)_mm_malloc(sizeof(T) * this->_ulDataSize, 32);
-#else
-                auto pNewData = (T*)malloc(sizeof(T) * this->_ulDataSize);
-#endif
+                auto pNewData = _Alloc(this->_ulDataSize);
                 /** Copy the matrix */
                 for (auto i = 0; i < _ulRow; ++i) {
                     for (auto j = 0; j < _ulCol; ++j) {
@@ -253,12 +289,7 @@ namespace mpimath {
                     }
                 }
                 std::swap(_ulCol, _ulRow);
-#ifdef __AVX__
-                _mm_free(_pData);
-#else
-                free(_pData);
-#endif
-                _pData = nullptr;
+                _Free();
                 _pData = pNewData;
             } else {
                 return;
@@ -268,47 +299,45 @@ namespace mpimath {
         /**
          * @brief Return the result of matrix multiplication
          *
+         * Reduced precision types are accumulated in tGemmTraits<T>::AccType
+         * and narrowed back to T when the product is written.
+         *
          * @param N The matrix to multiply: Self @ N
          * @return Matrix2D<T> Result
          */
-        Matrix2D<T> operator*(const Matrix2D<T>& N) {
+        Matrix2D<T, Alloc> operator*(const Matrix2D<T, Alloc>& N) const {
             /** Check shape */
             if (this->_ulCol != N._ulRow) {
                 throw MATRIX_ERR_SHAPE;
             }
 
-            Matrix2D<T> Res(this->_ulRow, N._ulCol);
-            // /** Normal matmul operation */
-            // for (auto i = 0; i < Res._ulRow; ++i) {
-            //     for (auto j = 0; j < Res._ulCol; ++j) {
-            //         T Sum = 0;
-            //         for (auto k = 0; k < this->_ulCol; ++k) {
-
-            //             Sum += this->_pData[i * this->_ulCol + k] * N._pData[k * N._ulCol + j];
-            //         }
-            //         Res._pData[i * Res._ulCol + j] = Sum;
-            //     }
-            // }
-            if (std::is_same<T, double>()) {
-                mpimath::gemm_f64((double*)Res._pData, (double*)this->_pData, (double*)N._pData, this->_ulRow, this->_ulCol, N._ulRow, N._ulCol);
-            } else if (std::is_same < T, float>()) {
-                mpimath::gemm_f32((float*)Res._pData, (float*)this->_pData, (float*)N._pData, this->_ulRow, this->_ulCol, N._ulRow, N._ulCol);
-            } else {
-                /** Normal matmul operation */
-                memset(Res._pData, 0, Res._ulDataSize);
-                for (auto i = 0; i < Res._ulRow; ++i) {
-                    for (auto k = 0; k < this->_ulCol; ++k) {
-                        for (auto j = 0; j < Res._ulCol; ++j) {
-                            Res._pData[i * Res._ulCol + j] += this->_pData[i * this->_ulCol + k] * N._pData[k * N._ulCol + j];
-                        }
-                    }
-                }
+            Matrix2D<T, Alloc> Res(this->_ulRow, N._ulCol);
+            _MatMulInto(Res, N, std::is_same<T, typename tGemmTraits<T>::AccType>());
+
+            return Res;
+        }
+
+        /**
+         * @brief Return the widened result of matrix multiplication, e.g. the
+         * int32 sums of an int8 product or the fp32 sums of a bf16 product
+         *
+         * @param N The matrix to multiply: Self @ N
+         * @return Matrix2D<typename tGemmTraits<T>::AccType> Result
+         */
+        Matrix2D<typename tGemmTraits<T>::AccType, Alloc> MatMulAccumulate(const Matrix2D<T, Alloc>& N) const {
+            /** Check shape */
+            if (this->_ulCol != N._ulRow) {
+                throw MATRIX_ERR_SHAPE;
             }
 
+            Matrix2D<typename tGemmTraits<T>::AccType, Alloc> Res(this->_ulRow, N._ulCol);
+            mpimath::gemm(Res.pData(), this->_pData, N._pData, this->_ulRow, this->_ulCol, N._ulRow, N._ulCol);
+
             return Res;
         }
 
-        void operator *=(const Matrix2D<T>& N) {
+        /** The product is moved in, see MatrixChain.hpp for powers and chains */
+        void operator *=(const Matrix2D<T, Alloc>& N) {
             *this = *this * N;
         }
 
@@ -318,7 +347,7 @@ namespace mpimath {
          * @return true
          * @return false
          */
-        bool IsValid() {
+        bool IsValid() const {
             return (_pData != nullptr);
         }
 
@@ -326,71 +355,23 @@ namespace mpimath {
         /**
          * @brief Read matrix from a comma seperated .csv file
          *
+         * The file is mapped and parsed by several threads, see csv.hpp
+         *
          * @param sPath Path to csv file
          * @return emMatrixError Status
          */
         emMatrixError ReadCSV(const std::string& sPath) {
-            std::ifstream InFile;
-            std::string sLine;
-            std::vector<std::vector<double>> vecData;
-
-            /** Open file */
-            InFile.open(sPath, std::ios::in);
-            if (not InFile.is_open()) {
-                return emMatrixError::MATRIX_ERR_IO;
-            }
-
-            /** Read CSV file */
-            while (std::getline(InFile, sLine)) {
-                /** For each line end with '\n' */
-                std::stringstream ssReadStr(sLine);
-                std::vector<double> vecDataLine;
-                std::string sNumber;
-
-                /** For each item seperated by ',' */
-                while (std::getline(ssReadStr, sNumber, ',')) {
-                    /** string -> double conversion */
-                    vecDataLine.push_back(std::stod(sNumber));
-                }
-                vecData.push_back(vecDataLine);
-
-                if (vecData.size() > 1) {
-                    /** Check the size of incoming matrix */
-                    if (vecData[vecData.size() - 1].size() != vecData[0].size()) {
-                        InFile.close();
-                        return emMatrixError::MATRIX_ERR_SHAPE;
-                    }
-                }
-            }
-
-            /** Cheke if the CSV contains valid data */
-            if (vecData.size() < 0) {
-                InFile.close();
-                return emMatrixError::MATRIX_ERR_DATA;
+            /** Map the file, count rows and columns */
+            CSVFile File;
+            int iRet = File.Open(sPath);
+            if (iRet != MATRIX_OK) {
+                return (emMatrixError)iRet;
             }
 
-            /** Free memory to avoid memory leak */
-            if (_pData != nullptr) {
-#ifdef __AVX__
-                _mm_free(_pData);
-#else
-                free(_pData);
-#endif
-                _pData = nullptr;
-            }
-
-            /** Change Matrix according to size */
-            Init(vecData.size(), vecData[0].size(), false);
-            for (auto row = 0; row < vecData.size(); ++row) {
-                for (auto col = 0; col < vecData[0].size(); ++col) {
-                    /** Convert data from double to type T */
-                    _pData[row * _ulCol + col] = (T)(vecData[row][col]);
-                }
-            }
-
-            /** Close input and return */
-            InFile.close();
-            return emMatrixError::MATRIX_OK;
+            /** Parse straight into the final buffer */
+            Init(File.ulRow(), File.ulCol(), false);
+            iRet = CSVParseInto(File, _pData);
+            return (emMatrixError)iRet;
         }
 
         /**
@@ -402,23 +383,8 @@ namespace mpimath {
         emMatrixError DumpCSV(const std::string& sPath) {
             /** Check validity of matrix */
             if (IsValid()) {
-                /** Open file */
-                std::ofstream OutFile;
-                OutFile.open(sPath, std::ios::out);
-                if (not OutFile.is_open()) {
-                    return emMatrixError::MATRIX_ERR_IO;
-                }
-                /** Dump matrix content to file */
-                for (auto row = 0; row < _ulRow; ++row) {
-                    OutFile << _pData[row * _ulCol + 0];
-                    for (auto col = 1; col < _ulCol; ++col) {
-                        OutFile << "," << _pData[row * _ulCol + col];
-                    }
-                    OutFile << "\n";
-                }
-                OutFile.close();
-
-                return emMatrixError::MATRIX_OK;
+                /** Shortest round-trip formatting, row chunks in parallel, pwrite at prefix-summed offsets */
+                return (emMatrixError)CSVWrite(sPath, _pData, _ulRow, _ulCol);
             }
             return emMatrixError::MATRIX_ERR_NULL;
 
@@ -427,6 +393,39 @@ namespace mpimath {
         T* _pData = nullptr;
         size_t _ulRow = 0, _ulCol = 0, _ulDataSize = 0;
 
+        /** Every buffer of the matrix goes through Alloc, ulBytes == 0 gives nullptr */
+        static T* _Alloc(size_t ulBytes) {
+            return ulBytes > 0 ? (T*)Alloc::Allocate(ulBytes) : nullptr;
+        }
+
+        void _Swap(Matrix2D<T, Alloc>& Other) noexcept {
+            std::swap(_pData, Other._pData);
+            std::swap(_ulRow, Other._ulRow);
+            std::swap(_ulCol, Other._ulCol);
+            std::swap(_ulDataSize, Other._ulDataSize);
+        }
+
+        /** Release _pData, _ulDataSize must still be the size it was allocated with */
+        void _Free() {
+            if (_pData != nullptr) {
+                Alloc::Deallocate(_pData, _ulDataSize);
+                _pData = nullptr;
+            }
+        }
+
+        /** T is its own accumulator: gemm writes the result directly */
+        void _MatMulInto(Matrix2D<T, Alloc>& Res, const Matrix2D<T, Alloc>& N, std::true_type) const {
+            mpimath::gemm(Res._pData, this->_pData, N._pData, this->_ulRow, this->_ulCol, N._ulRow, N._ulCol);
+        }
+
+        /** Accumulate in the wider type, then narrow */
+        void _MatMulInto(Matrix2D<T, Alloc>& Res, const Matrix2D<T, Alloc>& N, std::false_type) const {
+            auto Acc = MatMulAccumulate(N);
+            for (size_t idx = 0; idx < Res.Size(); ++idx) {
+                Res._pData[idx] = tGemmTraits<T>::FromAcc(Acc.pData()[idx]);
+            }
+        }
+
     };
 
     /**
@@ -443,7 +442,8 @@ namespace mpimath {
          * @param Mat
          * @param ulRow
          */
-        Matrix2DRow(const Matrix2D<T>& Mat, const size_t ulRow) {
+        template<typename Alloc>
+        Matrix2DRow(const Matrix2D<T, Alloc>& Mat, const size_t ulRow) {
             if (Mat.pData() == NULL) {
                 throw MATRIX_ERR_NULL;
             }
@@ -0,0 +1,234 @@
+/**
+ * @file MatrixChain.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Matrix powers by repeated squaring, matrix chains in the cheapest order
+ * @version 0.1
+ * @date 2022-06-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef MATRIXCHAIN_HPP
+#define MATRIXCHAIN_HPP
+
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "DistMatrix.hpp"
+#include "MatMul.hpp"
+#include "Matrix.hpp"
+#include "gemm.hpp"
+
+namespace mpimath {
+    /**
+     * @brief Cost model of one product, in flops per process
+     *
+     * @struct iProcRow     rows of the process grid the product runs on
+     * @struct iProcCol     columns of the process grid
+     * @struct dWordCost    flops one element received by a process is worth
+     */
+    typedef struct {
+        int iProcRow;
+        int iProcCol;
+        double dWordCost;
+    } tChainCost;
+
+    /**
+     * @brief Cost of an ulM x ulK by ulK x ulN product with SUMMA on the grid
+     * of Cost: its share of the flops, plus the elements of the A panels
+     * broadcast along its process row and of the B panels along its column
+     *
+     */
+    inline double ChainProductCost(size_t ulM, size_t ulK, size_t ulN, const tChainCost& Cost) {
+        const double dPr = Cost.iProcRow, dPc = Cost.iProcCol;
+        const double dFlops = 2.0 * (double)ulM * (double)ulK * (double)ulN / (dPr * dPc);
+        const double dWords = (double)ulM * (double)ulK / dPr * (dPc - 1) / dPc + (double)ulK * (double)ulN / dPc * (dPr - 1) / dPr;
+        return dFlops + Cost.dWordCost * dWords;
+    }
+
+    /**
+     * @brief Cheapest parenthesization of a chain by dynamic programming
+     *
+     * @param vecDims   n + 1 dimensions, matrix i is vecDims[i] x vecDims[i + 1]
+     * @param vecSplit  n x n, the product of matrices i..j splits after matrix vecSplit[i * n + j]
+     * @return double cost of the whole chain, 0 for a single matrix
+     */
+    inline double ChainPlan(const std::vector<size_t>& vecDims, const tChainCost& Cost, std::vector<size_t>& vecSplit) {
+        const size_t ulN = vecDims.size() > 0 ? vecDims.size() - 1 : 0;
+        std::vector<double> vecCost(ulN * ulN, 0);
+        vecSplit.assign(ulN * ulN, 0);
+        for (size_t ulLen = 2; ulLen <= ulN; ++ulLen) {
+            for (size_t i = 0; i + ulLen <= ulN; ++i) {
+                const size_t j = i + ulLen - 1;
+                double dBest = std::numeric_limits<double>::infinity();
+                for (size_t k = i; k < j; ++k) {
+                    const double dCost = vecCost[i * ulN + k] + vecCost[(k + 1) * ulN + j] +
+                                         ChainProductCost(vecDims[i], vecDims[k + 1], vecDims[j + 1], Cost);
+                    if (dCost < dBest) {
+                        dBest = dCost;
+                        vecSplit[i * ulN + j] = k;
+                    }
+                }
+                vecCost[i * ulN + j] = dBest;
+            }
+        }
+        return ulN > 0 ? vecCost[ulN - 1] : 0;
+    }
+
+    /** The plan of ChainPlan written out, e.g. "((A0 A1) A2)" */
+    inline std::string ChainOrder(const std::vector<size_t>& vecSplit, size_t ulN, size_t i, size_t j) {
+        if (i == j) return "A" + std::to_string(i);
+        const size_t k = vecSplit[i * ulN + j];
+        return "(" + ChainOrder(vecSplit, ulN, i, k) + " " + ChainOrder(vecSplit, ulN, k + 1, j) + ")";
+    }
+
+    /** Out = MatA @ MatB into the buffer of Out when it has the right shape, Out is neither operand */
+    template<typename T, typename Alloc>
+    void _ChainMultiply(Matrix2D<T, Alloc>& Out, const Matrix2D<T, Alloc>& MatA, const Matrix2D<T, Alloc>& MatB) {
+        if constexpr (std::is_same<T, typename tGemmTraits<T>::AccType>::value) {
+            if (MatA.ulCol() != MatB.ulRow()) throw MATRIX_ERR_SHAPE;
+            if (Out.ulRow() != MatA.ulRow() or Out.ulCol() != MatB.ulCol() or not Out.IsValid()) {
+                Out.Init(MatA.ulRow(), MatB.ulCol());
+            }
+            gemm(Out.pData(), MatA.pData(), MatB.pData(), MatA.ulRow(), MatA.ulCol(), MatB.ulRow(), MatB.ulCol());
+        } else {
+            Out = MatA * MatB;
+        }
+    }
+
+    template<typename T>
+    void _ChainMultiply(DistMatrix<T>& Out, const DistMatrix<T>& MatA, const DistMatrix<T>& MatB) {
+        DistMultiplyInto(Out, MatA, MatB);
+    }
+
+    template<typename T, typename Alloc>
+    void _ChainIdentity(Matrix2D<T, Alloc>& Out, const Matrix2D<T, Alloc>& MatA) {
+        Out.Init(MatA.ulRow(), MatA.ulCol(), true);
+        for (size_t i = 0; i < Out.ulRow(); ++i) Out.pData()[i * Out.ulCol() + i] = T(1);
+    }
+
+    template<typename T>
+    void _ChainIdentity(DistMatrix<T>& Out, const DistMatrix<T>& MatA) {
+        Out.Init(MatA.Layout(), MatA.Comm(), true);
+        auto& MatLocal = Out.Local();
+        for (size_t i = 0; i < MatLocal.ulRow(); ++i) {
+            for (size_t j = 0; j < MatLocal.ulCol(); ++j) {
+                if (Out.GlobalRow(i) == Out.GlobalCol(j)) MatLocal.pData()[i * MatLocal.ulCol() + j] = T(1);
+            }
+        }
+    }
+
+    /**
+     * @brief MatA^ulExp by repeated squaring, floor(log2 e) + popcount(e) - 1
+     * products; the result, the current square and one scratch matrix are
+     * the only buffers and take turns
+     *
+     * @throw MATRIX_ERR_SHAPE if MatA is not square
+     */
+    template<typename M>
+    M _MatrixPower(const M& MatA, unsigned long ulExp) {
+        if (MatA.ulRow() != MatA.ulCol()) throw MATRIX_ERR_SHAPE;
+        M MatRes, MatSquare, MatTmp;
+        if (ulExp == 0) {
+            _ChainIdentity(MatRes, MatA);
+            return MatRes;
+        }
+        const M* pBase = &MatA;
+        bool bHave = false;
+        while (true) {
+            if (ulExp & 1) {
+                if (bHave) {
+                    _ChainMultiply(MatTmp, MatRes, *pBase);
+                    std::swap(MatRes, MatTmp);
+                } else {
+                    MatRes = *pBase;
+                    bHave = true;
+                }
+            }
+            ulExp >>= 1;
+            if (ulExp == 0) break;
+            _ChainMultiply(MatTmp, *pBase, *pBase);
+            std::swap(MatSquare, MatTmp);
+            pBase = &MatSquare;
+        }
+        return MatRes;
+    }
+
+    /** Product of vecMats[i..j] along vecSplit, intermediates are released as soon as they are consumed */
+    template<typename M>
+    const M& _ChainEval(const std::vector<const M*>& vecMats, const std::vector<size_t>& vecSplit, size_t i, size_t j, M& Out) {
+        if (i == j) return *vecMats[i];
+        const size_t k = vecSplit[i * vecMats.size() + j];
+        M MatLeft, MatRight;
+        const M& Left = _ChainEval(vecMats, vecSplit, i, k, MatLeft);
+        const M& Right = _ChainEval(vecMats, vecSplit, k + 1, j, MatRight);
+        _ChainMultiply(Out, Left, Right);
+        return Out;
+    }
+
+    template<typename M>
+    M _MatrixChain(const std::vector<const M*>& vecMats, const tChainCost& Cost) {
+        if (vecMats.empty()) throw MATRIX_ERR_NULL;
+        std::vector<size_t> vecDims = { vecMats[0]->ulRow() };
+        for (size_t idx = 0; idx < vecMats.size(); ++idx) {
+            if (vecMats[idx]->ulRow() != vecDims.back()) throw MATRIX_ERR_SHAPE;
+            vecDims.push_back(vecMats[idx]->ulCol());
+        }
+        std::vector<size_t> vecSplit;
+        ChainPlan(vecDims, Cost, vecSplit);
+        M MatRes;
+        const M& Res = _ChainEval(vecMats, vecSplit, 0, vecMats.size() - 1, MatRes);
+        if (&Res != &MatRes) MatRes = Res;
+        return MatRes;
+    }
+
+    template<typename T, typename Alloc>
+    Matrix2D<T, Alloc> MatrixPower(const Matrix2D<T, Alloc>& MatA, unsigned long ulExp) {
+        return _MatrixPower(MatA, ulExp);
+    }
+
+    /**
+     * @brief Distributed MatA^ulExp, collective
+     *
+     * The squares need the rows of MatA cut like its columns; a layout where
+     * they are not (ROW, COL) is changed to DistLayoutBlockCyclic() for the
+     * computation and the result is brought back to it.
+     */
+    template<typename T>
+    DistMatrix<T> MatrixPower(const DistMatrix<T>& MatA, unsigned long ulExp) {
+        const tDistLayout& Layout = MatA.Layout();
+        if (DistLayoutSame(DistOperandLayout(Layout, Layout), Layout)) return _MatrixPower(MatA, ulExp);
+        int iSize = 1;
+        MPI_Comm_size(MatA.Comm(), &iSize);
+        DistMatrix<T> MatBC = MatA.Redistribute(DistLayoutBlockCyclic(MatA.ulRow(), MatA.ulCol(), iSize));
+        return _MatrixPower(MatBC, ulExp).Redistribute(Layout);
+    }
+
+    /**
+     * @brief vecMats[0] @ vecMats[1] @ ... in the order with the fewest flops
+     *
+     * @throw MATRIX_ERR_SHAPE, MATRIX_ERR_NULL for an empty chain
+     */
+    template<typename T, typename Alloc>
+    Matrix2D<T, Alloc> MatrixChain(const std::vector<const Matrix2D<T, Alloc>*>& vecMats) {
+        return _MatrixChain(vecMats, tChainCost{ 1, 1, 0 });
+    }
+
+    /**
+     * @brief Distributed chain product in the order ChainPlan finds cheapest
+     * in flops and communication on the grid of vecMats[0], collective
+     *
+     * @param dWordCost flops a received element is worth
+     */
+    template<typename T>
+    DistMatrix<T> MatrixChain(const std::vector<const DistMatrix<T>*>& vecMats, double dWordCost = MATMUL_WORD_COST) {
+        if (vecMats.empty()) throw MATRIX_ERR_NULL;
+        const tDistLayout& Layout = vecMats[0]->Layout();
+        return _MatrixChain(vecMats, tChainCost{ Layout.iProcRow, Layout.iProcCol, dWordCost });
+    }
+}
+
+#endif
@@ -0,0 +1,333 @@
+/**
+ * @file MatrixExpr.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Lazy element-wise expressions over Matrix2D
+ * @version 0.1
+ * @date 2022-06-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef MATRIXEXPR_HPP
+#define MATRIXEXPR_HPP
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#include "Matrix.hpp"
+
+/** Rows of a Prod() result computed at a time, sized so the tile stays in L2 */
+#define MATRIX_EXPR_PANEL_BYTES (1 << 17)
+
+namespace mpimath {
+    /**
+     * @brief CRTP base of every expression node
+     *
+     * A node E provides ValueType, iNumProd (number of Prod nodes below it),
+     * ulRow(), ulCol(), At(i, j), Prepare(ulRowLow, ulRowHigh) which lets
+     * Prod nodes compute their tile, and ProdReads(p) which tells whether a
+     * Prod operand lives at p.
+     *
+     * @tparam E derived node
+     */
+    template<typename E>
+    struct tMatExpr {
+        inline const E& Derived() const { return static_cast<const E&>(*this); }
+
+        /**
+         * @brief Write the expression to pOut (ulRow x ulCol) in a single pass
+         *
+         * Without a product the rows are evaluated in one loop. With one, rows
+         * are processed in panels: the products of a panel are computed first,
+         * then the rest of the expression is applied to the panel while it is
+         * still in cache.
+         *
+         * @tparam T
+         * @param pOut
+         */
+        template<typename T>
+        void EvalInto(T* __restrict pOut) const {
+            const E& Expr = Derived();
+            const size_t ulRow = Expr.ulRow(), ulCol = Expr.ulCol();
+            size_t ulPanel = ulRow;
+            if (E::iNumProd > 0) {
+                ulPanel = MATRIX_EXPR_PANEL_BYTES / (sizeof(T) * (ulCol > 0 ? ulCol : 1));
+                ulPanel = std::max<size_t>(8, ulPanel & ~(size_t)7);
+            }
+            for (size_t ulRowLow = 0; ulRowLow < ulRow; ulRowLow += ulPanel) {
+                const size_t ulRowHigh = std::min(ulRow, ulRowLow + ulPanel);
+                Expr.Prepare(ulRowLow, ulRowHigh);
+                for (size_t i = ulRowLow; i < ulRowHigh; ++i) {
+                    T* __restrict pRow = pOut + i * ulCol;
+                    for (size_t j = 0; j < ulCol; ++j) {
+                        pRow[j] = Expr.At(i, j);
+                    }
+                }
+            }
+        }
+    };
+
+    /**
+     * @brief Leaf referencing a Matrix2D, the matrix must outlive the expression
+     *
+     */
+    template<typename T>
+    class tMatRef : public tMatExpr<tMatRef<T>> {
+    public:
+        typedef T ValueType;
+        static constexpr int iNumProd = 0;
+
+        template<typename Alloc>
+        tMatRef(const Matrix2D<T, Alloc>& Mat) : _pData(Mat.pData()), _ulRow(Mat.ulRow()), _ulCol(Mat.ulCol()) {}
+
+        inline size_t ulRow() const { return _ulRow; };
+        inline size_t ulCol() const { return _ulCol; };
+        inline T At(size_t i, size_t j) const { return _pData[i * _ulCol + j]; }
+        inline void Prepare(size_t, size_t) const {}
+        inline bool ProdReads(const void*) const { return false; }
+
+    protected:
+        const T* _pData;
+        size_t _ulRow, _ulCol;
+    };
+
+    /**
+     * @brief Leaf repeating a 1 x ulCol row vector ulRow times, e.g. a bias
+     *
+     */
+    template<typename T>
+    class tMatRowBroadcast : public tMatExpr<tMatRowBroadcast<T>> {
+    public:
+        typedef T ValueType;
+        static constexpr int iNumProd = 0;
+
+        template<typename Alloc>
+        tMatRowBroadcast(const Matrix2D<T, Alloc>& Row, size_t ulRow) : _pData(Row.pData()), _ulRow(ulRow), _ulCol(Row.Size()) {
+            if (Row.ulRow() != 1) {
+                throw MATRIX_ERR_SHAPE;
+            }
+        }
+
+        inline size_t ulRow() const { return _ulRow; };
+        inline size_t ulCol() const { return _ulCol; };
+        inline T At(size_t, size_t j) const { return _pData[j]; }
+        inline void Prepare(size_t, size_t) const {}
+        inline bool ProdReads(const void*) const { return false; }
+
+    protected:
+        const T* _pData;
+        size_t _ulRow, _ulCol;
+    };
+
+    /**
+     * @brief Lazy matrix product M @ N
+     *
+     * Prepare() runs gemm on the rows of M in the current panel, At() then
+     * reads the tile. Operands are concrete matrices, T must be its own
+     * gemm accumulator.
+     */
+    template<typename T>
+    class tMatProd : public tMatExpr<tMatProd<T>> {
+        static_assert(std::is_same<T, typename tGemmTraits<T>::AccType>::value,
+                      "Prod() needs a type that is its own accumulator, use MatMulAccumulate()");
+    public:
+        typedef T ValueType;
+        static constexpr int iNumProd = 1;
+
+        template<typename AllocM, typename AllocN>
+        tMatProd(const Matrix2D<T, AllocM>& MatM, const Matrix2D<T, AllocN>& MatN)
+            : _pM(MatM.pData()), _pN(MatN.pData()), _ulM(MatM.ulRow()), _ulK(MatM.ulCol()), _ulN(MatN.ulCol()) {
+            if (MatM.ulCol() != MatN.ulRow()) {
+                throw MATRIX_ERR_SHAPE;
+            }
+        }
+
+        inline size_t ulRow() const { return _ulM; };
+        inline size_t ulCol() const { return _ulN; };
+        inline T At(size_t i, size_t j) const { return _vecTile[(i - _ulRowLow) * _ulN + j]; }
+
+        void Prepare(size_t ulRowLow, size_t ulRowHigh) const {
+            _ulRowLow = ulRowLow;
+            _vecTile.resize((ulRowHigh - ulRowLow) * _ulN);
+            mpimath::gemm(_vecTile.data(), _pM + ulRowLow * _ulK, _pN, ulRowHigh - ulRowLow, _ulK, _ulK, _ulN);
+        }
+
+        inline bool ProdReads(const void* p) const { return p == _pM or p == _pN; }
+
+    protected:
+        const T* _pM;
+        const T* _pN;
+        size_t _ulM, _ulK, _ulN;
+        mutable std::vector<T> _vecTile;
+        mutable size_t _ulRowLow = 0;
+    };
+
+    /**
+     * @brief Element-wise Op(L, R)
+     *
+     */
+    template<typename L, typename R, typename Op>
+    class tMatBinary : public tMatExpr<tMatBinary<L, R, Op>> {
+    public:
+        typedef typename L::ValueType ValueType;
+        static constexpr int iNumProd = L::iNumProd + R::iNumProd;
+
+        tMatBinary(const L& Lhs, const R& Rhs) : _Lhs(Lhs), _Rhs(Rhs) {
+            if (Lhs.ulRow() != Rhs.ulRow() or Lhs.ulCol() != Rhs.ulCol()) {
+                throw MATRIX_ERR_SHAPE;
+            }
+        }
+
+        inline size_t ulRow() const { return _Lhs.ulRow(); };
+        inline size_t ulCol() const { return _Lhs.ulCol(); };
+        inline ValueType At(size_t i, size_t j) const { return Op::Apply(_Lhs.At(i, j), _Rhs.At(i, j)); }
+
+        inline void Prepare(size_t ulRowLow, size_t ulRowHigh) const {
+            _Lhs.Prepare(ulRowLow, ulRowHigh);
+            _Rhs.Prepare(ulRowLow, ulRowHigh);
+        }
+        inline bool ProdReads(const void* p) const { return _Lhs.ProdReads(p) or _Rhs.ProdReads(p); }
+
+    protected:
+        L _Lhs;
+        R _Rhs;
+    };
+
+    /**
+     * @brief Element-wise Fn(E), Fn is any callable taking and returning ValueType
+     *
+     */
+    template<typename E, typename Fn>
+    class tMatUnary : public tMatExpr<tMatUnary<E, Fn>> {
+    public:
+        typedef typename E::ValueType ValueType;
+        static constexpr int iNumProd = E::iNumProd;
+
+        tMatUnary(const E& Expr, Fn Func) : _Expr(Expr), _Func(Func) {}
+
+        inline size_t ulRow() const { return _Expr.ulRow(); };
+        inline size_t ulCol() const { return _Expr.ulCol(); };
+        inline ValueType At(size_t i, size_t j) const { return _Func(_Expr.At(i, j)); }
+        inline void Prepare(size_t ulRowLow, size_t ulRowHigh) const { _Expr.Prepare(ulRowLow, ulRowHigh); }
+        inline bool ProdReads(const void* p) const { return _Expr.ProdReads(p); }
+
+    protected:
+        E _Expr;
+        Fn _Func;
+    };
+
+    /**
+     * @brief Scalar * E
+     *
+     */
+    template<typename E>
+    class tMatScale : public tMatExpr<tMatScale<E>> {
+    public:
+        typedef typename E::ValueType ValueType;
+        static constexpr int iNumProd = E::iNumProd;
+
+        tMatScale(const E& Expr, ValueType Scale) : _Expr(Expr), _Scale(Scale) {}
+
+        inline size_t ulRow() const { return _Expr.ulRow(); };
+        inline size_t ulCol() const { return _Expr.ulCol(); };
+        inline ValueType At(size_t i, size_t j) const { return _Scale * _Expr.At(i, j); }
+        inline void Prepare(size_t ulRowLow, size_t ulRowHigh) const { _Expr.Prepare(ulRowLow, ulRowHigh); }
+        inline bool ProdReads(const void* p) const { return _Expr.ProdReads(p); }
+
+    protected:
+        E _Expr;
+        ValueType _Scale;
+    };
+
+    struct tOpAdd {
+        template<typename T>
+        static inline T Apply(const T& A, const T& B) { return A + B; }
+    };
+
+    struct tOpSub {
+        template<typename T>
+        static inline T Apply(const T& A, const T& B) { return A - B; }
+    };
+
+    /**
+     * @brief Map an operand to its node type: Matrix2D becomes a tMatRef,
+     * expression nodes are kept by value
+     *
+     */
+    template<typename X, typename = void>
+    struct tExprOf {
+        static constexpr bool bValue = false;
+    };
+
+    template<typename T, typename Alloc>
+    struct tExprOf<Matrix2D<T, Alloc>> {
+        static constexpr bool bValue = true;
+        typedef tMatRef<T> Type;
+    };
+
+    template<typename X>
+    struct tExprOf<X, typename std::enable_if<std::is_base_of<tMatExpr<X>, X>::value>::type> {
+        static constexpr bool bValue = true;
+        typedef X Type;
+    };
+
+#define MATRIX_EXPR_ENABLE_IF(X) typename std::enable_if<tExprOf<X>::bValue, int>::type = 0
+
+    template<typename L, typename R, MATRIX_EXPR_ENABLE_IF(L), MATRIX_EXPR_ENABLE_IF(R)>
+    inline tMatBinary<typename tExprOf<L>::Type, typename tExprOf<R>::Type, tOpAdd> operator+(const L& Lhs, const R& Rhs) {
+        return { Lhs, Rhs };
+    }
+
+    template<typename L, typename R, MATRIX_EXPR_ENABLE_IF(L), MATRIX_EXPR_ENABLE_IF(R)>
+    inline tMatBinary<typename tExprOf<L>::Type, typename tExprOf<R>::Type, tOpSub> operator-(const L& Lhs, const R& Rhs) {
+        return { Lhs, Rhs };
+    }
+
+    template<typename X, MATRIX_EXPR_ENABLE_IF(X)>
+    inline tMatScale<typename tExprOf<X>::Type> operator*(const typename tExprOf<X>::Type::ValueType& Scale, const X& Expr) {
+        return { Expr, Scale };
+    }
+
+    template<typename X, MATRIX_EXPR_ENABLE_IF(X)>
+    inline tMatScale<typename tExprOf<X>::Type> operator*(const X& Expr, const typename tExprOf<X>::Type::ValueType& Scale) {
+        return { Expr, Scale };
+    }
+
+    template<typename X, MATRIX_EXPR_ENABLE_IF(X)>
+    inline tMatScale<typename tExprOf<X>::Type> operator-(const X& Expr) {
+        return { Expr, typename tExprOf<X>::Type::ValueType(-1) };
+    }
+
+    /**
+     * @brief Element-wise Func(Expr), e.g. Apply(A + B, [](double x) { return x > 0 ? x : 0; })
+     *
+     */
+    template<typename X, typename Fn, MATRIX_EXPR_ENABLE_IF(X)>
+    inline tMatUnary<typename tExprOf<X>::Type, Fn> Apply(const X& Expr, Fn Func) {
+        return { Expr, Func };
+    }
+
+    /**
+     * @brief Lazy M @ N, fused with the element-wise expression it appears in
+     *
+     */
+    template<typename T, typename AllocM, typename AllocN>
+    inline tMatProd<T> Prod(const Matrix2D<T, AllocM>& MatM, const Matrix2D<T, AllocN>& MatN) {
+        return { MatM, MatN };
+    }
+
+    /**
+     * @brief Broadcast a 1 x n row over ulRow rows
+     *
+     */
+    template<typename T, typename Alloc>
+    inline tMatRowBroadcast<T> BroadcastRow(const Matrix2D<T, Alloc>& Row, size_t ulRow) {
+        return { Row, ulRow };
+    }
+
+#undef MATRIX_EXPR_ENABLE_IF
+}
+
+#endif
@@ -0,0 +1,657 @@
+/**
+ * @file OutOfCore.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Out-of-core M @ N on matrices stored in files, streamed panel by panel
+ * @version 0.1
+ * @date 2022-06-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef OUTOFCORE_HPP
+#define OUTOFCORE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "Partition.hpp"
+#include "csv.hpp"
+
+/** Memory used by the panels of one process unless MPIMATH_OOC_MEM (MB) says otherwise */
+#define OOC_DEFAULT_MEM_BYTES (1ul << 30)
+
+namespace mpimath {
+    /**
+     * @brief Header of the binary dense format
+     *
+     * Followed by ulRow x ulCol row-major values of uElemSize bytes each.
+     */
+    typedef struct {
+        char acMagic[8];
+        uint32_t uVersion;
+        uint32_t uElemSize;
+        uint64_t ulRow;
+        uint64_t ulCol;
+    } tDenseFileHeader;
+
+#define DENSE_FILE_MAGIC "MPIMDNS"
+#define DENSE_FILE_VERSION 1
+
+    /**
+     * @brief A dense row-major matrix in a binary file, read and written by
+     * blocks with pread / pwrite so that several threads and processes can
+     * work on the same file
+     *
+     * @tparam T data type
+     */
+    template<typename T>
+    class DenseMatrixFile {
+    public:
+        DenseMatrixFile() {};
+        ~DenseMatrixFile() { Close(); };
+        DenseMatrixFile(const DenseMatrixFile&) = delete;
+        DenseMatrixFile& operator=(const DenseMatrixFile&) = delete;
+
+        /**
+         * @brief Check whether sPath starts with a dense file header
+         *
+         */
+        static bool IsBinary(const std::string& sPath) {
+            tDenseFileHeader Header;
+            int iFd = open(sPath.c_str(), O_RDONLY);
+            if (iFd < 0) return false;
+            bool bRet = pread(iFd, &Header, sizeof(Header), 0) == (ssize_t)sizeof(Header) and
+                        memcmp(Header.acMagic, DENSE_FILE_MAGIC, sizeof(DENSE_FILE_MAGIC)) == 0;
+            close(iFd);
+            return bRet;
+        }
+
+        /**
+         * @brief Open an existing file
+         *
+         * @param sPath
+         * @param bWrite open read-write
+         * @return emMatrixError MATRIX_ERR_DATA on a bad header, MATRIX_ERR_SHAPE on a different element size
+         */
+        emMatrixError Open(const std::string& sPath, bool bWrite = false) {
+            Close();
+            _iFd = open(sPath.c_str(), bWrite ? O_RDWR : O_RDONLY);
+            if (_iFd < 0) {
+                return emMatrixError::MATRIX_ERR_IO;
+            }
+            tDenseFileHeader Header;
+            if (pread(_iFd, &Header, sizeof(Header), 0) != (ssize_t)sizeof(Header) or
+                memcmp(Header.acMagic, DENSE_FILE_MAGIC, sizeof(DENSE_FILE_MAGIC)) != 0 or
+                Header.uVersion != DENSE_FILE_VERSION) {
+                Close();
+                return emMatrixError::MATRIX_ERR_DATA;
+            }
+            if (Header.uElemSize != sizeof(T)) {
+                Close();
+                return emMatrixError::MATRIX_ERR_SHAPE;
+            }
+            _ulRow = Header.ulRow;
+            _ulCol = Header.ulCol;
+            return emMatrixError::MATRIX_OK;
+        }
+
+        /**
+         * @brief Create (or truncate) sPath as a zero filled ulRow x ulCol matrix
+         *
+         */
+        emMatrixError Create(const std::string& sPath, size_t ulRow, size_t ulCol) {
+            Close();
+            _iFd = open(sPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (_iFd < 0) {
+                return emMatrixError::MATRIX_ERR_IO;
+            }
+            tDenseFileHeader Header = { DENSE_FILE_MAGIC, DENSE_FILE_VERSION, (uint32_t)sizeof(T), ulRow, ulCol };
+            if (not _PWriteAll(&Header, sizeof(Header), 0) or
+                ftruncate(_iFd, (off_t)(sizeof(Header) + ulRow * ulCol * sizeof(T))) != 0) {
+                Close();
+                return emMatrixError::MATRIX_ERR_IO;
+            }
+            _ulRow = ulRow;
+            _ulCol = ulCol;
+            return emMatrixError::MATRIX_OK;
+        }
+
+        void Close() {
+            if (_iFd >= 0) {
+                close(_iFd);
+                _iFd = -1;
+            }
+            _ulRow = _ulCol = 0;
+        }
+
+        inline bool IsOpen() const { return _iFd >= 0; };
+
+        inline size_t ulRow() const { return _ulRow; };
+
+        inline size_t ulCol() const { return _ulCol; };
+
+        /**
+         * @brief Read rows [ulRowLow, ulRowLow + ulRows) x cols [ulColLow, ulColLow + ulCols)
+         * into a dense ulRows x ulCols buffer, one pread when the block spans whole rows
+         *
+         */
+        emMatrixError ReadBlock(T* pOut, size_t ulRowLow, size_t ulRows, size_t ulColLow, size_t ulCols) const {
+            if (ulRowLow + ulRows > _ulRow or ulColLow + ulCols > _ulCol) {
+                return emMatrixError::MATRIX_ERR_SHAPE;
+            }
+            if (ulCols == _ulCol) {
+                return _PReadAll(pOut, ulRows * ulCols * sizeof(T), _Offset(ulRowLow, 0)) ? emMatrixError::MATRIX_OK : emMatrixError::MATRIX_ERR_IO;
+            }
+            for (size_t row = 0; row < ulRows; ++row) {
+                if (not _PReadAll(pOut + row * ulCols, ulCols * sizeof(T), _Offset(ulRowLow + row, ulColLow))) {
+                    return emMatrixError::MATRIX_ERR_IO;
+                }
+            }
+            return emMatrixError::MATRIX_OK;
+        }
+
+        /**
+         * @brief Write a dense ulRows x ulCols buffer at (ulRowLow, ulColLow)
+         *
+         */
+        emMatrixError WriteBlock(const T* pIn, size_t ulRowLow, size_t ulRows, size_t ulColLow, size_t ulCols) const {
+            if (ulRowLow + ulRows > _ulRow or ulColLow + ulCols > _ulCol) {
+                return emMatrixError::MATRIX_ERR_SHAPE;
+            }
+            if (ulCols == _ulCol) {
+                return _PWriteAll(pIn, ulRows * ulCols * sizeof(T), _Offset(ulRowLow, 0)) ? emMatrixError::MATRIX_OK : emMatrixError::MATRIX_ERR_IO;
+            }
+            for (size_t row = 0; row < ulRows; ++row) {
+                if (not _PWriteAll(pIn + row * ulCols, ulCols * sizeof(T), _Offset(ulRowLow + row, ulColLow))) {
+                    return emMatrixError::MATRIX_ERR_IO;
+                }
+            }
+            return emMatrixError::MATRIX_OK;
+        }
+
+        /**
+         * @brief Dump a whole matrix to sPath
+         *
+         */
+        template<typename Alloc>
+        static emMatrixError Dump(const std::string& sPath, const Matrix2D<T, Alloc>& Mat) {
+            if (not Mat.IsValid()) {
+                return emMatrixError::MATRIX_ERR_NULL;
+            }
+            DenseMatrixFile File;
+            emMatrixError emRet = File.Create(sPath, Mat.ulRow(), Mat.ulCol());
+            if (emRet != emMatrixError::MATRIX_OK) {
+                return emRet;
+            }
+            return File.WriteBlock(Mat.pData(), 0, Mat.ulRow(), 0, Mat.ulCol());
+        }
+
+        /**
+         * @brief Read a whole matrix from sPath
+         *
+         */
+        template<typename Alloc>
+        static emMatrixError Load(const std::string& sPath, Matrix2D<T, Alloc>& Mat) {
+            DenseMatrixFile File;
+            emMatrixError emRet = File.Open(sPath);
+            if (emRet != emMatrixError::MATRIX_OK) {
+                return emRet;
+            }
+            Mat.Init(File.ulRow(), File.ulCol(), false);
+            return File.ReadBlock(Mat.pData(), 0, File.ulRow(), 0, File.ulCol());
+        }
+
+    protected:
+        int _iFd = -1;
+        size_t _ulRow = 0, _ulCol = 0;
+
+        inline size_t _Offset(size_t ulRowIdx, size_t ulColIdx) const {
+            return sizeof(tDenseFileHeader) + (ulRowIdx * _ulCol + ulColIdx) * sizeof(T);
+        }
+
+        bool _PReadAll(void* pBuf, size_t ulSize, size_t ulOffset) const {
+            char* p = (char*)pBuf;
+            while (ulSize > 0) {
+                ssize_t lRead = pread(_iFd, p, ulSize, (off_t)ulOffset);
+                if (lRead < 0 and errno == EINTR) continue;
+                if (lRead <= 0) return false;
+                p += lRead;
+                ulOffset += (size_t)lRead;
+                ulSize -= (size_t)lRead;
+            }
+            return true;
+        }
+
+        bool _PWriteAll(const void* pBuf, size_t ulSize, size_t ulOffset) const {
+            const char* p = (const char*)pBuf;
+            while (ulSize > 0) {
+                ssize_t lWritten = pwrite(_iFd, p, ulSize, (off_t)ulOffset);
+                if (lWritten < 0 and errno == EINTR) continue;
+                if (lWritten <= 0) return false;
+                p += lWritten;
+                ulOffset += (size_t)lWritten;
+                ulSize -= (size_t)lWritten;
+            }
+            return true;
+        }
+    };
+
+    /**
+     * @brief Convert a CSV file to the binary dense format without holding
+     * the matrix: rows are parsed in parallel and pwritten where they belong
+     *
+     */
+    template<typename T>
+    emMatrixError CSVToBinary(const std::string& sCSVPath, const std::string& sBinPath) {
+        CSVFile InFile;
+        int iRet = InFile.Open(sCSVPath);
+        if (iRet != MATRIX_OK) {
+            return (emMatrixError)iRet;
+        }
+        DenseMatrixFile<T> OutFile;
+        emMatrixError emRet = OutFile.Create(sBinPath, InFile.ulRow(), InFile.ulCol());
+        if (emRet != emMatrixError::MATRIX_OK) {
+            return emRet;
+        }
+        const size_t ulCol = InFile.ulCol();
+        std::atomic<int> iWriteRet(MATRIX_OK);
+        iRet = InFile.ParseRows([&](size_t ulRowIdx, const double* pRow) {
+            /** Small per-call buffer: rows arrive from several threads */
+            std::vector<T> vecRow(pRow, pRow + ulCol);
+            if (OutFile.WriteBlock(vecRow.data(), ulRowIdx, 1, 0, ulCol) != emMatrixError::MATRIX_OK) {
+                iWriteRet.store(MATRIX_ERR_IO);
+            }
+        });
+        return (emMatrixError)(iRet != MATRIX_OK ? iRet : iWriteRet.load());
+    }
+
+    /**
+     * @brief Convert a binary dense file to CSV, the file is mapped and
+     * formatted by CSVWriteRows
+     *
+     */
+    template<typename T>
+    emMatrixError BinaryToCSV(const std::string& sBinPath, const std::string& sCSVPath) {
+        DenseMatrixFile<T> InFile;
+        emMatrixError emRet = InFile.Open(sBinPath);
+        if (emRet != emMatrixError::MATRIX_OK) {
+            return emRet;
+        }
+        const size_t ulRow = InFile.ulRow(), ulCol = InFile.ulCol();
+        const size_t ulMapSize = sizeof(tDenseFileHeader) + ulRow * ulCol * sizeof(T);
+        int iFd = open(sBinPath.c_str(), O_RDONLY);
+        void* pMap = iFd < 0 ? MAP_FAILED : mmap(nullptr, ulMapSize, PROT_READ, MAP_SHARED, iFd, 0);
+        if (iFd >= 0) close(iFd);
+        if (pMap == MAP_FAILED) {
+            return emMatrixError::MATRIX_ERR_IO;
+        }
+        madvise(pMap, ulMapSize, MADV_SEQUENTIAL);
+        const T* pData = (const T*)((const char*)pMap + sizeof(tDenseFileHeader));
+        int iRet = CSVWrite(sCSVPath, pData, ulRow, ulCol);
+        munmap(pMap, ulMapSize);
+        return (emMatrixError)iRet;
+    }
+
+    /**
+     * @brief A dedicated I/O thread running jobs in submission order
+     *
+     * The compute thread submits the reads of the next panels and the write
+     * of the last result tile, then runs gemm while the disk works.
+     */
+    class IOThread {
+    public:
+        IOThread() : _Thread(&IOThread::_Run, this) {};
+
+        ~IOThread() {
+            {
+                std::lock_guard<std::mutex> Lock(_Mutex);
+                _bStop = true;
+            }
+            _Cond.notify_one();
+            _Thread.join();
+        }
+
+        IOThread(const IOThread&) = delete;
+        IOThread& operator=(const IOThread&) = delete;
+
+        /**
+         * @brief Queue Fn, the future gets its emMatrixError
+         *
+         */
+        std::future<emMatrixError> Submit(std::function<emMatrixError()> Fn) {
+            std::packaged_task<emMatrixError()> Task(std::move(Fn));
+            std::future<emMatrixError> Future = Task.get_future();
+            {
+                std::lock_guard<std::mutex> Lock(_Mutex);
+                _dqTasks.push_back(std::move(Task));
+            }
+            _Cond.notify_one();
+            return Future;
+        }
+
+    protected:
+        std::mutex _Mutex;
+        std::condition_variable _Cond;
+        std::deque<std::packaged_task<emMatrixError()>> _dqTasks;
+        bool _bStop = false;
+        std::thread _Thread; /** last: started once the queue exists */
+
+        void _Run() {
+            while (true) {
+                std::packaged_task<emMatrixError()> Task;
+                {
+                    std::unique_lock<std::mutex> Lock(_Mutex);
+                    _Cond.wait(Lock, [this] { return _bStop or not _dqTasks.empty(); });
+                    if (_dqTasks.empty()) return;
+                    Task = std::move(_dqTasks.front());
+                    _dqTasks.pop_front();
+                }
+                Task();
+            }
+        }
+    };
+
+    /**
+     * @brief Counters of one out-of-core product
+     *
+     * @struct ulBytesRead, ulBytesWritten file traffic
+     * @struct ulPanelReadsN column panels of N read, (row panels) x (column panels)
+     *         - 2 (row panels - 1) with the snake order and two N buffers
+     * @struct dWaitIO seconds the compute thread waited for the I/O thread
+     * @struct dTotal seconds
+     */
+    typedef struct {
+        size_t ulBytesRead;
+        size_t ulBytesWritten;
+        size_t ulPanelsM;
+        size_t ulPanelsN;
+        size_t ulPanelReadsN;
+        double dWaitIO;
+        double dTotal;
+    } tOOCStats;
+
+    /**
+     * @brief Memory given to the panels, MPIMATH_OOC_MEM (in MB) overrides OOC_DEFAULT_MEM_BYTES
+     *
+     */
+    inline size_t OOCDefaultMemBytes() {
+        const char* sEnv = getenv("MPIMATH_OOC_MEM");
+        if (sEnv != nullptr and atol(sEnv) > 0) {
+            return (size_t)atol(sEnv) << 20;
+        }
+        return OOC_DEFAULT_MEM_BYTES;
+    }
+
+    /**
+     * @brief Rows [ulRowLow, ulRowHigh) of Out = M @ N, all three in dense files
+     *
+     * Two row panels of M (R x K), two column panels of N (K x C) and two
+     * result tiles (R x C) live in memory, C is capped at a quarter of
+     * ulMemBytes and R takes the rest, since N is re-read once per row panel.
+     * Row panels visit the column panels in snake order so that the last two
+     * panels of N of one pass, still in the two buffers, start the next one.
+     * An IOThread reads the next panels and writes the previous tile while
+     * gemm runs on the current one.
+     *
+     * @tparam T double or float
+     * @param FileM opened for reading
+     * @param FileN opened for reading
+     * @param FileOut opened for writing, M.ulRow() x N.ulCol()
+     * @param ulRowLow
+     * @param ulRowHigh
+     * @param ulMemBytes a soft budget: at least one row and 8 columns per panel
+     * @param pStats optional
+     * @return emMatrixError
+     */
+    template<typename T>
+    emMatrixError OOCMatMul(const DenseMatrixFile<T>& FileM,
+                            const DenseMatrixFile<T>& FileN,
+                            const DenseMatrixFile<T>& FileOut,
+                            size_t ulRowLow,
+                            size_t ulRowHigh,
+                            size_t ulMemBytes = 0,
+                            tOOCStats* pStats = nullptr) {
+        static_assert(std::is_same<typename tGemmTraits<T>::AccType, T>::value, "OOCMatMul writes the result as T");
+        const size_t ulK = FileM.ulCol(), ulCol = FileN.ulCol();
+        if (ulK != FileN.ulRow() or FileOut.ulRow() != FileM.ulRow() or FileOut.ulCol() != ulCol or
+            ulRowHigh > FileM.ulRow() or ulRowLow > ulRowHigh) {
+            return emMatrixError::MATRIX_ERR_SHAPE;
+        }
+        tOOCStats Stats = { 0 };
+        MPITimer Timer;
+        const size_t ulRow = ulRowHigh - ulRowLow;
+        if (ulRow == 0 or ulCol == 0 or ulK == 0) {
+            if (pStats != nullptr) *pStats = Stats;
+            return emMatrixError::MATRIX_OK;
+        }
+
+        /** Panel sizes in elements */
+        if (ulMemBytes == 0) ulMemBytes = OOCDefaultMemBytes();
+        const size_t ulBudget = ulMemBytes / sizeof(T);
+        size_t ulPanelCol = std::min(ulCol, std::max<size_t>(8, ulBudget / 4 / (2 * ulK)));
+        if (ulPanelCol < ulCol) ulPanelCol = std::max<size_t>(8, ulPanelCol / 8 * 8);
+        const size_t ulUsedN = 2 * ulK * ulPanelCol;
+        size_t ulPanelRow = ulBudget > ulUsedN ? (ulBudget - ulUsedN) / (2 * ulK + 2 * ulPanelCol) : 1;
+        ulPanelRow = std::max<size_t>(1, std::min(ulPanelRow, ulRow));
+        Stats.ulPanelsM = (ulRow + ulPanelRow - 1) / ulPanelRow;
+        Stats.ulPanelsN = (ulCol + ulPanelCol - 1) / ulPanelCol;
+
+        /** Tile schedule: row panels in order, column panels in snake order */
+        std::vector<std::pair<size_t, size_t>> vecTiles;
+        vecTiles.reserve(Stats.ulPanelsM * Stats.ulPanelsN);
+        for (size_t p = 0; p < Stats.ulPanelsM; ++p) {
+            for (size_t q = 0; q < Stats.ulPanelsN; ++q) {
+                vecTiles.emplace_back(p, p % 2 == 0 ? q : Stats.ulPanelsN - 1 - q);
+            }
+        }
+
+        Matrix2D<T, tPoolAllocator> aPanelM[2], aPanelN[2], aTile[2];
+        for (int s = 0; s < 2; ++s) {
+            aPanelM[s].Init(ulPanelRow, ulK, false);
+            aPanelN[s].Init(ulK, ulPanelCol, false);
+            aTile[s].Init(ulPanelRow, ulPanelCol, false);
+        }
+        std::future<emMatrixError> aReadM[2], aReadN[2], aWrite[2];
+        size_t aSlotPanelN[2] = { (size_t)-1, (size_t)-1 }; /** panel of N held by each slot */
+        std::atomic<size_t> ulBytesRead(0);
+
+        auto RowsOf = [&](size_t p) { return std::min(ulPanelRow, ulRow - p * ulPanelRow); };
+        auto ColsOf = [&](size_t q) { return std::min(ulPanelCol, ulCol - q * ulPanelCol); };
+
+        IOThread IO;
+        auto SubmitReadM = [&](size_t p) {
+            T* pBuf = aPanelM[p % 2].pData();
+            aReadM[p % 2] = IO.Submit([&, pBuf, p]() {
+                ulBytesRead += RowsOf(p) * ulK * sizeof(T);
+                return FileM.ReadBlock(pBuf, ulRowLow + p * ulPanelRow, RowsOf(p), 0, ulK);
+            });
+        };
+        /** Returns the slot holding panel q of N, reading it unless it is already there */
+        auto SubmitReadN = [&](size_t q, int iAvoidSlot) {
+            for (int s = 0; s < 2; ++s) {
+                if (aSlotPanelN[s] == q) return s;
+            }
+            int s = iAvoidSlot == 0 ? 1 : 0;
+            aSlotPanelN[s] = q;
+            T* pBuf = aPanelN[s].pData();
+            Stats.ulPanelReadsN++;
+            aReadN[s] = IO.Submit([&, pBuf, q]() {
+                ulBytesRead += ulK * ColsOf(q) * sizeof(T);
+                return FileN.ReadBlock(pBuf, 0, ulK, q * ulPanelCol, ColsOf(q));
+            });
+            return s;
+        };
+        auto Wait = [&](std::future<emMatrixError>& Future) {
+            if (not Future.valid()) return emMatrixError::MATRIX_OK;
+            MPITimer WaitTimer;
+            emMatrixError emRet = Future.get();
+            Stats.dWaitIO += WaitTimer.TimeDelta();
+            return emRet;
+        };
+
+        emMatrixError emRet = emMatrixError::MATRIX_OK;
+        SubmitReadM(0);
+        int iSlotN = SubmitReadN(vecTiles[0].second, -1);
+        for (size_t t = 0; t < vecTiles.size() and emRet == emMatrixError::MATRIX_OK; ++t) {
+            const size_t p = vecTiles[t].first, q = vecTiles[t].second;
+
+            /** Prefetch the panels of the next tile before waiting for this one */
+            int iNextSlotN = -1;
+            if (t + 1 < vecTiles.size()) {
+                if (vecTiles[t + 1].first != p) SubmitReadM(vecTiles[t + 1].first);
+                iNextSlotN = SubmitReadN(vecTiles[t + 1].second, iSlotN);
+            }
+
+            auto emReadM = Wait(aReadM[p % 2]);
+            auto emReadN = Wait(aReadN[iSlotN]);
+            if (emReadM != emMatrixError::MATRIX_OK or emReadN != emMatrixError::MATRIX_OK) {
+                emRet = emReadM != emMatrixError::MATRIX_OK ? emReadM : emReadN;
+                break;
+            }
+
+            /** The tile buffer may still be on its way to the disk */
+            emRet = Wait(aWrite[t % 2]);
+            if (emRet != emMatrixError::MATRIX_OK) break;
+            T* pTile = aTile[t % 2].pData();
+            const size_t ulRows = RowsOf(p), ulCols = ColsOf(q);
+            /** Panels are packed: the last, narrower column panel is ulK x ulCols */
+            gemm(pTile, aPanelM[p % 2].pData(), aPanelN[iSlotN].pData(), ulRows, ulK, ulK, ulCols);
+            Stats.ulBytesWritten += ulRows * ulCols * sizeof(T);
+            aWrite[t % 2] = IO.Submit([&FileOut, pTile, p, q, ulRows, ulCols, ulRowLow, ulPanelRow, ulPanelCol]() {
+                return FileOut.WriteBlock(pTile, ulRowLow + p * ulPanelRow, ulRows, q * ulPanelCol, ulCols);
+            });
+            if (iNextSlotN >= 0) iSlotN = iNextSlotN;
+        }
+
+        /** Drain the queue before the buffers go away */
+        for (int s = 0; s < 2; ++s) {
+            auto emReadM = Wait(aReadM[s]), emReadN = Wait(aReadN[s]), emWrite = Wait(aWrite[s]);
+            if (emRet == emMatrixError::MATRIX_OK) {
+                emRet = emWrite != emMatrixError::MATRIX_OK ? emWrite : (emReadM != emMatrixError::MATRIX_OK ? emReadM : emReadN);
+            }
+        }
+        Stats.ulBytesRead = ulBytesRead.load();
+        Stats.dTotal = Timer.TimeDelta();
+        if (pStats != nullptr) *pStats = Stats;
+        return emRet;
+    }
+
+    /**
+     * @brief The context of an out-of-core product
+     *
+     * @struct lMRow, lMCol, lNCol shapes
+     * @struct bConvertM, bConvertN the input is CSV and was converted to "<path>.ooc.bin"
+     * @struct iRet status of the preparation on the main process
+     */
+    typedef struct {
+        long lMRow;
+        long lMCol;
+        long lNCol;
+        bool bConvertM;
+        bool bConvertN;
+        int iRet;
+    } tOOCCtx;
+
+    /**
+     * @brief Out-of-core M @ N on every process of MPI_COMM_WORLD, straight
+     * from files to a file
+     *
+     * The main process converts CSV inputs to binary next to them (".ooc.bin")
+     * and creates the binary result, then every process computes its block of
+     * rows with OOCMatMul and pwrites it into the shared result file, so no
+     * process ever holds a whole matrix. A ".csv" result is converted from the
+     * binary one at the end. The files must be visible to all processes.
+     *
+     * @tparam T double or float
+     * @param sMPath binary dense file or CSV
+     * @param sNPath binary dense file or CSV
+     * @param sResultPath ".csv" for CSV, binary dense file otherwise
+     * @param Processor
+     * @param ulMemBytes per process, 0 for OOCDefaultMemBytes()
+     * @param pStats optional, this process' counters
+     * @return emMatrixError the same on every process
+     */
+    template<typename T = double>
+    emMatrixError MPIMatMulOOC(const std::string& sMPath,
+                               const std::string& sNPath,
+                               const std::string& sResultPath,
+                               MPIProcessorInfo Processor,
+                               size_t ulMemBytes = 0,
+                               tOOCStats* pStats = nullptr) {
+        auto EndsWith = [](const std::string& s, const char* sSuffix) {
+            size_t ulLen = strlen(sSuffix);
+            return s.size() >= ulLen and s.compare(s.size() - ulLen, ulLen, sSuffix) == 0;
+        };
+        if (pStats != nullptr) *pStats = { 0 };
+
+        /** Prepare the files on the main process, the others may not see them yet */
+        const bool bCSVOut = EndsWith(sResultPath, ".csv");
+        const std::string sMBin = sMPath + ".ooc.bin", sNBin = sNPath + ".ooc.bin";
+        const std::string sOutBin = bCSVOut ? sResultPath + ".ooc.bin" : sResultPath;
+        tOOCCtx Ctx = { 0 };
+        if (Processor.iRank() == 0) {
+            Ctx.bConvertM = not DenseMatrixFile<T>::IsBinary(sMPath);
+            Ctx.bConvertN = not DenseMatrixFile<T>::IsBinary(sNPath);
+            emMatrixError emRet = emMatrixError::MATRIX_OK;
+            if (Ctx.bConvertM) emRet = CSVToBinary<T>(sMPath, sMBin);
+            if (Ctx.bConvertN and emRet == emMatrixError::MATRIX_OK) emRet = CSVToBinary<T>(sNPath, sNBin);
+            DenseMatrixFile<T> FileM, FileN, FileOut;
+            if (emRet == emMatrixError::MATRIX_OK) emRet = FileM.Open(Ctx.bConvertM ? sMBin : sMPath);
+            if (emRet == emMatrixError::MATRIX_OK) emRet = FileN.Open(Ctx.bConvertN ? sNBin : sNPath);
+            if (emRet == emMatrixError::MATRIX_OK and FileM.ulCol() != FileN.ulRow()) emRet = emMatrixError::MATRIX_ERR_SHAPE;
+            if (emRet == emMatrixError::MATRIX_OK) emRet = FileOut.Create(sOutBin, FileM.ulRow(), FileN.ulCol());
+            Ctx.lMRow = (long)FileM.ulRow();
+            Ctx.lMCol = (long)FileM.ulCol();
+            Ctx.lNCol = (long)FileN.ulCol();
+            Ctx.iRet = (int)emRet;
+        }
+        MPI_Bcast(&Ctx, sizeof(Ctx), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+        /** Every process streams its own rows */
+        emMatrixError emRet = (emMatrixError)Ctx.iRet;
+        if (emRet == emMatrixError::MATRIX_OK) {
+            DenseMatrixFile<T> FileM, FileN, FileOut;
+            emRet = FileM.Open(Ctx.bConvertM ? sMBin : sMPath);
+            if (emRet == emMatrixError::MATRIX_OK) emRet = FileN.Open(Ctx.bConvertN ? sNBin : sNPath);
+            if (emRet == emMatrixError::MATRIX_OK) emRet = FileOut.Open(sOutBin, true);
+            if (emRet == emMatrixError::MATRIX_OK) {
+                const Partition<long> Rows = Partition<long>::Block(Ctx.lMRow, Processor.iSize());
+                emRet = OOCMatMul(FileM, FileN, FileOut, (size_t)Rows.Low(Processor.iRank()),
+                                  (size_t)Rows.Low(Processor.iRank() + 1), ulMemBytes, pStats);
+            }
+        }
+        int iRet = (int)emRet, iWorst = 0;
+        MPI_Allreduce(&iRet, &iWorst, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+        /** Main process: CSV result and temporaries */
+        if (Processor.iRank() == 0) {
+            if (iWorst == MATRIX_OK and bCSVOut) iWorst = BinaryToCSV<T>(sOutBin, sResultPath);
+            if (Ctx.bConvertM) remove(sMBin.c_str());
+            if (Ctx.bConvertN) remove(sNBin.c_str());
+            if (bCSVOut) remove(sOutBin.c_str());
+        }
+        MPI_Bcast(&iWorst, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        return (emMatrixError)iWorst;
+    }
+}
+
+#endif
@@ -0,0 +1,140 @@
+/**
+ * @file SharedMatrix.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief A read-only operand held once per node in an MPI shared memory window
+ * @version 0.1
+ * @date 2022-06-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef SHAREDMATRIX_HPP
+#define SHAREDMATRIX_HPP
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include <mpi.h>
+
+#include "MPIProcessorInfo.hpp"
+#include "MatCodec.hpp"
+
+namespace mpimath {
+    /**
+     * @brief MPI_COMM_WORLD split by node
+     *
+     * @struct NodeComm    processes sharing memory with this one, rank 0 is the node leader
+     * @struct LeaderComm  the node leaders, MPI_COMM_NULL on other processes;
+     *                     world rank 0 is always leader 0
+     */
+    typedef struct {
+        MPI_Comm NodeComm;
+        MPI_Comm LeaderComm;
+        int iNodeRank;
+        int iNodeSize;
+    } tNodeComms;
+
+    /**
+     * @brief The node communicators of MPITopology(), collective on the first call
+     *
+     */
+    inline const tNodeComms& NodeComms() {
+        static tNodeComms Comms = [] {
+            const tMPITopology& Topo = MPITopology();
+            return tNodeComms{ Topo.NodeComm, Topo.LeaderComm, Topo.iNodeRank, Topo.iNodeSize };
+        }();
+        return Comms;
+    }
+
+    /**
+     * @brief MPIMATH_SHARED_N=1 shares the broadcast N through a node window
+     *
+     */
+    inline bool SharedNFromEnv() {
+        const char* sEnv = getenv("MPIMATH_SHARED_N");
+        return sEnv != nullptr and atoi(sEnv) != 0;
+    }
+
+    /**
+     * @brief ulRow x ulCol elements allocated once per node with
+     * MPI_Win_allocate_shared, every process of the node reads the leader's copy
+     *
+     * Construction and destruction are collective over MPI_COMM_WORLD (the
+     * window over the node communicator).
+     *
+     * @tparam T trivially copyable element type
+     */
+    template<typename T>
+    class SharedMatrix {
+    public:
+        SharedMatrix(size_t ulRow, size_t ulCol) : _ulRow(ulRow), _ulCol(ulCol) {
+            const tNodeComms& Comms = NodeComms();
+            MPI_Aint lBytes = Comms.iNodeRank == 0 ? (MPI_Aint)(ulRow * ulCol * sizeof(T)) : 0;
+            T* pLocal = nullptr;
+            MPI_Win_allocate_shared(lBytes, sizeof(T), MPI_INFO_NULL, Comms.NodeComm, &pLocal, &_Win);
+            MPI_Aint lSize;
+            int iDispUnit;
+            MPI_Win_shared_query(_Win, 0, &lSize, &iDispUnit, &_pData);
+        }
+
+        ~SharedMatrix() {
+            MPI_Win_free(&_Win);
+        }
+
+        SharedMatrix(const SharedMatrix&) = delete;
+        SharedMatrix& operator=(const SharedMatrix&) = delete;
+
+        inline const T* pData() const { return _pData; };
+
+        inline size_t ulRow() const { return _ulRow; };
+
+        inline size_t ulCol() const { return _ulCol; };
+
+        inline size_t Size() const { return _ulRow * _ulCol; };
+
+        /**
+         * @brief Fill every node's copy from pRoot on world rank 0
+         *
+         * World rank 0 copies into its node's window, the leaders broadcast
+         * among themselves (encoded when Codec asks for it), then the window
+         * is fenced so that every local process sees the data.
+         *
+         * @param pRoot read on world rank 0 only
+         * @param Codec
+         * @return int MPI_SUCCESS, MPI_ERR_TRUNCATE on a corrupt encoded chunk
+         */
+        int Bcast(const T* pRoot, const tCodecConfig& Codec) {
+            const tNodeComms& Comms = NodeComms();
+            int iWorldRank, iRet = MPI_SUCCESS;
+            MPI_Comm_rank(MPI_COMM_WORLD, &iWorldRank);
+            MPI_Win_fence(0, _Win);
+            if (Comms.LeaderComm != MPI_COMM_NULL) {
+                T* pWindow = (T*)_pData;
+                if (iWorldRank == 0 and Size() > 0) {
+                    memcpy(pWindow, pRoot, Size() * sizeof(T));
+                }
+                if (Codec.emMode != emCodecMode::NONE) {
+                    iRet = CodecBcast(pWindow, Size(), 0, Comms.LeaderComm, Codec);
+                } else {
+                    /** Bytes in pieces below INT_MAX */
+                    const size_t ulBytes = Size() * sizeof(T), ulPiece = (size_t)1 << 30;
+                    for (size_t ulLow = 0; ulLow < ulBytes; ulLow += ulPiece) {
+                        MPI_Bcast((char*)pWindow + ulLow, (int)std::min(ulPiece, ulBytes - ulLow), MPI_BYTE, 0, Comms.LeaderComm);
+                    }
+                }
+            }
+            MPI_Win_fence(0, _Win);
+            int iWorst = iRet;
+            MPI_Allreduce(&iRet, &iWorst, 1, MPI_INT, MPI_MAX, Comms.NodeComm);
+            return iWorst;
+        }
+
+    protected:
+        size_t _ulRow, _ulCol;
+        MPI_Win _Win = MPI_WIN_NULL;
+        T* _pData = nullptr;
+    };
+}
+
+#endif
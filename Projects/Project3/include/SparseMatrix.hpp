@@ -0,0 +1,673 @@
+/**
+ * @file SparseMatrix.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief CSR / BSR sparse matrices, SpMV and sparse @ dense SpMM
+ * @version 0.1
+ * @date 2022-06-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SPARSEMATRIX_HPP
+#define SPARSEMATRIX_HPP
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "Matrix.hpp"
+#include "Partition.hpp"
+#include "parallel.hpp"
+
+namespace mpimath {
+    /**
+     * @brief Header of the binary sparse format
+     *
+     * Followed by (ulRow + 1) uint64 row pointers, ulNnz int32 column indices
+     * and ulNnz values of uElemSize bytes each.
+     */
+    typedef struct {
+        char acMagic[8];
+        uint32_t uVersion;
+        uint32_t uElemSize;
+        uint64_t ulRow;
+        uint64_t ulCol;
+        uint64_t ulNnz;
+    } tSparseFileHeader;
+
+#define SPARSE_FILE_MAGIC "MPIMCSR"
+#define SPARSE_FILE_VERSION 1
+
+    /**
+     * @brief y[row] = sum(values[k] * x[colidx[k]]) over one CSR row
+     *
+     * The generic version is scalar, double and float gather x with AVX2.
+     */
+    template<typename T>
+    inline T _SpMVRow(const T* __restrict pValues, const int32_t* __restrict pColIdx, size_t ulLen, const T* __restrict x) {
+        T Sum = T(0);
+        for (size_t k = 0; k < ulLen; ++k) {
+            Sum += pValues[k] * x[pColIdx[k]];
+        }
+        return Sum;
+    }
+
+#if defined(__AVX2__) && defined(__FMA__)
+    inline double _SpMVRow(const double* __restrict pValues, const int32_t* __restrict pColIdx, size_t ulLen, const double* __restrict x) {
+        __m256d Acc = _mm256_setzero_pd();
+        size_t k = 0;
+        for (; k + 4 <= ulLen; k += 4) {
+            __m128i Idx = _mm_loadu_si128((const __m128i*)(pColIdx + k));
+            Acc = _mm256_fmadd_pd(_mm256_loadu_pd(pValues + k), _mm256_i32gather_pd(x, Idx, 8), Acc);
+        }
+        __m128d Half = _mm_add_pd(_mm256_castpd256_pd128(Acc), _mm256_extractf128_pd(Acc, 1));
+        double Sum = _mm_cvtsd_f64(_mm_add_sd(Half, _mm_unpackhi_pd(Half, Half)));
+        for (; k < ulLen; ++k) {
+            Sum += pValues[k] * x[pColIdx[k]];
+        }
+        return Sum;
+    }
+
+    inline float _SpMVRow(const float* __restrict pValues, const int32_t* __restrict pColIdx, size_t ulLen, const float* __restrict x) {
+        __m256 Acc = _mm256_setzero_ps();
+        size_t k = 0;
+        for (; k + 8 <= ulLen; k += 8) {
+            __m256i Idx = _mm256_loadu_si256((const __m256i*)(pColIdx + k));
+            Acc = _mm256_fmadd_ps(_mm256_loadu_ps(pValues + k), _mm256_i32gather_ps(x, Idx, 4), Acc);
+        }
+        __m128 Half = _mm_add_ps(_mm256_castps256_ps128(Acc), _mm256_extractf128_ps(Acc, 1));
+        Half = _mm_add_ps(Half, _mm_movehl_ps(Half, Half));
+        float Sum = _mm_cvtss_f32(_mm_add_ss(Half, _mm_movehdup_ps(Half)));
+        for (; k < ulLen; ++k) {
+            Sum += pValues[k] * x[pColIdx[k]];
+        }
+        return Sum;
+    }
+#endif
+
+    /**
+     * @brief Split rows [0, ulRow) of a row pointer array into iParts ranges
+     * holding about the same number of nonzeros
+     *
+     * @param pRowPtr   ulRow + 1 offsets
+     * @param ulRow
+     * @param iPart
+     * @param iParts
+     * @return size_t   first row of iPart, iPart == iParts gives ulRow
+     */
+    inline size_t NnzBalancedRowLow(const size_t* pRowPtr, size_t ulRow, long iPart, long iParts) {
+        if (iPart <= 0) return 0;
+        if (iPart >= iParts) return ulRow;
+        const size_t ulTarget = (size_t)Partition<int64_t>::Block((int64_t)pRowPtr[ulRow], (int)iParts).Low((int)iPart);
+        return (size_t)(std::lower_bound(pRowPtr, pRowPtr + ulRow + 1, ulTarget) - pRowPtr);
+    }
+
+    /**
+     * @brief Compressed sparse row matrix
+     *
+     * Column indices are int32 so that SpMV can gather with them, the number
+     * of columns is limited to INT_MAX.
+     *
+     * @tparam T data type
+     */
+    template<typename T>
+    class CSRMatrix {
+    public:
+        /**
+         * @brief Construct a new empty CSRMatrix object
+         *
+         */
+        CSRMatrix() {};
+
+        /**
+         * @brief Construct a ulRow x ulCol matrix without nonzeros
+         *
+         * @param ulRow
+         * @param ulCol
+         */
+        CSRMatrix(size_t ulRow, size_t ulCol) : _ulRow(ulRow), _ulCol(ulCol), _vecRowPtr(ulRow + 1, 0) {}
+
+        /**
+         * @brief Construct from raw CSR arrays, the arrays are copied
+         *
+         * @param ulRow
+         * @param ulCol
+         * @param pRowPtr   ulRow + 1 offsets, pRowPtr[0] may be non zero
+         * @param pColIdx
+         * @param pValues
+         */
+        CSRMatrix(size_t ulRow, size_t ulCol, const size_t* pRowPtr, const int32_t* pColIdx, const T* pValues)
+            : _ulRow(ulRow), _ulCol(ulCol), _vecRowPtr(ulRow + 1) {
+            const size_t ulBase = pRowPtr[0];
+            for (size_t row = 0; row <= ulRow; ++row) {
+                _vecRowPtr[row] = pRowPtr[row] - ulBase;
+            }
+            _vecColIdx.assign(pColIdx, pColIdx + _vecRowPtr[ulRow]);
+            _vecValues.assign(pValues, pValues + _vecRowPtr[ulRow]);
+        }
+
+        /**
+         * @brief Build from (row, col, value) triplets, duplicates are summed
+         *
+         * @param ulRow
+         * @param ulCol
+         * @param vecTriplets
+         * @return CSRMatrix<T>
+         */
+        static CSRMatrix<T> FromTriplets(size_t ulRow, size_t ulCol, std::vector<std::tuple<size_t, size_t, T>> vecTriplets) {
+            CSRMatrix<T> Res(ulRow, ulCol);
+            std::sort(vecTriplets.begin(), vecTriplets.end(),
+                      [](const std::tuple<size_t, size_t, T>& A, const std::tuple<size_t, size_t, T>& B) {
+                          return std::get<0>(A) != std::get<0>(B) ? std::get<0>(A) < std::get<0>(B) : std::get<1>(A) < std::get<1>(B);
+                      });
+            Res._vecColIdx.reserve(vecTriplets.size());
+            Res._vecValues.reserve(vecTriplets.size());
+            for (size_t idx = 0; idx < vecTriplets.size(); ++idx) {
+                size_t row = std::get<0>(vecTriplets[idx]), col = std::get<1>(vecTriplets[idx]);
+                if (idx > 0 and row == std::get<0>(vecTriplets[idx - 1]) and col == std::get<1>(vecTriplets[idx - 1])) {
+                    Res._vecValues.back() += std::get<2>(vecTriplets[idx]);
+                    continue;
+                }
+                Res._vecColIdx.push_back((int32_t)col);
+                Res._vecValues.push_back(std::get<2>(vecTriplets[idx]));
+                Res._vecRowPtr[row + 1]++;
+            }
+            for (size_t row = 0; row < ulRow; ++row) {
+                Res._vecRowPtr[row + 1] += Res._vecRowPtr[row];
+            }
+            return Res;
+        }
+
+        /**
+         * @brief Keep the elements of a dense matrix whose magnitude is above Threshold
+         *
+         * @param Src
+         * @param Threshold
+         * @return CSRMatrix<T>
+         */
+        static CSRMatrix<T> FromDense(const Matrix2D<T>& Src, T Threshold = T(0)) {
+            CSRMatrix<T> Res(Src.ulRow(), Src.ulCol());
+            for (size_t row = 0; row < Src.ulRow(); ++row) {
+                for (size_t col = 0; col < Src.ulCol(); ++col) {
+                    T Value = Src.pData()[row * Src.ulCol() + col];
+                    if (Value > Threshold or -Value > Threshold) {
+                        Res._vecColIdx.push_back((int32_t)col);
+                        Res._vecValues.push_back(Value);
+                    }
+                }
+                Res._vecRowPtr[row + 1] = Res._vecColIdx.size();
+            }
+            return Res;
+        }
+
+        /**
+         * @brief Expand to a dense matrix
+         *
+         * @return Matrix2D<T>
+         */
+        Matrix2D<T> ToDense() const {
+            Matrix2D<T> Res(_ulRow, _ulCol, true);
+            for (size_t row = 0; row < _ulRow; ++row) {
+                for (size_t k = _vecRowPtr[row]; k < _vecRowPtr[row + 1]; ++k) {
+                    Res.pData()[row * _ulCol + _vecColIdx[k]] += _vecValues[k];
+                }
+            }
+            return Res;
+        }
+
+        inline size_t ulRow() const { return _ulRow; };
+
+        inline size_t ulCol() const { return _ulCol; };
+
+        inline size_t ulNnz() const { return _vecValues.size(); };
+
+        inline const size_t* pRowPtr() const { return _vecRowPtr.data(); };
+
+        inline const int32_t* pColIdx() const { return _vecColIdx.data(); };
+
+        inline const T* pValues() const { return _vecValues.data(); };
+
+        /**
+         * @brief Return if a matrix is valid
+         *
+         * @return true
+         * @return false
+         */
+        bool IsValid() const {
+            return _vecRowPtr.size() == _ulRow + 1 and _ulRow > 0;
+        }
+
+        /**
+         * @brief y = Self @ x
+         *
+         * Rows are split over threads by nonzero count, not by row count.
+         *
+         * @param x         ulCol elements
+         * @param y         ulRow elements
+         * @param uThreads  0 for DefaultNumThreads()
+         */
+        void SpMV(const T* x, T* y, unsigned uThreads = 0) const {
+            if (uThreads == 0) uThreads = _DefaultThreads(1);
+            ParallelFor(0, uThreads, [&](size_t ulLow, size_t ulHigh, unsigned) {
+                for (size_t uPart = ulLow; uPart < ulHigh; ++uPart) {
+                    const size_t ulRowLow = NnzBalancedRowLow(pRowPtr(), _ulRow, uPart, uThreads);
+                    const size_t ulRowHigh = NnzBalancedRowLow(pRowPtr(), _ulRow, uPart + 1, uThreads);
+                    for (size_t row = ulRowLow; row < ulRowHigh; ++row) {
+                        const size_t k = _vecRowPtr[row];
+                        y[row] = _SpMVRow(_vecValues.data() + k, _vecColIdx.data() + k, _vecRowPtr[row + 1] - k, x);
+                    }
+                }
+            }, uThreads);
+        }
+
+        /**
+         * @brief Res = Self @ N, N is dense
+         *
+         * Each nonzero a(i, k) adds a(i, k) * N[k, :] to Res[i, :], the inner
+         * loop runs over contiguous rows and is vectorized by the compiler.
+         *
+         * @param N
+         * @param Res   resized to ulRow x N.ulCol()
+         * @param uThreads 0 for DefaultNumThreads()
+         */
+        template<typename AllocN, typename AllocRes>
+        void SpMM(const Matrix2D<T, AllocN>& N, Matrix2D<T, AllocRes>& Res, unsigned uThreads = 0) const {
+            if (_ulCol != N.ulRow()) {
+                throw MATRIX_ERR_SHAPE;
+            }
+            if (Res.ulRow() != _ulRow or Res.ulCol() != N.ulCol()) {
+                Res.Init(_ulRow, N.ulCol(), false);
+            }
+            const size_t ulNCol = N.ulCol();
+            if (uThreads == 0) uThreads = _DefaultThreads(ulNCol);
+            ParallelFor(0, uThreads, [&](size_t ulLow, size_t ulHigh, unsigned) {
+                for (size_t uPart = ulLow; uPart < ulHigh; ++uPart) {
+                    const size_t ulRowLow = NnzBalancedRowLow(pRowPtr(), _ulRow, uPart, uThreads);
+                    const size_t ulRowHigh = NnzBalancedRowLow(pRowPtr(), _ulRow, uPart + 1, uThreads);
+                    for (size_t row = ulRowLow; row < ulRowHigh; ++row) {
+                        T* __restrict pOut = Res.pData() + row * ulNCol;
+                        std::fill(pOut, pOut + ulNCol, T(0));
+                        for (size_t k = _vecRowPtr[row]; k < _vecRowPtr[row + 1]; ++k) {
+                            const T Value = _vecValues[k];
+                            const T* __restrict pIn = N.pData() + (size_t)_vecColIdx[k] * ulNCol;
+                            for (size_t col = 0; col < ulNCol; ++col) {
+                                pOut[col] += Value * pIn[col];
+                            }
+                        }
+                    }
+                }
+            }, uThreads);
+        }
+
+        /**
+         * @brief Return the result of sparse @ dense multiplication
+         *
+         * @param N The matrix to multiply: Self @ N
+         * @return Matrix2D<T> Result
+         */
+        Matrix2D<T> operator*(const Matrix2D<T>& N) const {
+            Matrix2D<T> Res(_ulRow, N.ulCol());
+            SpMM(N, Res);
+            return Res;
+        }
+
+        /**
+         * @brief Copy rows [ulRowLow, ulRowHigh) into a new matrix
+         *
+         * @param ulRowLow
+         * @param ulRowHigh
+         * @return CSRMatrix<T>
+         */
+        CSRMatrix<T> RowSlice(size_t ulRowLow, size_t ulRowHigh) const {
+            return CSRMatrix<T>(ulRowHigh - ulRowLow, _ulCol, pRowPtr() + ulRowLow, pColIdx(), pValues());
+        }
+
+        /**
+         * @brief Read a Matrix Market coordinate file (.mtx)
+         *
+         * real / integer / pattern fields and general / symmetric layouts are
+         * accepted, indices are 1-based as in the format.
+         *
+         * @param sPath Path to .mtx file
+         * @return emMatrixError Status
+         */
+        emMatrixError ReadMTX(const std::string& sPath) {
+            std::ifstream InFile;
+            std::string sLine;
+
+            /** Open file */
+            InFile.open(sPath, std::ios::in);
+            if (not InFile.is_open()) {
+                return emMatrixError::MATRIX_ERR_IO;
+            }
+
+            /** Banner and comments */
+            bool bPattern = false, bSymmetric = false;
+            if (not std::getline(InFile, sLine)) {
+                return emMatrixError::MATRIX_ERR_DATA;
+            }
+            if (sLine.compare(0, 14, "%%MatrixMarket") == 0) {
+                if (sLine.find("coordinate") == std::string::npos) {
+                    return emMatrixError::MATRIX_ERR_DATA;
+                }
+                bPattern = sLine.find("pattern") != std::string::npos;
+                bSymmetric = sLine.find("symmetric") != std::string::npos;
+            }
+            while (sLine.empty() or sLine[0] == '%') {
+                if (not std::getline(InFile, sLine)) {
+                    return emMatrixError::MATRIX_ERR_DATA;
+                }
+            }
+
+            /** Size line: rows cols nnz */
+            size_t ulRow = 0, ulCol = 0, ulNnz = 0;
+            if (sscanf(sLine.c_str(), "%zu %zu %zu", &ulRow, &ulCol, &ulNnz) != 3 or ulCol > INT_MAX) {
+                return emMatrixError::MATRIX_ERR_SHAPE;
+            }
+
+            std::vector<std::tuple<size_t, size_t, T>> vecTriplets;
+            vecTriplets.reserve(bSymmetric ? 2 * ulNnz : ulNnz);
+            for (size_t idx = 0; idx < ulNnz; ++idx) {
+                if (not std::getline(InFile, sLine)) {
+                    return emMatrixError::MATRIX_ERR_DATA;
+                }
+                char* pEnd = nullptr;
+                size_t row = strtoull(sLine.c_str(), &pEnd, 10);
+                size_t col = strtoull(pEnd, &pEnd, 10);
+                double dValue = bPattern ? 1.0 : strtod(pEnd, &pEnd);
+                if (row < 1 or row > ulRow or col < 1 or col > ulCol) {
+                    return emMatrixError::MATRIX_ERR_SHAPE;
+                }
+                vecTriplets.emplace_back(row - 1, col - 1, (T)dValue);
+                if (bSymmetric and row != col) {
+                    vecTriplets.emplace_back(col - 1, row - 1, (T)dValue);
+                }
+            }
+
+            *this = FromTriplets(ulRow, ulCol, std::move(vecTriplets));
+            InFile.close();
+            return emMatrixError::MATRIX_OK;
+        }
+
+        /**
+         * @brief Dump the matrix to a Matrix Market coordinate file
+         *
+         * @param sPath Path to .mtx file
+         * @return emMatrixError Status
+         */
+        emMatrixError DumpMTX(const std::string& sPath) const {
+            if (not IsValid()) {
+                return emMatrixError::MATRIX_ERR_NULL;
+            }
+            std::ofstream OutFile;
+            OutFile.open(sPath, std::ios::out);
+            if (not OutFile.is_open()) {
+                return emMatrixError::MATRIX_ERR_IO;
+            }
+            OutFile.precision(17);
+            OutFile << "%%MatrixMarket matrix coordinate real general\n";
+            OutFile << _ulRow << " " << _ulCol << " " << ulNnz() << "\n";
+            for (size_t row = 0; row < _ulRow; ++row) {
+                for (size_t k = _vecRowPtr[row]; k < _vecRowPtr[row + 1]; ++k) {
+                    OutFile << row + 1 << " " << _vecColIdx[k] + 1 << " " << +_vecValues[k] << "\n";
+                }
+            }
+            OutFile.close();
+            return emMatrixError::MATRIX_OK;
+        }
+
+        /**
+         * @brief Read the binary format written by DumpBinary
+         *
+         * @param sPath
+         * @return emMatrixError Status
+         */
+        emMatrixError ReadBinary(const std::string& sPath) {
+            FILE* pFile = fopen(sPath.c_str(), "rb");
+            if (pFile == nullptr) {
+                return emMatrixError::MATRIX_ERR_IO;
+            }
+            tSparseFileHeader Header;
+            if (fread(&Header, sizeof(Header), 1, pFile) != 1 or
+                memcmp(Header.acMagic, SPARSE_FILE_MAGIC, sizeof(SPARSE_FILE_MAGIC)) != 0 or
+                Header.uVersion != SPARSE_FILE_VERSION) {
+                fclose(pFile);
+                return emMatrixError::MATRIX_ERR_DATA;
+            }
+            if (Header.uElemSize != sizeof(T) or Header.ulCol > INT_MAX) {
+                fclose(pFile);
+                return emMatrixError::MATRIX_ERR_SHAPE;
+            }
+
+            std::vector<uint64_t> vecRowPtr(Header.ulRow + 1);
+            CSRMatrix<T> Res(Header.ulRow, Header.ulCol);
+            Res._vecColIdx.resize(Header.ulNnz);
+            Res._vecValues.resize(Header.ulNnz);
+            bool bOK = fread(vecRowPtr.data(), sizeof(uint64_t), vecRowPtr.size(), pFile) == vecRowPtr.size() and
+                       fread(Res._vecColIdx.data(), sizeof(int32_t), Header.ulNnz, pFile) == Header.ulNnz and
+                       fread(Res._vecValues.data(), sizeof(T), Header.ulNnz, pFile) == Header.ulNnz;
+            fclose(pFile);
+            if (not bOK or vecRowPtr[0] != 0 or vecRowPtr[Header.ulRow] != Header.ulNnz) {
+                return emMatrixError::MATRIX_ERR_DATA;
+            }
+            std::copy(vecRowPtr.begin(), vecRowPtr.end(), Res._vecRowPtr.begin());
+            *this = std::move(Res);
+            return emMatrixError::MATRIX_OK;
+        }
+
+        /**
+         * @brief Dump the raw CSR arrays behind a tSparseFileHeader
+         *
+         * @param sPath
+         * @return emMatrixError Status
+         */
+        emMatrixError DumpBinary(const std::string& sPath) const {
+            if (not IsValid()) {
+                return emMatrixError::MATRIX_ERR_NULL;
+            }
+            FILE* pFile = fopen(sPath.c_str(), "wb");
+            if (pFile == nullptr) {
+                return emMatrixError::MATRIX_ERR_IO;
+            }
+            tSparseFileHeader Header = { SPARSE_FILE_MAGIC, SPARSE_FILE_VERSION, (uint32_t)sizeof(T), _ulRow, _ulCol, ulNnz() };
+            std::vector<uint64_t> vecRowPtr(_vecRowPtr.begin(), _vecRowPtr.end());
+            bool bOK = fwrite(&Header, sizeof(Header), 1, pFile) == 1 and
+                       fwrite(vecRowPtr.data(), sizeof(uint64_t), vecRowPtr.size(), pFile) == vecRowPtr.size() and
+                       fwrite(_vecColIdx.data(), sizeof(int32_t), ulNnz(), pFile) == ulNnz() and
+                       fwrite(_vecValues.data(), sizeof(T), ulNnz(), pFile) == ulNnz();
+            fclose(pFile);
+            return bOK ? emMatrixError::MATRIX_OK : emMatrixError::MATRIX_ERR_IO;
+        }
+
+    protected:
+        size_t _ulRow = 0, _ulCol = 0;
+        std::vector<size_t> _vecRowPtr; /** ulRow + 1 offsets into _vecColIdx / _vecValues */
+        std::vector<int32_t> _vecColIdx;
+        std::vector<T> _vecValues;
+
+        /** Spawn threads only when each gets a useful number of multiply-adds */
+        unsigned _DefaultThreads(size_t ulWorkPerNnz) const {
+            size_t ulMaxThreads = ulNnz() * ulWorkPerNnz / (1 << 16) + 1;
+            unsigned uThreads = DefaultNumThreads();
+            return uThreads > ulMaxThreads ? (unsigned)ulMaxThreads : uThreads;
+        }
+    };
+
+    /**
+     * @brief Block sparse row matrix with square ulBlock x ulBlock blocks
+     *
+     * Every stored block is dense and row-major, which suits matrices whose
+     * nonzeros come in small clusters (FEM, graph with vertex features...).
+     *
+     * @tparam T data type
+     */
+    template<typename T>
+    class BSRMatrix {
+    public:
+        /**
+         * @brief Construct a new empty BSRMatrix object
+         *
+         */
+        BSRMatrix() {};
+
+        /**
+         * @brief Convert from CSR, a block is stored if any of its elements is
+         * stored. Rows / columns are padded with zeros up to a multiple of ulBlock.
+         *
+         * @param Src
+         * @param ulBlock
+         * @return BSRMatrix<T>
+         */
+        static BSRMatrix<T> FromCSR(const CSRMatrix<T>& Src, size_t ulBlock) {
+            BSRMatrix<T> Res;
+            Res._ulRow = Src.ulRow();
+            Res._ulCol = Src.ulCol();
+            Res._ulBlock = ulBlock;
+            const size_t ulBlockRows = (Src.ulRow() + ulBlock - 1) / ulBlock;
+            const size_t ulBlockCols = (Src.ulCol() + ulBlock - 1) / ulBlock;
+            Res._vecBlockRowPtr.assign(ulBlockRows + 1, 0);
+
+            /** Position of block column bc in the current block row, -1 if absent */
+            std::vector<long> vecSlot(ulBlockCols, -1);
+            for (size_t br = 0; br < ulBlockRows; ++br) {
+                const size_t ulFirst = Res._vecBlockColIdx.size();
+                const size_t ulRowEnd = std::min((br + 1) * ulBlock, Src.ulRow());
+                for (size_t row = br * ulBlock; row < ulRowEnd; ++row) {
+                    for (size_t k = Src.pRowPtr()[row]; k < Src.pRowPtr()[row + 1]; ++k) {
+                        const size_t bc = Src.pColIdx()[k] / ulBlock;
+                        if (vecSlot[bc] < 0) {
+                            vecSlot[bc] = (long)Res._vecBlockColIdx.size();
+                            Res._vecBlockColIdx.push_back((int32_t)bc);
+                            Res._vecValues.resize(Res._vecValues.size() + ulBlock * ulBlock, T(0));
+                        }
+                        T* pBlock = Res._vecValues.data() + vecSlot[bc] * ulBlock * ulBlock;
+                        pBlock[(row - br * ulBlock) * ulBlock + Src.pColIdx()[k] % ulBlock] += Src.pValues()[k];
+                    }
+                }
+                for (size_t idx = ulFirst; idx < Res._vecBlockColIdx.size(); ++idx) {
+                    vecSlot[Res._vecBlockColIdx[idx]] = -1;
+                }
+                Res._vecBlockRowPtr[br + 1] = Res._vecBlockColIdx.size();
+            }
+            return Res;
+        }
+
+        inline size_t ulRow() const { return _ulRow; };
+
+        inline size_t ulCol() const { return _ulCol; };
+
+        inline size_t ulBlock() const { return _ulBlock; };
+
+        inline size_t ulNumBlocks() const { return _vecBlockColIdx.size(); };
+
+        /**
+         * @brief y = Self @ x
+         *
+         * @param x         ulCol elements
+         * @param y         ulRow elements
+         * @param uThreads  0 for DefaultNumThreads()
+         */
+        void SpMV(const T* x, T* y, unsigned uThreads = 0) const {
+            const size_t ulBlockRows = _vecBlockRowPtr.size() - 1, B = _ulBlock;
+            ParallelFor(0, ulBlockRows, [&](size_t ulLow, size_t ulHigh, unsigned) {
+                std::vector<T> vecAcc(B);
+                for (size_t br = ulLow; br < ulHigh; ++br) {
+                    std::fill(vecAcc.begin(), vecAcc.end(), T(0));
+                    for (size_t idx = _vecBlockRowPtr[br]; idx < _vecBlockRowPtr[br + 1]; ++idx) {
+                        const T* pBlock = _vecValues.data() + idx * B * B;
+                        const size_t ulColLow = (size_t)_vecBlockColIdx[idx] * B;
+                        const size_t ulWidth = std::min(B, _ulCol - ulColLow);
+                        for (size_t r = 0; r < B; ++r) {
+                            T Sum = T(0);
+                            for (size_t c = 0; c < ulWidth; ++c) {
+                                Sum += pBlock[r * B + c] * x[ulColLow + c];
+                            }
+                            vecAcc[r] += Sum;
+                        }
+                    }
+                    const size_t ulHeight = std::min(B, _ulRow - br * B);
+                    std::copy(vecAcc.begin(), vecAcc.begin() + ulHeight, y + br * B);
+                }
+            }, uThreads == 0 ? _DefaultThreads(1) : uThreads);
+        }
+
+        /**
+         * @brief Res = Self @ N, N is dense. Each block is a small dense gemm
+         * accumulated into a block row of Res.
+         *
+         * @param N
+         * @param Res   resized to ulRow x N.ulCol()
+         * @param uThreads 0 for DefaultNumThreads()
+         */
+        template<typename AllocN, typename AllocRes>
+        void SpMM(const Matrix2D<T, AllocN>& N, Matrix2D<T, AllocRes>& Res, unsigned uThreads = 0) const {
+            if (_ulCol != N.ulRow()) {
+                throw MATRIX_ERR_SHAPE;
+            }
+            if (Res.ulRow() != _ulRow or Res.ulCol() != N.ulCol()) {
+                Res.Init(_ulRow, N.ulCol(), false);
+            }
+            const size_t ulBlockRows = _vecBlockRowPtr.size() - 1, B = _ulBlock, ulNCol = N.ulCol();
+            ParallelFor(0, ulBlockRows, [&](size_t ulLow, size_t ulHigh, unsigned) {
+                for (size_t br = ulLow; br < ulHigh; ++br) {
+                    const size_t ulHeight = std::min(B, _ulRow - br * B);
+                    T* __restrict pOut = Res.pData() + br * B * ulNCol;
+                    std::fill(pOut, pOut + ulHeight * ulNCol, T(0));
+                    for (size_t idx = _vecBlockRowPtr[br]; idx < _vecBlockRowPtr[br + 1]; ++idx) {
+                        const T* pBlock = _vecValues.data() + idx * B * B;
+                        const size_t ulColLow = (size_t)_vecBlockColIdx[idx] * B;
+                        const size_t ulWidth = std::min(B, _ulCol - ulColLow);
+                        for (size_t r = 0; r < ulHeight; ++r) {
+                            for (size_t c = 0; c < ulWidth; ++c) {
+                                const T Value = pBlock[r * B + c];
+                                const T* __restrict pIn = N.pData() + (ulColLow + c) * ulNCol;
+                                for (size_t col = 0; col < ulNCol; ++col) {
+                                    pOut[r * ulNCol + col] += Value * pIn[col];
+                                }
+                            }
+                        }
+                    }
+                }
+            }, uThreads == 0 ? _DefaultThreads(ulNCol) : uThreads);
+        }
+
+        /**
+         * @brief Return the result of sparse @ dense multiplication
+         *
+         * @param N The matrix to multiply: Self @ N
+         * @return Matrix2D<T> Result
+         */
+        Matrix2D<T> operator*(const Matrix2D<T>& N) const {
+            Matrix2D<T> Res(_ulRow, N.ulCol());
+            SpMM(N, Res);
+            return Res;
+        }
+
+    protected:
+        size_t _ulRow = 0, _ulCol = 0, _ulBlock = 1;
+        std::vector<size_t> _vecBlockRowPtr;
+        std::vector<int32_t> _vecBlockColIdx;
+        std::vector<T> _vecValues; /** ulBlock * ulBlock per block */
+
+        unsigned _DefaultThreads(size_t ulWorkPerElem) const {
+            size_t ulMaxThreads = _vecValues.size() * ulWorkPerElem / (1 << 16) + 1;
+            unsigned uThreads = DefaultNumThreads();
+            return uThreads > ulMaxThreads ? (unsigned)ulMaxThreads : uThreads;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @file Tuning.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Runtime selected gemm kernels and block sizes, persisted per CPU model
+ * @version 0.1
+ * @date 2022-06-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef TUNING_HPP
+#define TUNING_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/** Path of the tuning file read on the first gemm_f32 / gemm_f64 / MPIMatMulMain call */
+#define TUNING_FILE_ENV "MPIMATH_TUNING_FILE"
+/** File written by tools/autotune when neither an argument nor the env names one */
+#define TUNING_DEFAULT_FILE "mpimath_tuning.txt"
+
+namespace mpimath {
+    /**
+     * @brief Inner kernels of gemm_f32 / gemm_f64
+     *
+     * NAIVE    i-k-j loop, the default without OPTIMIZE_GEMM
+     * ROW      one row of m broadcast against 2 vectors of n, default of OPTIMIZE_GEMM == 1
+     * UNROLL   one vector width of rows and of k at a time, default of OPTIMIZE_GEMM == 2
+     */
+    enum class emGemmKernel : int {
+        NAIVE = 0,
+        ROW = 1,
+        UNROLL = 2,
+        COUNT
+    };
+
+    /**
+     * @brief Products are tuned per class of shape rather than per shape
+     *
+     * SMALL    m * k * n <= 128^3
+     * SKINNY   one dimension <= 32
+     * MEDIUM   m * k * n <= 768^3
+     * LARGE    everything else
+     */
+    enum class emShapeClass : int {
+        SMALL = 0,
+        SKINNY,
+        MEDIUM,
+        LARGE,
+        COUNT
+    };
+
+    /**
+     * @brief Kernel and cache blocking of one product
+     *
+     * @struct ulMC, ulKC, ulNC rows of m, depth and columns of n per block, 0 for the whole dimension
+     */
+    typedef struct {
+        emGemmKernel emKernel;
+        size_t ulMC;
+        size_t ulKC;
+        size_t ulNC;
+    } tGemmParams;
+
+    /**
+     * @brief One line of a tuning file
+     *
+     * @struct sOp        "gemm_f32", "gemm_f64" or "matmul"
+     * @struct Gemm       used by the gemm_* entries
+     * @struct lTileRows  used by the matmul entry: rows of M per message, 0 for one block per worker
+     * @struct dGFlops    measured by the autotuner, informative only
+     */
+    typedef struct {
+        std::string sCPU;
+        std::string sOp;
+        emShapeClass emShape;
+        tGemmParams Gemm;
+        long lTileRows;
+        double dGFlops;
+    } tTuningEntry;
+
+    emShapeClass ShapeClassOf(size_t m_hgt, size_t m_wid, size_t n_wid);
+
+    const char* ShapeClassName(emShapeClass emShape);
+
+    const char* GemmKernelName(emGemmKernel emKernel);
+
+    /**
+     * @brief "model name" of /proc/cpuinfo, "unknown" when there is none
+     *
+     */
+    const std::string& CPUModel();
+
+    /**
+     * @brief What gemm runs without a tuning file: the kernel picked by
+     * OPTIMIZE_GEMM, no blocking
+     *
+     */
+    tGemmParams GemmDefaultParams();
+
+    /**
+     * @brief Read a tuning file, lines of
+     * "cpu model<TAB>op<TAB>shape<TAB>kernel=2 mc=64 kc=256 nc=0 tile=0 gflops=1.5",
+     * '#' starts a comment
+     *
+     * @return int MATRIX_ERR_IO if the file can not be read, MATRIX_ERR_DATA on a bad line
+     */
+    int LoadTuningFile(const std::string& sPath, std::vector<tTuningEntry>& vecEntries);
+
+    /**
+     * @brief Write vecEntries in the format read by LoadTuningFile
+     *
+     * @return int MATRIX_ERR_IO if the file can not be written
+     */
+    int SaveTuningFile(const std::string& sPath, const std::vector<tTuningEntry>& vecEntries);
+
+    /**
+     * @brief Parameters for an m_hgt x m_wid @ m_wid x n_wid product
+     *
+     * The entries matching CPUModel() of $MPIMATH_TUNING_FILE, or else of
+     * mpimath_tuning.txt in the working directory (where autotune writes by
+     * default), are loaded on the first call; classes without an entry get
+     * GemmDefaultParams().
+     *
+     * @param sOp "gemm_f32" or "gemm_f64"
+     */
+    tGemmParams GemmTuning(const char* sOp, size_t m_hgt, size_t m_wid, size_t n_wid);
+
+    /**
+     * @brief Rows of M per message of MPIMatMulMain, 0 for one block per worker
+     *
+     */
+    long MatMulTileRows(size_t m_hgt, size_t m_wid, size_t n_wid);
+
+    /**
+     * @brief Replace the entry of Entry.sOp / Entry.emShape for this process
+     *
+     * Not synchronized with gemm calls running on other threads.
+     */
+    void SetTuning(const tTuningEntry& Entry);
+}
+
+#endif
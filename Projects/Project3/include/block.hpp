@@ -1,4 +1,7 @@
-#define BLOCK_LOW(iRank,iSize,iN)  ((iRank) * (iN) / (iSize))
+/** Kept for older code, the split is the one of Partition<int64_t>::Block() */
+#include "Partition.hpp"
+
+#define BLOCK_LOW(iRank,iSize,iN)  ((size_t)::mpimath::Partition<int64_t>::Block((int64_t)(iN), (int)(iSize)).Low((int)(iRank)))
 #define BLOCK_HIGH(iRank,iSize,iN) (BLOCK_LOW(((iRank) + 1), iSize, iN) - 1)
 #define BLOCK_SIZE(iRank,iSize,iN) (BLOCK_LOW((iRank) + 1, iSize, iN) - BLOCK_LOW((iRank), iSize, iN))
-#define BLOCK_OWNER(iIndex,iSize,iN) (((iSize) * (iIndex)+1) - 1) / (iN))
\ No newline at end of file
+#define BLOCK_OWNER(iIndex,iSize,iN) ((size_t)::mpimath::Partition<int64_t>::Block((int64_t)(iN), (int)(iSize)).Owner((int64_t)(iIndex)))
@@ -0,0 +1,202 @@
+/**
+ * @file csv.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Memory mapped, multithreaded CSV reader and writer used by
+ * Matrix2D::ReadCSV / Matrix2D::DumpCSV
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef CSV_HPP
+#define CSV_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+/** std::to_chars for floating point: shortest round-trip (Ryu) formatting */
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define CSV_HAS_TO_CHARS 1
+#else
+#define CSV_HAS_TO_CHARS 0
+#endif
+
+/** Upper bound of one formatted value, "-2.2250738585072014e-308" is 24 */
+#define CSV_MAX_VALUE_CHARS 32
+
+namespace mpimath {
+    /**
+     * @brief Parse one decimal floating point number in [p, pEnd)
+     *
+     * Correctly rounded: Clinger's fast path, then Eisel-Lemire on a 128 bit
+     * table of powers of five, then strtod for the rare inputs neither can
+     * decide (more than 19 digits, inf/nan, ambiguous rounding).
+     *
+     * @param p
+     * @param pEnd
+     * @param pdValue   the parsed value
+     * @return const char* first character after the number, nullptr if there is no number at p
+     */
+    const char* ParseDouble(const char* p, const char* pEnd, double* pdValue);
+
+    /**
+     * @brief A CSV file mapped in memory and cut into newline aligned chunks
+     *
+     * Open() maps the file and runs the shape pre-pass (SIMD newline count
+     * per chunk, column count of the first line), Parse() then lets every
+     * thread parse its chunks straight into the destination rows.
+     *
+     * Rows are separated by '\n' ('\r\n' is accepted), values by ',', one
+     * trailing ',' per line and blank lines at the end of the file are
+     * ignored. All functions return an emMatrixError value.
+     */
+    class CSVFile {
+    public:
+        CSVFile() {};
+        ~CSVFile();
+        CSVFile(const CSVFile&) = delete;
+        CSVFile& operator=(const CSVFile&) = delete;
+
+        /**
+         * @brief Map sPath and compute its shape
+         *
+         * @param sPath
+         * @param uThreads 0 for DefaultNumThreads()
+         * @return int MATRIX_ERR_IO if the file can not be mapped, MATRIX_ERR_DATA if it is empty
+         */
+        int Open(const std::string& sPath, unsigned uThreads = 0);
+
+        inline size_t ulRow() const { return _ulRow; };
+
+        inline size_t ulCol() const { return _ulCol; };
+
+        /**
+         * @brief Parse every value into pOut, row-major, ulRow x ulCol
+         *
+         * @return int MATRIX_ERR_SHAPE on a ragged row, MATRIX_ERR_DATA on a bad number
+         */
+        int Parse(double* pOut, unsigned uThreads = 0) const;
+        int Parse(float* pOut, unsigned uThreads = 0) const;
+
+        /**
+         * @brief Parse row by row, Fn(ulRowIdx, pRow) gets ulCol doubles and
+         * may be called from several threads at once
+         *
+         */
+        int ParseRows(const std::function<void(size_t, const double*)>& Fn, unsigned uThreads = 0) const;
+
+    protected:
+        const char* _pBegin = nullptr;
+        const char* _pEnd = nullptr; /** trailing blank lines excluded */
+        size_t _ulMapSize = 0;
+        size_t _ulRow = 0, _ulCol = 0;
+        std::vector<const char*> _vecChunkBegin; /** chunk c is [_vecChunkBegin[c], _vecChunkBegin[c + 1]) */
+        std::vector<size_t> _vecChunkRow;        /** first row of chunk c */
+
+        template<typename TOut, typename FnRow>
+        int _Parse(TOut* pOut, FnRow Fn, unsigned uThreads) const;
+    };
+
+    /**
+     * @brief Parse a mapped CSV into a T buffer: double / float directly,
+     * any other type through a per-row double buffer
+     *
+     */
+    template<typename T>
+    inline int CSVParseInto(const CSVFile& File, T* pOut) {
+        const size_t ulCol = File.ulCol();
+        return File.ParseRows([pOut, ulCol](size_t ulRowIdx, const double* pRow) {
+            for (size_t col = 0; col < ulCol; ++col) {
+                pOut[ulRowIdx * ulCol + col] = (T)pRow[col];
+            }
+        });
+    }
+
+    inline int CSVParseInto(const CSVFile& File, double* pOut) { return File.Parse(pOut); }
+
+    inline int CSVParseInto(const CSVFile& File, float* pOut) { return File.Parse(pOut); }
+
+    /**
+     * @brief Format one value at p, at most CSV_MAX_VALUE_CHARS characters
+     *
+     * double and float print the shortest string that parses back to the
+     * same value, integers print as numbers, bf16 / fp16 go through float.
+     *
+     * @return char* one past the last character written
+     */
+    inline char* CSVFormatValue(char* p, double dValue) {
+#if CSV_HAS_TO_CHARS
+        return std::to_chars(p, p + CSV_MAX_VALUE_CHARS, dValue).ptr;
+#else
+        return p + snprintf(p, CSV_MAX_VALUE_CHARS, "%.17g", dValue);
+#endif
+    }
+
+    inline char* CSVFormatValue(char* p, float fValue) {
+#if CSV_HAS_TO_CHARS
+        return std::to_chars(p, p + CSV_MAX_VALUE_CHARS, fValue).ptr;
+#else
+        return p + snprintf(p, CSV_MAX_VALUE_CHARS, "%.9g", (double)fValue);
+#endif
+    }
+
+    template<typename T>
+    inline typename std::enable_if<std::is_integral<T>::value, char*>::type CSVFormatValue(char* p, T Value) {
+        return p + snprintf(p, CSV_MAX_VALUE_CHARS, "%lld", (long long)Value);
+    }
+
+    template<typename T>
+    inline typename std::enable_if<not std::is_integral<T>::value, char*>::type CSVFormatValue(char* p, const T& Value) {
+        return CSVFormatValue(p, (float)Value);
+    }
+
+    /**
+     * @brief Write ulRow lines to sPath, FnFormatRow(ulRowIdx, pBuf) formats
+     * one line (with its '\n') into pBuf and returns its length, which must
+     * not exceed ulMaxRowBytes
+     *
+     * Row chunks are formatted in parallel into per-thread buffers, their
+     * lengths are prefix-summed into file offsets and every thread pwrite()s
+     * its buffer, so no thread waits on another one's output.
+     *
+     * @param sPath
+     * @param ulRow
+     * @param ulMaxRowBytes
+     * @param FnFormatRow may be called from several threads at once
+     * @param uThreads 0 for DefaultNumThreads()
+     * @return int MATRIX_ERR_IO if the file can not be created or written
+     */
+    int CSVWriteRows(const std::string& sPath, size_t ulRow, size_t ulMaxRowBytes,
+                     const std::function<size_t(size_t, char*)>& FnFormatRow, unsigned uThreads = 0);
+
+    /**
+     * @brief Dump a row-major ulRow x ulCol buffer as CSV
+     *
+     */
+    template<typename T>
+    inline int CSVWrite(const std::string& sPath, const T* pData, size_t ulRow, size_t ulCol, unsigned uThreads = 0) {
+        return CSVWriteRows(sPath, ulRow, ulCol * (CSV_MAX_VALUE_CHARS + 1) + 1, [pData, ulCol](size_t ulRowIdx, char* pBuf) {
+            const T* pRow = pData + ulRowIdx * ulCol;
+            char* p = pBuf;
+            for (size_t col = 0; col < ulCol; ++col) {
+                if (col > 0) *p++ = ',';
+                p = CSVFormatValue(p, pRow[col]);
+            }
+            *p++ = '\n';
+            return (size_t)(p - pBuf);
+        }, uThreads);
+    }
+}
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file dtype.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Reduced precision storage types and GEMM accumulator traits
+ * @version 0.1
+ * @date 2022-06-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef DTYPE_HPP
+#define DTYPE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace mpimath {
+    /**
+     * @brief bfloat16 storage type, the upper 16 bits of an IEEE float
+     *
+     * Arithmetic is done in float, the type is only used to halve the memory
+     * and network footprint of operands.
+     */
+    struct bf16_t {
+        uint16_t uBits;
+
+        bf16_t() = default;
+        bf16_t(float fValue) : uBits(FromFloat(fValue)) {}
+        bf16_t(double dValue) : uBits(FromFloat((float)dValue)) {}
+
+        operator float() const { return ToFloat(uBits); }
+
+        /**
+         * @brief float -> bf16 with round to nearest even, NaN is kept quiet
+         *
+         * @param fValue
+         * @return uint16_t
+         */
+        static inline uint16_t FromFloat(float fValue) {
+            uint32_t uValue;
+            memcpy(&uValue, &fValue, sizeof(uValue));
+            if ((uValue & 0x7fffffffu) > 0x7f800000u) {
+                return (uint16_t)((uValue >> 16) | 0x0040u);
+            }
+            uValue += 0x7fffu + ((uValue >> 16) & 1u);
+            return (uint16_t)(uValue >> 16);
+        }
+
+        static inline float ToFloat(uint16_t uBits) {
+            uint32_t uValue = (uint32_t)uBits << 16;
+            float fValue;
+            memcpy(&fValue, &uValue, sizeof(fValue));
+            return fValue;
+        }
+    };
+
+    /**
+     * @brief IEEE 754 binary16 storage type
+     *
+     */
+    struct fp16_t {
+        uint16_t uBits;
+
+        fp16_t() = default;
+        fp16_t(float fValue) : uBits(FromFloat(fValue)) {}
+        fp16_t(double dValue) : uBits(FromFloat((float)dValue)) {}
+
+        operator float() const { return ToFloat(uBits); }
+
+        /**
+         * @brief float -> half with round to nearest even
+         *
+         * @param fValue
+         * @return uint16_t
+         */
+        static inline uint16_t FromFloat(float fValue) {
+#ifdef __F16C__
+            return (uint16_t)_cvtss_sh(fValue, 0);
+#else
+            uint32_t uValue;
+            memcpy(&uValue, &fValue, sizeof(uValue));
+            uint32_t uSign = (uValue >> 16) & 0x8000u;
+            uint32_t uAbs = uValue & 0x7fffffffu;
+
+            if (uAbs >= 0x7f800000u) {
+                /** Inf or NaN */
+                return (uint16_t)(uSign | 0x7c00u | ((uAbs > 0x7f800000u) ? 0x0200u : 0u));
+            }
+            if (uAbs >= 0x477ff000u) {
+                /** Rounds to a value above 65504 */
+                return (uint16_t)(uSign | 0x7c00u);
+            }
+            if (uAbs < 0x38800000u) {
+                /** Subnormal half, let the FPU do the rounding */
+                float fAbs;
+                memcpy(&fAbs, &uAbs, sizeof(fAbs));
+                fAbs += 0.5f;
+                uint32_t uSub;
+                memcpy(&uSub, &fAbs, sizeof(uSub));
+                return (uint16_t)(uSign | (uSub - 0x3f000000u));
+            }
+            uint32_t uMantOdd = (uAbs >> 13) & 1u;
+            uAbs += 0xc8000fffu + uMantOdd; /** Rebias exponent (-112 << 23) and round */
+            return (uint16_t)(uSign | (uAbs >> 13));
+#endif
+        }
+
+        static inline float ToFloat(uint16_t uBits) {
+#ifdef __F16C__
+            return _cvtsh_ss(uBits);
+#else
+            uint32_t uSign = ((uint32_t)uBits & 0x8000u) << 16;
+            uint32_t uExp = (uBits >> 10) & 0x1fu;
+            uint32_t uMant = uBits & 0x3ffu;
+            uint32_t uValue;
+            if (uExp == 0x1fu) {
+                uValue = uSign | 0x7f800000u | (uMant << 13);
+            } else if (uExp != 0) {
+                uValue = uSign | ((uExp + 112u) << 23) | (uMant << 13);
+            } else if (uMant == 0) {
+                uValue = uSign;
+            } else {
+                /** Subnormal: value = mant * 2^-24 */
+                float fValue = (float)uMant * 5.9604644775390625e-8f;
+                memcpy(&uValue, &fValue, sizeof(uValue));
+                uValue |= uSign;
+            }
+            float fValue;
+            memcpy(&fValue, &uValue, sizeof(fValue));
+            return fValue;
+#endif
+        }
+    };
+
+    /**
+     * @brief Accumulator type used by gemm for operand type T
+     *
+     * @tparam T operand type
+     * @struct AccType  type of partial sums and of the widened result
+     * @fn FromAcc      narrow an accumulated value back to T
+     */
+    template<typename T>
+    struct tGemmTraits {
+        typedef T AccType;
+        static inline T FromAcc(const AccType& Value) { return Value; }
+    };
+
+    template<>
+    struct tGemmTraits<bf16_t> {
+        typedef float AccType;
+        static inline bf16_t FromAcc(const AccType& Value) { return bf16_t(Value); }
+    };
+
+    template<>
+    struct tGemmTraits<fp16_t> {
+        typedef float AccType;
+        static inline fp16_t FromAcc(const AccType& Value) { return fp16_t(Value); }
+    };
+
+    template<>
+    struct tGemmTraits<int8_t> {
+        typedef int32_t AccType;
+        /** Saturate, the same way the quantized result of an int8 layer is clamped */
+        static inline int8_t FromAcc(const AccType& Value) {
+            return (int8_t)(Value > INT8_MAX ? INT8_MAX : (Value < INT8_MIN ? INT8_MIN : Value));
+        }
+    };
+}
+
+#endif
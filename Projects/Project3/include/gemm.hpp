@@ -10,6 +10,11 @@
  */
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include "dtype.hpp"
+#include "Tuning.hpp"
+
 namespace mpimath {
     int gemm_f32(float* dout,
                  float* m,
@@ -25,4 +30,153 @@ namespace mpimath {
                  size_t m_wid,
                  size_t n_hgt,
                  size_t n_wid);
-}
\ No newline at end of file
+
+    /** gemm_f32 / gemm_f64 with an explicit kernel and blocking instead of GemmTuning() */
+    int gemm_f32_tuned(const tGemmParams& Params,
+                       float* dout,
+                       const float* m,
+                       const float* n,
+                       size_t m_hgt,
+                       size_t m_wid,
+                       size_t n_hgt,
+                       size_t n_wid);
+    int gemm_f64_tuned(const tGemmParams& Params,
+                       double* dout,
+                       const double* m,
+                       const double* n,
+                       size_t m_hgt,
+                       size_t m_wid,
+                       size_t n_hgt,
+                       size_t n_wid);
+
+    /** bf16 operands, fp32 accumulation and result */
+    int gemm_bf16(float* dout,
+                  const bf16_t* m,
+                  const bf16_t* n,
+                  size_t m_hgt,
+                  size_t m_wid,
+                  size_t n_hgt,
+                  size_t n_wid);
+    /** fp16 operands, fp32 accumulation and result */
+    int gemm_fp16(float* dout,
+                  const fp16_t* m,
+                  const fp16_t* n,
+                  size_t m_hgt,
+                  size_t m_wid,
+                  size_t n_hgt,
+                  size_t n_wid);
+    /** int8 operands, int32 accumulation and result */
+    int gemm_i8(int32_t* dout,
+                const int8_t* m,
+                const int8_t* n,
+                size_t m_hgt,
+                size_t m_wid,
+                size_t n_hgt,
+                size_t n_wid);
+    int gemm_i32(int32_t* dout,
+                 const int32_t* m,
+                 const int32_t* n,
+                 size_t m_hgt,
+                 size_t m_wid,
+                 size_t n_hgt,
+                 size_t n_wid);
+    int gemm_i64(int64_t* dout,
+                 const int64_t* m,
+                 const int64_t* n,
+                 size_t m_hgt,
+                 size_t m_wid,
+                 size_t n_hgt,
+                 size_t n_wid);
+
+    /**
+     * @brief Strided batched gemm, dout[b] = m[b] * n[b] for b in [0, batch)
+     *
+     * Meant for many small products (4x4 to 64x64): common shapes run a kernel
+     * specialized on M/K/N at compile time and the batch is split over threads.
+     *
+     * @param m_stride    elements between consecutive m, -1 for m_hgt * m_wid
+     * @param n_stride    elements between consecutive n, -1 for m_wid * n_wid, 0 to reuse one n
+     * @param dout_stride elements between consecutive dout, -1 for m_hgt * n_wid
+     * @param threads     0 picks a count from the amount of work
+     */
+    int gemm_batched_f32(float* dout,
+                         const float* m,
+                         const float* n,
+                         size_t batch,
+                         size_t m_hgt,
+                         size_t m_wid,
+                         size_t n_wid,
+                         size_t m_stride = (size_t)-1,
+                         size_t n_stride = (size_t)-1,
+                         size_t dout_stride = (size_t)-1,
+                         unsigned threads = 0);
+    int gemm_batched_f64(double* dout,
+                         const double* m,
+                         const double* n,
+                         size_t batch,
+                         size_t m_hgt,
+                         size_t m_wid,
+                         size_t n_wid,
+                         size_t m_stride = (size_t)-1,
+                         size_t n_stride = (size_t)-1,
+                         size_t dout_stride = (size_t)-1,
+                         unsigned threads = 0);
+
+    /**
+     * @brief Type dispatched gemm, dout = m * n
+     *
+     * The overload is picked by (accumulator, operand) types, see tGemmTraits.
+     * Types without a dedicated kernel fall back to the naive loop.
+     */
+    template<typename TAcc, typename T>
+    inline int gemm(TAcc* dout, const T* m, const T* n, size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        if (m_wid != n_hgt) return -1;
+        for (size_t idx = 0; idx < m_hgt * n_wid; ++idx) dout[idx] = TAcc(0);
+        for (size_t i = 0; i < m_hgt; ++i) {
+            for (size_t k = 0; k < m_wid; ++k) {
+                for (size_t j = 0; j < n_wid; ++j) {
+                    dout[i * n_wid + j] += TAcc(m[i * m_wid + k]) * TAcc(n[k * n_wid + j]);
+                }
+            }
+        }
+        return 0;
+    }
+
+    inline int gemm(double* dout, const double* m, const double* n, size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_f64(dout, (double*)m, (double*)n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    inline int gemm(float* dout, const float* m, const float* n, size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_f32(dout, (float*)m, (float*)n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    inline int gemm(float* dout, const bf16_t* m, const bf16_t* n, size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_bf16(dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    inline int gemm(float* dout, const fp16_t* m, const fp16_t* n, size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_fp16(dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    inline int gemm(int32_t* dout, const int8_t* m, const int8_t* n, size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_i8(dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    inline int gemm(int32_t* dout, const int32_t* m, const int32_t* n, size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_i32(dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    inline int gemm(int64_t* dout, const int64_t* m, const int64_t* n, size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_i64(dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    inline int gemm_batched(double* dout, const double* m, const double* n, size_t batch, size_t m_hgt, size_t m_wid, size_t n_wid,
+                            size_t m_stride = (size_t)-1, size_t n_stride = (size_t)-1, size_t dout_stride = (size_t)-1, unsigned threads = 0) {
+        return gemm_batched_f64(dout, m, n, batch, m_hgt, m_wid, n_wid, m_stride, n_stride, dout_stride, threads);
+    }
+
+    inline int gemm_batched(float* dout, const float* m, const float* n, size_t batch, size_t m_hgt, size_t m_wid, size_t n_wid,
+                            size_t m_stride = (size_t)-1, size_t n_stride = (size_t)-1, size_t dout_stride = (size_t)-1, unsigned threads = 0) {
+        return gemm_batched_f32(dout, m, n, batch, m_hgt, m_wid, n_wid, m_stride, n_stride, dout_stride, threads);
+    }
+}
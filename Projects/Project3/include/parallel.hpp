@@ -0,0 +1,74 @@
+/**
+ * @file parallel.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Minimal fork-join helpers over std::thread
+ * @version 0.1
+ * @date 2022-06-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "Partition.hpp"
+
+namespace mpimath {
+    /**
+     * @brief Number of threads used by default, MPIMATH_NUM_THREADS overrides
+     * std::thread::hardware_concurrency()
+     *
+     * @return unsigned
+     */
+    inline unsigned DefaultNumThreads() {
+        const char* sEnv = getenv("MPIMATH_NUM_THREADS");
+        if (sEnv != nullptr and atoi(sEnv) > 0) {
+            return (unsigned)atoi(sEnv);
+        }
+        unsigned uThreads = std::thread::hardware_concurrency();
+        return uThreads > 0 ? uThreads : 1;
+    }
+
+    /**
+     * @brief Split [ulBegin, ulEnd) into contiguous blocks and run
+     * Fn(ulLow, ulHigh, uThreadID) on each block, one block per thread.
+     * The calling thread takes block 0.
+     *
+     * @tparam F void(size_t, size_t, unsigned)
+     * @param ulBegin
+     * @param ulEnd
+     * @param Fn
+     * @param uThreads 0 for DefaultNumThreads()
+     */
+    template<typename F>
+    void ParallelFor(size_t ulBegin, size_t ulEnd, F Fn, unsigned uThreads = 0) {
+        if (ulEnd <= ulBegin) return;
+        const size_t ulN = ulEnd - ulBegin;
+        if (uThreads == 0) uThreads = DefaultNumThreads();
+        if (uThreads > ulN) uThreads = (unsigned)ulN;
+        if (uThreads <= 1) {
+            Fn(ulBegin, ulEnd, 0u);
+            return;
+        }
+
+        const Partition<int64_t> Parts = Partition<int64_t>::Block((int64_t)ulN, (int)uThreads);
+        std::vector<std::thread> vecThreads;
+        vecThreads.reserve(uThreads - 1);
+        for (unsigned uID = 1; uID < uThreads; ++uID) {
+            vecThreads.emplace_back(Fn,
+                                    ulBegin + (size_t)Parts.Low((int)uID),
+                                    ulBegin + (size_t)Parts.Low((int)uID + 1),
+                                    uID);
+        }
+        Fn(ulBegin, ulBegin + (size_t)Parts.Low(1), 0u);
+        for (auto& Thread : vecThreads) {
+            Thread.join();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * @file codec.cpp
+ * @author davidliyutong@sjtu.edu.cn
+ * @brief Byte shuffle and LZ4 style block compression behind MatCodec.hpp
+ * @version 0.1
+ * @date 2022-06-09
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "MatCodec.hpp"
+
+/** Shortest match worth a sequence */
+#define LZ_MIN_MATCH 4
+/** 2^LZ_HASH_BITS entries of 4 byte prefixes */
+#define LZ_HASH_BITS 14
+/** The last bytes of a block are always literals, so the decoder never reads past a match */
+#define LZ_LAST_LITERALS 5
+#define LZ_MF_LIMIT 12
+#define LZ_MAX_OFFSET 65535
+
+namespace mpimath {
+    void ByteShuffle(const uint8_t* pSrc, size_t ulCount, size_t ulElemSize, uint8_t* pDst) {
+        for (size_t idx = 0; idx < ulCount; ++idx) {
+            for (size_t b = 0; b < ulElemSize; ++b) {
+                pDst[b * ulCount + idx] = pSrc[idx * ulElemSize + b];
+            }
+        }
+    }
+
+    void ByteUnshuffle(const uint8_t* pSrc, size_t ulCount, size_t ulElemSize, uint8_t* pDst) {
+        for (size_t idx = 0; idx < ulCount; ++idx) {
+            for (size_t b = 0; b < ulElemSize; ++b) {
+                pDst[idx * ulElemSize + b] = pSrc[b * ulCount + idx];
+            }
+        }
+    }
+
+    static inline uint32_t Read32(const uint8_t* p) {
+        uint32_t uValue;
+        memcpy(&uValue, p, sizeof(uValue));
+        return uValue;
+    }
+
+    static inline uint32_t HashPrefix(uint32_t uValue) {
+        return (uValue * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+
+    /** Lengths >= 15 continue in bytes of 255 */
+    static inline uint8_t* WriteLength(uint8_t* pOut, size_t ulLen) {
+        while (ulLen >= 255) {
+            *pOut++ = 255;
+            ulLen -= 255;
+        }
+        *pOut++ = (uint8_t)ulLen;
+        return pOut;
+    }
+
+    static inline uint8_t* WriteSequence(uint8_t* pOut, const uint8_t* pLiterals, size_t ulLiterals, size_t ulOffset, size_t ulMatch) {
+        uint8_t* pToken = pOut++;
+        *pToken = (uint8_t)(std::min<size_t>(ulLiterals, 15) << 4);
+        if (ulLiterals >= 15) pOut = WriteLength(pOut, ulLiterals - 15);
+        memcpy(pOut, pLiterals, ulLiterals);
+        pOut += ulLiterals;
+        if (ulOffset == 0) {
+            return pOut;
+        }
+        *pOut++ = (uint8_t)(ulOffset & 0xff);
+        *pOut++ = (uint8_t)(ulOffset >> 8);
+        *pToken |= (uint8_t)std::min<size_t>(ulMatch, 15);
+        if (ulMatch >= 15) pOut = WriteLength(pOut, ulMatch - 15);
+        return pOut;
+    }
+
+    size_t LZCompressBound(size_t ulSize) {
+        return ulSize + ulSize / 255 + 16;
+    }
+
+    size_t LZCompress(const uint8_t* pSrc, size_t ulSize, uint8_t* pDst) {
+        uint32_t aTable[1 << LZ_HASH_BITS];
+        memset(aTable, 0, sizeof(aTable));
+        const uint8_t* pEnd = pSrc + ulSize;
+        const uint8_t* pAnchor = pSrc;
+        uint8_t* pOut = pDst;
+
+        if (ulSize >= LZ_MF_LIMIT) {
+            const uint8_t* pMatchStartLimit = pEnd - LZ_MF_LIMIT;
+            const uint8_t* pMatchEndLimit = pEnd - LZ_LAST_LITERALS;
+            const uint8_t* p = pSrc;
+            while (p < pMatchStartLimit) {
+                const uint32_t uPrefix = Read32(p);
+                const uint32_t uHash = HashPrefix(uPrefix);
+                const uint8_t* pRef = pSrc + aTable[uHash];
+                aTable[uHash] = (uint32_t)(p - pSrc);
+                if (pRef >= p or p - pRef > LZ_MAX_OFFSET or Read32(pRef) != uPrefix) {
+                    ++p;
+                    continue;
+                }
+                /** Extend backwards into the pending literals, then forwards */
+                while (p > pAnchor and pRef > pSrc and p[-1] == pRef[-1]) {
+                    --p;
+                    --pRef;
+                }
+                const uint8_t* pMatchEnd = p + LZ_MIN_MATCH;
+                const uint8_t* pRefEnd = pRef + LZ_MIN_MATCH;
+                while (pMatchEnd < pMatchEndLimit and *pMatchEnd == *pRefEnd) {
+                    ++pMatchEnd;
+                    ++pRefEnd;
+                }
+                pOut = WriteSequence(pOut, pAnchor, (size_t)(p - pAnchor), (size_t)(p - pRef), (size_t)(pMatchEnd - p) - LZ_MIN_MATCH);
+                p = pMatchEnd;
+                pAnchor = p;
+                if (p < pMatchStartLimit) {
+                    aTable[HashPrefix(Read32(p - 2))] = (uint32_t)(p - 2 - pSrc);
+                }
+            }
+        }
+        /** Last literals, no match */
+        pOut = WriteSequence(pOut, pAnchor, (size_t)(pEnd - pAnchor), 0, 0);
+        return (size_t)(pOut - pDst);
+    }
+
+    size_t LZDecompress(const uint8_t* pSrc, size_t ulSize, uint8_t* pDst, size_t ulCapacity) {
+        const uint8_t* p = pSrc;
+        const uint8_t* pEnd = pSrc + ulSize;
+        uint8_t* pOut = pDst;
+        uint8_t* pOutEnd = pDst + ulCapacity;
+        auto ReadLength = [&](size_t& ulLen) {
+            uint8_t uByte;
+            do {
+                if (p >= pEnd) return false;
+                uByte = *p++;
+                ulLen += uByte;
+            } while (uByte == 255);
+            return true;
+        };
+
+        while (p < pEnd) {
+            const uint8_t uToken = *p++;
+            size_t ulLiterals = uToken >> 4;
+            if (ulLiterals == 15 and not ReadLength(ulLiterals)) return (size_t)-1;
+            if (ulLiterals > (size_t)(pEnd - p) or ulLiterals > (size_t)(pOutEnd - pOut)) return (size_t)-1;
+            memcpy(pOut, p, ulLiterals);
+            p += ulLiterals;
+            pOut += ulLiterals;
+            if (p >= pEnd) {
+                break;
+            }
+
+            if (pEnd - p < 2) return (size_t)-1;
+            const size_t ulOffset = (size_t)p[0] | ((size_t)p[1] << 8);
+            p += 2;
+            size_t ulMatch = uToken & 15;
+            if (ulMatch == 15 and not ReadLength(ulMatch)) return (size_t)-1;
+            ulMatch += LZ_MIN_MATCH;
+            if (ulOffset == 0 or ulOffset > (size_t)(pOut - pDst) or ulMatch > (size_t)(pOutEnd - pOut)) return (size_t)-1;
+            const uint8_t* pRef = pOut - ulOffset;
+            if (ulOffset >= ulMatch) {
+                memcpy(pOut, pRef, ulMatch);
+            } else {
+                /** Overlapping match repeats the last ulOffset bytes */
+                for (size_t idx = 0; idx < ulMatch; ++idx) pOut[idx] = pRef[idx];
+            }
+            pOut += ulMatch;
+        }
+        return (size_t)(pOut - pDst);
+    }
+}
@@ -0,0 +1,536 @@
+/**
+ * @file csv.cpp
+ * @author davidliyutong@sjtu.edu.cn
+ * @brief Memory mapped, multithreaded CSV reader
+ * @version 0.1
+ * @date 2022-06-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "Matrix.hpp"
+#include "csv.hpp"
+#include "Partition.hpp"
+#include "parallel.hpp"
+
+/** Files smaller than this per thread are not worth another thread */
+#define CSV_MIN_BYTES_PER_THREAD (1 << 20)
+/** Chunks per thread, more chunks even out lines of different length */
+#define CSV_CHUNKS_PER_THREAD 4
+/** Output formatted by one thread before it is written */
+#define CSV_WRITE_CHUNK_BYTES (4 << 20)
+
+namespace mpimath {
+    /** 5^q, q in [-342, 308] */
+    static const uint64_t aPowerOfFive128[] = {
+#include "csv_pow5.inc"
+    };
+
+#define POW5_SMALLEST (-342)
+#define POW5_LARGEST 308
+
+    static const double adPow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    static inline bool IsDigit(char c) { return (unsigned char)(c - '0') < 10; }
+
+    static inline bool IsBlank(char c) { return c == ' ' or c == '\t'; }
+
+    /** SWAR: the 8 bytes at p are all ASCII digits */
+    static inline bool Is8Digits(uint64_t v) {
+        return (((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+                0x3333333333333333ULL);
+    }
+
+    /** SWAR: value of 8 ASCII digits, little endian load */
+    static inline uint64_t Parse8Digits(uint64_t v) {
+        const uint64_t ulMask = 0x000000FF000000FFULL;
+        v -= 0x3030303030303030ULL;
+        v = (v * 10) + (v >> 8);
+        v = (((v & ulMask) * 0x000F424000000064ULL) + (((v >> 16) & ulMask) * 0x0000271000000001ULL)) >> 32;
+        return v;
+    }
+
+    /**
+     * @brief Take 8 significant digits at once while they fit in 19
+     *
+     * @return int number of digits consumed, 0 or 8
+     */
+    static inline int TryParse8(const char* p, const char* pEnd, uint64_t& w, int& iSigDigits) {
+        if (w == 0 or iSigDigits + 8 > 19 or p + 8 > pEnd) return 0;
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        if (not Is8Digits(v)) return 0;
+        w = w * 100000000ULL + Parse8Digits(v);
+        iSigDigits += 8;
+        return 8;
+    }
+
+    /**
+     * @brief Eisel-Lemire: w * 10^q rounded to nearest double
+     *
+     * @param w         decimal significand, non zero, at most 19 digits
+     * @param q         decimal exponent
+     * @param bNeg
+     * @param pdValue
+     * @return true     pdValue is correctly rounded
+     * @return false    the 128 bit product can not decide the rounding, use a slow path
+     */
+    static bool EiselLemire(uint64_t w, int64_t q, bool bNeg, double* pdValue) {
+        uint64_t ulMantissa = 0;
+        int64_t lPower2 = 0;
+        if (q < POW5_SMALLEST) {
+            ulMantissa = 0;
+            lPower2 = 0;
+        } else if (q > POW5_LARGEST) {
+            lPower2 = 0x7FF;
+        } else {
+            const int iLeadingZeros = __builtin_clzll(w);
+            w <<= iLeadingZeros;
+
+            /** 64 x 128 bit product, the low word is only needed when the high one is close to a tie */
+            const size_t ulIndex = 2 * (size_t)(q - POW5_SMALLEST);
+            unsigned __int128 First = (unsigned __int128)w * aPowerOfFive128[ulIndex];
+            uint64_t ulHigh = (uint64_t)(First >> 64), ulLow = (uint64_t)First;
+            const uint64_t ulPrecisionMask = 0xFFFFFFFFFFFFFFFFULL >> 55;
+            if ((ulHigh & ulPrecisionMask) == ulPrecisionMask) {
+                unsigned __int128 Second = (unsigned __int128)w * aPowerOfFive128[ulIndex + 1];
+                uint64_t ulSecondHigh = (uint64_t)(Second >> 64);
+                ulLow += ulSecondHigh;
+                if (ulSecondHigh > ulLow) ulHigh++;
+            }
+            if (ulLow == 0xFFFFFFFFFFFFFFFFULL and (q < -27 or q > 55)) {
+                return false;
+            }
+
+            const int iUpperBit = (int)(ulHigh >> 63);
+            const int iShift = iUpperBit + 64 - 52 - 3;
+            ulMantissa = ulHigh >> iShift;
+            lPower2 = (((152170 + 65536) * q) >> 16) + 63 + iUpperBit - iLeadingZeros + 1023;
+
+            if (lPower2 <= 0) {
+                /** Subnormal */
+                if (-lPower2 + 1 >= 64) {
+                    ulMantissa = 0;
+                    lPower2 = 0;
+                } else {
+                    ulMantissa >>= -lPower2 + 1;
+                    ulMantissa += (ulMantissa & 1);
+                    ulMantissa >>= 1;
+                    lPower2 = (ulMantissa < (1ULL << 52)) ? 0 : 1;
+                }
+            } else {
+                /** Exactly halfway between two doubles: round to even */
+                if (ulLow <= 1 and q >= -4 and q <= 23 and (ulMantissa & 3) == 1 and
+                    (ulMantissa << iShift) == ulHigh) {
+                    ulMantissa &= ~1ULL;
+                }
+                ulMantissa += (ulMantissa & 1);
+                ulMantissa >>= 1;
+                if (ulMantissa >= (2ULL << 52)) {
+                    ulMantissa = 1ULL << 52;
+                    lPower2++;
+                }
+                ulMantissa &= ~(1ULL << 52);
+                if (lPower2 >= 0x7FF) {
+                    lPower2 = 0x7FF;
+                    ulMantissa = 0;
+                }
+            }
+        }
+        uint64_t ulBits = ulMantissa | ((uint64_t)lPower2 << 52) | ((uint64_t)bNeg << 63);
+        memcpy(pdValue, &ulBits, sizeof(double));
+        return true;
+    }
+
+    /**
+     * @brief strtod on a copy of [p, pEnd) that is null terminated
+     *
+     */
+    static const char* ParseDoubleSlow(const char* p, const char* pEnd, double* pdValue) {
+        const char* pTokenEnd = p;
+        while (pTokenEnd < pEnd and *pTokenEnd != ',' and *pTokenEnd != '\n' and *pTokenEnd != '\r' and not IsBlank(*pTokenEnd)) {
+            ++pTokenEnd;
+        }
+        std::string sToken(p, pTokenEnd);
+        char* pStop = nullptr;
+        *pdValue = strtod(sToken.c_str(), &pStop);
+        if (pStop == sToken.c_str()) {
+            return nullptr;
+        }
+        return p + (pStop - sToken.c_str());
+    }
+
+    const char* ParseDouble(const char* p, const char* pEnd, double* pdValue) {
+        const char* pStart = p;
+        bool bNeg = false;
+        if (p < pEnd and (*p == '-' or *p == '+')) {
+            bNeg = (*p == '-');
+            ++p;
+        }
+        if (p < pEnd and not IsDigit(*p) and *p != '.') {
+            /** inf, nan */
+            return ParseDoubleSlow(pStart, pEnd, pdValue);
+        }
+
+        uint64_t w = 0;
+        int64_t lExp10 = 0;
+        int iSigDigits = 0;
+        bool bTruncated = false, bAnyDigit = false;
+
+        /** Integer part, leading zeros are not significant */
+        for (; p < pEnd and IsDigit(*p); ++p) {
+            bAnyDigit = true;
+            int iTaken = TryParse8(p, pEnd, w, iSigDigits);
+            if (iTaken > 0) {
+                p += iTaken - 1;
+                continue;
+            }
+            const uint64_t d = (uint64_t)(*p - '0');
+            if (iSigDigits < 19) {
+                if (w != 0 or d != 0) {
+                    w = w * 10 + d;
+                    iSigDigits++;
+                }
+            } else {
+                lExp10++;
+                bTruncated |= (d != 0);
+            }
+        }
+        /** Fraction */
+        if (p < pEnd and *p == '.') {
+            ++p;
+            for (; p < pEnd and IsDigit(*p); ++p) {
+                bAnyDigit = true;
+                int iTaken = TryParse8(p, pEnd, w, iSigDigits);
+                if (iTaken > 0) {
+                    lExp10 -= iTaken;
+                    p += iTaken - 1;
+                    continue;
+                }
+                const uint64_t d = (uint64_t)(*p - '0');
+                if (iSigDigits < 19) {
+                    if (w != 0 or d != 0) {
+                        w = w * 10 + d;
+                        iSigDigits++;
+                    }
+                    lExp10--;
+                } else {
+                    bTruncated |= (d != 0);
+                }
+            }
+        }
+        if (not bAnyDigit) {
+            return nullptr;
+        }
+        /** Exponent */
+        if (p < pEnd and (*p == 'e' or *p == 'E')) {
+            const char* pExp = p + 1;
+            bool bExpNeg = false;
+            if (pExp < pEnd and (*pExp == '-' or *pExp == '+')) {
+                bExpNeg = (*pExp == '-');
+                ++pExp;
+            }
+            if (pExp < pEnd and IsDigit(*pExp)) {
+                int64_t lExp = 0;
+                for (; pExp < pEnd and IsDigit(*pExp); ++pExp) {
+                    if (lExp < 100000) lExp = lExp * 10 + (*pExp - '0');
+                }
+                lExp10 += bExpNeg ? -lExp : lExp;
+                p = pExp;
+            }
+        }
+
+        if (bTruncated) {
+            return ParseDoubleSlow(pStart, pEnd, pdValue);
+        }
+        if (w == 0) {
+            *pdValue = bNeg ? -0.0 : 0.0;
+            return p;
+        }
+        /** Clinger: both w and 10^|q| are exact doubles, one rounding */
+        if (lExp10 >= -22 and lExp10 <= 22 and w <= (1ULL << 53)) {
+            double dValue = (double)w;
+            dValue = lExp10 < 0 ? dValue / adPow10[-lExp10] : dValue * adPow10[lExp10];
+            *pdValue = bNeg ? -dValue : dValue;
+            return p;
+        }
+        if (not EiselLemire(w, lExp10, bNeg, pdValue)) {
+            return ParseDoubleSlow(pStart, pEnd, pdValue);
+        }
+        return p;
+    }
+
+    /**
+     * @brief Number of '\n' in [p, pEnd), 32 bytes per compare with AVX2
+     *
+     */
+    static size_t CountNewlines(const char* p, const char* pEnd) {
+        size_t ulCount = 0;
+#ifdef __AVX2__
+        const __m256i NewLine = _mm256_set1_epi8('\n');
+        for (; p + 32 <= pEnd; p += 32) {
+            __m256i Bytes = _mm256_loadu_si256((const __m256i*)p);
+            ulCount += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Bytes, NewLine)));
+        }
+#endif
+        for (; p < pEnd; ++p) {
+            ulCount += (*p == '\n');
+        }
+        return ulCount;
+    }
+
+    CSVFile::~CSVFile() {
+        if (_pBegin != nullptr) {
+            munmap((void*)_pBegin, _ulMapSize);
+            _pBegin = nullptr;
+        }
+    }
+
+    int CSVFile::Open(const std::string& sPath, unsigned uThreads) {
+        int iFd = open(sPath.c_str(), O_RDONLY);
+        if (iFd < 0) {
+            return MATRIX_ERR_IO;
+        }
+        struct stat Stat;
+        if (fstat(iFd, &Stat) != 0) {
+            close(iFd);
+            return MATRIX_ERR_IO;
+        }
+        if (Stat.st_size == 0) {
+            close(iFd);
+            return MATRIX_ERR_DATA;
+        }
+        _ulMapSize = (size_t)Stat.st_size;
+        void* pMap = mmap(nullptr, _ulMapSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, iFd, 0);
+        close(iFd);
+        if (pMap == MAP_FAILED) {
+            return MATRIX_ERR_IO;
+        }
+        madvise(pMap, _ulMapSize, MADV_SEQUENTIAL);
+        _pBegin = (const char*)pMap;
+        _pEnd = _pBegin + _ulMapSize;
+
+        /** Blank lines at the end of the file are not rows */
+        while (_pEnd > _pBegin and (_pEnd[-1] == '\n' or _pEnd[-1] == '\r' or IsBlank(_pEnd[-1]))) {
+            --_pEnd;
+        }
+        if (_pEnd == _pBegin) {
+            return MATRIX_ERR_DATA;
+        }
+        const size_t ulSize = (size_t)(_pEnd - _pBegin);
+
+        /** Columns: values in the first line, a trailing ',' does not open a column */
+        const char* pLineEnd = (const char*)memchr(_pBegin, '\n', ulSize);
+        if (pLineEnd == nullptr) pLineEnd = _pEnd;
+        const char* pLast = pLineEnd;
+        while (pLast > _pBegin and (pLast[-1] == '\r' or IsBlank(pLast[-1]))) --pLast;
+        _ulCol = 1;
+        for (const char* p = _pBegin; p < pLast; ++p) {
+            _ulCol += (*p == ',');
+        }
+        if (pLast > _pBegin and pLast[-1] == ',') _ulCol--;
+
+        /** Cut into chunks that start at the beginning of a line */
+        if (uThreads == 0) uThreads = DefaultNumThreads();
+        size_t ulMaxThreads = ulSize / CSV_MIN_BYTES_PER_THREAD + 1;
+        if (uThreads > ulMaxThreads) uThreads = (unsigned)ulMaxThreads;
+        const size_t ulChunks = uThreads > 1 ? (size_t)uThreads * CSV_CHUNKS_PER_THREAD : 1;
+        _vecChunkBegin.assign(ulChunks + 1, _pEnd);
+        _vecChunkBegin[0] = _pBegin;
+        for (size_t c = 1; c < ulChunks; ++c) {
+            const char* p = _pBegin + Partition<int64_t>::Block((int64_t)ulSize, (int)ulChunks).Low((int)c);
+            if (p < _vecChunkBegin[c - 1]) p = _vecChunkBegin[c - 1];
+            const char* pNewLine = (const char*)memchr(p - 1, '\n', (size_t)(_pEnd - (p - 1)));
+            _vecChunkBegin[c] = pNewLine == nullptr ? _pEnd : pNewLine + 1;
+        }
+
+        /** Rows: newlines per chunk, in parallel, then a prefix sum */
+        std::vector<size_t> vecNewLines(ulChunks);
+        ParallelFor(0, ulChunks, [&](size_t ulLow, size_t ulHigh, unsigned) {
+            for (size_t c = ulLow; c < ulHigh; ++c) {
+                vecNewLines[c] = CountNewlines(_vecChunkBegin[c], _vecChunkBegin[c + 1]);
+            }
+        }, uThreads);
+        _vecChunkRow.assign(ulChunks + 1, 0);
+        for (size_t c = 0; c < ulChunks; ++c) {
+            _vecChunkRow[c + 1] = _vecChunkRow[c] + vecNewLines[c];
+        }
+        /** The last line has no '\n' after trimming */
+        _vecChunkRow[ulChunks]++;
+        _ulRow = _vecChunkRow[ulChunks];
+        return MATRIX_OK;
+    }
+
+    /**
+     * @brief Parse the lines of [p, pEnd) into ulRows rows of ulCol values
+     *
+     * With bStride the rows go to consecutive rows of pOut, otherwise every
+     * row is parsed into pOut and handed to Fn.
+     */
+    template<typename TOut, typename FnRow>
+    static int ParseChunk(const char* p, const char* pEnd, size_t ulFirstRow, size_t ulRows, size_t ulCol,
+                          TOut* pOut, bool bStride, FnRow& Fn) {
+        for (size_t row = 0; row < ulRows; ++row) {
+            TOut* pRow = bStride ? pOut + (ulFirstRow + row) * ulCol : pOut;
+            for (size_t col = 0; col < ulCol; ++col) {
+                while (p < pEnd and IsBlank(*p)) ++p;
+                double dValue;
+                const char* pNext = ParseDouble(p, pEnd, &dValue);
+                if (pNext == nullptr) {
+                    /** A line that ends early is a shape error, garbage is a data error */
+                    return (p >= pEnd or *p == '\n' or *p == '\r' or *p == ',') ? MATRIX_ERR_SHAPE : MATRIX_ERR_DATA;
+                }
+                pRow[col] = (TOut)dValue;
+                p = pNext;
+                while (p < pEnd and IsBlank(*p)) ++p;
+                if (col + 1 < ulCol) {
+                    if (p >= pEnd or *p != ',') {
+                        return (p >= pEnd or *p == '\n' or *p == '\r') ? MATRIX_ERR_SHAPE : MATRIX_ERR_DATA;
+                    }
+                    ++p;
+                }
+            }
+            /** End of line: optional trailing ',' then '\n' */
+            if (p < pEnd and *p == ',') ++p;
+            while (p < pEnd and (IsBlank(*p) or *p == '\r')) ++p;
+            if (p < pEnd) {
+                if (*p != '\n') {
+                    return MATRIX_ERR_SHAPE;
+                }
+                ++p;
+            }
+            Fn(ulFirstRow + row, pRow);
+        }
+        return p == pEnd ? MATRIX_OK : MATRIX_ERR_SHAPE;
+    }
+
+    template<typename TOut, typename FnRow>
+    int CSVFile::_Parse(TOut* pOut, FnRow Fn, unsigned uThreads) const {
+        if (_pBegin == nullptr) {
+            return MATRIX_ERR_NULL;
+        }
+        const bool bStride = (pOut != nullptr);
+        const size_t ulChunks = _vecChunkBegin.size() - 1;
+        if (uThreads == 0) uThreads = (unsigned)std::max<size_t>(1, ulChunks / CSV_CHUNKS_PER_THREAD);
+        std::atomic<int> iResult(MATRIX_OK);
+        ParallelFor(0, ulChunks, [&](size_t ulLow, size_t ulHigh, unsigned) {
+            std::vector<TOut> vecRow(bStride ? 0 : _ulCol);
+            for (size_t c = ulLow; c < ulHigh and iResult.load(std::memory_order_relaxed) == MATRIX_OK; ++c) {
+                int iRet = ParseChunk(_vecChunkBegin[c], _vecChunkBegin[c + 1], _vecChunkRow[c],
+                                      _vecChunkRow[c + 1] - _vecChunkRow[c], _ulCol,
+                                      bStride ? pOut : vecRow.data(), bStride, Fn);
+                if (iRet != MATRIX_OK) {
+                    int iExpected = MATRIX_OK;
+                    iResult.compare_exchange_strong(iExpected, iRet);
+                }
+            }
+        }, uThreads);
+        return iResult.load();
+    }
+
+    int CSVFile::Parse(double* pOut, unsigned uThreads) const {
+        auto Fn = [](size_t, const double*) {};
+        return _Parse(pOut, Fn, uThreads);
+    }
+
+    int CSVFile::Parse(float* pOut, unsigned uThreads) const {
+        auto Fn = [](size_t, const float*) {};
+        return _Parse(pOut, Fn, uThreads);
+    }
+
+    int CSVFile::ParseRows(const std::function<void(size_t, const double*)>& Fn, unsigned uThreads) const {
+        return _Parse((double*)nullptr, Fn, uThreads);
+    }
+
+    /**
+     * @brief pwrite() all of [pBuf, pBuf + ulSize) at ulOffset
+     *
+     */
+    static bool PWriteAll(int iFd, const char* pBuf, size_t ulSize, size_t ulOffset) {
+        while (ulSize > 0) {
+            ssize_t lWritten = pwrite(iFd, pBuf, ulSize, (off_t)ulOffset);
+            if (lWritten < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            pBuf += lWritten;
+            ulOffset += (size_t)lWritten;
+            ulSize -= (size_t)lWritten;
+        }
+        return true;
+    }
+
+    int CSVWriteRows(const std::string& sPath, size_t ulRow, size_t ulMaxRowBytes,
+                     const std::function<size_t(size_t, char*)>& FnFormatRow, unsigned uThreads) {
+        int iFd = open(sPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (iFd < 0) {
+            return MATRIX_ERR_IO;
+        }
+
+        /** A round formats uThreads chunks of ulChunkRows rows, then writes them */
+        const size_t ulChunkRows = std::max<size_t>(1, CSV_WRITE_CHUNK_BYTES / std::max<size_t>(1, ulMaxRowBytes));
+        const size_t ulChunks = (ulRow + ulChunkRows - 1) / ulChunkRows;
+        if (uThreads == 0) uThreads = DefaultNumThreads();
+        if (uThreads > ulChunks) uThreads = (unsigned)std::max<size_t>(1, ulChunks);
+
+        std::vector<std::vector<char>> vecBuf(uThreads);
+        std::vector<size_t> vecLen(uThreads), vecOffset(uThreads);
+        std::atomic<bool> bFailed(false);
+        size_t ulFileOffset = 0;
+        for (size_t ulFirst = 0; ulFirst < ulChunks and not bFailed.load(); ulFirst += uThreads) {
+            const size_t ulRoundChunks = std::min<size_t>(uThreads, ulChunks - ulFirst);
+            ParallelFor(0, ulRoundChunks, [&](size_t ulLow, size_t ulHigh, unsigned) {
+                for (size_t c = ulLow; c < ulHigh; ++c) {
+                    const size_t ulRowLow = (ulFirst + c) * ulChunkRows;
+                    const size_t ulRowHigh = std::min(ulRow, ulRowLow + ulChunkRows);
+                    /** Allocated and first touched by the thread that fills it */
+                    vecBuf[c].resize((ulRowHigh - ulRowLow) * ulMaxRowBytes);
+                    char* p = vecBuf[c].data();
+                    for (size_t row = ulRowLow; row < ulRowHigh; ++row) {
+                        p += FnFormatRow(row, p);
+                    }
+                    vecLen[c] = (size_t)(p - vecBuf[c].data());
+                }
+            }, (unsigned)ulRoundChunks);
+
+            for (size_t c = 0; c < ulRoundChunks; ++c) {
+                vecOffset[c] = ulFileOffset;
+                ulFileOffset += vecLen[c];
+            }
+
+            ParallelFor(0, ulRoundChunks, [&](size_t ulLow, size_t ulHigh, unsigned) {
+                for (size_t c = ulLow; c < ulHigh; ++c) {
+                    if (not PWriteAll(iFd, vecBuf[c].data(), vecLen[c], vecOffset[c])) {
+                        bFailed.store(true);
+                    }
+                }
+            }, (unsigned)ulRoundChunks);
+        }
+
+        if (close(iFd) != 0 or bFailed.load()) {
+            return MATRIX_ERR_IO;
+        }
+        return MATRIX_OK;
+    }
+}
@@ -10,6 +10,8 @@
  */
 
 #include <memory.h>
+#include <vector>
+#include <algorithm>
 #include "gemm.hpp"
 
 #ifdef __AVX__
@@ -19,7 +21,118 @@
 
 namespace mpimath {
     /**
-     * @brief 通用矩阵乘法dout = m * n
+     * @brief 256 bit vectors through GCC vector extensions, lowered to SSE
+     * pairs (or scalars) when AVX is off
+     *
+     */
+    /** Only the static kernels below pass these vectors around, the ABI note does not apply */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+    template<typename T>
+    struct tGemmVec {
+        typedef T Type __attribute__((vector_size(32)));
+        static constexpr size_t W = 32 / sizeof(T);
+
+        static inline Type Load(const T* p) {
+            Type v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        static inline void Store(T* p, Type v) {
+            memcpy(p, &v, sizeof(v));
+        }
+    };
+
+    /**
+     * @brief d += a * b on an mc x kc x nc block, i-k-j order
+     *
+     * @param ldd, lda, ldb leading dimensions of the full matrices
+     */
+    template<typename T>
+    static void kernel_naive(T* d, size_t ldd, const T* a, size_t lda, const T* b, size_t ldb, size_t mc, size_t kc, size_t nc) {
+        for (size_t i = 0; i < mc; i++)
+            for (size_t k = 0; k < kc; k++)
+                for (size_t j = 0; j < nc; j++)
+                    d[i * ldd + j] += a[i * lda + k] * b[k * ldb + j];
+    }
+
+    /**
+     * @brief d[i] += a[i][k] * b[k] for one row i, 2 vectors of b at a time
+     *
+     */
+    template<typename T>
+    static inline void kernel_row(T* d, const T* a, const T* b, size_t ldb, size_t kc, size_t nc) {
+        typedef tGemmVec<T> V;
+        for (size_t k = 0; k < kc; k++) {
+            const T s = a[k];
+            const T* bk = b + k * ldb;
+            size_t j = 0;
+            for (; j + 2 * V::W <= nc; j += 2 * V::W) {
+                V::Store(d + j, V::Load(d + j) + s * V::Load(bk + j));
+                V::Store(d + j + V::W, V::Load(d + j + V::W) + s * V::Load(bk + j + V::W));
+            }
+            for (; j < nc; j++) {
+                d[j] += s * bk[j];
+            }
+        }
+    }
+
+    template<typename T>
+    static void kernel_rows(T* d, size_t ldd, const T* a, size_t lda, const T* b, size_t ldb, size_t mc, size_t kc, size_t nc) {
+        for (size_t i = 0; i < mc; i++) {
+            kernel_row(d + i * ldd, a + i * lda, b, ldb, kc, nc);
+        }
+    }
+
+    /**
+     * @brief W rows of a times W rows of b per step, W = elements per vector,
+     * the W accumulators of a column strip stay in registers
+     *
+     */
+    template<typename T>
+    static void kernel_unroll(T* d, size_t ldd, const T* a, size_t lda, const T* b, size_t ldb, size_t mc, size_t kc, size_t nc) {
+        typedef tGemmVec<T> V;
+        constexpr size_t R = V::W;
+        size_t i = 0;
+        for (; i + R <= mc; i += R) {
+            size_t k = 0;
+            for (; k + R <= kc; k += R) {
+                size_t j = 0;
+                for (; j + V::W <= nc; j += V::W) {
+                    typename V::Type acc[R];
+#pragma GCC unroll 8
+                    for (size_t r = 0; r < R; r++) acc[r] = V::Load(&d[(i + r) * ldd + j]);
+#pragma GCC unroll 8
+                    for (size_t t = 0; t < R; t++) {
+                        const typename V::Type bv = V::Load(&b[(k + t) * ldb + j]);
+#pragma GCC unroll 8
+                        for (size_t r = 0; r < R; r++) acc[r] += a[(i + r) * lda + k + t] * bv;
+                    }
+#pragma GCC unroll 8
+                    for (size_t r = 0; r < R; r++) V::Store(&d[(i + r) * ldd + j], acc[r]);
+                }
+                for (; j < nc; j++) {
+                    for (size_t r = 0; r < R; r++) {
+                        for (size_t t = 0; t < R; t++) {
+                            d[(i + r) * ldd + j] += a[(i + r) * lda + k + t] * b[(k + t) * ldb + j];
+                        }
+                    }
+                }
+            }
+            for (size_t r = 0; r < R; r++) {
+                kernel_row(d + (i + r) * ldd, a + (i + r) * lda + k, b + k * ldb, ldb, kc - k, nc);
+            }
+        }
+        kernel_rows(d + i * ldd, ldd, a + i * lda, lda, b, ldb, mc - i, kc, nc);
+    }
+#pragma GCC diagnostic pop
+
+    /**
+     * @brief 通用矩阵乘法dout = m * n, with the kernel and the blocking of Params
+     *
+     * The loops over blocks run NC columns of n, then KC of the depth, then MC
+     * rows of m, so that a KC x NC panel of n is reused by every row block.
      *
      * @param dout
      * @param m
@@ -30,6 +143,53 @@ namespace mpimath {
      * @param n_wid N
      * @return pythorch_err_t
      */
+    template<typename T>
+    static int gemm_tuned(const tGemmParams& Params,
+                          T* dout,
+                          const T* m,
+                          const T* n,
+                          size_t m_hgt,
+                          size_t m_wid,
+                          size_t n_hgt,
+                          size_t n_wid) {
+
+        if (m_wid != n_hgt) return -1;
+
+        memset(dout, 0, sizeof(T) * m_hgt * n_wid);
+
+        void (*kernel)(T*, size_t, const T*, size_t, const T*, size_t, size_t, size_t, size_t) = kernel_naive<T>;
+        if (Params.emKernel == emGemmKernel::ROW) {
+            kernel = kernel_rows<T>;
+        } else if (Params.emKernel == emGemmKernel::UNROLL) {
+            kernel = kernel_unroll<T>;
+        }
+        const size_t mc = Params.ulMC > 0 ? Params.ulMC : std::max<size_t>(m_hgt, 1);
+        const size_t kc = Params.ulKC > 0 ? Params.ulKC : std::max<size_t>(m_wid, 1);
+        const size_t nc = Params.ulNC > 0 ? Params.ulNC : std::max<size_t>(n_wid, 1);
+
+        for (size_t jc = 0; jc < n_wid; jc += nc) {
+            for (size_t pc = 0; pc < m_wid; pc += kc) {
+                for (size_t ic = 0; ic < m_hgt; ic += mc) {
+                    kernel(dout + ic * n_wid + jc, n_wid,
+                           m + ic * m_wid + pc, m_wid,
+                           n + pc * n_wid + jc, n_wid,
+                           std::min(mc, m_hgt - ic), std::min(kc, m_wid - pc), std::min(nc, n_wid - jc));
+                }
+            }
+        }
+        return 0;
+    }
+
+    int gemm_f32_tuned(const tGemmParams& Params, float* dout, const float* m, const float* n,
+                       size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_tuned(Params, dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    int gemm_f64_tuned(const tGemmParams& Params, double* dout, const double* m, const double* n,
+                       size_t m_hgt, size_t m_wid, size_t n_hgt, size_t n_wid) {
+        return gemm_tuned(Params, dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
     int gemm_f32(float* dout,
                  float* m,
                  float* n,
@@ -37,200 +197,306 @@ namespace mpimath {
                  size_t m_wid,
                  size_t n_hgt,
                  size_t n_wid) {
+        return gemm_tuned(GemmTuning("gemm_f32", m_hgt, m_wid, n_wid), dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
 
-        if (m_wid != n_hgt) return -1;
+    int gemm_f64(double* dout,
+                 double* m,
+                 double* n,
+                 size_t m_hgt,
+                 size_t m_wid,
+                 size_t n_hgt,
+                 size_t n_wid) {
+        return gemm_tuned(GemmTuning("gemm_f64", m_hgt, m_wid, n_wid), dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
 
-        memset(dout, 0, sizeof(float) * m_hgt * n_wid);
+#if defined(__AVX2__) && defined(__FMA__)
+    /**
+     * @brief Widen 8 half precision values to fp32
+     *
+     */
+    static inline __m256 load8_ps(const bf16_t* p) {
+        __m128i h = _mm_loadu_si128((const __m128i*)p);
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+    }
 
-#if !defined(OPTIMIZE_GEMM)
-        for (int i = 0; i < m_hgt; i++)
-            for (int k = 0; k < n_hgt; k++)
-                for (int j = 0; j < n_wid; j++)
-                    dout[i * n_wid + j] += m[i * m_wid + k] * n[k * n_wid + j];
+#if defined(__F16C__)
+    static inline __m256 load8_ps(const fp16_t* p) {
+        return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p));
+    }
+#define GEMM_FP16_VECTORIZED 1
 #else
-#if OPTIMIZE_GEMM == 1
+    /** No vcvtph2ps: widen in scalar code so gemm_half still compiles for fp16 */
+    static inline __m256 load8_ps(const fp16_t* p) {
+        alignas(32) float afTmp[8];
+        for (int t = 0; t < 8; ++t) afTmp[t] = (float)p[t];
+        return _mm256_load_ps(afTmp);
+    }
+#endif
+#endif
 
-        for (int i = 0; i < m_hgt; i++) {
-            for (int k = 0; k < n_hgt; k++) {
-                int j = 0;
-#ifdef __AVX__
-                __m256 ymm0 = _mm256_set1_ps(m[i * m_wid + k]);
-                for (j = 0; j < ((n_wid)-16); j += 16) {
-                    __m256 ymm1 = _mm256_load_ps(n + (k * n_wid + j));
-                    __m256 ymm2 = _mm256_load_ps(n + (k * n_wid + j + 8));
-                    __m256 ymm3 = _mm256_load_ps(dout + (i * n_wid + j));
-                    __m256 ymm4 = _mm256_load_ps(dout + (i * n_wid + j + 8));
-                    _mm256_store_ps(dout + (i * n_wid + j), _mm256_add_ps(ymm3, _mm256_mul_ps(ymm0, ymm1)));
-                    _mm256_store_ps(dout + (i * n_wid + j + 8), _mm256_add_ps(ymm4, _mm256_mul_ps(ymm0, ymm2)));
+    /**
+     * @brief dout = m * n for 16 bit storage types, accumulated in fp32
+     *
+     * The K dimension is cut into panels of GEMM_HALF_KC, a 4-row strip of m is
+     * widened to fp32 once per panel and reused against all columns of n.
+     * Columns are processed 16 at a time in a 4x16 register tile.
+     */
+#define GEMM_HALF_KC 256
+    template<typename T, bool bVectorized>
+    static int gemm_half(float* dout,
+                         const T* m,
+                         const T* n,
+                         size_t m_hgt,
+                         size_t m_wid,
+                         size_t n_hgt,
+                         size_t n_wid) {
+
+        if (m_wid != n_hgt) return -1;
+
+        memset(dout, 0, sizeof(float) * m_hgt * n_wid);
+
+        float afPanel[4][GEMM_HALF_KC];
+        for (size_t kk = 0; kk < m_wid; kk += GEMM_HALF_KC) {
+            size_t kc = std::min((size_t)GEMM_HALF_KC, m_wid - kk);
+            size_t i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+            if (bVectorized) {
+                for (; i + 4 <= m_hgt; i += 4) {
+                    for (size_t r = 0; r < 4; ++r) {
+                        for (size_t k = 0; k < kc; ++k) afPanel[r][k] = (float)m[(i + r) * m_wid + kk + k];
+                    }
+                    size_t j = 0;
+                    for (; j + 16 <= n_wid; j += 16) {
+                        float* c = dout + i * n_wid + j;
+                        __m256 c00 = _mm256_loadu_ps(c + 0 * n_wid), c01 = _mm256_loadu_ps(c + 0 * n_wid + 8);
+                        __m256 c10 = _mm256_loadu_ps(c + 1 * n_wid), c11 = _mm256_loadu_ps(c + 1 * n_wid + 8);
+                        __m256 c20 = _mm256_loadu_ps(c + 2 * n_wid), c21 = _mm256_loadu_ps(c + 2 * n_wid + 8);
+                        __m256 c30 = _mm256_loadu_ps(c + 3 * n_wid), c31 = _mm256_loadu_ps(c + 3 * n_wid + 8);
+                        for (size_t k = 0; k < kc; ++k) {
+                            const T* b = n + (kk + k) * n_wid + j;
+                            __m256 b0 = load8_ps(b), b1 = load8_ps(b + 8);
+                            __m256 a;
+                            a = _mm256_set1_ps(afPanel[0][k]); c00 = _mm256_fmadd_ps(a, b0, c00); c01 = _mm256_fmadd_ps(a, b1, c01);
+                            a = _mm256_set1_ps(afPanel[1][k]); c10 = _mm256_fmadd_ps(a, b0, c10); c11 = _mm256_fmadd_ps(a, b1, c11);
+                            a = _mm256_set1_ps(afPanel[2][k]); c20 = _mm256_fmadd_ps(a, b0, c20); c21 = _mm256_fmadd_ps(a, b1, c21);
+                            a = _mm256_set1_ps(afPanel[3][k]); c30 = _mm256_fmadd_ps(a, b0, c30); c31 = _mm256_fmadd_ps(a, b1, c31);
+                        }
+                        _mm256_storeu_ps(c + 0 * n_wid, c00); _mm256_storeu_ps(c + 0 * n_wid + 8, c01);
+                        _mm256_storeu_ps(c + 1 * n_wid, c10); _mm256_storeu_ps(c + 1 * n_wid + 8, c11);
+                        _mm256_storeu_ps(c + 2 * n_wid, c20); _mm256_storeu_ps(c + 2 * n_wid + 8, c21);
+                        _mm256_storeu_ps(c + 3 * n_wid, c30); _mm256_storeu_ps(c + 3 * n_wid + 8, c31);
+                    }
+                    for (; j + 8 <= n_wid; j += 8) {
+                        float* c = dout + i * n_wid + j;
+                        __m256 c0 = _mm256_loadu_ps(c + 0 * n_wid), c1 = _mm256_loadu_ps(c + 1 * n_wid);
+                        __m256 c2 = _mm256_loadu_ps(c + 2 * n_wid), c3 = _mm256_loadu_ps(c + 3 * n_wid);
+                        for (size_t k = 0; k < kc; ++k) {
+                            __m256 b0 = load8_ps(n + (kk + k) * n_wid + j);
+                            c0 = _mm256_fmadd_ps(_mm256_set1_ps(afPanel[0][k]), b0, c0);
+                            c1 = _mm256_fmadd_ps(_mm256_set1_ps(afPanel[1][k]), b0, c1);
+                            c2 = _mm256_fmadd_ps(_mm256_set1_ps(afPanel[2][k]), b0, c2);
+                            c3 = _mm256_fmadd_ps(_mm256_set1_ps(afPanel[3][k]), b0, c3);
+                        }
+                        _mm256_storeu_ps(c + 0 * n_wid, c0);
+                        _mm256_storeu_ps(c + 1 * n_wid, c1);
+                        _mm256_storeu_ps(c + 2 * n_wid, c2);
+                        _mm256_storeu_ps(c + 3 * n_wid, c3);
+                    }
+                    for (; j < n_wid; ++j) {
+                        for (size_t r = 0; r < 4; ++r) {
+                            float fSum = dout[(i + r) * n_wid + j];
+                            for (size_t k = 0; k < kc; ++k) fSum += afPanel[r][k] * (float)n[(kk + k) * n_wid + j];
+                            dout[(i + r) * n_wid + j] = fSum;
+                        }
+                    }
                 }
+            }
 #endif
-                for (; j < n_wid; j++) {
-                    dout[i * n_wid + j] += m[i * m_wid + k] * n[k * n_wid + j];
+            /** Remaining rows, also the portable path */
+            for (; i < m_hgt; ++i) {
+                for (size_t k = 0; k < kc; ++k) afPanel[0][k] = (float)m[i * m_wid + kk + k];
+                for (size_t k = 0; k < kc; ++k) {
+                    const float a = afPanel[0][k];
+                    const T* b = n + (kk + k) * n_wid;
+                    float* c = dout + i * n_wid;
+                    size_t j = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+                    if (bVectorized) {
+                        __m256 av = _mm256_set1_ps(a);
+                        for (; j + 8 <= n_wid; j += 8) {
+                            _mm256_storeu_ps(c + j, _mm256_fmadd_ps(av, load8_ps(b + j), _mm256_loadu_ps(c + j)));
+                        }
+                    }
+#endif
+                    for (; j < n_wid; ++j) c[j] += a * (float)b[j];
                 }
             }
         }
-#elif OPTIMIZE_GEMM == 2
-#if defined(__AVX__)
-
-        int i = 0, k = 0, j = 0;
-        for (i = 0; i < m_hgt - 8; i += 8) {
-            for (k = 0; k < m_wid - 8; k += 8) {
-                __m256 dout0v, dout1v, dout2v, dout3v, dout4v, dout5v, dout6v, dout7v, n0v, n1v, n2v, n3v, n4v, n5v, n6v, n7v;
-                for (j = 0; j < n_wid - 8; j += 8) {
-                    dout0v = _mm256_load_ps(&dout[(i + 0) * n_wid + j]);
-                    dout1v = _mm256_load_ps(&dout[(i + 1) * n_wid + j]);
-                    dout2v = _mm256_load_ps(&dout[(i + 2) * n_wid + j]);
-                    dout3v = _mm256_load_ps(&dout[(i + 3) * n_wid + j]);
-                    dout4v = _mm256_load_ps(&dout[(i + 4) * n_wid + j]);
-                    dout5v = _mm256_load_ps(&dout[(i + 5) * n_wid + j]);
-                    dout6v = _mm256_load_ps(&dout[(i + 6) * n_wid + j]);
-                    dout7v = _mm256_load_ps(&dout[(i + 7) * n_wid + j]);
-
-                    n0v = _mm256_load_ps(&n[(k + 0) * n_wid + j]);
-                    dout0v += m[(i + 0) * m_wid + k + 0] * n0v;
-                    dout1v += m[(i + 1) * m_wid + k + 0] * n0v;
-                    dout2v += m[(i + 2) * m_wid + k + 0] * n0v;
-                    dout3v += m[(i + 3) * m_wid + k + 0] * n0v;
-                    dout4v += m[(i + 4) * m_wid + k + 0] * n0v;
-                    dout5v += m[(i + 5) * m_wid + k + 0] * n0v;
-                    dout6v += m[(i + 6) * m_wid + k + 0] * n0v;
-                    dout7v += m[(i + 7) * m_wid + k + 0] * n0v;
-
-                    n1v = _mm256_load_ps(&n[(k + 1) * n_wid + j]);
-                    dout0v += m[(i + 0) * m_wid + k + 1] * n1v;
-                    dout1v += m[(i + 1) * m_wid + k + 1] * n1v;
-                    dout2v += m[(i + 2) * m_wid + k + 1] * n1v;
-                    dout3v += m[(i + 3) * m_wid + k + 1] * n1v;
-                    dout4v += m[(i + 4) * m_wid + k + 1] * n1v;
-                    dout5v += m[(i + 5) * m_wid + k + 1] * n1v;
-                    dout6v += m[(i + 6) * m_wid + k + 1] * n1v;
-                    dout7v += m[(i + 7) * m_wid + k + 1] * n1v;
-
-                    n2v = _mm256_load_ps(&n[(k + 2) * n_wid + j]);
-                    dout0v += m[(i + 0) * m_wid + k + 2] * n2v;
-                    dout1v += m[(i + 1) * m_wid + k + 2] * n2v;
-                    dout2v += m[(i + 2) * m_wid + k + 2] * n2v;
-                    dout3v += m[(i + 3) * m_wid + k + 2] * n2v;
-                    dout4v += m[(i + 4) * m_wid + k + 2] * n2v;
-                    dout5v += m[(i + 5) * m_wid + k + 2] * n2v;
-                    dout6v += m[(i + 6) * m_wid + k + 2] * n2v;
-                    dout7v += m[(i + 7) * m_wid + k + 2] * n2v;
-
-                    n3v = _mm256_load_ps(&n[(k + 3) * n_wid + j]);
-                    dout0v += m[(i + 0) * m_wid + k + 3] * n3v;
-                    dout1v += m[(i + 1) * m_wid + k + 3] * n3v;
-                    dout2v += m[(i + 2) * m_wid + k + 3] * n3v;
-                    dout3v += m[(i + 3) * m_wid + k + 3] * n3v;
-                    dout4v += m[(i + 4) * m_wid + k + 3] * n3v;
-                    dout5v += m[(i + 5) * m_wid + k + 3] * n3v;
-                    dout6v += m[(i + 6) * m_wid + k + 3] * n3v;
-                    dout7v += m[(i + 7) * m_wid + k + 3] * n3v;
-
-                    n4v = _mm256_load_ps(&n[(k + 4) * n_wid + j]);
-                    dout0v += m[(i + 0) * m_wid + k + 4] * n4v;
-                    dout1v += m[(i + 1) * m_wid + k + 4] * n4v;
-                    dout2v += m[(i + 2) * m_wid + k + 4] * n4v;
-                    dout3v += m[(i + 3) * m_wid + k + 4] * n4v;
-                    dout4v += m[(i + 4) * m_wid + k + 4] * n4v;
-                    dout5v += m[(i + 5) * m_wid + k + 4] * n4v;
-                    dout6v += m[(i + 6) * m_wid + k + 4] * n4v;
-                    dout7v += m[(i + 7) * m_wid + k + 4] * n4v;
-
-                    n5v = _mm256_load_ps(&n[(k + 5) * n_wid + j]);
-                    dout0v += m[(i + 0) * m_wid + k + 5] * n5v;
-                    dout1v += m[(i + 1) * m_wid + k + 5] * n5v;
-                    dout2v += m[(i + 2) * m_wid + k + 5] * n5v;
-                    dout3v += m[(i + 3) * m_wid + k + 5] * n5v;
-                    dout4v += m[(i + 4) * m_wid + k + 5] * n5v;
-                    dout5v += m[(i + 5) * m_wid + k + 5] * n5v;
-                    dout6v += m[(i + 6) * m_wid + k + 5] * n5v;
-                    dout7v += m[(i + 7) * m_wid + k + 5] * n5v;
-
-                    n6v = _mm256_load_ps(&n[(k + 6) * n_wid + j]);
-                    dout0v += m[(i + 0) * m_wid + k + 6] * n6v;
-                    dout1v += m[(i + 1) * m_wid + k + 6] * n6v;
-                    dout2v += m[(i + 2) * m_wid + k + 6] * n6v;
-                    dout3v += m[(i + 3) * m_wid + k + 6] * n6v;
-                    dout4v += m[(i + 4) * m_wid + k + 6] * n6v;
-                    dout5v += m[(i + 5) * m_wid + k + 6] * n6v;
-                    dout6v += m[(i + 6) * m_wid + k + 6] * n6v;
-                    dout7v += m[(i + 7) * m_wid + k + 6] * n6v;
-
-                    n7v = _mm256_load_ps(&n[(k + 7) * n_wid + j]);
-                    dout0v += m[(i + 0) * m_wid + k + 7] * n7v;
-                    dout1v += m[(i + 1) * m_wid + k + 7] * n7v;
-                    dout2v += m[(i + 2) * m_wid + k + 7] * n7v;
-                    dout3v += m[(i + 3) * m_wid + k + 7] * n7v;
-                    dout4v += m[(i + 4) * m_wid + k + 7] * n7v;
-                    dout5v += m[(i + 5) * m_wid + k + 7] * n7v;
-                    dout6v += m[(i + 6) * m_wid + k + 7] * n7v;
-                    dout7v += m[(i + 7) * m_wid + k + 7] * n7v;
-
-                    _mm256_store_ps(&dout[(i + 0) * n_wid + j], dout0v);
-                    _mm256_store_ps(&dout[(i + 1) * n_wid + j], dout1v);
-                    _mm256_store_ps(&dout[(i + 2) * n_wid + j], dout2v);
-                    _mm256_store_ps(&dout[(i + 3) * n_wid + j], dout3v);
-                    _mm256_store_ps(&dout[(i + 4) * n_wid + j], dout4v);
-                    _mm256_store_ps(&dout[(i + 5) * n_wid + j], dout5v);
-                    _mm256_store_ps(&dout[(i + 6) * n_wid + j], dout6v);
-                    _mm256_store_ps(&dout[(i + 7) * n_wid + j], dout7v);
-                }
-                for (; j < n_wid; j++) {
-                    dout[i * n_wid + j] += m[i * m_wid + k + 0] * n[k + 0 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 1] * n[k + 1 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 2] * n[k + 2 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 3] * n[k + 3 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 4] * n[k + 4 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 5] * n[k + 5 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 6] * n[k + 6 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 7] * n[k + 7 * n_wid + j];
-                }
+        return 0;
+    }
+
+    int gemm_bf16(float* dout,
+                  const bf16_t* m,
+                  const bf16_t* n,
+                  size_t m_hgt,
+                  size_t m_wid,
+                  size_t n_hgt,
+                  size_t n_wid) {
+        return gemm_half<bf16_t, true>(dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+    }
+
+    int gemm_fp16(float* dout,
+                  const fp16_t* m,
+                  const fp16_t* n,
+                  size_t m_hgt,
+                  size_t m_wid,
+                  size_t n_hgt,
+                  size_t n_wid) {
+#ifdef GEMM_FP16_VECTORIZED
+        return gemm_half<fp16_t, true>(dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+#else
+        return gemm_half<fp16_t, false>(dout, m, n, m_hgt, m_wid, n_hgt, n_wid);
+#endif
+    }
+
+#if defined(__AVXVNNI__)
+#define GEMM_I8_DPBUSD(acc, a, b) _mm256_dpbusd_avx_epi32(acc, a, b)
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+#define GEMM_I8_DPBUSD(acc, a, b) _mm256_dpbusd_epi32(acc, a, b)
+#endif
+
+    /**
+     * @brief dout = m * n for int8 operands with exact int32 accumulation
+     *
+     * n is packed once into 8-column strips. With VNNI each strip holds 4
+     * consecutive k per column and vpdpbusd does 4 MACs per lane; m is biased
+     * to unsigned (+128) and 128 * colsum(n) is subtracted at the end.
+     * Plain AVX2 packs 2 consecutive k as int16 and uses vpmaddwd, which,
+     * unlike vpmaddubsw, cannot saturate for int8 x int8 products.
+     */
+    int gemm_i8(int32_t* dout,
+                const int8_t* m,
+                const int8_t* n,
+                size_t m_hgt,
+                size_t m_wid,
+                size_t n_hgt,
+                size_t n_wid) {
+
+        if (m_wid != n_hgt) return -1;
+
+#if defined(__AVX2__)
+        const size_t ulStrips = (n_wid + 7) / 8;
+#if defined(GEMM_I8_DPBUSD)
+        const size_t ulKGroup = 4;
+        typedef int8_t tPacked;
+#else
+        const size_t ulKGroup = 2;
+        typedef int16_t tPacked;
+#endif
+        const size_t ulKGroups = (m_wid + ulKGroup - 1) / ulKGroup;
+        const size_t ulStripLen = ulKGroups * 8 * ulKGroup;
+
+        /** Pack n: [strip][k / ulKGroup][column][k % ulKGroup] */
+        std::vector<tPacked> vecPacked(ulStrips * ulStripLen, 0);
+        std::vector<int32_t> vecColSum(ulStrips * 8, 0);
+        for (size_t k = 0; k < m_wid; ++k) {
+            for (size_t j = 0; j < n_wid; ++j) {
+                size_t s = j / 8, c = j % 8;
+                vecPacked[s * ulStripLen + (k / ulKGroup) * 8 * ulKGroup + c * ulKGroup + k % ulKGroup] = n[k * n_wid + j];
+                vecColSum[j] += n[k * n_wid + j];
             }
-            for (; k < m_wid; k++) {
-                __m256 ymm0 = _mm256_set1_ps(m[i * m_wid + k]);
-                for (j = 0; j < ((n_wid)-16); j += 16) {
-                    __m256 ymm1 = _mm256_load_ps(n + (k * n_wid + j));
-                    __m256 ymm2 = _mm256_load_ps(n + (k * n_wid + j + 8));
-                    __m256 ymm3 = _mm256_load_ps(dout + (i * n_wid + j));
-                    __m256 ymm4 = _mm256_load_ps(dout + (i * n_wid + j + 8));
-                    _mm256_store_ps(dout + (i * n_wid + j), _mm256_add_ps(ymm3, _mm256_mul_ps(ymm0, ymm1)));
-                    _mm256_store_ps(dout + (i * n_wid + j + 8), _mm256_add_ps(ymm4, _mm256_mul_ps(ymm0, ymm2)));
+        }
+
+        /** A row is broadcast ulKGroup elements at a time as one 32 bit word */
+        std::vector<int32_t> vecRow(4 * ulKGroups);
+        auto PackRow = [&](size_t r, size_t i) {
+            int32_t* p = &vecRow[r * ulKGroups];
+            for (size_t g = 0; g < ulKGroups; ++g) {
+                uint32_t uWord = 0;
+                for (size_t t = 0; t < ulKGroup; ++t) {
+                    size_t k = g * ulKGroup + t;
+#if defined(GEMM_I8_DPBUSD)
+                    uint32_t uVal = (k < m_wid) ? (uint8_t)(m[i * m_wid + k] + 128) : 0u;
+                    uWord |= uVal << (8 * t);
+#else
+                    uint32_t uVal = (k < m_wid) ? (uint16_t)(int16_t)m[i * m_wid + k] : 0u;
+                    uWord |= uVal << (16 * t);
+#endif
                 }
-                for (; j < n_wid; j++) {
-                    dout[i * n_wid + j] += m[i * m_wid + k] * n[k * n_wid + j];
+                p[g] = (int32_t)uWord;
+            }
+        };
+
+#if defined(GEMM_I8_DPBUSD)
+#define GEMM_I8_MAC(acc, a, b) acc = GEMM_I8_DPBUSD(acc, a, b)
+#else
+#define GEMM_I8_MAC(acc, a, b) acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a, b))
+#endif
+
+        auto StoreStrip = [&](size_t i, size_t s, __m256i acc) {
+#if defined(GEMM_I8_DPBUSD)
+            /** Remove the +128 bias applied to m */
+            __m256i bias = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i*)&vecColSum[s * 8]), 7);
+            acc = _mm256_sub_epi32(acc, bias);
+#endif
+            size_t j = s * 8;
+            if (j + 8 <= n_wid) {
+                _mm256_storeu_si256((__m256i*)&dout[i * n_wid + j], acc);
+            } else {
+                alignas(32) int32_t aiTmp[8];
+                _mm256_store_si256((__m256i*)aiTmp, acc);
+                for (size_t c = 0; j + c < n_wid; ++c) dout[i * n_wid + j + c] = aiTmp[c];
+            }
+        };
+
+        size_t i = 0;
+        for (; i + 4 <= m_hgt; i += 4) {
+            for (size_t r = 0; r < 4; ++r) PackRow(r, i + r);
+            for (size_t s = 0; s < ulStrips; ++s) {
+                const tPacked* b = &vecPacked[s * ulStripLen];
+                __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+                __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+                for (size_t g = 0; g < ulKGroups; ++g) {
+                    __m256i bv = _mm256_loadu_si256((const __m256i*)(b + g * 8 * ulKGroup));
+                    GEMM_I8_MAC(acc0, _mm256_set1_epi32(vecRow[0 * ulKGroups + g]), bv);
+                    GEMM_I8_MAC(acc1, _mm256_set1_epi32(vecRow[1 * ulKGroups + g]), bv);
+                    GEMM_I8_MAC(acc2, _mm256_set1_epi32(vecRow[2 * ulKGroups + g]), bv);
+                    GEMM_I8_MAC(acc3, _mm256_set1_epi32(vecRow[3 * ulKGroups + g]), bv);
                 }
+                StoreStrip(i + 0, s, acc0);
+                StoreStrip(i + 1, s, acc1);
+                StoreStrip(i + 2, s, acc2);
+                StoreStrip(i + 3, s, acc3);
             }
         }
-        for (; i < m_hgt; i++) {
-            for (k = 0; k < n_hgt; k++) {
-                int j = 0;
-                __m256 ymm0 = _mm256_set1_ps(m[i * m_wid + k]);
-                for (j = 0; j < ((n_wid)-16); j += 16) {
-                    __m256 ymm1 = _mm256_load_ps(n + (k * n_wid + j));
-                    __m256 ymm2 = _mm256_load_ps(n + (k * n_wid + j + 8));
-                    __m256 ymm3 = _mm256_load_ps(dout + (i * n_wid + j));
-                    __m256 ymm4 = _mm256_load_ps(dout + (i * n_wid + j + 8));
-                    _mm256_store_ps(dout + (i * n_wid + j), _mm256_add_ps(ymm3, _mm256_mul_ps(ymm0, ymm1)));
-                    _mm256_store_ps(dout + (i * n_wid + j + 8), _mm256_add_ps(ymm4, _mm256_mul_ps(ymm0, ymm2)));
-                }
-                for (; j < n_wid; j++) {
-                    dout[i * n_wid + j] += m[i * m_wid + k] * n[k * n_wid + j];
+        for (; i < m_hgt; ++i) {
+            PackRow(0, i);
+            for (size_t s = 0; s < ulStrips; ++s) {
+                const tPacked* b = &vecPacked[s * ulStripLen];
+                __m256i acc0 = _mm256_setzero_si256();
+                for (size_t g = 0; g < ulKGroups; ++g) {
+                    GEMM_I8_MAC(acc0, _mm256_set1_epi32(vecRow[g]), _mm256_loadu_si256((const __m256i*)(b + g * 8 * ulKGroup)));
                 }
+                StoreStrip(i, s, acc0);
             }
         }
+#undef GEMM_I8_MAC
 #else
-#error("AVX not enabled")
-#endif
-#endif
+        memset(dout, 0, sizeof(int32_t) * m_hgt * n_wid);
+        for (size_t i = 0; i < m_hgt; i++)
+            for (size_t k = 0; k < n_hgt; k++) {
+                const int32_t a = m[i * m_wid + k];
+                for (size_t j = 0; j < n_wid; j++)
+                    dout[i * n_wid + j] += a * (int32_t)n[k * n_wid + j];
+            }
 #endif
-
         return 0;
-
     }
 
-    int gemm_f64(double* dout,
-                 double* m,
-                 double* n,
+    int gemm_i32(int32_t* dout,
+                 const int32_t* m,
+                 const int32_t* n,
                  size_t m_hgt,
                  size_t m_wid,
                  size_t n_hgt,
@@ -238,28 +504,17 @@ namespace mpimath {
 
         if (m_wid != n_hgt) return -1;
 
-        memset(dout, 0, sizeof(double) * m_hgt * n_wid);
-
-#if !defined(OPTIMIZE_GEMM)
-        for (int i = 0; i < m_hgt; i++)
-            for (int k = 0; k < n_hgt; k++)
-                for (int j = 0; j < n_wid; j++)
-                    dout[i * n_wid + j] += m[i * m_wid + k] * n[k * n_wid + j];
-#else
-#if OPTIMIZE_GEMM == 1
-
-        for (int i = 0; i < m_hgt; i++) {
-            for (int k = 0; k < n_hgt; k++) {
-                int j = 0;
-#ifdef __AVX__
-                __m256d ymm0 = _mm256_set1_pd(m[i * m_wid + k]);
-                for (j = 0; j < ((n_wid)-8); j += 8) {
-                    __m256d ymm1 = _mm256_load_pd(n + (k * n_wid + j));
-                    __m256d ymm2 = _mm256_load_pd(n + (k * n_wid + j + 4));
-                    __m256d ymm3 = _mm256_load_pd(dout + (i * n_wid + j));
-                    __m256d ymm4 = _mm256_load_pd(dout + (i * n_wid + j + 4));
-                    _mm256_store_pd(dout + (i * n_wid + j), _mm256_add_pd(ymm3, _mm256_mul_pd(ymm0, ymm1)));
-                    _mm256_store_pd(dout + (i * n_wid + j + 4), _mm256_add_pd(ymm4, _mm256_mul_pd(ymm0, ymm2)));
+        memset(dout, 0, sizeof(int32_t) * m_hgt * n_wid);
+
+        for (size_t i = 0; i < m_hgt; i++) {
+            for (size_t k = 0; k < n_hgt; k++) {
+                size_t j = 0;
+#ifdef __AVX2__
+                __m256i ymm0 = _mm256_set1_epi32(m[i * m_wid + k]);
+                for (; j + 8 <= n_wid; j += 8) {
+                    __m256i ymm1 = _mm256_loadu_si256((const __m256i*)(n + (k * n_wid + j)));
+                    __m256i ymm2 = _mm256_loadu_si256((const __m256i*)(dout + (i * n_wid + j)));
+                    _mm256_storeu_si256((__m256i*)(dout + (i * n_wid + j)), _mm256_add_epi32(ymm2, _mm256_mullo_epi32(ymm0, ymm1)));
                 }
 #endif
                 for (; j < n_wid; j++) {
@@ -267,127 +522,31 @@ namespace mpimath {
                 }
             }
         }
-#elif OPTIMIZE_GEMM == 2
-#if defined(__AVX__)
-
-        int i = 0, k = 0, j = 0;
-        for (i = 0; i < m_hgt - 4; i += 4) {
-            for (k = 0; k < m_wid - 4; k += 4) {
-                __m256d n0v, n1v, n2v, n3v;
-                __m256d dout0v_0, dout1v_0, dout2v_0, dout3v_0;
-                // __m256d dout0v_1, dout1v_1, dout2v_1, dout3v_1;
-
-                for (j = 0; j < n_wid - 4; j += 4) {
-                    dout0v_0 = _mm256_load_pd(&dout[(i + 0) * n_wid + j]);
-                    dout1v_0 = _mm256_load_pd(&dout[(i + 1) * n_wid + j]);
-                    dout2v_0 = _mm256_load_pd(&dout[(i + 2) * n_wid + j]);
-                    dout3v_0 = _mm256_load_pd(&dout[(i + 3) * n_wid + j]);
-                    // dout0v_1 = _mm256_load_pd(&dout[(i + 4) * n_wid + j]);
-                    // dout1v_1 = _mm256_load_pd(&dout[(i + 5) * n_wid + j]);
-                    // dout2v_1 = _mm256_load_pd(&dout[(i + 6) * n_wid + j]);
-                    // dout3v_1 = _mm256_load_pd(&dout[(i + 7) * n_wid + j]);
-
-
-                    n0v = _mm256_load_pd(&n[(k + 0) * n_wid + j]);
-                    dout0v_0 += m[(i + 0) * m_wid + k + 0] * n0v;
-                    dout1v_0 += m[(i + 1) * m_wid + k + 0] * n0v;
-                    dout2v_0 += m[(i + 2) * m_wid + k + 0] * n0v;
-                    dout3v_0 += m[(i + 3) * m_wid + k + 0] * n0v;
-                    // dout0v_1 += m[(i + 4) * m_wid + k + 0] * n0v;
-                    // dout1v_1 += m[(i + 5) * m_wid + k + 0] * n0v;
-                    // dout2v_1 += m[(i + 6) * m_wid + k + 0] * n0v;
-                    // dout3v_1 += m[(i + 7) * m_wid + k + 0] * n0v;
-
-
-                    n1v = _mm256_load_pd(&n[(k + 1) * n_wid + j]);
-                    dout0v_0 += m[(i + 0) * m_wid + k + 1] * n1v;
-                    dout1v_0 += m[(i + 1) * m_wid + k + 1] * n1v;
-                    dout2v_0 += m[(i + 2) * m_wid + k + 1] * n1v;
-                    dout3v_0 += m[(i + 3) * m_wid + k + 1] * n1v;
-                    // dout0v_1 += m[(i + 4) * m_wid + k + 1] * n1v;
-                    // dout1v_1 += m[(i + 5) * m_wid + k + 1] * n1v;
-                    // dout2v_1 += m[(i + 6) * m_wid + k + 1] * n1v;
-                    // dout3v_1 += m[(i + 7) * m_wid + k + 1] * n1v;
-
-
-                    n2v = _mm256_load_pd(&n[(k + 2) * n_wid + j]);
-                    dout0v_0 += m[(i + 0) * m_wid + k + 2] * n2v;
-                    dout1v_0 += m[(i + 1) * m_wid + k + 2] * n2v;
-                    dout2v_0 += m[(i + 2) * m_wid + k + 2] * n2v;
-                    dout3v_0 += m[(i + 3) * m_wid + k + 2] * n2v;
-                    // dout0v_1 += m[(i + 4) * m_wid + k + 2] * n2v;
-                    // dout1v_1 += m[(i + 5) * m_wid + k + 2] * n2v;
-                    // dout2v_1 += m[(i + 6) * m_wid + k + 2] * n2v;
-                    // dout3v_1 += m[(i + 7) * m_wid + k + 2] * n2v;
-
-
-                    n3v = _mm256_load_pd(&n[(k + 3) * n_wid + j]);
-                    dout0v_0 += m[(i + 0) * m_wid + k + 3] * n3v;
-                    dout1v_0 += m[(i + 1) * m_wid + k + 3] * n3v;
-                    dout2v_0 += m[(i + 2) * m_wid + k + 3] * n3v;
-                    dout3v_0 += m[(i + 3) * m_wid + k + 3] * n3v;
-                    // dout0v_1 += m[(i + 4) * m_wid + k + 3] * n3v;
-                    // dout1v_1 += m[(i + 5) * m_wid + k + 3] * n3v;
-                    // dout2v_1 += m[(i + 6) * m_wid + k + 3] * n3v;
-                    // dout3v_1 += m[(i + 7) * m_wid + k + 3] * n3v;
-
-
-                    _mm256_store_pd(&dout[(i + 0) * n_wid + j], dout0v_0);
-                    _mm256_store_pd(&dout[(i + 1) * n_wid + j], dout1v_0);
-                    _mm256_store_pd(&dout[(i + 2) * n_wid + j], dout2v_0);
-                    _mm256_store_pd(&dout[(i + 3) * n_wid + j], dout3v_0);
-                    // _mm256_store_pd(&dout[(i + 4) * n_wid + j], dout0v_1);
-                    // _mm256_store_pd(&dout[(i + 5) * n_wid + j], dout1v_1);
-                    // _mm256_store_pd(&dout[(i + 6) * n_wid + j], dout2v_1);
-                    // _mm256_store_pd(&dout[(i + 7) * n_wid + j], dout3v_1);
-                }
-                for (; j < n_wid; j++) {
-                    dout[i * n_wid + j] += m[i * m_wid + k + 0] * n[k + 0 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 1] * n[k + 1 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 2] * n[k + 2 * n_wid + j];
-                    dout[i * n_wid + j] += m[i * m_wid + k + 3] * n[k + 3 * n_wid + j];
-                }
-            }
-            for (; k < m_wid; k++) {
-                __m256d ymm0 = _mm256_set1_pd(m[i * m_wid + k]);
-                for (j = 0; j < ((n_wid)-8); j += 8) {
-                    __m256d ymm1 = _mm256_load_pd(n + (k * n_wid + j));
-                    __m256d ymm2 = _mm256_load_pd(n + (k * n_wid + j + 4));
-                    __m256d ymm3 = _mm256_load_pd(dout + (i * n_wid + j));
-                    __m256d ymm4 = _mm256_load_pd(dout + (i * n_wid + j + 4));
-                    _mm256_store_pd(dout + (i * n_wid + j), _mm256_add_pd(ymm3, _mm256_mul_pd(ymm0, ymm1)));
-                    _mm256_store_pd(dout + (i * n_wid + j + 4), _mm256_add_pd(ymm4, _mm256_mul_pd(ymm0, ymm2)));
-                }
-                for (; j < n_wid; j++) {
-                    dout[i * n_wid + j] += m[i * m_wid + k] * n[k * n_wid + j];
-                }
-            }
-        }
-        for (; i < m_hgt; i++) {
-            for (k = 0; k < n_hgt; k++) {
-                int j = 0;
-                __m256d ymm0 = _mm256_set1_pd(m[i * m_wid + k]);
-                for (j = 0; j < ((n_wid)-8); j += 8) {
-                    __m256d ymm1 = _mm256_load_pd(n + (k * n_wid + j));
-                    __m256d ymm2 = _mm256_load_pd(n + (k * n_wid + j + 4));
-                    __m256d ymm3 = _mm256_load_pd(dout + (i * n_wid + j));
-                    __m256d ymm4 = _mm256_load_pd(dout + (i * n_wid + j + 4));
-                    _mm256_store_pd(dout + (i * n_wid + j), _mm256_add_pd(ymm3, _mm256_mul_pd(ymm0, ymm1)));
-                    _mm256_store_pd(dout + (i * n_wid + j + 4), _mm256_add_pd(ymm4, _mm256_mul_pd(ymm0, ymm2)));
-                }
-                for (; j < n_wid; j++) {
-                    dout[i * n_wid + j] += m[i * m_wid + k] * n[k * n_wid + j];
+        return 0;
+    }
+
+    int gemm_i64(int64_t* dout,
+                 const int64_t* m,
+                 const int64_t* n,
+                 size_t m_hgt,
+                 size_t m_wid,
+                 size_t n_hgt,
+                 size_t n_wid) {
+
+        if (m_wid != n_hgt) return -1;
+
+        memset(dout, 0, sizeof(int64_t) * m_hgt * n_wid);
+
+        /** AVX2 has no 64 bit multiply, the ikj order lets the compiler vectorize what it can */
+        for (size_t i = 0; i < m_hgt; i++) {
+            for (size_t k = 0; k < n_hgt; k++) {
+                const int64_t a = m[i * m_wid + k];
+                for (size_t j = 0; j < n_wid; j++) {
+                    dout[i * n_wid + j] += a * n[k * n_wid + j];
                 }
             }
         }
-#else
-#error("AVX not enabled")
-#endif
-#endif
-#endif
-
         return 0;
-
     }
 
 } // namespace mpimath
\ No newline at end of file
@@ -0,0 +1,219 @@
+/**
+ * @file gemm_batched.cpp
+ * @author davidliyutong@sjtu.edu.cn
+ * @brief Strided batched gemm for many small matrices
+ * @version 0.1
+ * @date 2022-06-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <memory.h>
+#include "gemm.hpp"
+#include "parallel.hpp"
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/** Below this many multiply-adds per thread a batch is not worth a thread */
+#define GEMM_BATCHED_MIN_WORK_PER_THREAD (1 << 18)
+
+namespace mpimath {
+    /**
+     * @brief c = a * b for one M x K by K x N product, shapes known at compile time
+     *
+     * Every loop bound is a constant: the j loops are unrolled so a row of c
+     * stays in registers across the whole k loop.
+     */
+    template<typename T, size_t M, size_t K, size_t N>
+    struct tSmallGemm {
+        static inline void Run(T* __restrict c, const T* __restrict a, const T* __restrict b) {
+            for (size_t i = 0; i < M; ++i) {
+                T acc[N] = {};
+                for (size_t k = 0; k < K; ++k) {
+                    const T aik = a[i * K + k];
+#pragma GCC unroll 16
+                    for (size_t j = 0; j < N; ++j) {
+                        acc[j] += aik * b[k * N + j];
+                    }
+                }
+#pragma GCC unroll 16
+                for (size_t j = 0; j < N; ++j) {
+                    c[i * N + j] = acc[j];
+                }
+            }
+        }
+    };
+
+#if defined(__AVX__) && defined(__FMA__)
+    /**
+     * @brief 4x4x4 double: the whole of b and c live in 8 ymm registers
+     *
+     */
+    template<>
+    struct tSmallGemm<double, 4, 4, 4> {
+        static inline void Run(double* __restrict c, const double* __restrict a, const double* __restrict b) {
+            const __m256d b0 = _mm256_loadu_pd(b + 0), b1 = _mm256_loadu_pd(b + 4);
+            const __m256d b2 = _mm256_loadu_pd(b + 8), b3 = _mm256_loadu_pd(b + 12);
+#define SMALL_GEMM_ROW(i) \
+            { \
+                __m256d r = _mm256_mul_pd(_mm256_set1_pd(a[i * 4 + 0]), b0); \
+                r = _mm256_fmadd_pd(_mm256_set1_pd(a[i * 4 + 1]), b1, r); \
+                r = _mm256_fmadd_pd(_mm256_set1_pd(a[i * 4 + 2]), b2, r); \
+                r = _mm256_fmadd_pd(_mm256_set1_pd(a[i * 4 + 3]), b3, r); \
+                _mm256_storeu_pd(c + i * 4, r); \
+            }
+            SMALL_GEMM_ROW(0) SMALL_GEMM_ROW(1) SMALL_GEMM_ROW(2) SMALL_GEMM_ROW(3)
+#undef SMALL_GEMM_ROW
+        }
+    };
+
+    /**
+     * @brief 8x8x8 float: one ymm per row of b, 8 fma per row of c
+     *
+     */
+    template<>
+    struct tSmallGemm<float, 8, 8, 8> {
+        static inline void Run(float* __restrict c, const float* __restrict a, const float* __restrict b) {
+            __m256 bv[8];
+            for (int k = 0; k < 8; ++k) bv[k] = _mm256_loadu_ps(b + k * 8);
+            for (int i = 0; i < 8; ++i) {
+                __m256 r = _mm256_mul_ps(_mm256_set1_ps(a[i * 8 + 0]), bv[0]);
+                r = _mm256_fmadd_ps(_mm256_set1_ps(a[i * 8 + 1]), bv[1], r);
+                r = _mm256_fmadd_ps(_mm256_set1_ps(a[i * 8 + 2]), bv[2], r);
+                r = _mm256_fmadd_ps(_mm256_set1_ps(a[i * 8 + 3]), bv[3], r);
+                r = _mm256_fmadd_ps(_mm256_set1_ps(a[i * 8 + 4]), bv[4], r);
+                r = _mm256_fmadd_ps(_mm256_set1_ps(a[i * 8 + 5]), bv[5], r);
+                r = _mm256_fmadd_ps(_mm256_set1_ps(a[i * 8 + 6]), bv[6], r);
+                r = _mm256_fmadd_ps(_mm256_set1_ps(a[i * 8 + 7]), bv[7], r);
+                _mm256_storeu_ps(c + i * 8, r);
+            }
+        }
+    };
+#endif
+
+    /**
+     * @brief Shapes unknown at compile time, same loop order as tSmallGemm
+     *
+     */
+    template<typename T>
+    static inline void small_gemm_generic(T* __restrict c, const T* __restrict a, const T* __restrict b,
+                                          size_t m, size_t k_, size_t n) {
+        memset(c, 0, sizeof(T) * m * n);
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t k = 0; k < k_; ++k) {
+                const T aik = a[i * k_ + k];
+                for (size_t j = 0; j < n; ++j) {
+                    c[i * n + j] += aik * b[k * n + j];
+                }
+            }
+        }
+    }
+
+    /** Kernel signature shared by all specializations */
+    template<typename T>
+    using tSmallGemmFn = void (*)(T*, const T*, const T*);
+
+    /**
+     * @brief Return the compile-time specialized kernel for (m, k, n), or
+     * nullptr when the shape has none
+     *
+     * Square sizes 4..64 and the 4/8/16 rectangular mixes are instantiated.
+     */
+    template<typename T>
+    static tSmallGemmFn<T> select_small_gemm(size_t m, size_t k, size_t n) {
+#define SMALL_GEMM_CASE(M, K, N) \
+        if (m == M and k == K and n == N) return &tSmallGemm<T, M, K, N>::Run;
+        SMALL_GEMM_CASE(2, 2, 2)
+        SMALL_GEMM_CASE(3, 3, 3)
+        SMALL_GEMM_CASE(4, 4, 4)
+        SMALL_GEMM_CASE(6, 6, 6)
+        SMALL_GEMM_CASE(8, 8, 8)
+        SMALL_GEMM_CASE(12, 12, 12)
+        SMALL_GEMM_CASE(16, 16, 16)
+        SMALL_GEMM_CASE(24, 24, 24)
+        SMALL_GEMM_CASE(32, 32, 32)
+        SMALL_GEMM_CASE(48, 48, 48)
+        SMALL_GEMM_CASE(64, 64, 64)
+        SMALL_GEMM_CASE(4, 4, 1)
+        SMALL_GEMM_CASE(4, 8, 4)
+        SMALL_GEMM_CASE(8, 4, 8)
+        SMALL_GEMM_CASE(8, 16, 8)
+        SMALL_GEMM_CASE(16, 8, 16)
+#undef SMALL_GEMM_CASE
+        return nullptr;
+    }
+
+    template<typename T>
+    static int gemm_batched_impl(T* dout,
+                                 const T* m,
+                                 const T* n,
+                                 size_t batch,
+                                 size_t m_hgt,
+                                 size_t m_wid,
+                                 size_t n_wid,
+                                 size_t m_stride,
+                                 size_t n_stride,
+                                 size_t dout_stride,
+                                 unsigned threads) {
+        if (batch == 0) return 0;
+        if (m_stride == (size_t)-1) m_stride = m_hgt * m_wid;
+        if (n_stride == (size_t)-1) n_stride = m_wid * n_wid;
+        if (dout_stride == (size_t)-1) dout_stride = m_hgt * n_wid;
+
+        /** Resolve the kernel once for the whole batch */
+        tSmallGemmFn<T> Kernel = select_small_gemm<T>(m_hgt, m_wid, n_wid);
+
+        auto Worker = [&](size_t ulLow, size_t ulHigh, unsigned) {
+            if (Kernel != nullptr) {
+                for (size_t b = ulLow; b < ulHigh; ++b) {
+                    Kernel(dout + b * dout_stride, m + b * m_stride, n + b * n_stride);
+                }
+            } else {
+                for (size_t b = ulLow; b < ulHigh; ++b) {
+                    small_gemm_generic(dout + b * dout_stride, m + b * m_stride, n + b * n_stride, m_hgt, m_wid, n_wid);
+                }
+            }
+        };
+
+        if (threads == 0) {
+            /** Do not pay for threads the work can not amortize */
+            size_t ulWork = batch * m_hgt * m_wid * n_wid;
+            size_t ulMaxThreads = ulWork / GEMM_BATCHED_MIN_WORK_PER_THREAD + 1;
+            threads = DefaultNumThreads();
+            if (threads > ulMaxThreads) threads = (unsigned)ulMaxThreads;
+        }
+        ParallelFor(0, batch, Worker, threads);
+        return 0;
+    }
+
+    int gemm_batched_f32(float* dout,
+                         const float* m,
+                         const float* n,
+                         size_t batch,
+                         size_t m_hgt,
+                         size_t m_wid,
+                         size_t n_wid,
+                         size_t m_stride,
+                         size_t n_stride,
+                         size_t dout_stride,
+                         unsigned threads) {
+        return gemm_batched_impl(dout, m, n, batch, m_hgt, m_wid, n_wid, m_stride, n_stride, dout_stride, threads);
+    }
+
+    int gemm_batched_f64(double* dout,
+                         const double* m,
+                         const double* n,
+                         size_t batch,
+                         size_t m_hgt,
+                         size_t m_wid,
+                         size_t n_wid,
+                         size_t m_stride,
+                         size_t n_stride,
+                         size_t dout_stride,
+                         unsigned threads) {
+        return gemm_batched_impl(dout, m, n, batch, m_hgt, m_wid, n_wid, m_stride, n_stride, dout_stride, threads);
+    }
+} // namespace mpimath
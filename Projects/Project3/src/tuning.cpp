@@ -0,0 +1,195 @@
+/**
+ * @file tuning.cpp
+ * @author davidliyutong@sjtu.edu.cn
+ * @brief Tuning file I/O and the per process table read by gemm and MatMul
+ * @version 0.1
+ * @date 2022-06-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+#include "Matrix.hpp"
+#include "Tuning.hpp"
+#include "debug.h"
+
+namespace mpimath {
+    static const char* asShapeNames[] = { "small", "skinny", "medium", "large" };
+    static const char* asKernelNames[] = { "naive", "row", "unroll" };
+
+    emShapeClass ShapeClassOf(size_t m_hgt, size_t m_wid, size_t n_wid) {
+        const double dVolume = (double)m_hgt * (double)m_wid * (double)n_wid;
+        if (dVolume <= 128.0 * 128 * 128) return emShapeClass::SMALL;
+        if (std::min(m_hgt, std::min(m_wid, n_wid)) <= 32) return emShapeClass::SKINNY;
+        if (dVolume <= 768.0 * 768 * 768) return emShapeClass::MEDIUM;
+        return emShapeClass::LARGE;
+    }
+
+    const char* ShapeClassName(emShapeClass emShape) {
+        return asShapeNames[(int)emShape];
+    }
+
+    const char* GemmKernelName(emGemmKernel emKernel) {
+        return asKernelNames[(int)emKernel];
+    }
+
+    const std::string& CPUModel() {
+        static std::string sModel = [] {
+            std::ifstream File("/proc/cpuinfo");
+            std::string sLine;
+            while (std::getline(File, sLine)) {
+                if (sLine.compare(0, 10, "model name") != 0) continue;
+                size_t ulColon = sLine.find(':');
+                if (ulColon == std::string::npos) break;
+                size_t ulBegin = sLine.find_first_not_of(" \t", ulColon + 1);
+                return ulBegin == std::string::npos ? std::string("unknown") : sLine.substr(ulBegin);
+            }
+            return std::string("unknown");
+        }();
+        return sModel;
+    }
+
+    tGemmParams GemmDefaultParams() {
+#if !defined(OPTIMIZE_GEMM)
+        return { emGemmKernel::NAIVE, 0, 0, 0 };
+#elif OPTIMIZE_GEMM == 1
+        return { emGemmKernel::ROW, 0, 0, 0 };
+#else
+        return { emGemmKernel::UNROLL, 0, 0, 0 };
+#endif
+    }
+
+    int LoadTuningFile(const std::string& sPath, std::vector<tTuningEntry>& vecEntries) {
+        std::ifstream File(sPath);
+        if (not File.is_open()) return MATRIX_ERR_IO;
+        std::string sLine;
+        while (std::getline(File, sLine)) {
+            if (sLine.empty() or sLine[0] == '#') continue;
+            std::istringstream Line(sLine);
+            std::string sShape, sFields;
+            tTuningEntry Entry = { "", "", emShapeClass::SMALL, GemmDefaultParams(), 0, 0 };
+            if (not std::getline(Line, Entry.sCPU, '\t') or not std::getline(Line, Entry.sOp, '\t') or
+                not std::getline(Line, sShape, '\t')) {
+                return MATRIX_ERR_DATA;
+            }
+            std::getline(Line, sFields);
+
+            int iShape = 0;
+            while (iShape < (int)emShapeClass::COUNT and sShape != asShapeNames[iShape]) iShape++;
+            if (iShape == (int)emShapeClass::COUNT) return MATRIX_ERR_DATA;
+            Entry.emShape = (emShapeClass)iShape;
+
+            std::istringstream Fields(sFields);
+            std::string sField;
+            while (Fields >> sField) {
+                size_t ulEq = sField.find('=');
+                if (ulEq == std::string::npos) return MATRIX_ERR_DATA;
+                const std::string sKey = sField.substr(0, ulEq);
+                const char* sValue = sField.c_str() + ulEq + 1;
+                if (sKey == "kernel") {
+                    int iKernel = atoi(sValue);
+                    if (iKernel < 0 or iKernel >= (int)emGemmKernel::COUNT) return MATRIX_ERR_DATA;
+                    Entry.Gemm.emKernel = (emGemmKernel)iKernel;
+                } else if (sKey == "mc") {
+                    Entry.Gemm.ulMC = strtoul(sValue, nullptr, 10);
+                } else if (sKey == "kc") {
+                    Entry.Gemm.ulKC = strtoul(sValue, nullptr, 10);
+                } else if (sKey == "nc") {
+                    Entry.Gemm.ulNC = strtoul(sValue, nullptr, 10);
+                } else if (sKey == "tile") {
+                    Entry.lTileRows = atol(sValue);
+                } else if (sKey == "gflops") {
+                    Entry.dGFlops = atof(sValue);
+                }
+                /** Unknown keys are left for newer readers */
+            }
+            vecEntries.push_back(Entry);
+        }
+        return MATRIX_OK;
+    }
+
+    int SaveTuningFile(const std::string& sPath, const std::vector<tTuningEntry>& vecEntries) {
+        FILE* pFile = fopen(sPath.c_str(), "w");
+        if (pFile == nullptr) return MATRIX_ERR_IO;
+        fprintf(pFile, "# mpimath tuning: cpu model<TAB>op<TAB>shape class<TAB>parameters\n");
+        for (const auto& Entry : vecEntries) {
+            fprintf(pFile, "%s\t%s\t%s\tkernel=%d mc=%zu kc=%zu nc=%zu tile=%ld gflops=%.3f\n",
+                    Entry.sCPU.c_str(), Entry.sOp.c_str(), ShapeClassName(Entry.emShape), (int)Entry.Gemm.emKernel,
+                    Entry.Gemm.ulMC, Entry.Gemm.ulKC, Entry.Gemm.ulNC, Entry.lTileRows, Entry.dGFlops);
+        }
+        return fclose(pFile) == 0 ? MATRIX_OK : MATRIX_ERR_IO;
+    }
+
+    /**
+     * @brief The parameters in use by this process
+     *
+     */
+    typedef struct {
+        tGemmParams aGemm[2][(int)emShapeClass::COUNT];
+        long alTileRows[(int)emShapeClass::COUNT];
+    } tActiveTuning;
+
+    /** 0 for gemm_f32, 1 for gemm_f64, -1 for matmul or anything else */
+    static int GemmOpIndex(const char* sOp) {
+        if (strcmp(sOp, "gemm_f32") == 0) return 0;
+        if (strcmp(sOp, "gemm_f64") == 0) return 1;
+        return -1;
+    }
+
+    static void ApplyEntry(tActiveTuning& Active, const tTuningEntry& Entry) {
+        const int iOp = GemmOpIndex(Entry.sOp.c_str());
+        if (iOp >= 0) {
+            Active.aGemm[iOp][(int)Entry.emShape] = Entry.Gemm;
+        } else if (Entry.sOp == "matmul") {
+            Active.alTileRows[(int)Entry.emShape] = Entry.lTileRows;
+        }
+    }
+
+    static tActiveTuning& ActiveTuning() {
+        static tActiveTuning Active = [] {
+            tActiveTuning Res;
+            for (auto& aOp : Res.aGemm) {
+                for (auto& Params : aOp) Params = GemmDefaultParams();
+            }
+            for (auto& lTile : Res.alTileRows) lTile = 0;
+
+            /** Same lookup as autotune: $MPIMATH_TUNING_FILE, then mpimath_tuning.txt if it exists */
+            const char* sPath = getenv(TUNING_FILE_ENV);
+            const bool bExplicit = sPath != nullptr;
+            if (not bExplicit) sPath = TUNING_DEFAULT_FILE;
+            if (not bExplicit and access(sPath, R_OK) != 0) return Res;
+            std::vector<tTuningEntry> vecEntries;
+            if (LoadTuningFile(sPath, vecEntries) != MATRIX_OK) {
+                LOGW("Can not use tuning file %s, running with defaults", sPath);
+                return Res;
+            }
+            for (const auto& Entry : vecEntries) {
+                if (Entry.sCPU == CPUModel()) ApplyEntry(Res, Entry);
+            }
+            return Res;
+        }();
+        return Active;
+    }
+
+    tGemmParams GemmTuning(const char* sOp, size_t m_hgt, size_t m_wid, size_t n_wid) {
+        const int iOp = GemmOpIndex(sOp);
+        if (iOp < 0) return GemmDefaultParams();
+        return ActiveTuning().aGemm[iOp][(int)ShapeClassOf(m_hgt, m_wid, n_wid)];
+    }
+
+    long MatMulTileRows(size_t m_hgt, size_t m_wid, size_t n_wid) {
+        return ActiveTuning().alTileRows[(int)ShapeClassOf(m_hgt, m_wid, n_wid)];
+    }
+
+    void SetTuning(const tTuningEntry& Entry) {
+        ApplyEntry(ActiveTuning(), Entry);
+    }
+}
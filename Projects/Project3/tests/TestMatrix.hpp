@@ -0,0 +1,30 @@
+/**
+ * @file TestMatrix.hpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Random operands shared by the distributed product tests
+ * @version 0.1
+ * @date 2022-06-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef TESTMATRIX_HPP
+#define TESTMATRIX_HPP
+
+#include <random>
+
+#include "Matrix.hpp"
+
+namespace mpimath {
+    /** Small integers, so every product is exact in any element type */
+    template<typename T>
+    Matrix2D<T> RandomMatrix(size_t ulRow, size_t ulCol, unsigned uSeed) {
+        Matrix2D<T> Mat(ulRow, ulCol);
+        std::mt19937 Rng(uSeed);
+        std::uniform_int_distribution<int> Dist(-9, 9);
+        for (size_t idx = 0; idx < Mat.Size(); ++idx) Mat.pData()[idx] = (T)Dist(Rng);
+        return Mat;
+    }
+}
+
+#endif
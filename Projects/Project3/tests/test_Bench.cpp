@@ -0,0 +1,52 @@
+#include "Bench.hpp"
+#include "debug.h"
+#include <unistd.h>
+
+using namespace mpimath;
+
+int main(int argc, char** argv) {
+    int iErrors = 0;
+    /** mpirun may start several copies in the same directory */
+    const std::string sReport = "test_bench_report_" + std::to_string(getpid());
+
+    /** Statistics: 1..20 shuffled */
+    std::vector<double> vecSamples = { 7, 3, 20, 1, 15, 9, 12, 2, 18, 5, 11, 4, 16, 8, 19, 6, 14, 10, 17, 13 };
+    tBenchResult Res = BenchSummarize("case/a", vecSamples, 2e9, 1e9);
+    iErrors += Res.ulReps != 20 or Res.dMedian != 10.5 or Res.dP95 != 19 or Res.dMin != 1 or Res.dMean != 10.5;
+    iErrors += std::fabs(BenchGFlops(Res) - 2e9 / 10.5 / 1e9) > 1e-12;
+    std::vector<double> vecOne = { 0.25 };
+    tBenchResult ResOne = BenchSummarize("case/b", vecOne, 0, 0);
+    iErrors += ResOne.dMedian != 0.25 or ResOne.dP95 != 0.25 or BenchGFlops(ResOne) != 0;
+
+    /** Warmups are not measured, at least iReps samples */
+    int iCalls = 0;
+    tBenchConfig Config = { 3, 5, 0 };
+    Res = BenchRun("case/c", Config, 0, 0, [&] { iCalls++; });
+    iErrors += iCalls != 8 or Res.ulReps != 5;
+
+    /** A failing command is negative */
+    iErrors += BenchExec("true") < 0;
+    iErrors += BenchExec("exit 3") >= 0;
+
+    /** Both formats load back as a baseline, a slower run is flagged */
+    std::vector<tBenchResult> vecResults = { BenchSummarize("case/a", vecSamples, 1, 1), ResOne };
+    for (const char* sFormat : { "json", "csv" }) {
+        iErrors += BenchWrite(sReport, sFormat, vecResults) != MATRIX_OK;
+        std::map<std::string, double> mapBaseline;
+        iErrors += BenchLoadBaseline(sReport, mapBaseline) != MATRIX_OK;
+        iErrors += mapBaseline.size() != 2 or mapBaseline["case/a"] != 10.5 or mapBaseline["case/b"] != 0.25;
+
+        std::vector<tBenchResult> vecNow = vecResults;
+        iErrors += BenchCompare(vecNow, mapBaseline, 0.1) != 0;
+        vecNow[1].dMedian = 0.3;
+        vecNow.push_back(BenchSummarize("case/new", vecOne, 0, 0));
+        iErrors += BenchCompare(vecNow, mapBaseline, 0.1) != 1;
+        iErrors += BenchCompare(vecNow, mapBaseline, 0.25) != 0;
+    }
+    remove(sReport.c_str());
+    std::map<std::string, double> mapMissing;
+    iErrors += BenchLoadBaseline("test_bench_missing", mapMissing) != MATRIX_ERR_IO;
+
+    LOGI("Bench: %d errors", iErrors);
+    return iErrors == 0 ? 0 : 1;
+}
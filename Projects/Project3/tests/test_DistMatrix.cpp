@@ -0,0 +1,127 @@
+#include "DistMatrix.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "Matrix.hpp"
+#include "TestMatrix.hpp"
+#include "debug.h"
+#include <cmath>
+
+using namespace mpimath;
+
+/** Only meaningful on the main process, where Gather() puts the matrix */
+template<typename T>
+bool Same(const Matrix2D<T>& A, const Matrix2D<T>& B, double dTol = 0) {
+    if (A.ulRow() != B.ulRow() or A.ulCol() != B.ulCol()) return false;
+    for (size_t idx = 0; idx < A.Size(); ++idx) {
+        if (std::fabs((double)A.pData()[idx] - (double)B.pData()[idx]) > dTol) return false;
+    }
+    return true;
+}
+
+std::vector<tDistLayout> Layouts(size_t ulRow, size_t ulCol, int iSize) {
+    return {
+        DistLayoutRow(ulRow, ulCol, iSize),
+        DistLayoutCol(ulRow, ulCol, iSize),
+        DistLayoutBlockCyclic(ulRow, ulCol, iSize, 3),
+        DistLayoutBlockCyclic(ulRow, ulCol, iSize, 5, iSize),
+        DistLayoutBlockCyclic(ulRow, ulCol, iSize, 2, 1),
+    };
+}
+
+/**
+ * @brief test_DistMatrix
+ *
+ * Every process builds the same matrices, the distributed results are
+ * gathered on the main process and compared with Matrix2D.
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    const int iSize = Processor.iSize();
+    const bool bMain = Processor.iRank() == 0;
+    int iErrors = 0;
+
+    /** Scatter / Gather, every pair of layouts through Redistribute, transpose */
+    for (auto Shape : { std::make_pair(1, 1), std::make_pair(7, 5), std::make_pair(30, 17) }) {
+        Matrix2D<double> A = RandomMatrix<double>(Shape.first, Shape.second, 1);
+        Matrix2D<double> AT = A;
+        AT.Transpose();
+        for (const auto& LayoutFrom : Layouts(Shape.first, Shape.second, iSize)) {
+            DistMatrix<double> DA = DistMatrix<double>::Scatter(A, LayoutFrom);
+            if (bMain and not Same(DA.Gather(), A)) {
+                LOGE("scatter/gather %dx%d grid %dx%d", Shape.first, Shape.second, LayoutFrom.iProcRow, LayoutFrom.iProcCol);
+                iErrors++;
+            } else if (not bMain) {
+                DA.Gather();
+            }
+            Matrix2D<double> MatT = DA.Transposed().Gather();
+            iErrors += bMain and not Same(MatT, AT);
+            for (const auto& LayoutTo : Layouts(Shape.first, Shape.second, iSize)) {
+                DistMatrix<double> DB = DA.Redistribute(LayoutTo);
+                iErrors += not DistLayoutSame(DB.Layout(), LayoutTo);
+                Matrix2D<double> MatB = DB.Gather();
+                if (bMain and not Same(MatB, A)) {
+                    LOGE("redistribute %dx%d grid %dx%d -> %dx%d", Shape.first, Shape.second, LayoutFrom.iProcRow,
+                         LayoutFrom.iProcCol, LayoutTo.iProcRow, LayoutTo.iProcCol);
+                    iErrors++;
+                }
+            }
+        }
+    }
+
+    /** Products for every pair of layouts, exact in int32 */
+    {
+        const size_t ulM = 23, ulK = 19, ulN = 11;
+        Matrix2D<int32_t> A = RandomMatrix<int32_t>(ulM, ulK, 2), B = RandomMatrix<int32_t>(ulK, ulN, 3);
+        Matrix2D<int32_t> C = A * B;
+        for (const auto& LayoutA : Layouts(ulM, ulK, iSize)) {
+            for (const auto& LayoutB : Layouts(ulK, ulN, iSize)) {
+                DistMatrix<int32_t> DA = DistMatrix<int32_t>::Scatter(A, LayoutA);
+                DistMatrix<int32_t> DB = DistMatrix<int32_t>::Scatter(B, LayoutB);
+                Matrix2D<int32_t> MatC = (DA * DB).Gather();
+                if (bMain and not Same(MatC, C)) {
+                    LOGE("multiply grid %dx%d by %dx%d", LayoutA.iProcRow, LayoutA.iProcCol, LayoutB.iProcRow, LayoutB.iProcCol);
+                    iErrors++;
+                }
+            }
+        }
+    }
+
+    /** Element-wise operations across layouts */
+    {
+        Matrix2D<double> A = RandomMatrix<double>(13, 9, 4), B = RandomMatrix<double>(13, 9, 5), R(13, 9);
+        for (size_t idx = 0; idx < R.Size(); ++idx) R.pData()[idx] = 2 * (A.pData()[idx] + B.pData()[idx]) - A.pData()[idx];
+        DistMatrix<double> DA = DistMatrix<double>::Scatter(A, DistLayoutRow(13, 9, iSize));
+        DistMatrix<double> DB = DistMatrix<double>::Scatter(B, DistLayoutBlockCyclic(13, 9, iSize, 4));
+        DistMatrix<double> DR = DA + DB;
+        DR *= 2.0;
+        DR -= DA;
+        iErrors += DR.Layout().Kind != emDistKind::ROW;
+        Matrix2D<double> MatR = DR.Gather();
+        iErrors += bMain and not Same(MatR, R);
+    }
+
+    /** A = A * B four times: stays in rows, B moves once */
+    {
+        const size_t ulN = 40;
+        Matrix2D<double> A = RandomMatrix<double>(ulN, ulN, 6), B = RandomMatrix<double>(ulN, ulN, 7);
+        for (size_t idx = 0; idx < B.Size(); ++idx) B.pData()[idx] /= 16;
+        DistMatrix<double> DA = DistMatrix<double>::Scatter(A, DistLayoutRow(ulN, ulN, iSize));
+        DistMatrix<double> DB = DistMatrix<double>::Scatter(B, DistLayoutRow(ulN, ulN, iSize));
+        DB = DB.Redistribute(DistOperandLayout(DA.Layout(), DB.Layout()));
+        for (int iStep = 0; iStep < 4; ++iStep) {
+            A = A * B;
+            DA = DA * DB;
+            iErrors += DA.Layout().Kind != emDistKind::ROW;
+        }
+        Matrix2D<double> MatA = DA.Gather();
+        iErrors += bMain and not Same(MatA, A, 1e-9);
+    }
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("DistMatrix: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
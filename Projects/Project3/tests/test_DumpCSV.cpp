@@ -0,0 +1,121 @@
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "csv.hpp"
+#include "debug.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+using namespace mpimath;
+
+/**
+ * @brief The previous writer: ofstream << with default precision
+ *
+ */
+void DumpCSVOfstream(const std::string& sPath, const Matrix2D<double>& Mat) {
+    std::ofstream OutFile(sPath);
+    for (size_t row = 0; row < Mat.ulRow(); ++row) {
+        OutFile << Mat.pData()[row * Mat.ulCol()];
+        for (size_t col = 1; col < Mat.ulCol(); ++col) {
+            OutFile << "," << Mat.pData()[row * Mat.ulCol() + col];
+        }
+        OutFile << "\n";
+    }
+}
+
+std::string ReadFile(const char* sPath) {
+    std::ifstream InFile(sPath);
+    std::stringstream ssContent;
+    ssContent << InFile.rdbuf();
+    return ssContent.str();
+}
+
+int CheckSemantics() {
+    int iErrors = 0;
+    const char* sPath = "test_DumpCSV.csv";
+
+    /** Shortest strings, one line per row, no trailing ',' */
+    Matrix2D<double> Mat(2, 3);
+    double adValues[] = {0.1, -2, 1e22, 5e-324, 1.0 / 3, 0};
+    memcpy(Mat.pData(), adValues, sizeof(adValues));
+    iErrors += Mat.DumpCSV(sPath) != MATRIX_OK;
+    std::string sContent = ReadFile(sPath);
+#if CSV_HAS_TO_CHARS
+    if (sContent != "0.1,-2,1e+22\n5e-324,0.3333333333333333,0\n") {
+        LOGE("unexpected output:\n%s", sContent.c_str());
+        iErrors++;
+    }
+#endif
+
+    /** Narrow types print as numbers */
+    Matrix2D<int8_t> MatInt(1, 3);
+    MatInt.pData()[0] = -7, MatInt.pData()[1] = 0, MatInt.pData()[2] = 127;
+    iErrors += MatInt.DumpCSV(sPath) != MATRIX_OK or ReadFile(sPath) != "-7,0,127\n";
+    Matrix2D<float> MatFloat(1, 2);
+    MatFloat.pData()[0] = 0.1f, MatFloat.pData()[1] = 16777216.0f;
+#if CSV_HAS_TO_CHARS
+    iErrors += MatFloat.DumpCSV(sPath) != MATRIX_OK or ReadFile(sPath) != "0.1,16777216\n";
+#endif
+
+    /** Empty matrix and unwritable path */
+    Matrix2D<double> MatEmpty;
+    iErrors += MatEmpty.DumpCSV(sPath) != MATRIX_ERR_NULL;
+    iErrors += Mat.DumpCSV("/nonexistent/dir/x.csv") != MATRIX_ERR_IO;
+    remove(sPath);
+    return iErrors;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckSemantics();
+        LOGI("CSV writer: %d errors", iErrors);
+
+        /** Exact round trip of random bit patterns and of normal samples, more rows than one chunk */
+        const size_t ulRow = 3000, ulCol = 500;
+        const char* sPath = "test_DumpCSV_big.csv";
+        Matrix2D<double> MatRef(ulRow, ulCol);
+        std::mt19937_64 Rng(7);
+        std::normal_distribution<double> Dist;
+        for (size_t idx = 0; idx < MatRef.Size(); ++idx) {
+            double dValue = Dist(Rng);
+            if (idx % 2 == 0) {
+                uint64_t ulBits = Rng();
+                memcpy(&dValue, &ulBits, sizeof(dValue));
+                if (not std::isfinite(dValue)) dValue = 0;
+            }
+            MatRef.pData()[idx] = dValue;
+        }
+
+        MPITimer Timer;
+        iErrors += MatRef.DumpCSV(sPath) != MATRIX_OK;
+        double dFast = Timer.TimeDelta();
+        FILE* pFile = fopen(sPath, "r");
+        fseek(pFile, 0, SEEK_END);
+        double dBytes = (double)ftell(pFile);
+        fclose(pFile);
+
+        Matrix2D<double> Mat;
+        iErrors += Mat.ReadCSV(sPath) != MATRIX_OK;
+        if (Mat.ulRow() != ulRow or Mat.ulCol() != ulCol or memcmp(Mat.pData(), MatRef.pData(), MatRef.ulDataSize()) != 0) {
+            LOGE("DumpCSV -> ReadCSV is not exact");
+            iErrors++;
+        }
+
+        Timer.Reset();
+        DumpCSVOfstream(sPath, MatRef);
+        double dSlow = Timer.TimeDelta();
+        LOGI("%.1f MB: DumpCSV %.1f MB/s, ofstream << %.1f MB/s", dBytes / 1e6, dBytes / 1e6 / dFast, dBytes / 1e6 / dSlow);
+        remove(sPath);
+        LOGI("DumpCSV: %d errors", iErrors);
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include "Factorize.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+using namespace mpimath;
+
+void FillRandom(Matrix2D<double>& Mat, unsigned uSeed) {
+    std::mt19937 Rng(uSeed);
+    std::normal_distribution<double> Dist;
+    for (size_t idx = 0; idx < Mat.Size(); ++idx) Mat.pData()[idx] = Dist(Rng);
+}
+
+/** Symmetric positive definite: M M^T + n I */
+Matrix2D<double> RandomSPD(size_t ulN, unsigned uSeed) {
+    Matrix2D<double> M(ulN, ulN), MT(ulN, ulN);
+    FillRandom(M, uSeed);
+    for (size_t i = 0; i < ulN; ++i) {
+        for (size_t j = 0; j < ulN; ++j) MT.pData()[j * ulN + i] = M.pData()[i * ulN + j];
+    }
+    Matrix2D<double> A = M * MT;
+    for (size_t i = 0; i < ulN; ++i) A.pData()[i * ulN + i] += (double)ulN;
+    return A;
+}
+
+/** ||A X - B||_max / (||A||_max ||X||_max n) */
+double Residual(Matrix2D<double>& A, Matrix2D<double>& X, const Matrix2D<double>& B) {
+    if (not X.IsValid() or X.ulRow() != B.ulRow() or X.ulCol() != B.ulCol()) return INFINITY;
+    Matrix2D<double> AX = A * X;
+    double dRes = 0, dA = 0, dX = 0;
+    for (size_t idx = 0; idx < B.Size(); ++idx) dRes = std::max(dRes, std::fabs(AX.pData()[idx] - B.pData()[idx]));
+    for (size_t idx = 0; idx < A.Size(); ++idx) dA = std::max(dA, std::fabs(A.pData()[idx]));
+    for (size_t idx = 0; idx < X.Size(); ++idx) dX = std::max(dX, std::fabs(X.pData()[idx]));
+    return dRes / (dA * dX * (double)A.ulRow());
+}
+
+/**
+ * @brief Local factorizations on odd sizes and block widths, error paths
+ *
+ */
+int CheckLocal() {
+    int iErrors = 0;
+    for (size_t ulN : { 1, 7, 64, 100, 257 }) {
+        for (size_t ulBlock : { 1, 16, 64 }) {
+            Matrix2D<double> A(ulN, ulN), B(ulN, 3), X;
+            FillRandom(A, (unsigned)ulN);
+            FillRandom(B, (unsigned)ulN + 1);
+            iErrors += Solve(A, B, X, false, ulBlock) != MATRIX_OK;
+            double dLU = Residual(A, X, B);
+            Matrix2D<double> S = RandomSPD(ulN, (unsigned)ulN + 2);
+            iErrors += Solve(S, B, X, true, ulBlock) != MATRIX_OK;
+            double dChol = Residual(S, X, B);
+            if (dLU > 1e-12 or dChol > 1e-12) {
+                LOGE("n=%zu block=%zu residual LU %g Cholesky %g", ulN, ulBlock, dLU, dChol);
+                iErrors++;
+            }
+        }
+    }
+
+    /** L L^T reproduces A, upper triangle zeroed */
+    Matrix2D<double> S = RandomSPD(50, 3), L = S;
+    iErrors += CholeskyFactor(L, 16) != MATRIX_OK;
+    Matrix2D<double> LT(50, 50);
+    for (size_t i = 0; i < 50; ++i) {
+        for (size_t j = 0; j < 50; ++j) LT.pData()[j * 50 + i] = L.pData()[i * 50 + j];
+    }
+    Matrix2D<double> LLT = L * LT;
+    for (size_t idx = 0; idx < S.Size(); ++idx) {
+        if (std::fabs(LLT.pData()[idx] - S.pData()[idx]) > 1e-10 * 50) {
+            iErrors++;
+            break;
+        }
+    }
+    iErrors += L.pData()[1] != 0;
+
+    /** Singular, indefinite and mismatched inputs */
+    Matrix2D<double> Z(10, 10, true), B(10, 2, true), X, R(10, 9);
+    iErrors += Solve(Z, B, X) != MATRIX_ERR_DATA;
+    Matrix2D<double> I(10, 10, true);
+    for (size_t i = 0; i < 10; ++i) I.pData()[i * 10 + i] = i == 5 ? -1.0 : 1.0;
+    iErrors += Solve(I, B, X, true) != MATRIX_ERR_DATA;
+    iErrors += Solve(I, B, X, false) != MATRIX_OK;
+    iErrors += Solve(R, B, X) != MATRIX_ERR_SHAPE;
+    return iErrors;
+}
+
+/**
+ * @brief test_Factorize
+ *
+ * ./test_Factorize [N] benchmarks the distributed solve on an N x N system
+ * (default 1024) after the correctness checks.
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+    const size_t ulBench = argc >= 2 ? (size_t)atol(argv[1]) : 1024;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckLocal();
+    }
+
+    /** Distributed: several sizes so that some processes own no column block */
+    for (size_t ulN : { 5, 130, 301 }) {
+        for (bool bSPD : { false, true }) {
+            Matrix2D<double> A, B, X;
+            ON_MAIN_PROC(Processor) {
+                if (bSPD) {
+                    A = RandomSPD(ulN, 11);
+                } else {
+                    A.Init(ulN, ulN);
+                    FillRandom(A, 12);
+                }
+                B.Init(ulN, 4);
+                FillRandom(B, 13);
+                iErrors += MPISolveMain(A, B, X, Processor, bSPD, 32) != MATRIX_OK;
+                double dRes = Residual(A, X, B);
+                if (dRes > 1e-12) {
+                    LOGE("distributed n=%zu SPD=%d residual %g", ulN, bSPD, dRes);
+                    iErrors++;
+                }
+            } else {
+                iErrors += MPISolveWorker(Processor) != MATRIX_OK;
+            }
+        }
+    }
+
+    /** A singular system fails on every process */
+    ON_MAIN_PROC(Processor) {
+        Matrix2D<double> Z(40, 40, true), B(40, 1, true), X;
+        iErrors += MPISolveMain(Z, B, X, Processor, false, 8) != MATRIX_ERR_DATA;
+    } else {
+        iErrors += MPISolveWorker(Processor) != MATRIX_ERR_DATA;
+    }
+
+    /** GFLOP/s of the local and distributed factorizations */
+    for (bool bSPD : { false, true }) {
+        const double dFlops = (bSPD ? 1.0 : 2.0) / 3.0 * (double)ulBench * ulBench * ulBench;
+        Matrix2D<double> A, B, X;
+        double dLocal = 0;
+        ON_MAIN_PROC(Processor) {
+            if (bSPD) {
+                A = RandomSPD(ulBench, 21);
+            } else {
+                A.Init(ulBench, ulBench);
+                FillRandom(A, 22);
+            }
+            B.Init(ulBench, 1);
+            FillRandom(B, 23);
+            MPITimer Timer;
+            Matrix2D<double> F = A;
+            std::vector<int> vecPiv;
+            iErrors += (bSPD ? CholeskyFactor(F) : LUFactor(F, vecPiv)) != MATRIX_OK;
+            dLocal = Timer.TimeDelta();
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPITimer Timer;
+        ON_MAIN_PROC(Processor) {
+            iErrors += MPISolveMain(A, B, X, Processor, bSPD) != MATRIX_OK;
+            double dDist = Timer.TimeDelta();
+            LOGI("%s %zu: local %.2f GFLOP/s, %d processes %.2f GFLOP/s (with distribution and solve), residual %g",
+                 bSPD ? "Cholesky" : "LU", ulBench, dFlops / dLocal / 1e9, Processor.iSize(), dFlops / dDist / 1e9,
+                 Residual(A, X, B));
+        } else {
+            iErrors += MPISolveWorker(Processor) != MATRIX_OK;
+        }
+    }
+
+    ON_MAIN_PROC(Processor) {
+        LOGI("Factorize: %d errors", iErrors);
+    }
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
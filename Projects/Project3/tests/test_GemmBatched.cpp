@@ -0,0 +1,101 @@
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+#include <cmath>
+#include <random>
+
+using namespace mpimath;
+
+/**
+ * @brief Check gemm_batched against one Matrix2D product per element
+ *
+ * @return int Number of mismatching products
+ */
+template<typename T>
+int CheckBatched(size_t ulBatch, size_t ulM, size_t ulK, size_t ulN, bool bShareN) {
+    std::mt19937 Rng(7);
+    std::uniform_real_distribution<double> Dist(-1, 1);
+    Matrix2D<T> MatM(ulBatch, ulM * ulK), MatN(bShareN ? 1 : ulBatch, ulK * ulN), MatRes(ulBatch, ulM * ulN);
+    for (size_t idx = 0; idx < MatM.Size(); ++idx) MatM.pData()[idx] = (T)Dist(Rng);
+    for (size_t idx = 0; idx < MatN.Size(); ++idx) MatN.pData()[idx] = (T)Dist(Rng);
+
+    gemm_batched(MatRes.pData(), MatM.pData(), MatN.pData(), ulBatch, ulM, ulK, ulN,
+                 ulM * ulK, bShareN ? 0 : ulK * ulN, ulM * ulN);
+
+    int iErrors = 0;
+    for (size_t b = 0; b < ulBatch; ++b) {
+        Matrix2D<T> A(ulM, ulK), B(ulK, ulN);
+        memcpy(A.pData(), MatM.pData() + b * ulM * ulK, A.ulDataSize());
+        memcpy(B.pData(), MatN.pData() + (bShareN ? 0 : b) * ulK * ulN, B.ulDataSize());
+        /** Naive reference, and operator* which goes through gemm_f32/gemm_f64 */
+        Matrix2D<T> C(ulM, ulN);
+        gemm<T, T>(C.pData(), A.pData(), B.pData(), ulM, ulK, ulK, ulN);
+        auto D = A * B;
+        for (size_t idx = 0; idx < C.Size(); ++idx) {
+            if (std::fabs(C.pData()[idx] - MatRes.pData()[b * ulM * ulN + idx]) > 1e-4 or
+                std::fabs(C.pData()[idx] - D.pData()[idx]) > 1e-4) {
+                if (iErrors < 4) LOGE("%zux%zux%zu batch %zu differs at %zu", ulM, ulK, ulN, b, idx);
+                ++iErrors;
+                break;
+            }
+        }
+    }
+    return iErrors;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        const size_t aShapes[][3] = { {4, 4, 4}, {8, 8, 8}, {16, 16, 16}, {64, 64, 64}, {8, 16, 8}, {5, 7, 3}, {20, 1, 20}, {13, 19, 11}, {9, 33, 17} };
+        for (auto& Shape : aShapes) {
+            iErrors += CheckBatched<double>(257, Shape[0], Shape[1], Shape[2], false);
+            iErrors += CheckBatched<float>(257, Shape[0], Shape[1], Shape[2], false);
+            iErrors += CheckBatched<double>(33, Shape[0], Shape[1], Shape[2], true);
+        }
+        LOGI("gemm_batched: %d errors", iErrors);
+
+        /** Batched call vs one operator* per product */
+        const size_t ulBatch = 100000, ulDim = 4;
+        Matrix2D<double> MatM(ulBatch, ulDim * ulDim, true), MatN(ulBatch, ulDim * ulDim, true), MatRes(ulBatch, ulDim * ulDim);
+        MatM.fill(0.5);
+        MatN.fill(2.0);
+        MPITimer Timer;
+        gemm_batched(MatRes.pData(), MatM.pData(), MatN.pData(), ulBatch, ulDim, ulDim, ulDim);
+        double dBatched = Timer.TimeDelta();
+        Timer.Reset();
+        for (size_t b = 0; b < ulBatch; ++b) {
+            Matrix2D<double> A(ulDim, ulDim), B(ulDim, ulDim);
+            memcpy(A.pData(), MatM.pData() + b * ulDim * ulDim, A.ulDataSize());
+            memcpy(B.pData(), MatN.pData() + b * ulDim * ulDim, B.ulDataSize());
+            auto C = A * B;
+            memcpy(MatRes.pData() + b * ulDim * ulDim, C.pData(), C.ulDataSize());
+        }
+        LOGI("%zu x %zux%zu products: gemm_batched %fs, operator* %fs", ulBatch, ulDim, ulDim, dBatched, Timer.TimeDelta());
+    }
+
+    /** Batch spread over the ranks */
+    {
+        const size_t ulBatch = 1001, ulDim = 8;
+        Matrix2D<double> MatM(ulBatch, ulDim * ulDim), MatN(1, ulDim * ulDim);
+        ON_MAIN_PROC(Processor) {
+            for (size_t idx = 0; idx < MatM.Size(); ++idx) MatM.pData()[idx] = (double)(idx % 17) - 8;
+            for (size_t idx = 0; idx < MatN.Size(); ++idx) MatN.pData()[idx] = (double)(idx % 5) - 2;
+            auto MatRes = MPIGemmBatchedMain(MatM, MatN, ulDim, ulDim, ulDim, Processor);
+            Matrix2D<double> MatRef(ulBatch, ulDim * ulDim);
+            gemm_batched(MatRef.pData(), MatM.pData(), MatN.pData(), ulBatch, ulDim, ulDim, ulDim, ulDim * ulDim, 0);
+            int iMPIErrors = memcmp(MatRes.pData(), MatRef.pData(), MatRef.ulDataSize()) != 0;
+            LOGI("MPIGemmBatched on %d procs: %d errors", Processor.iSize(), iMPIErrors);
+            iErrors += iMPIErrors;
+        } else {
+            MPIGemmBatchedWorker<double>(Processor);
+        }
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
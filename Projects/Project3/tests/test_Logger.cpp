@@ -0,0 +1,167 @@
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "debug.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Lines written to pFile so far */
+std::vector<std::string> ReadLines(FILE* pFile) {
+    LogFlush();
+    std::vector<std::string> vecLines;
+    char acLine[1024];
+    rewind(pFile);
+    while (fgets(acLine, sizeof(acLine), pFile) != nullptr) vecLines.emplace_back(acLine);
+    return vecLines;
+}
+
+size_t CountWith(const std::vector<std::string>& vecLines, const std::string& sText) {
+    size_t ulCount = 0;
+    for (const auto& sLine : vecLines) ulCount += sLine.find(sText) != std::string::npos;
+    return ulCount;
+}
+
+/**
+ * @brief Lines of several threads all arrive, each thread's in order, and
+ * the level is honoured at run time
+ *
+ */
+int CheckLocal() {
+    int iErrors = 0;
+    FILE* pFile = tmpfile();
+    LogSetOutput(pFile);
+    LogSetLevel(LEVEL_INFO);
+
+    /** Many more lines than a ring holds */
+    const int iThreads = 4, iLines = 1000;
+    std::vector<std::thread> vecThreads;
+    for (int iThread = 0; iThread < iThreads; ++iThread) {
+        vecThreads.emplace_back([=] {
+            for (int iLine = 0; iLine < iLines; ++iLine) {
+                LOGI("thread %d line %d", iThread, iLine);
+                LOGD("hidden %d", iLine);
+            }
+        });
+    }
+    for (auto& Thread : vecThreads) Thread.join();
+    std::vector<std::string> vecLines = ReadLines(pFile);
+    iErrors += vecLines.size() != (size_t)(iThreads * iLines);
+    std::vector<int> vecNext(iThreads, 0);
+    for (const auto& sLine : vecLines) {
+        int iThread = -1, iLine = -1;
+        const size_t ulPos = sLine.find("thread ");
+        if (ulPos == std::string::npos or sscanf(sLine.c_str() + ulPos, "thread %d line %d", &iThread, &iLine) != 2 or
+            iThread < 0 or iThread >= iThreads or iLine != vecNext[iThread]++) {
+            if (iErrors++ < 4) LOGE_S("out of order: %s", sLine.c_str());
+        }
+    }
+
+    /** Rings of exited threads are reused */
+    size_t ulRings = 0;
+    for (tLogRing* pRing = LogRings().load(); pRing != nullptr; pRing = pRing->pNext) ulRings++;
+    std::thread([] { LOGI("reuse"); }).join();
+    size_t ulAfter = 0;
+    for (tLogRing* pRing = LogRings().load(); pRing != nullptr; pRing = pRing->pNext) ulAfter++;
+    iErrors += ulAfter != ulRings;
+
+    /** Lower and raise the level while running, LOGD may be compiled out */
+    LogSetLevel(LEVEL_WARNING);
+    LOGI("now hidden");
+    LOGW("warning kept");
+    LogSetLevel(LEVEL_INFO);
+    LOGI("now visible");
+    /** A long line is cut */
+    LOGI("%s", std::string(4 * CONFIG_LOG_RECORD_BYTES, 'x').c_str());
+    vecLines = ReadLines(pFile);
+    iErrors += CountWith(vecLines, "now visible") != 1 or CountWith(vecLines, "now hidden") != 0 or CountWith(vecLines, "warning kept") != 1;
+    iErrors += CountWith(vecLines, "hidden ") != 0 or CountWith(vecLines, "reuse") != 1;
+    iErrors += vecLines.back().size() != CONFIG_LOG_RECORD_BYTES - 1 or vecLines.back().compare(vecLines.back().size() - 4, 4, "...\n") != 0;
+
+    LogSetOutput(nullptr);
+    fclose(pFile);
+    return iErrors;
+}
+
+/**
+ * @brief With forwarding on, rank 0 prints the lines of every rank
+ *
+ */
+int CheckForward(const MPIProcessorInfo& Processor) {
+    int iErrors = 0;
+    FILE* pFile = tmpfile();
+    LogSetOutput(pFile);
+    LogSetForward(true);
+    for (int iLine = 0; iLine < 3; ++iLine) LOGI("forwarded %d from %d", iLine, Processor.iRank());
+    LogFinalize();
+    /** Forwarding is over, this one stays here */
+    LOGI("local from %d", Processor.iRank());
+    std::vector<std::string> vecLines = ReadLines(pFile);
+    ON_MAIN_PROC(Processor) {
+        iErrors += CountWith(vecLines, "forwarded ") != (size_t)(3 * Processor.iSize());
+        for (int iRank = 1; iRank < Processor.iSize(); ++iRank) {
+            const std::string sPrefix = "[" + std::to_string(iRank) + "] ";
+            iErrors += CountWith(vecLines, "from " + std::to_string(iRank) + "\n") != 3;
+            for (const auto& sLine : vecLines) {
+                if (sLine.find("from " + std::to_string(iRank) + "\n") != std::string::npos) iErrors += sLine.compare(0, sPrefix.size(), sPrefix) != 0;
+            }
+        }
+    } else {
+        iErrors += CountWith(vecLines, "forwarded ") != 0;
+    }
+    iErrors += CountWith(vecLines, "local from " + std::to_string(Processor.iRank())) != 1;
+    LogSetOutput(nullptr);
+    fclose(pFile);
+    return iErrors;
+}
+
+/**
+ * @brief test_Logger
+ *
+ * ./test_Logger [multiple] checks the ordering, level and forwarding of
+ * log lines, then times a LOGI below the level and one written by the
+ * background thread and at the call site. With "multiple" MPI is started
+ * with MPI_THREAD_MULTIPLE and forwarding runs in the background thread.
+ */
+int main(int argc, char** argv) {
+    if (argc >= 2 and std::string(argv[1]) == "multiple") {
+        int iProvided = MPI_THREAD_SINGLE;
+        MPI_Init_thread(NULL, NULL, MPI_THREAD_MULTIPLE, &iProvided);
+    } else {
+        MPI_Init(NULL, NULL);
+    }
+    MPIProcessorInfo Processor;
+    int iErrors = CheckLocal();
+    iErrors += CheckForward(Processor);
+
+    /** Cost per call, into an unbuffered file like stderr */
+    const int iCalls = 100000;
+    FILE* pNull = fopen("/dev/null", "w");
+    setvbuf(pNull, nullptr, _IONBF, 0);
+    LogSetOutput(pNull);
+    LogSetLevel(LEVEL_WARNING);
+    MPITimer Timer;
+    for (int iCall = 0; iCall < iCalls; ++iCall) LOGI("disabled %d", iCall);
+    const double dDisabled = Timer.TimeDelta();
+    LogSetLevel(LEVEL_INFO);
+    MPITimer AsyncTimer;
+    for (int iCall = 0; iCall < iCalls; ++iCall) LOGI("enabled %d %f", iCall, iCall * 0.5);
+    const double dAsync = AsyncTimer.TimeDelta();
+    LogFlush();
+    LogSetSync(true);
+    MPITimer SyncTimer;
+    for (int iCall = 0; iCall < iCalls; ++iCall) LOGI("enabled %d %f", iCall, iCall * 0.5);
+    const double dSync = SyncTimer.TimeDelta();
+    LogSetSync(false);
+    LogSetOutput(nullptr);
+    fclose(pNull);
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("per call: LOGI below the level %.1f ns, LOGI %.1f ns in the background, %.1f ns at the call site", dDisabled / iCalls * 1e9,
+             dAsync / iCalls * 1e9, dSync / iCalls * 1e9);
+        LOGI("Logger: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
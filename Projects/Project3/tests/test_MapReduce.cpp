@@ -0,0 +1,181 @@
+#include "MPIProcessorInfo.hpp"
+#include "MapReduce.hpp"
+#include "debug.h"
+#include <cmath>
+#include <map>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+using namespace mpimath;
+
+/** Words "w0" ... separated by spaces and tabs, lines of random length, no newline at the end */
+std::string MakeText(unsigned uSeed, size_t ulWords, int iVocabulary) {
+    std::mt19937 Rng(uSeed);
+    std::string sText;
+    for (size_t idx = 0; idx < ulWords; ++idx) {
+        /** A skewed vocabulary, some words are far more common */
+        const int iWord = (int)(std::pow(std::uniform_real_distribution<double>(0, 1)(Rng), 3) * iVocabulary);
+        sText += "w" + std::to_string(iWord);
+        const unsigned uSep = Rng() % 8;
+        sText += uSep == 0 ? "\n" : uSep == 1 ? "\t" : " ";
+    }
+    sText.pop_back();
+    return sText;
+}
+
+std::map<std::string, int64_t> CountSerial(const std::vector<std::string>& vecTexts) {
+    std::map<std::string, int64_t> mapCounts;
+    for (const auto& sText : vecTexts) {
+        std::istringstream Stream(sText);
+        std::string sWord;
+        while (Stream >> sWord) mapCounts[sWord]++;
+    }
+    return mapCounts;
+}
+
+template<typename FEmit>
+void SplitWords(const char* pLine, size_t ulLength, FEmit& Emit) {
+    size_t ulBegin = 0;
+    for (size_t idx = 0; idx <= ulLength; ++idx) {
+        if (idx == ulLength or pLine[idx] == ' ' or pLine[idx] == '\t' or pLine[idx] == '\r') {
+            if (idx > ulBegin) Emit(std::string(pLine + ulBegin, idx - ulBegin), (int64_t)1);
+            ulBegin = idx + 1;
+        }
+    }
+}
+
+/**
+ * @brief WordCount against a serial count, with and without a combiner,
+ * with memory limits that force both spills and many shuffle rounds
+ *
+ */
+int CheckWordCount(const MPIProcessorInfo& Processor) {
+    int iErrors = 0;
+    const std::vector<std::string> vecTexts = { MakeText(1, 40000, 3000), MakeText(2, 25000, 500), "", "single" };
+    std::vector<std::string> vecPaths;
+    for (size_t idx = 0; idx < vecTexts.size(); ++idx) {
+        vecPaths.push_back("test_MapReduce_" + std::to_string(idx) + ".txt");
+        ON_MAIN_PROC(Processor) {
+            FILE* pFile = fopen(vecPaths.back().c_str(), "w");
+            fwrite(vecTexts[idx].data(), 1, vecTexts[idx].size(), pFile);
+            fclose(pFile);
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    const std::map<std::string, int64_t> mapExpected = CountSerial(vecTexts);
+
+    tMapReduceConfig Small = MapReduceConfigFromEnv();
+    Small.ulMemBytes = 16 << 10;
+    Small.ulRoundBytes = 4 << 10;
+    Small.iSpillBuckets = 5;
+    for (bool bCombine : { true, false }) {
+        for (size_t ulSplit : { (size_t)1 << 20, (size_t)4099 }) {
+            for (const tMapReduceConfig& Config : { MapReduceConfigFromEnv(), Small }) {
+                MapReduce<std::string, int64_t> Job(Processor, Config);
+                if (bCombine) Job.Combiner([](int64_t& lAcc, const int64_t& lValue) { lAcc += lValue; });
+                Job.MapLines(InputSplits(vecPaths, ulSplit), [](const char* pLine, size_t ulLength, auto& Emit) { SplitWords(pLine, ulLength, Emit); });
+                auto vecLocal = Job.Reduce([&](const std::string& sKey, const std::vector<int64_t>& vecValues) {
+                    /** With a combiner the reducer sees one value per key */
+                    iErrors += bCombine and (int)vecValues.size() != 1;
+                    int64_t lSum = 0;
+                    for (int64_t lValue : vecValues) lSum += lValue;
+                    return lSum;
+                });
+                const tMapReduceStats Total = Job.TotalStats();
+                auto vecAll = Job.Gather(vecLocal);
+                ON_MAIN_PROC(Processor) {
+                    bool bSame = vecAll.size() == mapExpected.size();
+                    auto It = mapExpected.begin();
+                    for (size_t idx = 0; bSame and idx < vecAll.size(); ++idx, ++It) bSame = vecAll[idx].first == It->first and vecAll[idx].second == It->second;
+                    const bool bSmall = Config.ulMemBytes == Small.ulMemBytes;
+                    if (not bSame or (bSmall and Total.ulSpillBytes == 0) or (bSmall and Job.Stats().iRounds < 2) or Total.ulKeys != mapExpected.size()) {
+                        LOGE("combine %d split %zu memory %zu: %zu keys (%zu expected), %llu spilled, %d rounds", bCombine, ulSplit, Config.ulMemBytes,
+                             vecAll.size(), mapExpected.size(), (unsigned long long)Total.ulSpillBytes, Job.Stats().iRounds);
+                        iErrors++;
+                    }
+                }
+            }
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        for (const auto& sPath : vecPaths) remove(sPath.c_str());
+    }
+    return iErrors;
+}
+
+/**
+ * @brief PI as in GetPI: chunks of the integral map to one key
+ *
+ */
+int CheckPI(const MPIProcessorInfo& Processor) {
+    const int64_t lN = 1000000;
+    MapReduce<int, double> Job(Processor);
+    Job.Combiner([](double& dAcc, const double& dValue) { dAcc += dValue; });
+    Job.MapRange(lN, 4096, [&](int64_t lBegin, int64_t lEnd, auto& Emit) {
+        double dSum = 0;
+        for (int64_t i = lBegin; i < lEnd; ++i) {
+            const double dX = (i + 0.5) / lN;
+            dSum += 4.0 / (1.0 + dX * dX);
+        }
+        Emit(0, dSum / lN);
+    });
+    auto vecAll = Job.Gather(Job.Reduce([](const int&, const std::vector<double>& vecValues) { return vecValues.front(); }));
+    ON_MAIN_PROC(Processor) {
+        if (vecAll.size() != 1 or std::fabs(vecAll[0].second - M_PI) > 1e-9) {
+            LOGE("PI = %.15f", vecAll.empty() ? 0.0 : vecAll[0].second);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Keys of other types and grouped values without a combiner
+ *
+ */
+int CheckGroups(const MPIProcessorInfo& Processor) {
+    int iErrors = 0;
+    MapReduce<int64_t, std::pair<std::string, int>> Job(Processor);
+    Job.MapRange(1000, 7, [](int64_t lBegin, int64_t lEnd, auto& Emit) {
+        for (int64_t i = lBegin; i < lEnd; ++i) Emit(i % 10, std::make_pair(std::to_string(i), (int)i));
+    });
+    auto vecLocal = Job.Reduce([&](const int64_t& lKey, const std::vector<std::pair<std::string, int>>& vecValues) {
+        int64_t lSum = 0;
+        for (const auto& Value : vecValues) {
+            iErrors += Value.first != std::to_string(Value.second) or Value.second % 10 != lKey;
+            lSum += Value.second;
+        }
+        iErrors += vecValues.size() != 100;
+        return lSum;
+    });
+    auto vecAll = Job.Gather(vecLocal);
+    ON_MAIN_PROC(Processor) {
+        iErrors += vecAll.size() != 10;
+        for (const auto& Item : vecAll) iErrors += Item.second != 49500 + 100 * Item.first;
+    }
+    return iErrors;
+}
+
+/**
+ * @brief test_MapReduce
+ *
+ * WordCount over local files against a serial count, PI through MapRange,
+ * and grouped values of a pair type.
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = CheckWordCount(Processor);
+    iErrors += CheckPI(Processor);
+    iErrors += CheckGroups(Processor);
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("MapReduce: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+#include "MatCodec.hpp"
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+#include <cmath>
+#include <random>
+
+using namespace mpimath;
+
+int CheckLZ() {
+    int iErrors = 0;
+    std::mt19937 Rng(5);
+    auto RoundTrip = [&](const std::vector<uint8_t>& vecIn) {
+        std::vector<uint8_t> vecPacked(LZCompressBound(vecIn.size())), vecOut(vecIn.size());
+        size_t ulPacked = LZCompress(vecIn.data(), vecIn.size(), vecPacked.data());
+        size_t ulOut = LZDecompress(vecPacked.data(), ulPacked, vecOut.data(), vecOut.size());
+        if (ulPacked > vecPacked.size() or ulOut != vecIn.size() or vecOut != vecIn) {
+            LOGE("LZ round trip failed for %zu bytes", vecIn.size());
+            iErrors++;
+        }
+        /** A truncated stream never writes past the buffer */
+        if (ulPacked > 1) {
+            LZDecompress(vecPacked.data(), ulPacked - 1, vecOut.data(), vecOut.size());
+        }
+        return ulPacked;
+    };
+
+    for (size_t ulSize = 0; ulSize < 64; ++ulSize) {
+        std::vector<uint8_t> vecIn(ulSize);
+        for (auto& b : vecIn) b = (uint8_t)(Rng() % 3);
+        RoundTrip(vecIn);
+    }
+    std::vector<uint8_t> vecRandom(100000), vecZeros(100000, 0), vecText;
+    for (auto& b : vecRandom) b = (uint8_t)Rng();
+    for (int iter = 0; iter < 5000; ++iter) {
+        std::string s = "row " + std::to_string(iter % 97) + ", col " + std::to_string(iter % 13) + ";";
+        vecText.insert(vecText.end(), s.begin(), s.end());
+    }
+    iErrors += RoundTrip(vecRandom) > LZCompressBound(vecRandom.size());
+    iErrors += RoundTrip(vecZeros) > 1000;
+    iErrors += RoundTrip(vecText) > vecText.size() / 2;
+
+    /** Garbage must be rejected or stay in bounds */
+    std::vector<uint8_t> vecOut(256);
+    for (int iter = 0; iter < 1000; ++iter) {
+        std::vector<uint8_t> vecGarbage(1 + Rng() % 64);
+        for (auto& b : vecGarbage) b = (uint8_t)Rng();
+        size_t ulOut = LZDecompress(vecGarbage.data(), vecGarbage.size(), vecOut.data(), vecOut.size());
+        iErrors += ulOut != (size_t)-1 and ulOut > vecOut.size();
+    }
+    return iErrors;
+}
+
+int CheckChunks() {
+    int iErrors = 0;
+    std::vector<double> vecIn(1000), vecOut(1000);
+    std::mt19937 Rng(6);
+    std::normal_distribution<double> Dist;
+    for (auto& d : vecIn) d = Dist(Rng);
+    std::vector<uint8_t> vecChunk;
+    auto Check = [&](double dBound, emCodecMode emMode, uint32_t uExpected) {
+        tCodecConfig Cfg = { emMode, dBound, CODEC_DEFAULT_CHUNK_BYTES };
+        CodecEncodeChunk(vecIn.data(), vecIn.size(), 0, Cfg, vecChunk);
+        tCodecChunkHeader Header;
+        memcpy(&Header, vecChunk.data(), sizeof(Header));
+        std::fill(vecOut.begin(), vecOut.end(), 0.0);
+        iErrors += CodecDecodeChunk(vecChunk.data(), vecChunk.size(), vecOut.data(), vecOut.size()) != (long)vecIn.size();
+        if (Header.uFormat != uExpected) {
+            LOGE("chunk format %#x, expected %#x", Header.uFormat, uExpected);
+            iErrors++;
+        }
+        for (size_t idx = 0; idx < vecIn.size(); ++idx) {
+            if (not (std::fabs(vecOut[idx] - vecIn[idx]) <= dBound * std::fabs(vecIn[idx]))) {
+                iErrors++;
+                break;
+            }
+        }
+    };
+    const uint32_t uRaw = (uint32_t)emChunkFormat::RAW;
+    const uint32_t uBF16 = (uint32_t)emChunkFormat::BFLOAT16, uFP32 = (uint32_t)emChunkFormat::FLOAT32;
+    /** Normal samples: bf16 under 1%, fp32 under 1e-6, only the exponent bytes compress */
+    Check(1e-2, emCodecMode::LOSSY, uBF16 | CODEC_CHUNK_LZ);
+    Check(1e-6, emCodecMode::LOSSY, uFP32 | CODEC_CHUNK_LZ);
+    Check(0, emCodecMode::LOSSY, uRaw | CODEC_CHUNK_LZ);
+    Check(0, emCodecMode::LOSSLESS, uRaw | CODEC_CHUNK_LZ);
+    /** Mostly zeros, exact */
+    for (size_t idx = 0; idx < vecIn.size(); ++idx) vecIn[idx] = idx % 10 == 0 ? Dist(Rng) : 0.0;
+    Check(0, emCodecMode::LOSSLESS, uRaw | CODEC_CHUNK_LZ);
+    /** Out of float range: no lossy format */
+    vecIn[3] = 1e300;
+    Check(1e-2, emCodecMode::LOSSY, uRaw | CODEC_CHUNK_LZ);
+    /** Random bits do not compress */
+    for (auto& d : vecIn) {
+        uint64_t ulBits = ((uint64_t)Rng() << 32) | Rng();
+        memcpy(&d, &ulBits, sizeof(d));
+        if (not std::isfinite(d)) d = 0;
+    }
+    Check(0, emCodecMode::LOSSLESS, uRaw);
+
+    /** A chunk that does not fit is refused */
+    iErrors += CodecDecodeChunk(vecChunk.data(), vecChunk.size(), vecOut.data(), vecOut.size() - 1) != -1;
+    return iErrors;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckLZ();
+        iErrors += CheckChunks();
+        LOGI("Codec: %d errors", iErrors);
+    }
+
+    /** Sparse M, dense N: NONE, LOSSLESS and LOSSY against the local product */
+    const size_t ulM = 600, ulK = 500, ulN = 400;
+    const emCodecMode aModes[] = { emCodecMode::NONE, emCodecMode::LOSSLESS, emCodecMode::LOSSY };
+    const char* asModes[] = { "none", "lossless", "lossy 1e-2" };
+    Matrix2D<double> M(ulM, ulK, true), N(ulK, ulN), Ref;
+    ON_MAIN_PROC(Processor) {
+        std::mt19937 Rng(7);
+        std::normal_distribution<double> Dist;
+        for (size_t idx = 0; idx < M.Size(); ++idx) M.pData()[idx] = Rng() % 10 == 0 ? Dist(Rng) : 0.0;
+        for (size_t idx = 0; idx < N.Size(); ++idx) N.pData()[idx] = Dist(Rng);
+        Ref = M * N;
+    }
+    for (int iMode = 0; iMode < 3; ++iMode) {
+        ON_MAIN_PROC(Processor) {
+            tCodecConfig Cfg = { aModes[iMode], 1e-2, 64 << 10 };
+            tCodecStats Stats = { 0 };
+            MPITimer Timer;
+            auto Res = Processor.iSize() > 1 ? MPIMatMulMain(M, N, Processor, Cfg, &Stats) : M * N;
+            double dTime = Timer.TimeDelta();
+            double dErr = 0, dScale = 0;
+            for (size_t idx = 0; idx < Ref.Size(); ++idx) {
+                dErr = std::max(dErr, std::fabs(Res.pData()[idx] - Ref.pData()[idx]));
+                dScale = std::max(dScale, std::fabs(Ref.pData()[idx]));
+            }
+            /** Lossless paths are exact, bf16 operands keep about 2 digits */
+            if ((aModes[iMode] == emCodecMode::LOSSY) ? dErr > 0.05 * dScale : dErr != 0) {
+                LOGE("%s: max error %g of %g", asModes[iMode], dErr, dScale);
+                iErrors++;
+            }
+            LOGI("%-10s %.4fs, ratio %.2f, encode %.0f MB/s, decode %.3fs, %zu of %zu chunks lossy, max error %g",
+                 asModes[iMode], dTime, CodecRatio(Stats),
+                 Stats.dEncodeTime > 0 ? Stats.ulRawBytes / 1e6 / Stats.dEncodeTime : 0.0,
+                 Stats.dDecodeTime, Stats.ulLossyChunks, Stats.ulChunks, dErr);
+        } else {
+            MPIMatMulWorker<double>(Processor);
+        }
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
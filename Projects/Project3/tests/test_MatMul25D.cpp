@@ -0,0 +1,129 @@
+#include "MatMul.hpp"
+#include "MatMul25D.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "TestMatrix.hpp"
+#include "debug.h"
+#include <cmath>
+
+using namespace mpimath;
+
+int CheckGrid() {
+    int iErrors = 0;
+    const size_t ulPlenty = (size_t)1 << 40;
+    /** Big square products replicate when it puts more processes to work: 8 = 2 x 2 x 2, 27 = 3 x 3 x 3 */
+    tGrid25D Grid = MatMul25DGrid(4096, 4096, 4096, 8, 8, 8, ulPlenty);
+    iErrors += Grid.iSide != 2 or Grid.iReplicas != 2;
+    Grid = MatMul25DGrid(4096, 4096, 4096, 27, 8, 8, ulPlenty);
+    iErrors += Grid.iSide != 3 or Grid.iReplicas != 3;
+    /** 64 = 8 x 8 already uses everyone, and replicas would cost more words than they save */
+    Grid = MatMul25DGrid(4096, 4096, 4096, 64, 8, 8, ulPlenty);
+    iErrors += Grid.iSide != 8 or Grid.iReplicas != 1;
+    /** Without memory to spare the grid stays 2D */
+    Grid = MatMul25DGrid(4096, 4096, 4096, 8, 8, 8, 0);
+    iErrors += Grid.iSide != 2 or Grid.iReplicas != 1;
+    /** A fixed factor takes the largest square layer left */
+    Grid = MatMul25DGrid(100, 100, 100, 12, 8, 8, 0, 3);
+    iErrors += Grid.iSide != 2 or Grid.iReplicas != 3;
+    /** On 4096 processes, 16 layers receive fewer words than one 64 x 64 layer */
+    auto Words = [](tGrid25D G) { return MatMul25DCost(4096, 4096, 4096, G, 1) - MatMul25DCost(4096, 4096, 4096, G, 0); };
+    iErrors += Words({ 64, 1 }) < 1.5 * Words({ 16, 16 });
+    if (iErrors) LOGE("MatMul25DGrid: %d errors", iErrors);
+    return iErrors;
+}
+
+/**
+ * @brief test_MatMul25D
+ *
+ * ./test_MatMul25D [N] checks MPIMatMul25D for every replication factor the
+ * processes allow, then times it against MPIMatMulMain on N x N (default 256).
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    const bool bMain = Processor.iRank() == 0;
+    const long lBench = argc >= 2 ? atol(argv[1]) : 256;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckGrid();
+    }
+
+    /** Odd shapes, blocks of zero rows, every c, exact in int32 */
+    for (int iReplicas = 1; iReplicas <= Processor.iSize(); ++iReplicas) {
+        for (auto Shape : { std::array<size_t, 3>{ 37, 23, 29 }, std::array<size_t, 3>{ 1, 5, 3 },
+                            std::array<size_t, 3>{ 64, 64, 64 }, std::array<size_t, 3>{ 3, 40, 2 } }) {
+            Matrix2D<int32_t> M = RandomMatrix<int32_t>(Shape[0], Shape[1], 1);
+            Matrix2D<int32_t> N = RandomMatrix<int32_t>(Shape[1], Shape[2], 2);
+            tGrid25D Grid;
+            Matrix2D<int32_t> Res = MPIMatMul25D(M, N, Processor, iReplicas, &Grid);
+            iErrors += Grid.iReplicas != iReplicas or Grid.iSide * Grid.iSide * Grid.iReplicas > Processor.iSize();
+            Matrix2D<int32_t> Ref = M * N;
+            if (bMain and (Res.ulRow() != Ref.ulRow() or Res.ulCol() != Ref.ulCol() or
+                           memcmp(Res.pData(), Ref.pData(), Ref.ulDataSize()) != 0)) {
+                LOGE("%zux%zux%zu on %dx%dx%d: result differs", Shape[0], Shape[1], Shape[2], Grid.iSide, Grid.iSide,
+                     Grid.iReplicas);
+                iErrors++;
+            }
+        }
+    }
+
+    /** Mismatched shapes are refused everywhere */
+    {
+        Matrix2D<double> M(4, 3), N(4, 3);
+        iErrors += MPIMatMul25D(M, N, Processor).Size() != 0;
+    }
+
+    /** Float, the replicas sum their parts in another order */
+    {
+        Matrix2D<float> M = RandomMatrix<float>(33, 17, 3), N = RandomMatrix<float>(17, 21, 4);
+        auto Res = MPIMatMul25D(M, N, Processor);
+        auto Ref = M * N;
+        for (size_t idx = 0; bMain and idx < Ref.Size(); ++idx) {
+            if (std::fabs((double)Res.pData()[idx] - (double)Ref.pData()[idx]) > 1e-3) {
+                LOGE("float: element %zu differs", idx);
+                iErrors++;
+                break;
+            }
+        }
+    }
+
+    /** Against 1D MPIMatMulMain with the same processes */
+    if (Processor.iSize() > 1) {
+        Matrix2D<double> M = RandomMatrix<double>(lBench, lBench, 5), N = RandomMatrix<double>(lBench, lBench, 6);
+        Matrix2D<double> Res1D, Res25D;
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPITimer Timer;
+        ON_MAIN_PROC(Processor) {
+            Res1D = MPIMatMulMain(M, N, Processor);
+        } else {
+            MPIMatMulWorker<double>(Processor);
+        }
+        const double d1D = Timer.TimeDelta();
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPITimer Timer25D;
+        tGrid25D Grid;
+        Res25D = MPIMatMul25D(M, N, Processor, 0, &Grid);
+        const double d25D = Timer25D.TimeDelta();
+        ON_MAIN_PROC(Processor) {
+            for (size_t idx = 0; idx < Res1D.Size(); ++idx) {
+                if (std::fabs(Res1D.pData()[idx] - Res25D.pData()[idx]) > 1e-9) {
+                    LOGE("%ld^3: 2.5D result differs at %zu", lBench, idx);
+                    iErrors++;
+                    break;
+                }
+            }
+            LOGI("%ld^3 on %d processes: 1D %.4fs, 2.5D %.4fs on %dx%dx%d", lBench, Processor.iSize(), d1D, d25D,
+                 Grid.iSide, Grid.iSide, Grid.iReplicas);
+        }
+    }
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("MatMul 2.5D: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
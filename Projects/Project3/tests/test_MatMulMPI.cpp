@@ -1,5 +1,6 @@
 #include "MatMul.hpp"
 #include "MPIProcessorInfo.hpp"
+#include "MPIRegionTimer.hpp"
 #include "MPITimer.hpp"
 #include "Matrix.hpp"
 #include "debug.h"
@@ -32,6 +33,7 @@ int main(int argc, char** argv) {
     Matrix2D<double> Res{};
 
     ON_MAIN_PROC(Processor) {
+        REGION_SCOPE("read");
         iRet = M.ReadCSV(sMatMPath);
         if (iRet != emMatrixError::MATRIX_OK) {
             LOGE_S("Read Error: %d", iRet);
@@ -40,6 +42,7 @@ int main(int argc, char** argv) {
         if (iRet != emMatrixError::MATRIX_OK) {
             LOGE_S("Read Error: %d", iRet);
         }
+        REGION_BYTES((M.Size() + N.Size()) * sizeof(double));
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
@@ -59,9 +62,12 @@ int main(int argc, char** argv) {
     ON_MAIN_PROC(Processor) {
         LOGI("Time elapsed: %f", Timer.TimeDelta());
         // std::cout << Res;
+        REGION_SCOPE("write");
         Res.DumpCSV(sResultPath);
+        REGION_BYTES(Res.Size() * sizeof(double));
     }
 
+    MPIRegionFinalize();
     MPI_Finalize();
     return 0;
 
@@ -0,0 +1,107 @@
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+#include <cmath>
+#include <random>
+
+using namespace mpimath;
+
+static std::mt19937 Rng(42);
+
+/**
+ * @brief Fill a matrix with random values representable in T
+ *
+ */
+template<typename T>
+void RandomFill(Matrix2D<T>& Mat, double dLow, double dHigh) {
+    std::uniform_real_distribution<double> Dist(dLow, dHigh);
+    for (size_t idx = 0; idx < Mat.Size(); ++idx) {
+        Mat.pData()[idx] = (T)(std::is_integral<T>() ? std::round(Dist(Rng)) : Dist(Rng));
+    }
+}
+
+/**
+ * @brief Compare MatMulAccumulate against a double precision reference
+ *
+ * @return int Number of mismatches
+ */
+template<typename T>
+int CheckType(const char* sName, size_t ulM, size_t ulK, size_t ulN, double dLow, double dHigh, double dTol) {
+    Matrix2D<T> M(ulM, ulK), N(ulK, ulN);
+    RandomFill(M, dLow, dHigh);
+    RandomFill(N, dLow, dHigh);
+
+    auto Res = M.MatMulAccumulate(N);
+    int iErrors = 0;
+    for (size_t i = 0; i < ulM; ++i) {
+        for (size_t j = 0; j < ulN; ++j) {
+            double dRef = 0;
+            for (size_t k = 0; k < ulK; ++k) {
+                dRef += (double)M.pData()[i * ulK + k] * (double)N.pData()[k * ulN + j];
+            }
+            if (std::fabs((double)Res.pData()[i * ulN + j] - dRef) > dTol * (1.0 + std::fabs(dRef))) {
+                if (iErrors++ < 4) {
+                    LOGE("%s %zux%zux%zu: [%zu][%zu] got %f expected %f", sName, ulM, ulK, ulN, i, j, (double)Res.pData()[i * ulN + j], dRef);
+                }
+            }
+        }
+    }
+
+    /** operator* must agree with the narrowed accumulator */
+    auto Narrow = M * N;
+    for (size_t idx = 0; idx < Narrow.Size(); ++idx) {
+        T Expected = tGemmTraits<T>::FromAcc(Res.pData()[idx]);
+        if (memcmp(&Narrow.pData()[idx], &Expected, sizeof(T)) != 0) {
+            if (iErrors++ < 4) LOGE("%s operator* differs at %zu", sName, idx);
+        }
+    }
+    return iErrors;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        const size_t aShapes[][3] = { {1, 1, 1}, {4, 16, 16}, {7, 13, 5}, {33, 67, 41}, {64, 300, 72} };
+        for (auto& Shape : aShapes) {
+            iErrors += CheckType<bf16_t>("bf16", Shape[0], Shape[1], Shape[2], -2, 2, 1e-4);
+            iErrors += CheckType<fp16_t>("fp16", Shape[0], Shape[1], Shape[2], -2, 2, 1e-4);
+            iErrors += CheckType<int8_t>("int8", Shape[0], Shape[1], Shape[2], -128, 127, 0);
+            iErrors += CheckType<int32_t>("int32", Shape[0], Shape[1], Shape[2], -1000, 1000, 0);
+            iErrors += CheckType<int64_t>("int64", Shape[0], Shape[1], Shape[2], -1e5, 1e5, 0);
+        }
+        LOGI("Local mixed precision gemm: %d errors", iErrors);
+    }
+
+    /** bf16 and int8 through the MPI path */
+    if (Processor.iSize() > 1) {
+        Matrix2D<bf16_t> M(37, 29), N(29, 23);
+        Matrix2D<int8_t> MI(37, 29), NI(29, 23);
+        ON_MAIN_PROC(Processor) {
+            RandomFill(M, -1, 1);
+            RandomFill(N, -1, 1);
+            RandomFill(MI, -128, 127);
+            RandomFill(NI, -128, 127);
+            auto Res = MPIMatMulMain(M, N, Processor);
+            auto Ref = M.MatMulAccumulate(N);
+            auto ResI = MPIMatMulMain(MI, NI, Processor);
+            auto RefI = MI.MatMulAccumulate(NI);
+            int iMPIErrors = 0;
+            for (size_t idx = 0; idx < Ref.Size(); ++idx) {
+                iMPIErrors += (Res.pData()[idx] != Ref.pData()[idx]);
+                iMPIErrors += (ResI.pData()[idx] != RefI.pData()[idx]);
+            }
+            LOGI("MPI mixed precision gemm: %d errors", iMPIErrors);
+            iErrors += iMPIErrors;
+        } else {
+            MPIMatMulWorker<bf16_t>(Processor);
+            MPIMatMulWorker<int8_t>(Processor);
+        }
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
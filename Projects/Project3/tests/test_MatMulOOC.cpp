@@ -0,0 +1,140 @@
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "OutOfCore.hpp"
+#include "debug.h"
+#include <cmath>
+#include <random>
+
+using namespace mpimath;
+
+template<typename Alloc>
+void FillRandom(Matrix2D<double, Alloc>& Mat, unsigned uSeed) {
+    std::mt19937 Rng(uSeed);
+    std::normal_distribution<double> Dist;
+    for (size_t idx = 0; idx < Mat.Size(); ++idx) Mat.pData()[idx] = Dist(Rng);
+}
+
+double MaxRelErr(const Matrix2D<double>& A, const Matrix2D<double>& B) {
+    if (A.ulRow() != B.ulRow() or A.ulCol() != B.ulCol()) return INFINITY;
+    double dErr = 0;
+    for (size_t idx = 0; idx < A.Size(); ++idx) {
+        dErr = std::max(dErr, std::fabs(A.pData()[idx] - B.pData()[idx]) / (1.0 + std::fabs(B.pData()[idx])));
+    }
+    return dErr;
+}
+
+/**
+ * @brief Small product with a tiny budget: many panels, CSV and binary in and out
+ *
+ */
+int CheckSmall(MPIProcessorInfo& Processor) {
+    int iErrors = 0;
+    const size_t ulM = 157, ulK = 93, ulN = 211;
+    Matrix2D<double> M(ulM, ulK), N(ulK, ulN), Ref;
+    ON_MAIN_PROC(Processor) {
+        FillRandom(M, 1);
+        FillRandom(N, 2);
+        Ref = M * N;
+        iErrors += DenseMatrixFile<double>::Dump("test_OOC_M.bin", M) != MATRIX_OK;
+        iErrors += N.DumpCSV("test_OOC_N.csv") != MATRIX_OK;
+    }
+
+    /** 64 KB: 8 column panels of N, a handful of rows per panel of M */
+    tOOCStats Stats;
+    iErrors += MPIMatMulOOC<double>("test_OOC_M.bin", "test_OOC_N.csv", "test_OOC_R.bin", Processor, 64 << 10, &Stats) != MATRIX_OK;
+    if (Stats.ulPanelsM > 0 and Stats.ulPanelReadsN != Stats.ulPanelsM * Stats.ulPanelsN - 2 * (Stats.ulPanelsM - 1)) {
+        LOGE("[%d] %zu reads of N for %zu x %zu tiles", Processor.iRank(), Stats.ulPanelReadsN, Stats.ulPanelsM, Stats.ulPanelsN);
+        iErrors++;
+    }
+    iErrors += MPIMatMulOOC<double>("test_OOC_M.bin", "test_OOC_N.csv", "test_OOC_R.csv", Processor, 64 << 10) != MATRIX_OK;
+
+    ON_MAIN_PROC(Processor) {
+        Matrix2D<double> Res, ResCSV;
+        iErrors += DenseMatrixFile<double>::Load("test_OOC_R.bin", Res) != MATRIX_OK;
+        iErrors += ResCSV.ReadCSV("test_OOC_R.csv") != MATRIX_OK;
+        double dErr = MaxRelErr(Res, Ref);
+        if (dErr > 1e-12 or MaxRelErr(ResCSV, Res) != 0) {
+            LOGE("out-of-core result differs: %g", dErr);
+            iErrors++;
+        }
+        LOGI("%zux%zux%zu in %zu x %zu tiles per process, max error %g", ulM, ulK, ulN, Stats.ulPanelsM, Stats.ulPanelsN, dErr);
+    }
+
+    /** Shape mismatch is reported on every process */
+    iErrors += MPIMatMulOOC<double>("test_OOC_N.csv", "test_OOC_N.csv", "test_OOC_R.bin", Processor) != MATRIX_ERR_SHAPE;
+    /** Temporaries are gone */
+    ON_MAIN_PROC(Processor) {
+        iErrors += access("test_OOC_N.csv.ooc.bin", F_OK) == 0 or access("test_OOC_R.csv.ooc.bin", F_OK) == 0;
+        remove("test_OOC_M.bin");
+        remove("test_OOC_N.csv");
+        remove("test_OOC_R.bin");
+        remove("test_OOC_R.csv");
+    }
+    return iErrors;
+}
+
+/**
+ * @brief test_MatMulOOC
+ *
+ * Without arguments runs the self test, otherwise
+ * ./test_MatMulOOC MatM MatN Result [MemMB]
+ * where the files are CSV or binary dense files (".csv" result for CSV).
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    if (argc >= 4) {
+        size_t ulMemBytes = argc >= 5 ? (size_t)atol(argv[4]) << 20 : 0;
+        tOOCStats Stats;
+        MPITimer Timer;
+        int iRet = MPIMatMulOOC<double>(argv[1], argv[2], argv[3], Processor, ulMemBytes, &Stats);
+        ON_MAIN_PROC(Processor) {
+            LOGI("Time elapsed: %f, status %d", Timer.TimeDelta(), iRet);
+            LOGI("tiles %zu x %zu, N read %zu times, %.1f MB read, waited %.3fs on I/O of %.3fs",
+                 Stats.ulPanelsM, Stats.ulPanelsN, Stats.ulPanelReadsN, Stats.ulBytesRead / 1e6, Stats.dWaitIO, Stats.dTotal);
+        }
+        MPI_Finalize();
+        return iRet;
+    }
+
+    iErrors += CheckSmall(Processor);
+
+    /** 768^3 with an 8 MB budget per process, against the in-core product */
+    const size_t ulDim = 768;
+    Matrix2D<double> Ref;
+    ON_MAIN_PROC(Processor) {
+        Matrix2D<double> M(ulDim, ulDim), N(ulDim, ulDim);
+        FillRandom(M, 3);
+        FillRandom(N, 4);
+        Ref = M * N;
+        iErrors += DenseMatrixFile<double>::Dump("test_OOC_big_M.bin", M) != MATRIX_OK;
+        iErrors += DenseMatrixFile<double>::Dump("test_OOC_big_N.bin", N) != MATRIX_OK;
+    }
+    tOOCStats Stats;
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPITimer Timer;
+    iErrors += MPIMatMulOOC<double>("test_OOC_big_M.bin", "test_OOC_big_N.bin", "test_OOC_big_R.bin", Processor, 8 << 20, &Stats) != MATRIX_OK;
+    double dTime = Timer.TimeDelta();
+    ON_MAIN_PROC(Processor) {
+        LOGI("%zu^3 out-of-core: %.2f GFLOP/s, tiles %zu x %zu, %.1f MB read, waited %.3fs on I/O of %.3fs",
+             ulDim, 2.0 * ulDim * ulDim * ulDim / dTime / 1e9, Stats.ulPanelsM, Stats.ulPanelsN, Stats.ulBytesRead / 1e6,
+             Stats.dWaitIO, Stats.dTotal);
+        Matrix2D<double> Res;
+        iErrors += DenseMatrixFile<double>::Load("test_OOC_big_R.bin", Res) != MATRIX_OK;
+        double dErr = MaxRelErr(Res, Ref);
+        if (dErr > 1e-12) {
+            LOGE("%zu^3 out-of-core result differs: %g", ulDim, dErr);
+            iErrors++;
+        }
+        remove("test_OOC_big_M.bin");
+        remove("test_OOC_big_N.bin");
+        remove("test_OOC_big_R.bin");
+        LOGI("Out-of-core MatMul: %d errors", iErrors);
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
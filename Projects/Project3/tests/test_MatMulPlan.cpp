@@ -0,0 +1,126 @@
+#include "MatMul.hpp"
+#include "MatMulPlan.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+#include <cmath>
+#include <random>
+
+using namespace mpimath;
+
+template<typename T, typename Alloc>
+void FillRandom(Matrix2D<T, Alloc>& Mat, unsigned uSeed) {
+    std::mt19937 Rng(uSeed);
+    std::uniform_int_distribution<int> Dist(-9, 9);
+    for (size_t idx = 0; idx < Mat.Size(); ++idx) Mat.pData()[idx] = (T)Dist(Rng);
+}
+
+template<typename TRes, typename T>
+bool SameProduct(const TRes& Res, const Matrix2D<T>& M, const Matrix2D<T>& N) {
+    Matrix2D<T> Ref = M * N;
+    if (Res.ulRow() != Ref.ulRow() or Res.ulCol() != Ref.ulCol()) return false;
+    for (size_t idx = 0; idx < Ref.Size(); ++idx) {
+        if (Res.pData()[idx] != Ref.pData()[idx]) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief test_MatMulPlan
+ *
+ * ./test_MatMulPlan [N] [REPS] compares REPS products of N x N matrices
+ * (default 128, 200) through MPIMatMulMain and through one MatMulPlan.
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+    const long lBench = argc >= 2 ? atol(argv[1]) : 128;
+    const int iReps = argc >= 3 ? atoi(argv[2]) : 200;
+
+    /** Odd shapes, one and several tiles per worker, fewer rows than workers; new operands every run */
+    for (long lTileRows : { 0L, 4L, -1L }) {
+        for (auto Shape : { std::array<long, 3>{ 37, 23, 29 }, std::array<long, 3>{ 2, 5, 3 } }) {
+            MatMulPlan<double> Plan(Shape[0], Shape[1], Shape[2], Processor, lTileRows);
+            for (unsigned uRun = 0; uRun < 3; ++uRun) {
+                Matrix2D<double> M, N;
+                ON_MAIN_PROC(Processor) {
+                    M.Init(Shape[0], Shape[1]);
+                    N.Init(Shape[1], Shape[2]);
+                    FillRandom(M, uRun);
+                    FillRandom(N, uRun + 100);
+                }
+                iErrors += Plan.Execute(M, N) != MATRIX_OK;
+                ON_MAIN_PROC(Processor) {
+                    if (not SameProduct(Plan.Result(), M, N)) {
+                        LOGE("%ldx%ldx%ld tile rows %ld run %u", Shape[0], Shape[1], Shape[2], lTileRows, uRun);
+                        iErrors++;
+                    }
+                }
+            }
+        }
+    }
+
+    /** Operands written in place, int32 */
+    {
+        MatMulPlan<int32_t> Plan(16, 16, 16, Processor, 3);
+        ON_MAIN_PROC(Processor) {
+            FillRandom(Plan.M(), 7);
+            FillRandom(Plan.N(), 8);
+        }
+        iErrors += Plan.Execute() != MATRIX_OK;
+        ON_MAIN_PROC(Processor) {
+            Matrix2D<int32_t> M(16, 16), N(16, 16);
+            memcpy(M.pData(), Plan.M().pData(), M.ulDataSize());
+            memcpy(N.pData(), Plan.N().pData(), N.ulDataSize());
+            iErrors += not SameProduct(Plan.Result(), M, N);
+        }
+    }
+
+    /** An invalid shape is refused everywhere */
+    {
+        MatMulPlan<double> Plan(-1, 4, 4, Processor);
+        iErrors += Plan.IsValid() or Plan.Execute() != MATRIX_ERR_SHAPE;
+    }
+
+    /** Many products of one shape: the plan against MPIMatMulMain */
+    {
+        Matrix2D<double> M, N;
+        ON_MAIN_PROC(Processor) {
+            M.Init(lBench, lBench);
+            N.Init(lBench, lBench);
+            FillRandom(M, 1);
+            FillRandom(N, 2);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPITimer Timer;
+        for (int iRep = 0; iRep < iReps; ++iRep) {
+            ON_MAIN_PROC(Processor) {
+                MPIMatMulMain(M, N, Processor);
+            } else {
+                MPIMatMulWorker<double>(Processor);
+            }
+        }
+        const double dMain = Timer.TimeDelta();
+        MPI_Barrier(MPI_COMM_WORLD);
+        MPITimer PlanTimer;
+        {
+            MatMulPlan<double> Plan(lBench, lBench, lBench, Processor);
+            for (int iRep = 0; iRep < iReps; ++iRep) Plan.Execute(M, N);
+        }
+        const double dPlan = PlanTimer.TimeDelta();
+        ON_MAIN_PROC(Processor) {
+            LOGI("%d x %ld^3 on %d processes: MPIMatMulMain %.3f ms, MatMulPlan %.3f ms per product", iReps, lBench,
+                 Processor.iSize(), dMain / iReps * 1e3, dPlan / iReps * 1e3);
+        }
+    }
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("MatMulPlan: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
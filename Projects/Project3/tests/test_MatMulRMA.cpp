@@ -0,0 +1,110 @@
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "TestMatrix.hpp"
+#include "debug.h"
+#include <cmath>
+#include <cstdlib>
+
+using namespace mpimath;
+
+/** M @ N through MPIMatMulMain, the result is only meaningful on the main process */
+template<typename T>
+Matrix2D<typename tGemmTraits<T>::AccType> Product(const Matrix2D<T>& M, const Matrix2D<T>& N, MPIProcessorInfo Processor) {
+    ON_MAIN_PROC(Processor) {
+        return MPIMatMulMain(M, N, Processor);
+    }
+    MPIMatMulWorker<T>(Processor);
+    return Matrix2D<typename tGemmTraits<T>::AccType>();
+}
+
+/**
+ * @brief test_MatMulRMA
+ *
+ * ./test_MatMulRMA [N] compares MPIMatMulMain with MPIMATH_MATMUL_RMA=1
+ * against the default mode, then times both on N x N (default 256).
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    const bool bMain = Processor.iRank() == 0;
+    const long lBench = argc >= 2 ? atol(argv[1]) : 256;
+    int iErrors = 0;
+
+    /** Only the main process reads the environment, the mode travels in the context */
+    ON_MAIN_PROC(Processor) {
+        setenv("MPIMATH_MATMUL_RMA", "1", 1);
+    }
+
+    /** Odd shapes, fewer rows than workers, private and shared N, exact in int32 */
+    for (const char* sShared : { "0", "1" }) {
+        ON_MAIN_PROC(Processor) {
+            setenv("MPIMATH_SHARED_N", sShared, 1);
+        }
+        for (auto Shape : { std::array<size_t, 3>{ 37, 23, 29 }, std::array<size_t, 3>{ 2, 5, 3 },
+                            std::array<size_t, 3>{ 1, 1, 1 }, std::array<size_t, 3>{ 130, 7, 65 } }) {
+            Matrix2D<int32_t> M = RandomMatrix<int32_t>(Shape[0], Shape[1], 1);
+            Matrix2D<int32_t> N = RandomMatrix<int32_t>(Shape[1], Shape[2], 2);
+            Matrix2D<int32_t> Res = Product(M, N, Processor);
+            Matrix2D<int32_t> Ref = M * N;
+            if (bMain and (Res.ulRow() != Ref.ulRow() or Res.ulCol() != Ref.ulCol() or
+                           memcmp(Res.pData(), Ref.pData(), Ref.ulDataSize()) != 0)) {
+                LOGE("%zux%zux%zu shared N %s: result differs", Shape[0], Shape[1], Shape[2], sShared);
+                iErrors++;
+            }
+        }
+    }
+    ON_MAIN_PROC(Processor) {
+        setenv("MPIMATH_SHARED_N", "0", 1);
+    }
+
+    /** Float, accumulated in double */
+    {
+        Matrix2D<float> M = RandomMatrix<float>(41, 19, 3), N = RandomMatrix<float>(19, 22, 4);
+        auto Res = Product(M, N, Processor);
+        auto Ref = M * N;
+        for (size_t idx = 0; bMain and idx < Ref.Size(); ++idx) {
+            if (std::fabs((double)Res.pData()[idx] - (double)Ref.pData()[idx]) > 1e-3) {
+                LOGE("float: element %zu differs", idx);
+                iErrors++;
+                break;
+            }
+        }
+    }
+
+    /** Pull against push */
+    {
+        Matrix2D<double> M = RandomMatrix<double>(lBench, lBench, 5), N = RandomMatrix<double>(lBench, lBench, 6);
+        double adTime[2];
+        Matrix2D<double> aRes[2];
+        for (int iRMA = 0; iRMA < 2; ++iRMA) {
+            ON_MAIN_PROC(Processor) {
+                setenv("MPIMATH_MATMUL_RMA", iRMA ? "1" : "0", 1);
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+            MPITimer Timer;
+            aRes[iRMA] = Product(M, N, Processor);
+            adTime[iRMA] = Timer.TimeDelta();
+        }
+        ON_MAIN_PROC(Processor) {
+            /** The send/recv mode needs a worker, the RMA mode computes alone */
+            for (size_t idx = 0; Processor.iSize() > 1 and idx < aRes[0].Size(); ++idx) {
+                if (std::fabs(aRes[0].pData()[idx] - aRes[1].pData()[idx]) > 1e-9) {
+                    LOGE("%ld^3: RMA result differs at %zu", lBench, idx);
+                    iErrors++;
+                    break;
+                }
+            }
+            LOGI("%ld^3 on %d processes: send/recv %.4fs, RMA %.4fs", lBench, Processor.iSize(), adTime[0], adTime[1]);
+        }
+    }
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("MatMul RMA: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
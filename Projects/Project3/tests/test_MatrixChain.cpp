@@ -0,0 +1,168 @@
+#include "DistMatrix.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MatrixChain.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+#include <cmath>
+#include <random>
+
+using namespace mpimath;
+
+Matrix2D<double> RandomMatrix(size_t ulRow, size_t ulCol, unsigned uSeed) {
+    Matrix2D<double> Mat(ulRow, ulCol);
+    std::mt19937 Rng(uSeed);
+    std::uniform_real_distribution<double> Dist(-1, 1);
+    for (size_t idx = 0; idx < Mat.Size(); ++idx) Mat.pData()[idx] = Dist(Rng) / (double)ulCol;
+    return Mat;
+}
+
+/** max |A - B| relative to max |B| */
+double RelError(const Matrix2D<double>& A, const Matrix2D<double>& B) {
+    if (A.ulRow() != B.ulRow() or A.ulCol() != B.ulCol()) return INFINITY;
+    double dErr = 0, dMax = 1e-300;
+    for (size_t idx = 0; idx < A.Size(); ++idx) {
+        dErr = std::max(dErr, std::fabs(A.pData()[idx] - B.pData()[idx]));
+        dMax = std::max(dMax, std::fabs(B.pData()[idx]));
+    }
+    return dErr / dMax;
+}
+
+/** A^e by e - 1 multiplications */
+Matrix2D<double> NaivePower(const Matrix2D<double>& A, unsigned long ulExp) {
+    Matrix2D<double> Res(A.ulRow(), A.ulCol(), true);
+    for (size_t i = 0; i < A.ulRow(); ++i) Res.pData()[i * A.ulCol() + i] = 1;
+    for (unsigned long ulStep = 0; ulStep < ulExp; ++ulStep) Res *= A;
+    return Res;
+}
+
+int CheckPlan() {
+    int iErrors = 0;
+    std::vector<size_t> vecSplit;
+    const tChainCost Local = { 1, 1, 0 };
+    /** 2 * (10 * 30 * 5 + 10 * 5 * 60) flops */
+    iErrors += ChainPlan({ 10, 30, 5, 60 }, Local, vecSplit) != 9000;
+    iErrors += ChainOrder(vecSplit, 3, 0, 2) != "((A0 A1) A2)";
+    /** The textbook chain, 15125 multiplications */
+    iErrors += ChainPlan({ 30, 35, 15, 5, 10, 20, 25 }, Local, vecSplit) != 2 * 15125;
+    iErrors += ChainOrder(vecSplit, 6, 0, 5) != "((A0 (A1 A2)) ((A3 A4) A5))";
+    iErrors += ChainPlan({ 4, 7 }, Local, vecSplit) != 0;
+
+    /** On a 4 x 1 grid only B panels move: communication can change the order */
+    const tChainCost Dist = { 4, 1, 1000 };
+    ChainPlan({ 1, 100, 100, 10 }, Local, vecSplit);
+    iErrors += ChainOrder(vecSplit, 3, 0, 2) != "((A0 A1) A2)";
+    ChainPlan({ 1, 100, 100, 10 }, Dist, vecSplit);
+    iErrors += ChainOrder(vecSplit, 3, 0, 2) != "(A0 (A1 A2))";
+    if (iErrors) LOGE("ChainPlan: %d errors", iErrors);
+    return iErrors;
+}
+
+int CheckLocal() {
+    int iErrors = 0;
+
+    /** Moves leave the source empty */
+    Matrix2D<double> A = RandomMatrix(9, 9, 1), B = A;
+    Matrix2D<double> C(std::move(B));
+    iErrors += B.IsValid() or B.Size() != 0 or RelError(C, A) != 0;
+    B = std::move(C);
+    iErrors += C.IsValid() or RelError(B, A) != 0;
+
+    for (unsigned long ulExp : { 0, 1, 2, 5, 13, 16 }) {
+        double dErr = RelError(MatrixPower(A, ulExp), NaivePower(A, ulExp));
+        if (dErr > 1e-12) {
+            LOGE("MatrixPower e=%lu error %g", ulExp, dErr);
+            iErrors++;
+        }
+    }
+    /** [[1, 1], [0, 1]]^e = [[1, e], [0, 1]] */
+    Matrix2D<int32_t> J(2, 2);
+    J[0] = { 1, 1 };
+    J[1] = { 0, 1 };
+    Matrix2D<int32_t> J7 = MatrixPower(J, 7);
+    iErrors += J7.pData()[0] != 1 or J7.pData()[1] != 7 or J7.pData()[2] != 0 or J7.pData()[3] != 1;
+
+    std::vector<Matrix2D<double>> vecMats;
+    const size_t aDims[] = { 20, 3, 31, 2, 17, 25 };
+    for (size_t idx = 0; idx + 1 < sizeof(aDims) / sizeof(aDims[0]); ++idx) {
+        vecMats.push_back(RandomMatrix(aDims[idx], aDims[idx + 1], 10 + (unsigned)idx));
+    }
+    std::vector<const Matrix2D<double>*> vecPtrs;
+    Matrix2D<double> Ref = vecMats[0];
+    for (size_t idx = 0; idx < vecMats.size(); ++idx) {
+        vecPtrs.push_back(&vecMats[idx]);
+        if (idx > 0) Ref *= vecMats[idx];
+    }
+    iErrors += RelError(MatrixChain(vecPtrs), Ref) > 1e-12;
+    iErrors += RelError(MatrixChain(std::vector<const Matrix2D<double>*>{ &A }), A) != 0;
+
+    std::swap(vecPtrs[1], vecPtrs[2]);
+    try {
+        MatrixChain(vecPtrs);
+        iErrors++;
+    } catch (emMatrixError Err) {
+        iErrors += Err != MATRIX_ERR_SHAPE;
+    }
+    if (iErrors) LOGE("local: %d errors", iErrors);
+    return iErrors;
+}
+
+/**
+ * @brief test_MatrixChain
+ *
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    const int iSize = Processor.iSize();
+    const bool bMain = Processor.iRank() == 0;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckPlan();
+        iErrors += CheckLocal();
+    }
+
+    /** Distributed powers in every layout, back in the layout they came in */
+    const size_t ulN = 37;
+    Matrix2D<double> A = RandomMatrix(ulN, ulN, 2);
+    for (const auto& Layout : { DistLayoutRow(ulN, ulN, iSize), DistLayoutCol(ulN, ulN, iSize),
+                                DistLayoutBlockCyclic(ulN, ulN, iSize, 8) }) {
+        DistMatrix<double> DA = DistMatrix<double>::Scatter(A, Layout);
+        for (unsigned long ulExp : { 0, 1, 6, 11 }) {
+            DistMatrix<double> DP = MatrixPower(DA, ulExp);
+            iErrors += not DistLayoutSame(DP.Layout(), Layout);
+            Matrix2D<double> MatP = DP.Gather();
+            if (bMain and RelError(MatP, NaivePower(A, ulExp)) > 1e-12) {
+                LOGE("distributed MatrixPower e=%lu grid %dx%d", ulExp, Layout.iProcRow, Layout.iProcCol);
+                iErrors++;
+            }
+        }
+    }
+
+    /** Distributed chain */
+    {
+        const size_t aDims[] = { 40, 4, 33, 3, 29 };
+        std::vector<DistMatrix<double>> vecMats;
+        Matrix2D<double> Ref;
+        for (size_t idx = 0; idx + 1 < sizeof(aDims) / sizeof(aDims[0]); ++idx) {
+            Matrix2D<double> Mat = RandomMatrix(aDims[idx], aDims[idx + 1], 20 + (unsigned)idx);
+            Ref = idx == 0 ? Mat : Ref * Mat;
+            vecMats.push_back(DistMatrix<double>::Scatter(Mat, DistLayoutBlockCyclic(aDims[idx], aDims[idx + 1], iSize, 4)));
+        }
+        std::vector<const DistMatrix<double>*> vecPtrs;
+        for (const auto& Mat : vecMats) vecPtrs.push_back(&Mat);
+        Matrix2D<double> MatC = MatrixChain(vecPtrs).Gather();
+        if (bMain and RelError(MatC, Ref) > 1e-12) {
+            LOGE("distributed MatrixChain error %g", RelError(MatC, Ref));
+            iErrors++;
+        }
+    }
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("MatrixChain: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "MatrixExpr.hpp"
+#include "debug.h"
+#include <cmath>
+#include <random>
+
+using namespace mpimath;
+
+template<typename T>
+Matrix2D<T> Random(size_t ulRow, size_t ulCol, unsigned uSeed) {
+    std::mt19937 Rng(uSeed);
+    std::uniform_real_distribution<double> Dist(-1, 1);
+    Matrix2D<T> Res(ulRow, ulCol);
+    for (size_t idx = 0; idx < Res.Size(); ++idx) Res.pData()[idx] = (T)Dist(Rng);
+    return Res;
+}
+
+template<typename T>
+int Compare(const Matrix2D<T>& A, const Matrix2D<T>& B, double dTol, const char* sWhat) {
+    if (A.ulRow() != B.ulRow() or A.ulCol() != B.ulCol()) {
+        LOGE("%s: shape %zux%zu vs %zux%zu", sWhat, A.ulRow(), A.ulCol(), B.ulRow(), B.ulCol());
+        return 1;
+    }
+    for (size_t idx = 0; idx < A.Size(); ++idx) {
+        if (std::fabs((double)A.pData()[idx] - (double)B.pData()[idx]) > dTol) {
+            LOGE("%s differs at %zu: %f vs %f", sWhat, idx, (double)A.pData()[idx], (double)B.pData()[idx]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+template<typename T>
+int CheckExpr(size_t ulM, size_t ulK, size_t ulN, double dTol) {
+    int iErrors = 0;
+    auto A = Random<T>(ulM, ulK, 1), B = Random<T>(ulK, ulN, 2), C = Random<T>(ulM, ulN, 3), D = Random<T>(ulM, ulN, 4);
+    auto Bias = Random<T>(1, ulN, 5);
+    const T a = (T)1.5, b = (T)-0.25;
+
+    /** Element-wise only */
+    Matrix2D<T> Ref(ulM, ulN);
+    for (size_t idx = 0; idx < Ref.Size(); ++idx) Ref.pData()[idx] = a * C.pData()[idx] - D.pData()[idx] + C.pData()[idx] * b;
+    Matrix2D<T> E = a * C - D + C * b;
+    iErrors += Compare(E, Ref, dTol, "a*C - D + C*b");
+
+    /** Unary function and negation */
+    for (size_t idx = 0; idx < Ref.Size(); ++idx) Ref.pData()[idx] = -std::max(C.pData()[idx] + D.pData()[idx], T(0));
+    E = -Apply(C + D, [](T x) { return x > 0 ? x : T(0); });
+    iErrors += Compare(E, Ref, dTol, "-relu(C + D)");
+
+    /** gemm with an epilogue, reading the destination itself */
+    auto AB = A * B;
+    for (size_t i = 0; i < ulM; ++i) {
+        for (size_t j = 0; j < ulN; ++j) {
+            size_t idx = i * ulN + j;
+            Ref.pData()[idx] = a * AB.pData()[idx] + b * C.pData()[idx] + Bias.pData()[j];
+        }
+    }
+    C = a * Prod(A, B) + b * C + BroadcastRow(Bias, ulM);
+    iErrors += Compare(C, Ref, dTol, "a*A@B + b*C + bias");
+
+    /** Destination is a Prod operand */
+    if (ulK == ulN) {
+        auto Ref2 = A * B;
+        A = Prod(A, B);
+        iErrors += Compare(A, Ref2, dTol, "A = A@B");
+    }
+
+    /** Shape errors are reported when the expression is built */
+    bool bThrown = false;
+    try {
+        auto Bad = C + B;
+        (void)Bad;
+    } catch (emMatrixError) {
+        bThrown = true;
+    }
+    iErrors += bThrown != (ulK != ulM);
+    return iErrors;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckExpr<double>(67, 45, 31, 1e-10);
+        iErrors += CheckExpr<float>(67, 45, 31, 1e-4);
+        iErrors += CheckExpr<double>(300, 40, 40, 1e-10);
+        iErrors += CheckExpr<double>(1, 1, 1, 1e-12);
+        LOGI("Matrix expressions: %d errors", iErrors);
+
+        /** Fused epilogue vs one temporary per operator */
+        const size_t ulDim = 512;
+        auto A = Random<double>(ulDim, ulDim, 1), B = Random<double>(ulDim, ulDim, 2), C = Random<double>(ulDim, ulDim, 3);
+        auto Bias = Random<double>(1, ulDim, 4);
+        MPITimer Timer;
+        C = 2.0 * Prod(A, B) + 0.5 * C + BroadcastRow(Bias, ulDim);
+        double dFused = Timer.TimeDelta();
+        Timer.Reset();
+        auto Tmp = A * B;
+        Matrix2D<double> Tmp2(ulDim, ulDim);
+        for (size_t idx = 0; idx < Tmp.Size(); ++idx) Tmp.pData()[idx] *= 2.0;
+        for (size_t idx = 0; idx < C.Size(); ++idx) Tmp2.pData()[idx] = 0.5 * C.pData()[idx];
+        for (size_t idx = 0; idx < C.Size(); ++idx) Tmp.pData()[idx] += Tmp2.pData()[idx];
+        for (size_t idx = 0; idx < C.Size(); ++idx) C.pData()[idx] = Tmp.pData()[idx] + Bias.pData()[idx % ulDim];
+        LOGI("%zux%zu C = a*A@B + b*C + bias: fused %fs, step by step %fs", ulDim, ulDim, dFused, Timer.TimeDelta());
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
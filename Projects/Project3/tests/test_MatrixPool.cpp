@@ -0,0 +1,103 @@
+#include "Allocator.hpp"
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+
+using namespace mpimath;
+
+/**
+ * @brief Repeated same-shape products, the pattern of a long running service
+ *
+ */
+template<typename Alloc>
+double RepeatedMatMul(size_t ulDim, int iRepeat, double* pdChecksum) {
+    Matrix2D<double, Alloc> A(ulDim, ulDim), B(ulDim, ulDim);
+    A.fill(1.0);
+    B.fill(0.5);
+    MPITimer Timer;
+    double dSum = 0;
+    for (int iter = 0; iter < iRepeat; ++iter) {
+        Matrix2D<double, Alloc> C = A * B;
+        dSum += C.pData()[iter % C.Size()];
+    }
+    *pdChecksum = dSum;
+    return Timer.TimeDelta();
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        /** Size classes: 4 per power of two, 64 byte granularity below 256 */
+        iErrors += MatrixPool::SizeClass(1) != 64;
+        iErrors += MatrixPool::SizeClass(256) != 256;
+        iErrors += MatrixPool::SizeClass(1024) != 1024;
+        iErrors += MatrixPool::SizeClass(1025) != 1280;
+        iErrors += MatrixPool::SizeClass(3 << 20) != (3 << 20);
+
+        /** Re-Init and re-assignment go through the allocator */
+        {
+            Matrix2D<double, tPoolAllocator> A(3, 5, true), B(7, 2);
+            A.Init(4, 4, true);
+            B = A;
+            iErrors += B.ulRow() != 4 or B.pData()[15] != 0.0;
+            A.Transpose();
+        }
+
+        /** Every buffer comes back: nothing in use, second round only hits */
+        MatrixPool::Instance().ResetStats();
+        double dPooled = 0, dPlain = 0;
+        double dTimePooled = RepeatedMatMul<tPoolAllocator>(64, 2000, &dPooled);
+        auto Stats = MatrixPool::Instance().Stats();
+        LOGI("pool: hits=%zu misses=%zu in use=%zu peak=%zu cached=%zu", Stats.ulHits, Stats.ulMisses,
+             Stats.ulBytesInUse, Stats.ulPeakBytes, Stats.ulBytesCached);
+        iErrors += Stats.ulBytesInUse != 0;
+        iErrors += Stats.ulMisses > 4;
+        iErrors += Stats.ulPeakBytes < 3 * 64 * 64 * sizeof(double);
+
+        double dTimePlain = RepeatedMatMul<tAlignedAllocator>(64, 2000, &dPlain);
+        iErrors += dPooled != dPlain;
+        LOGI("2000 x 64x64 products: pooled %fs, aligned malloc %fs", dTimePooled, dTimePlain);
+
+        /** Large buffers: huge page class */
+        MatrixPool::Instance().ResetStats();
+        for (int iter = 0; iter < 10; ++iter) {
+            Matrix2D<float, tPoolAllocator> Big(1024, 1024, true);
+            iErrors += ((uintptr_t)Big.pData() % MATRIX_POOL_HUGE_PAGE) != 0;
+        }
+        Stats = MatrixPool::Instance().Stats();
+        iErrors += Stats.ulHits != 9 or Stats.ulMisses != 1;
+        MatrixPool::Instance().Trim();
+        iErrors += MatrixPool::Instance().Stats().ulBytesCached != 0;
+        LOGI("Matrix pool: %d errors", iErrors);
+    }
+
+    /** Worker temporaries come from the pool */
+    {
+        Matrix2D<double> M(33, 17), N(17, 9);
+        M.fill(1.0);
+        N.fill(2.0);
+        for (int iter = 0; iter < 3; ++iter) {
+            ON_MAIN_PROC(Processor) {
+                auto Res = Processor.iSize() > 1 ? MPIMatMulMain(M, N, Processor) : M * N;
+                iErrors += Res.pData()[Res.Size() - 1] != 34.0;
+            } else {
+                MPIMatMulWorker<double>(Processor);
+            }
+        }
+        ON_SUB_PROCS(Processor) {
+            auto Stats = MatrixPool::Instance().Stats();
+            if (Stats.ulHits == 0) {
+                LOGE("[%d] worker buffers were not recycled", Processor.iRank());
+                iErrors++;
+            }
+        }
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include "MPIProcessorInfo.hpp"
+#include "Partition.hpp"
+#include "debug.h"
+#include <random>
+
+using namespace mpimath;
+
+/** Queries of constant partitions fold at compile time */
+static_assert(Partition<int64_t>::Block(10, 4).Size(0) == 3 and Partition<int64_t>::Block(10, 4).Size(3) == 2, "block sizes");
+static_assert(Partition<int64_t>::Block(10, 4).Low(2) == 6 and Partition<int64_t>::Block(10, 4).High(2) == 7, "block bounds");
+static_assert(Partition<int64_t>::Block(10, 4).Owner(9) == 3 and Partition<int64_t>::Block(3, 8).Size(5) == 0, "block owner");
+static_assert(Partition<int64_t>::Cyclic(10, 4).Size(1) == 3 and Partition<int64_t>::Cyclic(10, 4).Global(1, 2) == 9, "cyclic");
+static_assert(Partition<int64_t>::BlockCyclic(10, 2, 3).Size(1) == 4 and Partition<int64_t>::BlockCyclic(10, 2, 3).Owner(9) == 1, "block cyclic");
+static constexpr int64_t alBounds[] = { 0, 1, 1, 7, 10 };
+static_assert(Partition<int64_t>::Weighted(10, 4, alBounds).Owner(1) == 2 and Partition<int64_t>::Weighted(10, 4, alBounds).Local(8) == 1, "weighted");
+/** Rank * N would overflow int64_t here */
+static_assert(Partition<int64_t>::Block(INT64_MAX - 1, 1 << 20).High((1 << 20) - 1) == INT64_MAX - 2, "64-bit");
+
+/**
+ * @brief Every index has exactly one owner, and Owner/Local/Global/Low/High/Size agree
+ *
+ */
+int CheckRoundTrip(const Partition<int64_t>& Part, const char* sName) {
+    int iErrors = 0;
+    std::vector<int64_t> vecSeen(Part.iParts(), 0);
+    for (int64_t lIndex = 0; lIndex < Part.lN(); ++lIndex) {
+        const int iOwner = Part.Owner(lIndex);
+        const int64_t lLocal = Part.Local(lIndex);
+        if (iOwner < 0 or iOwner >= Part.iParts() or lLocal < 0 or lLocal >= Part.Size(iOwner) or Part.Global(iOwner, lLocal) != lIndex) {
+            if (iErrors < 4) LOGE("%s N=%ld P=%d: index %ld -> rank %d local %ld", sName, Part.lN(), Part.iParts(), lIndex, iOwner, lLocal);
+            iErrors++;
+            continue;
+        }
+        /** Positions at a rank come in increasing index order */
+        iErrors += lLocal != vecSeen[iOwner]++;
+        if (Part.bContiguous()) iErrors += lIndex < Part.Low(iOwner) or lIndex > Part.High(iOwner);
+    }
+    int64_t lTotal = 0;
+    for (int iRank = 0; iRank < Part.iParts(); ++iRank) {
+        iErrors += vecSeen[iRank] != Part.Size(iRank);
+        if (Part.Size(iRank) > 0) iErrors += Part.Global(iRank, 0) != Part.Low(iRank) or Part.Global(iRank, Part.Size(iRank) - 1) != Part.High(iRank);
+        lTotal += Part.Size(iRank);
+    }
+    iErrors += lTotal != Part.lN();
+    return iErrors;
+}
+
+int CheckKinds() {
+    int iErrors = 0;
+    std::mt19937 Rng(3);
+    for (int64_t lN : { 0, 1, 7, 64, 97, 1000 }) {
+        for (int iParts : { 1, 2, 3, 8, 13 }) {
+            iErrors += CheckRoundTrip(Partition<int64_t>::Block(lN, iParts), "block");
+            iErrors += CheckRoundTrip(Partition<int64_t>::Cyclic(lN, iParts), "cyclic");
+            for (int64_t lBlock : { 1, 4, 10 }) iErrors += CheckRoundTrip(Partition<int64_t>::BlockCyclic(lN, iParts, lBlock), "block-cyclic");
+
+            /** Block sizes differ by at most one, larger ones first */
+            const auto Block = Partition<int64_t>::Block(lN, iParts);
+            for (int iRank = 1; iRank < iParts; ++iRank) iErrors += Block.Size(iRank - 1) < Block.Size(iRank) or Block.Size(0) - Block.Size(iRank) > 1;
+
+            /** Even, random and very skewed speeds, with idle ranks */
+            std::vector<double> vecEven(iParts, 1.0), vecRandom(iParts), vecSkewed(iParts, 0.0);
+            for (double& dWeight : vecRandom) dWeight = std::uniform_real_distribution<double>(0.0, 4.0)(Rng);
+            vecSkewed[iParts - 1] = 1.0;
+            for (const auto& vecWeights : { vecEven, vecRandom, vecSkewed }) {
+                const std::vector<int64_t> vecBounds = WeightedBounds<int64_t>(lN, vecWeights);
+                iErrors += vecBounds.front() != 0 or vecBounds.back() != lN;
+                iErrors += CheckRoundTrip(Partition<int64_t>::Weighted(lN, iParts, vecBounds.data()), "weighted");
+            }
+        }
+    }
+
+    /** Shares follow the weights */
+    const std::vector<int64_t> vecBounds = WeightedBounds<int64_t>(1000, { 1.0, 3.0, 0.0, 4.0 });
+    iErrors += vecBounds != std::vector<int64_t>({ 0, 125, 500, 500, 1000 });
+    iErrors += Partition<int64_t>::Weighted(1000, 4, vecBounds.data()).Owner(500) != 3;
+    /** No weight at all splits evenly */
+    iErrors += WeightedBounds<int64_t>(9, { 0.0, 0.0, 0.0 }) != std::vector<int64_t>({ 0, 3, 6, 9 });
+    return iErrors;
+}
+
+/**
+ * @brief test_Partition
+ *
+ * Round trips of every kind of partition on every process, then each
+ * process sums its cyclic share of 0..N-1 and the shares must add up.
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = CheckKinds();
+
+    const int64_t lN = 100003;
+    const auto Terms = Partition<int64_t>::Cyclic(lN, Processor.iSize());
+    int64_t lLocal = 0, lSum = 0;
+    for (int64_t j = 0; j < Terms.Size(Processor.iRank()); ++j) lLocal += Terms.Global(Processor.iRank(), j);
+    MPI_Allreduce(&lLocal, &lSum, 1, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+    iErrors += lSum != lN * (lN - 1) / 2;
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("Partition: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
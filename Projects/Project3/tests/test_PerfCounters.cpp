@@ -0,0 +1,80 @@
+#include "Bench.hpp"
+#include "PerfCounters.hpp"
+#include "debug.h"
+#include <unistd.h>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace mpimath;
+
+bool Near(double dValue, double dExpected) {
+    return std::fabs(dValue - dExpected) <= 1e-9 * std::max(1.0, std::fabs(dExpected));
+}
+
+/**
+ * @brief test_PerfCounters, runs with or without access to the counters
+ *
+ */
+int main(int argc, char** argv) {
+    int iErrors = 0;
+    /** mpirun may start several copies in the same directory */
+    const std::string sReport = "test_perf_report_" + std::to_string(getpid());
+    /** Fixed peaks, before anything reads them */
+    setenv(PERF_PEAK_GFLOPS_ENV, "10", 1);
+    setenv(PERF_PEAK_GBYTES_ENV, "5", 1);
+    iErrors += not Near(PerfPeakGFlops(), 10) or not Near(PerfPeakGFlops(4), 20) or not Near(PerfPeakGBytes(), 5);
+
+    PerfCounters Counters;
+    tPerfSample Begin = Counters.Read();
+    volatile double dSum = 0;
+    for (int idx = 0; idx < 1000000; ++idx) dSum = dSum + idx * 0.5;
+    tPerfSample Delta = PerfDelta(Counters.Read(), Begin);
+    if (Counters.bAvailable()) {
+        iErrors += Delta.uMask == 0;
+        if (PerfHas(Delta, emPerfEvent::INSTRUCTIONS)) iErrors += Delta.aulValues[(int)emPerfEvent::INSTRUCTIONS] < 1000000;
+        LOGI("Counters available, mask %x", Delta.uMask);
+    } else {
+        iErrors += Delta.uMask != 0;
+        LOGI("Counters unavailable, checking the fallback only");
+    }
+
+    /** Derived metrics of a made up sample */
+    tPerfSample Sample = { { 1000, 2500, 400, 40, 100, 25 }, 0x3f };
+    tPerfMetrics Metrics = PerfMetrics(Sample, 6400, 1e9, 1e-6);
+    iErrors += not Near(Metrics.dIPC, 2.5) or not Near(Metrics.dL1MissRate, 0.1) or not Near(Metrics.dLLCMissRate, 0.25);
+    /** 25 misses of 64 bytes for 6400 flops: 4 flop/byte, above the ridge of 10 / 5 */
+    iErrors += not Near(Metrics.dGFlops, 6.4) or not Near(Metrics.dPeakFraction, 0.64) or not Near(Metrics.dIntensity, 4);
+    iErrors += not Near(Metrics.dBytesPerFlop, 0.25) or not Near(Metrics.dRoofGFlops, 10) or std::string(Metrics.sBound) != "compute";
+
+    /** Nothing counted: the caller's bytes place it on the roofline */
+    tPerfSample None = { { 0 }, 0 };
+    Metrics = PerfMetrics(None, 1000, 1000, 1e-6);
+    iErrors += Metrics.dIPC >= 0 or Metrics.dL1MissRate >= 0 or Metrics.dLLCMissRate >= 0;
+    iErrors += not Near(Metrics.dIntensity, 1) or not Near(Metrics.dRoofGFlops, 5) or std::string(Metrics.sBound) != "memory";
+    Metrics = PerfMetrics(None, 0, 0, 0);
+    iErrors += Metrics.dGFlops >= 0 or std::string(Metrics.sBound) != "n/a";
+
+    /** Bench reports the metrics with --perf, the baseline still loads */
+    tBenchConfig Config = { 0, 3, 0, true };
+    std::vector<tBenchResult> vecResults;
+    vecResults.push_back(BenchRun("case/perf", Config, 2e6, 8e6, [&] {
+        for (int idx = 0; idx < 100000; ++idx) dSum = dSum + idx;
+    }));
+    Config.bPerf = false;
+    vecResults.push_back(BenchRun("case/plain", Config, 0, 0, [] {}));
+    iErrors += not vecResults[0].bPerf or vecResults[1].bPerf;
+    for (const char* sFormat : { "json", "csv" }) {
+        iErrors += BenchWrite(sReport, sFormat, vecResults) != MATRIX_OK;
+        std::ifstream File(sReport);
+        std::stringstream Stream;
+        Stream << File.rdbuf();
+        iErrors += Stream.str().find("roof_gflops") == std::string::npos;
+        std::map<std::string, double> mapBaseline;
+        iErrors += BenchLoadBaseline(sReport, mapBaseline) != MATRIX_OK or mapBaseline.size() != 2;
+    }
+    remove(sReport.c_str());
+
+    LOGI("PerfCounters: %d errors", iErrors);
+    return iErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "csv.hpp"
+#include "debug.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace mpimath;
+
+/**
+ * @brief ParseDouble must agree bit for bit with strtod
+ *
+ */
+int CheckParseDouble() {
+    std::mt19937_64 Rng(42);
+    int iErrors = 0;
+    char acBuf[128];
+    auto Check = [&](const char* sText) {
+        double dFast = 0, dRef = strtod(sText, nullptr);
+        const char* pEnd = ParseDouble(sText, sText + strlen(sText), &dFast);
+        if (pEnd == nullptr or (memcmp(&dFast, &dRef, sizeof(double)) != 0 and not (std::isnan(dFast) and std::isnan(dRef)))) {
+            if (iErrors < 8) LOGE("ParseDouble(\"%s\") = %.17g, strtod gives %.17g", sText, dFast, dRef);
+            iErrors++;
+        }
+    };
+
+    const char* asSpecial[] = {
+        "0", "-0", "0.0", "1", "-1", ".5", "5.", "1e308", "1.7976931348623157e308", "1.7976931348623159e308",
+        "2.2250738585072014e-308", "4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "1e-400", "1e400", "9007199254740993", "9007199254740992.5", "123456789012345678901234567890",
+        "0.000000000000000000000000000001234", "3.14159265358979323846264338327950288", "1E5", "1e+05", "-2.5E-3",
+        "7.2057594037927933e16", "inf", "-inf", "nan", "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124", "-1.906823460215680610e+00",
+    };
+    for (auto sText : asSpecial) Check(sText);
+
+    for (int iter = 0; iter < 200000; ++iter) {
+        uint64_t ulBits = Rng();
+        double dValue;
+        memcpy(&dValue, &ulBits, sizeof(dValue));
+        if (not std::isfinite(dValue)) continue;
+        switch (iter % 4) {
+            case 0: snprintf(acBuf, sizeof(acBuf), "%.17g", dValue); break;
+            case 1: snprintf(acBuf, sizeof(acBuf), "%.6e", dValue); break;
+            case 2: snprintf(acBuf, sizeof(acBuf), "%.5f", std::ldexp((double)(Rng() % 100000000), -(int)(Rng() % 20))); break;
+            default: snprintf(acBuf, sizeof(acBuf), "%llue%d", (unsigned long long)(Rng() >> (Rng() % 64)), (int)(Rng() % 700) - 350); break;
+        }
+        Check(acBuf);
+    }
+    return iErrors;
+}
+
+int WriteFile(const char* sPath, const char* sContent) {
+    FILE* pFile = fopen(sPath, "w");
+    fputs(sContent, pFile);
+    fclose(pFile);
+    return 0;
+}
+
+int CheckSemantics() {
+    int iErrors = 0;
+    const char* sPath = "test_ReadCSV.csv";
+    Matrix2D<double> Mat;
+
+    /** numpy style trailing ',', CRLF, blanks and blank lines at the end */
+    WriteFile(sPath, "1,2,3,\r\n4, 5 ,6e1,\r\n\n\n");
+    iErrors += Mat.ReadCSV(sPath) != MATRIX_OK;
+    iErrors += Mat.ulRow() != 2 or Mat.ulCol() != 3 or Mat.pData()[5] != 60.0 or Mat.pData()[4] != 5.0;
+
+    /** No newline at the end */
+    WriteFile(sPath, "1.5,-2\n3,4");
+    iErrors += Mat.ReadCSV(sPath) != MATRIX_OK or Mat.ulRow() != 2 or Mat.pData()[3] != 4.0;
+
+    /** Other element types go through the row buffer */
+    Matrix2D<int32_t> MatInt;
+    iErrors += MatInt.ReadCSV(sPath) != MATRIX_OK or MatInt.pData()[1] != -2;
+    Matrix2D<float> MatFloat;
+    iErrors += MatFloat.ReadCSV(sPath) != MATRIX_OK or MatFloat.pData()[0] != 1.5f;
+
+    /** Ragged rows */
+    WriteFile(sPath, "1,2,3\n4,5\n");
+    iErrors += Mat.ReadCSV(sPath) != MATRIX_ERR_SHAPE;
+    WriteFile(sPath, "1,2\n4,5,6\n");
+    iErrors += Mat.ReadCSV(sPath) != MATRIX_ERR_SHAPE;
+    WriteFile(sPath, "1,2\n\n4,5\n");
+    iErrors += Mat.ReadCSV(sPath) != MATRIX_ERR_SHAPE;
+
+    /** Not a number */
+    WriteFile(sPath, "1,x\n");
+    iErrors += Mat.ReadCSV(sPath) != MATRIX_ERR_DATA;
+
+    /** Empty and missing files */
+    WriteFile(sPath, "");
+    iErrors += Mat.ReadCSV(sPath) != MATRIX_ERR_DATA;
+    remove(sPath);
+    iErrors += Mat.ReadCSV(sPath) != MATRIX_ERR_IO;
+    return iErrors;
+}
+
+/**
+ * @brief The previous reader: getline, stringstream and stod per token
+ *
+ */
+size_t ReadCSVGetline(const std::string& sPath, std::vector<std::vector<double>>& vecData) {
+    std::ifstream InFile(sPath);
+    std::string sLine;
+    while (std::getline(InFile, sLine)) {
+        std::stringstream ssReadStr(sLine);
+        std::vector<double> vecDataLine;
+        std::string sNumber;
+        while (std::getline(ssReadStr, sNumber, ',')) {
+            vecDataLine.push_back(std::stod(sNumber));
+        }
+        vecData.push_back(vecDataLine);
+    }
+    return vecData.size();
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckParseDouble();
+        iErrors += CheckSemantics();
+        LOGI("CSV parser: %d errors", iErrors);
+
+        /** Throughput on a 1000 x 1000 matrix printed with 17 digits */
+        const size_t ulDim = 1000;
+        const char* sPath = "test_ReadCSV_big.csv";
+        Matrix2D<double> MatRef(ulDim, ulDim);
+        std::mt19937 Rng(1);
+        std::normal_distribution<double> Dist;
+        FILE* pFile = fopen(sPath, "w");
+        for (size_t row = 0; row < ulDim; ++row) {
+            for (size_t col = 0; col < ulDim; ++col) {
+                MatRef.pData()[row * ulDim + col] = Dist(Rng);
+                fprintf(pFile, col + 1 < ulDim ? "%.17g," : "%.17g\n", MatRef.pData()[row * ulDim + col]);
+            }
+        }
+        double dBytes = (double)ftell(pFile);
+        fclose(pFile);
+
+        Matrix2D<double> Mat;
+        MPITimer Timer;
+        iErrors += Mat.ReadCSV(sPath) != MATRIX_OK;
+        double dFast = Timer.TimeDelta();
+        iErrors += memcmp(Mat.pData(), MatRef.pData(), MatRef.ulDataSize()) != 0;
+        Timer.Reset();
+        std::vector<std::vector<double>> vecData;
+        ReadCSVGetline(sPath, vecData);
+        double dSlow = Timer.TimeDelta();
+        LOGI("%.1f MB: ReadCSV %.1f MB/s, getline + stod %.1f MB/s", dBytes / 1e6, dBytes / 1e6 / dFast, dBytes / 1e6 / dSlow);
+        remove(sPath);
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPIRegionTimer.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace mpimath;
+
+const tRegionSummary* Find(const std::vector<tRegionSummary>& vecSummary, const char* sPath) {
+    for (const auto& Summary : vecSummary) {
+        if (Summary.sPath == sPath) return &Summary;
+    }
+    LOGE("Region %s not found", sPath);
+    return nullptr;
+}
+
+/**
+ * @brief test_RegionTimer, built with CONFIG_ENABLE_TRACE=1 and a ring of 256 events
+ *
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    const int iSize = Processor.iSize();
+    int iErrors = 0;
+
+    /** Nested regions, the last rank is slower */
+    for (int iRun = 0; iRun < 3; ++iRun) {
+        REGION_SCOPE("outer");
+        REGION_BYTES(10);
+        for (int idx = 0; idx < 2; ++idx) {
+            REGION_SCOPE("inner");
+            REGION_BYTES(100);
+            usleep(Processor.iRank() == iSize - 1 ? 4000 : 1000);
+        }
+    }
+    std::thread Thread([] {
+        REGION_SCOPE("thread");
+        REGION_SCOPE("child");
+    });
+    Thread.join();
+
+    std::vector<tRegionSummary> vecSummary;
+    const char* sTrace = "test_region_trace.json";
+    iErrors += MPIRegionMerge(MPI_COMM_WORLD, vecSummary, sTrace) != MPI_SUCCESS;
+    ON_MAIN_PROC(Processor) {
+        const tRegionSummary* pOuter = Find(vecSummary, "outer");
+        const tRegionSummary* pInner = Find(vecSummary, "outer/inner");
+        const tRegionSummary* pChild = Find(vecSummary, "thread/child");
+        if (pOuter == nullptr or pInner == nullptr or pChild == nullptr) {
+            iErrors++;
+        } else {
+            iErrors += pOuter->iRanks != iSize or pOuter->ulCalls != 3ul * iSize or pOuter->ulBytes != 30ul * iSize;
+            iErrors += pInner->ulCalls != 6ul * iSize or pInner->ulBytes != 600ul * iSize;
+            iErrors += pInner->dMin < 0.006 or pInner->dMax < 0.024 or pOuter->dAvg < pInner->dAvg;
+            iErrors += pInner->dMin > pInner->dAvg or pInner->dAvg > pInner->dMax;
+            if (iSize > 1) iErrors += pInner->dImbalance < 1.2;
+            iErrors += pChild->ulCalls != (uint64_t)iSize;
+        }
+        iErrors += vecSummary.size() != 4;
+
+        /** One complete event per region and one name per rank */
+        std::ifstream File(sTrace);
+        std::stringstream Stream;
+        Stream << File.rdbuf();
+        const std::string sJson = Stream.str();
+        size_t ulComplete = 0, ulNames = 0;
+        for (size_t ulAt = sJson.find("\"ph\": \"X\""); ulAt != std::string::npos; ulAt = sJson.find("\"ph\": \"X\"", ulAt + 1)) ulComplete++;
+        for (size_t ulAt = sJson.find("\"ph\": \"M\""); ulAt != std::string::npos; ulAt = sJson.find("\"ph\": \"M\"", ulAt + 1)) ulNames++;
+        iErrors += ulComplete != 11ul * iSize or ulNames != (size_t)iSize;
+        iErrors += sJson.find("\"path\": \"outer/inner\", \"bytes\": 100") == std::string::npos;
+        iErrors += sJson.compare(0, 1, "{") != 0 or sJson.find("]}") == std::string::npos;
+        remove(sTrace);
+    }
+
+    /** Collected events are gone, an overflowing ring keeps the newest */
+    for (int idx = 0; idx < CONFIG_TRACE_RING_SIZE + 44; ++idx) {
+        REGION_SCOPE("many");
+    }
+    iErrors += MPIRegionMerge(MPI_COMM_WORLD, vecSummary) != MPI_SUCCESS;
+    ON_MAIN_PROC(Processor) {
+        iErrors += vecSummary.size() != 1 or vecSummary[0].sPath != "many" or
+                   vecSummary[0].ulCalls != (uint64_t)CONFIG_TRACE_RING_SIZE * iSize;
+    }
+
+    /** Every phase of MPIMatMulMain / Worker */
+    Matrix2D<double> M(40, 30), N(30, 20);
+    ON_MAIN_PROC(Processor) {
+        MPIMatMulMain(M, N, Processor);
+    } else {
+        MPIMatMulWorker<double>(Processor);
+    }
+    iErrors += MPIRegionMerge(MPI_COMM_WORLD, vecSummary) != MPI_SUCCESS;
+    ON_MAIN_PROC(Processor) {
+        for (const char* sPath : { "MatMulMain", "MatMulMain/bcast_ctx", "MatMulMain/bcast_n", "MatMulMain/scatter", "MatMulMain/gather" }) {
+            iErrors += Find(vecSummary, sPath) == nullptr;
+        }
+        if (iSize > 1) {
+            for (const char* sPath : { "MatMulWorker/bcast_n", "MatMulWorker/recv", "MatMulWorker/compute", "MatMulWorker/send" }) {
+                const tRegionSummary* pSummary = Find(vecSummary, sPath);
+                iErrors += pSummary == nullptr or pSummary->iRanks != iSize - 1;
+            }
+            iErrors += Find(vecSummary, "MatMulMain/scatter")->ulBytes != 40 * 30 * sizeof(double);
+        }
+        LOGI("RegionTimer: %d errors", iErrors);
+    }
+    MPIRegionFinalize();
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
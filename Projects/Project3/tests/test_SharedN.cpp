@@ -0,0 +1,70 @@
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "SharedMatrix.hpp"
+#include "debug.h"
+#include <cstdlib>
+#include <random>
+
+using namespace mpimath;
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+    const tNodeComms& Comms = NodeComms();
+
+    /** Every process of a node reads the same bytes, filled from world rank 0 */
+    {
+        std::vector<int64_t> vecRoot(1000);
+        for (size_t idx = 0; idx < vecRoot.size(); ++idx) vecRoot[idx] = (int64_t)(idx * idx);
+        SharedMatrix<int64_t> Shared(10, 100);
+        tCodecConfig Raw = { emCodecMode::NONE, 0, CODEC_DEFAULT_CHUNK_BYTES };
+        tCodecConfig Lossless = { emCodecMode::LOSSLESS, 0, 1024 };
+        for (auto& Codec : { Raw, Lossless }) {
+            iErrors += Shared.Bcast(Processor.iRank() == 0 ? vecRoot.data() : nullptr, Codec) != MPI_SUCCESS;
+            iErrors += memcmp(Shared.pData(), vecRoot.data(), vecRoot.size() * sizeof(int64_t)) != 0;
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+    }
+
+    /** MPIMatMulMain with private and shared N, raw and encoded */
+    const size_t ulM = 301, ulK = 257, ulN = 263;
+    Matrix2D<double> M(ulM, ulK), N(ulK, ulN), Ref;
+    ON_MAIN_PROC(Processor) {
+        std::mt19937 Rng(8);
+        std::normal_distribution<double> Dist;
+        for (size_t idx = 0; idx < M.Size(); ++idx) M.pData()[idx] = Dist(Rng);
+        for (size_t idx = 0; idx < N.Size(); ++idx) N.pData()[idx] = Dist(Rng);
+        Ref = M * N;
+    }
+    const char* asCases[] = { "private N", "shared N", "shared N + lossless codec" };
+    for (int iCase = 0; iCase < 3 and Processor.iSize() > 1; ++iCase) {
+        ON_MAIN_PROC(Processor) {
+            setenv("MPIMATH_SHARED_N", iCase > 0 ? "1" : "0", 1);
+            tCodecConfig Codec = { iCase == 2 ? emCodecMode::LOSSLESS : emCodecMode::NONE, 0, 64 << 10 };
+            MPITimer Timer;
+            auto Res = MPIMatMulMain(M, N, Processor, Codec);
+            double dTime = Timer.TimeDelta();
+            if (memcmp(Res.pData(), Ref.pData(), Ref.ulDataSize()) != 0) {
+                LOGE("%s: result differs", asCases[iCase]);
+                iErrors++;
+            }
+            /** Copies of N on this node: one per process, or the window alone */
+            int iCopies = iCase > 0 ? 1 : Comms.iNodeSize - 1;
+            LOGI("%-26s %.4fs, %d process(es) on the node, %d copy of N (%.1f KB each)",
+                 asCases[iCase], dTime, Comms.iNodeSize, iCopies, N.ulDataSize() / 1024.0);
+        } else {
+            MPIMatMulWorker<double>(Processor);
+        }
+    }
+
+    int iTotal = 0;
+    MPI_Allreduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("Shared N: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "SparseMatrix.hpp"
+#include "debug.h"
+#include <cmath>
+#include <random>
+
+using namespace mpimath;
+
+/**
+ * @brief Random matrix with about dDensity of its elements non zero, the
+ * first rows are much denser to make row-count partitioning unbalanced
+ *
+ */
+template<typename T>
+Matrix2D<T> RandomSparse(size_t ulRow, size_t ulCol, double dDensity, unsigned uSeed) {
+    std::mt19937 Rng(uSeed);
+    std::uniform_real_distribution<double> Dist(0, 1);
+    Matrix2D<T> Res(ulRow, ulCol, true);
+    for (size_t row = 0; row < ulRow; ++row) {
+        double dRowDensity = row < ulRow / 10 ? dDensity * 8 : dDensity;
+        for (size_t col = 0; col < ulCol; ++col) {
+            if (Dist(Rng) < dRowDensity) Res.pData()[row * ulCol + col] = (T)(Dist(Rng) * 2 - 1);
+        }
+    }
+    return Res;
+}
+
+template<typename T>
+int Compare(const T* pA, const T* pB, size_t ulSize, double dTol, const char* sWhat) {
+    for (size_t idx = 0; idx < ulSize; ++idx) {
+        if (std::fabs((double)pA[idx] - (double)pB[idx]) > dTol) {
+            LOGE("%s differs at %zu: %f vs %f", sWhat, idx, (double)pA[idx], (double)pB[idx]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+template<typename T>
+int CheckKernels(size_t ulRow, size_t ulCol, size_t ulNCol, double dTol) {
+    int iErrors = 0;
+    auto MatDense = RandomSparse<T>(ulRow, ulCol, 0.03, 11);
+    auto MatA = CSRMatrix<T>::FromDense(MatDense);
+    auto MatN = RandomSparse<T>(ulCol, ulNCol, 1.0, 12);
+    Matrix2D<T> MatRef(ulRow, ulNCol);
+    gemm<T, T>(MatRef.pData(), MatDense.pData(), MatN.pData(), ulRow, ulCol, ulCol, ulNCol);
+
+    /** SpMV against the first column of the dense product */
+    std::vector<T> vecX(ulCol), vecY(ulRow), vecYRef(ulRow, T(0));
+    for (size_t idx = 0; idx < ulCol; ++idx) vecX[idx] = MatN.pData()[idx * ulNCol];
+    for (size_t row = 0; row < ulRow; ++row) vecYRef[row] = MatRef.pData()[row * ulNCol];
+    MatA.SpMV(vecX.data(), vecY.data());
+    iErrors += Compare(vecY.data(), vecYRef.data(), ulRow, dTol, "CSR SpMV");
+    MatA.SpMV(vecX.data(), vecY.data(), 3);
+    iErrors += Compare(vecY.data(), vecYRef.data(), ulRow, dTol, "CSR SpMV 3 threads");
+
+    auto MatRes = MatA * MatN;
+    iErrors += Compare(MatRes.pData(), MatRef.pData(), MatRef.Size(), dTol, "CSR SpMM");
+
+    for (size_t ulBlock : { 1, 3, 4 }) {
+        auto MatB = BSRMatrix<T>::FromCSR(MatA, ulBlock);
+        MatB.SpMV(vecX.data(), vecY.data(), 2);
+        iErrors += Compare(vecY.data(), vecYRef.data(), ulRow, dTol, "BSR SpMV");
+        auto MatBRes = MatB * MatN;
+        iErrors += Compare(MatBRes.pData(), MatRef.pData(), MatRef.Size(), dTol, "BSR SpMM");
+    }
+    return iErrors;
+}
+
+int CheckIO() {
+    int iErrors = 0;
+    auto MatA = CSRMatrix<double>::FromDense(RandomSparse<double>(37, 29, 0.05, 5));
+    CSRMatrix<double> MatMTX, MatBin;
+
+    iErrors += MatA.DumpMTX("test_SpMM.mtx") != MATRIX_OK;
+    iErrors += MatMTX.ReadMTX("test_SpMM.mtx") != MATRIX_OK;
+    iErrors += MatA.DumpBinary("test_SpMM.bin") != MATRIX_OK;
+    iErrors += MatBin.ReadBinary("test_SpMM.bin") != MATRIX_OK;
+    if (iErrors != 0) {
+        LOGE("Sparse IO failed");
+        return iErrors;
+    }
+    auto MatRef = MatA.ToDense();
+    iErrors += Compare(MatMTX.ToDense().pData(), MatRef.pData(), MatRef.Size(), 0, "MTX round trip");
+    iErrors += Compare(MatBin.ToDense().pData(), MatRef.pData(), MatRef.Size(), 0, "binary round trip");
+
+    /** Wrong element size is a shape error */
+    CSRMatrix<float> MatFloat;
+    iErrors += MatFloat.ReadBinary("test_SpMM.bin") != MATRIX_ERR_SHAPE;
+    remove("test_SpMM.mtx");
+    remove("test_SpMM.bin");
+    return iErrors;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckKernels<double>(203, 171, 19, 1e-9);
+        iErrors += CheckKernels<float>(203, 171, 19, 1e-4);
+        iErrors += CheckKernels<double>(5, 3, 1, 1e-9);
+        iErrors += CheckIO();
+        LOGI("Sparse kernels: %d errors", iErrors);
+
+        /** SpMV vs dense gemv on a 98% sparse matrix */
+        const size_t ulDim = 3000;
+        auto MatDense = RandomSparse<double>(ulDim, ulDim, 0.02, 3);
+        auto MatA = CSRMatrix<double>::FromDense(MatDense);
+        std::vector<double> vecX(ulDim, 1.0), vecY(ulDim);
+        MPITimer Timer;
+        for (int iter = 0; iter < 10; ++iter) MatA.SpMV(vecX.data(), vecY.data());
+        double dSparse = Timer.TimeDelta();
+        Timer.Reset();
+        Matrix2D<double> MatX(ulDim, 1), MatY(ulDim, 1);
+        MatX.fill(1.0);
+        for (int iter = 0; iter < 10; ++iter) gemm(MatY.pData(), MatDense.pData(), MatX.pData(), ulDim, ulDim, ulDim, 1);
+        LOGI("%zux%zu nnz=%zu, 10 x SpMV %fs, 10 x dense %fs", ulDim, ulDim, MatA.ulNnz(), dSparse, Timer.TimeDelta());
+    }
+
+    /** Rows distributed by nonzero count */
+    {
+        auto MatDense = RandomSparse<double>(301, 97, 0.04, 9);
+        auto MatN = RandomSparse<double>(97, 13, 1.0, 10);
+        ON_MAIN_PROC(Processor) {
+            auto MatA = CSRMatrix<double>::FromDense(MatDense);
+            auto MatRes = MPISpMMMain(MatA, MatN, Processor);
+            auto MatRef = MatA * MatN;
+            int iMPIErrors = Compare(MatRes.pData(), MatRef.pData(), MatRef.Size(), 0, "MPISpMM");
+            LOGI("MPISpMM on %d procs: %d errors", Processor.iSize(), iMPIErrors);
+            iErrors += iMPIErrors;
+        } else {
+            MPISpMMWorker<double>(Processor);
+        }
+    }
+
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
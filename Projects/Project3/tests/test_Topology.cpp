@@ -0,0 +1,111 @@
+#include "MPIProcessorInfo.hpp"
+#include "SharedMatrix.hpp"
+#include "debug.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** A fake sysfs: 2 sockets x 2 cores x 2 threads, one NUMA node per socket, with caches */
+std::string MakeFakeSysfs() {
+    const std::string sRoot = "test_Topology_sysfs_" + std::to_string(getpid());
+    auto Write = [](const std::string& sPath, const std::string& sLine) {
+        for (size_t ulPos = sPath.find('/'); ulPos != std::string::npos; ulPos = sPath.find('/', ulPos + 1)) {
+            mkdir(sPath.substr(0, ulPos).c_str(), 0755);
+        }
+        FILE* pFile = fopen(sPath.c_str(), "w");
+        fprintf(pFile, "%s\n", sLine.c_str());
+        fclose(pFile);
+    };
+    Write(sRoot + "/cpu/online", "0-7");
+    for (int iCpu = 0; iCpu < 8; ++iCpu) {
+        const std::string sCpu = sRoot + "/cpu/cpu" + std::to_string(iCpu);
+        /** cpu n and n + 4 are hyperthreads of one core */
+        Write(sCpu + "/topology/physical_package_id", std::to_string((iCpu % 4) / 2));
+        Write(sCpu + "/topology/core_id", std::to_string(iCpu % 2));
+    }
+    const char* asCache[][3] = { { "1", "Data", "48K" }, { "1", "Instruction", "32K" }, { "2", "Unified", "2048K" }, { "3", "Unified", "32M" } };
+    for (int iIndex = 0; iIndex < 4; ++iIndex) {
+        const std::string sCache = sRoot + "/cpu/cpu0/cache/index" + std::to_string(iIndex);
+        Write(sCache + "/level", asCache[iIndex][0]);
+        Write(sCache + "/type", asCache[iIndex][1]);
+        Write(sCache + "/size", asCache[iIndex][2]);
+    }
+    Write(sRoot + "/node/online", "0-1");
+    Write(sRoot + "/node/node0/cpulist", "0-1,4-5");
+    Write(sRoot + "/node/node1/cpulist", "2-3,6-7");
+    return sRoot;
+}
+
+int CheckProbe() {
+    int iErrors = 0;
+    iErrors += _ParseCpuList("0-3,8,10-11") != std::vector<int>({ 0, 1, 2, 3, 8, 10, 11 });
+    iErrors += not _ParseCpuList("").empty();
+    iErrors += _ParseCacheSize("48K") != 48 << 10 or _ParseCacheSize("32M") != 32 << 20;
+
+    const std::string sRoot = MakeFakeSysfs();
+    tCpuTopology Topo = ProbeCpuTopology(sRoot);
+    iErrors += Topo.vecCpus.size() != 8 or Topo.iPackages != 2 or Topo.iNumaNodes != 2;
+    iErrors += Topo.vecCpuNuma != std::vector<int>({ 0, 0, 1, 1, 0, 0, 1, 1 });
+    iErrors += Topo.vecCpuCore[0] != Topo.vecCpuCore[4] or Topo.vecCpuCore[0] == Topo.vecCpuCore[2];
+    iErrors += Topo.ulL1D != 48 << 10 or Topo.ulL2 != 2048 << 10 or Topo.ulL3 != 32 << 20;
+    system(("rm -rf " + sRoot).c_str());
+
+    /** No sysfs at all: every online CPU on one socket */
+    Topo = ProbeCpuTopology("/nonexistent");
+    iErrors += Topo.vecCpus.empty() or Topo.iPackages != 1 or Topo.iNumaNodes != 1 or Topo.ulL1D != 0;
+    if (iErrors) LOGE("ProbeCpuTopology: %d errors", iErrors);
+    return iErrors;
+}
+
+/**
+ * @brief test_Topology
+ *
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckProbe();
+    }
+
+    /** The node view agrees with MPI and with SharedMatrix */
+    const tMPITopology& Topo = Processor.Topology();
+    int iNodeSize;
+    MPI_Comm_size(Processor.NodeComm(), &iNodeSize);
+    iErrors += iNodeSize != Processor.iNodeSize() or Processor.iNodeRank() >= iNodeSize;
+    iErrors += mpimath::NodeComms().NodeComm != Processor.NodeComm();
+    iErrors += (Processor.iNodeRank() == 0) != (Processor.LeaderComm() != MPI_COMM_NULL);
+    iErrors += not Processor.bSameNode(Processor.iRank()) or Processor.iNodeOf(0) != 0;
+    iErrors += (int)Topo.vecNodeMajor.size() != Processor.iSize() or Topo.vecNodeMajor[0] != 0;
+    int iOnMyNode = 0;
+    for (int iRank = 0; iRank < Processor.iSize(); ++iRank) iOnMyNode += Processor.bSameNode(iRank);
+    iErrors += iOnMyNode != Processor.iNodeSize();
+
+    /** Two level reduction */
+    long lRank = Processor.iRank(), lSum = -1;
+    Processor.NodeReduce(&lRank, &lSum, 1, MPI_LONG, MPI_SUM);
+    ON_MAIN_PROC(Processor) {
+        iErrors += lSum != (long)Processor.iSize() * (Processor.iSize() - 1) / 2;
+    }
+
+    /** Binding lands on an online CPU, or is refused by the sandbox */
+    const int iCpu = Processor.Bind(emBindPolicy::CORE);
+    if (iCpu >= 0) {
+        iErrors += std::find(Topo.Cpu.vecCpus.begin(), Topo.Cpu.vecCpus.end(), iCpu) == Topo.Cpu.vecCpus.end();
+        iErrors += sched_getcpu() != iCpu;
+    }
+    iErrors += Processor.Bind(emBindPolicy::NONE) != -1;
+    ON_MAIN_PROC(Processor) {
+        LOGI("%d node(s), %d process(es) here, %zu CPU(s), %d socket(s), %d NUMA node(s), L1D %zu KB, L2 %zu KB, L3 %zu KB, bound to %d",
+             Processor.iNodeCount(), Processor.iNodeSize(), Topo.Cpu.vecCpus.size(), Topo.Cpu.iPackages, Topo.Cpu.iNumaNodes,
+             Topo.Cpu.ulL1D >> 10, Topo.Cpu.ulL2 >> 10, Topo.Cpu.ulL3 >> 10, iCpu);
+    }
+
+    int iTotal = 0;
+    MPI_Reduce(&iErrors, &iTotal, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    ON_MAIN_PROC(Processor) {
+        LOGI("Topology: %d errors", iTotal);
+    }
+    MPI_Finalize();
+    return iTotal == 0 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "Tuning.hpp"
+#include "debug.h"
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+using namespace mpimath;
+
+template<typename T>
+void FillRandom(T* pData, size_t ulSize, unsigned uSeed) {
+    std::mt19937 Rng(uSeed);
+    std::normal_distribution<T> Dist;
+    for (size_t idx = 0; idx < ulSize; ++idx) pData[idx] = Dist(Rng);
+}
+
+/**
+ * @brief Every kernel and blocking against a plain triple loop, odd shapes
+ *
+ */
+template<typename T>
+int CheckKernels(int (*fnGemm)(const tGemmParams&, T*, const T*, const T*, size_t, size_t, size_t, size_t), double dTol) {
+    int iErrors = 0;
+    const size_t aShapes[][3] = { { 1, 1, 1 }, { 3, 5, 7 }, { 17, 33, 19 }, { 64, 64, 64 }, { 101, 67, 130 }, { 8, 300, 9 } };
+    const tGemmParams aParams[] = {
+        { emGemmKernel::NAIVE, 0, 0, 0 },
+        { emGemmKernel::ROW, 0, 0, 0 },
+        { emGemmKernel::UNROLL, 0, 0, 0 },
+        { emGemmKernel::UNROLL, 16, 32, 24 },
+        { emGemmKernel::ROW, 7, 13, 5 },
+        { emGemmKernel::NAIVE, 1, 1, 1 },
+    };
+    for (auto& aShape : aShapes) {
+        const size_t ulM = aShape[0], ulK = aShape[1], ulN = aShape[2];
+        std::vector<T> vecA(ulM * ulK), vecB(ulK * ulN), vecRef(ulM * ulN, 0), vecOut(ulM * ulN);
+        FillRandom(vecA.data(), vecA.size(), 1);
+        FillRandom(vecB.data(), vecB.size(), 2);
+        for (size_t i = 0; i < ulM; ++i)
+            for (size_t k = 0; k < ulK; ++k)
+                for (size_t j = 0; j < ulN; ++j) vecRef[i * ulN + j] += vecA[i * ulK + k] * vecB[k * ulN + j];
+        for (auto& Params : aParams) {
+            std::fill(vecOut.begin(), vecOut.end(), T(-1));
+            iErrors += fnGemm(Params, vecOut.data(), vecA.data(), vecB.data(), ulM, ulK, ulK, ulN) != 0;
+            double dErr = 0;
+            for (size_t idx = 0; idx < vecOut.size(); ++idx) {
+                dErr = std::max(dErr, (double)std::fabs(vecOut[idx] - vecRef[idx]) / (1.0 + std::fabs(vecRef[idx])));
+            }
+            if (dErr > dTol) {
+                LOGE("%zux%zux%zu kernel %s mc=%zu kc=%zu nc=%zu: error %g", ulM, ulK, ulN, GemmKernelName(Params.emKernel),
+                     Params.ulMC, Params.ulKC, Params.ulNC, dErr);
+                iErrors++;
+            }
+        }
+    }
+    iErrors += fnGemm(aParams[0], nullptr, nullptr, nullptr, 2, 3, 4, 5) != -1;
+    return iErrors;
+}
+
+/**
+ * @brief Shape classes, file round trip, entries of another CPU are ignored
+ *
+ */
+int CheckTable() {
+    int iErrors = 0;
+    iErrors += ShapeClassOf(64, 64, 64) != emShapeClass::SMALL;
+    iErrors += ShapeClassOf(4096, 16, 4096) != emShapeClass::SKINNY;
+    iErrors += ShapeClassOf(512, 512, 512) != emShapeClass::MEDIUM;
+    iErrors += ShapeClassOf(1024, 1024, 1024) != emShapeClass::LARGE;
+
+    std::vector<tTuningEntry> vecEntries = {
+        { CPUModel(), "gemm_f64", emShapeClass::MEDIUM, { emGemmKernel::ROW, 32, 128, 256 }, 0, 3.5 },
+        { CPUModel(), "matmul", emShapeClass::LARGE, GemmDefaultParams(), 48, 1.0 },
+        { "Some Other CPU @ 1.00GHz", "gemm_f64", emShapeClass::LARGE, { emGemmKernel::NAIVE, 8, 8, 8 }, 0, 0.1 },
+    };
+    iErrors += SaveTuningFile("test_tuning.txt", vecEntries) != MATRIX_OK;
+    std::vector<tTuningEntry> vecLoaded;
+    iErrors += LoadTuningFile("test_tuning.txt", vecLoaded) != MATRIX_OK;
+    iErrors += vecLoaded.size() != vecEntries.size();
+    for (size_t idx = 0; idx < std::min(vecLoaded.size(), vecEntries.size()); ++idx) {
+        const auto &A = vecLoaded[idx], &B = vecEntries[idx];
+        iErrors += A.sCPU != B.sCPU or A.sOp != B.sOp or A.emShape != B.emShape or A.Gemm.emKernel != B.Gemm.emKernel or
+                   A.Gemm.ulMC != B.Gemm.ulMC or A.Gemm.ulKC != B.Gemm.ulKC or A.Gemm.ulNC != B.Gemm.ulNC or
+                   A.lTileRows != B.lTileRows;
+    }
+    std::vector<tTuningEntry> vecBad;
+    iErrors += LoadTuningFile("test_tuning_missing.txt", vecBad) != MATRIX_ERR_IO;
+    FILE* pFile = fopen("test_tuning_bad.txt", "w");
+    fprintf(pFile, "cpu\tgemm_f64\thuge\tkernel=1\n");
+    fclose(pFile);
+    iErrors += LoadTuningFile("test_tuning_bad.txt", vecBad) != MATRIX_ERR_DATA;
+    remove("test_tuning_bad.txt");
+    return iErrors;
+}
+
+/**
+ * @brief test_Tuning
+ *
+ * Run with MPIMATH_TUNING_FILE=test_tuning.txt written by a previous run to
+ * check that the file is picked up at startup.
+ */
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+    int iErrors = 0;
+
+    ON_MAIN_PROC(Processor) {
+        iErrors += CheckKernels<float>(gemm_f32_tuned, 1e-4);
+        iErrors += CheckKernels<double>(gemm_f64_tuned, 1e-12);
+        iErrors += CheckTable();
+
+        const char* sFile = getenv(TUNING_FILE_ENV);
+        if (sFile != nullptr and std::string(sFile) == "test_tuning.txt") {
+            tGemmParams Params = GemmTuning("gemm_f64", 512, 512, 512);
+            iErrors += Params.emKernel != emGemmKernel::ROW or Params.ulMC != 32 or Params.ulKC != 128 or Params.ulNC != 256;
+            iErrors += MatMulTileRows(1024, 1024, 1024) != 48;
+            iErrors += GemmTuning("gemm_f64", 1024, 1024, 1024).emKernel != GemmDefaultParams().emKernel;
+            LOGI("Tuning file %s loaded", sFile);
+        }
+    }
+
+    /** MPIMatMulMain in tiles of 7 rows, and in one block per worker */
+    const size_t ulM = 301, ulK = 129, ulN = 77;
+    Matrix2D<double> M(ulM, ulK), N(ulK, ulN), Ref;
+    for (long lTileRows : { 7L, 0L }) {
+        ON_MAIN_PROC(Processor) {
+            FillRandom(M.pData(), M.Size(), 3);
+            FillRandom(N.pData(), N.Size(), 4);
+            Ref = M * N;
+            tTuningEntry Entry = { CPUModel(), "matmul", ShapeClassOf(ulM, ulK, ulN), GemmDefaultParams(), lTileRows, 0 };
+            SetTuning(Entry);
+            tCodecConfig Raw = { emCodecMode::NONE, 0, CODEC_DEFAULT_CHUNK_BYTES };
+            Matrix2D<double> Res = MPIMatMulMain(M, N, Processor, Raw);
+            double dErr = 0;
+            for (size_t idx = 0; idx < Ref.Size(); ++idx) dErr = std::max(dErr, std::fabs(Res.pData()[idx] - Ref.pData()[idx]));
+            if (Processor.iSize() > 1 and dErr > 1e-12) {
+                LOGE("tiles of %ld rows: error %g", lTileRows, dErr);
+                iErrors++;
+            }
+        } else {
+            MPIMatMulWorker<double>(Processor);
+        }
+    }
+
+    ON_MAIN_PROC(Processor) {
+        LOGI("Tuning: %d errors", iErrors);
+    }
+    MPI_Finalize();
+    return iErrors == 0 ? 0 : 1;
+}
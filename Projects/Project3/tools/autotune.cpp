@@ -0,0 +1,237 @@
+/**
+ * @file autotune.cpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Sweep gemm kernels, block sizes and MatMul tile rows on this node,
+ * write the best of each shape class to a tuning file
+ * @version 0.1
+ * @date 2022-06-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * mpirun -n P ./autotune [file] [--quick]
+ *
+ * file defaults to $MPIMATH_TUNING_FILE, then mpimath_tuning.txt. Entries of
+ * other CPU models already in the file are kept. The MatMul tile sweep needs
+ * P > 1 and is skipped otherwise.
+ */
+#include "MatMul.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MPITimer.hpp"
+#include "Matrix.hpp"
+#include "Tuning.hpp"
+#include "debug.h"
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+
+using namespace mpimath;
+
+/** Each measurement repeats the product for at least this long and keeps the fastest run */
+#define AUTOTUNE_MIN_SECONDS 0.2
+
+typedef struct {
+    emShapeClass emShape;
+    size_t ulM, ulK, ulN;
+} tShape;
+
+template<typename T>
+void FillRandom(T* pData, size_t ulSize, unsigned uSeed) {
+    std::mt19937 Rng(uSeed);
+    std::uniform_real_distribution<T> Dist(-1, 1);
+    for (size_t idx = 0; idx < ulSize; ++idx) pData[idx] = Dist(Rng);
+}
+
+/**
+ * @brief GFLOP/s of the fastest of repeated runs of fnRun
+ *
+ */
+template<typename Fn>
+double Measure(double dFlops, Fn&& fnRun) {
+    double dBest = 1e30, dSpent = 0;
+    int iRuns = 0;
+    while (iRuns < 2 or dSpent < AUTOTUNE_MIN_SECONDS) {
+        MPITimer Timer;
+        fnRun();
+        double dTime = Timer.TimeDelta();
+        dBest = std::min(dBest, dTime);
+        dSpent += dTime;
+        iRuns++;
+    }
+    return dFlops / dBest / 1e9;
+}
+
+/**
+ * @brief Coordinate descent over kernel, then KC, MC and NC
+ *
+ */
+template<typename T>
+tTuningEntry TuneGemm(const char* sOp, const tShape& Shape,
+                      int (*fnGemm)(const tGemmParams&, T*, const T*, const T*, size_t, size_t, size_t, size_t)) {
+    std::vector<T> vecA(Shape.ulM * Shape.ulK), vecB(Shape.ulK * Shape.ulN), vecC(Shape.ulM * Shape.ulN);
+    FillRandom(vecA.data(), vecA.size(), 1);
+    FillRandom(vecB.data(), vecB.size(), 2);
+    const double dFlops = 2.0 * Shape.ulM * Shape.ulK * Shape.ulN;
+    auto Run = [&](const tGemmParams& Params) {
+        return Measure(dFlops, [&] {
+            fnGemm(Params, vecC.data(), vecA.data(), vecB.data(), Shape.ulM, Shape.ulK, Shape.ulK, Shape.ulN);
+        });
+    };
+
+    tGemmParams Best = GemmDefaultParams();
+    double dBest = Run(Best);
+    auto Try = [&](tGemmParams Params) {
+        double dGFlops = Run(Params);
+        LOGD("%s %s kernel=%s mc=%zu kc=%zu nc=%zu: %.2f GFLOP/s", sOp, ShapeClassName(Shape.emShape),
+             GemmKernelName(Params.emKernel), Params.ulMC, Params.ulKC, Params.ulNC, dGFlops);
+        if (dGFlops > dBest) {
+            dBest = dGFlops;
+            Best = Params;
+        }
+    };
+
+    for (int iKernel = 0; iKernel < (int)emGemmKernel::COUNT; ++iKernel) {
+        if ((emGemmKernel)iKernel == Best.emKernel) continue;
+        Try({ (emGemmKernel)iKernel, 0, 0, 0 });
+    }
+    for (size_t ulKC : { 64, 128, 256, 512 }) {
+        if (ulKC < Shape.ulK) Try({ Best.emKernel, Best.ulMC, ulKC, Best.ulNC });
+    }
+    for (size_t ulMC : { 32, 64, 128, 256 }) {
+        if (ulMC < Shape.ulM) Try({ Best.emKernel, ulMC, Best.ulKC, Best.ulNC });
+    }
+    for (size_t ulNC : { 256, 512, 1024, 2048 }) {
+        if (ulNC < Shape.ulN) Try({ Best.emKernel, Best.ulMC, Best.ulKC, ulNC });
+    }
+    return { CPUModel(), sOp, Shape.emShape, Best, 0, dBest };
+}
+
+/**
+ * @brief Rows of M per message of MPIMatMulMain, collective
+ *
+ */
+tTuningEntry TuneMatMul(const tShape& Shape, MPIProcessorInfo& Processor) {
+    Matrix2D<double> M, N;
+    ON_MAIN_PROC(Processor) {
+        M.Init(Shape.ulM, Shape.ulK);
+        N.Init(Shape.ulK, Shape.ulN);
+        FillRandom(M.pData(), M.Size(), 3);
+        FillRandom(N.pData(), N.Size(), 4);
+    }
+    const double dFlops = 2.0 * Shape.ulM * Shape.ulK * Shape.ulN;
+    tCodecConfig Raw = { emCodecMode::NONE, 0, CODEC_DEFAULT_CHUNK_BYTES };
+    long lBest = 0;
+    double dBest = 0;
+    for (long lTileRows : { 0L, 8L, 32L, 128L }) {
+        tTuningEntry Entry = { CPUModel(), "matmul", Shape.emShape, GemmDefaultParams(), lTileRows, 0 };
+        SetTuning(Entry);
+        /** Same repetitions everywhere: the main process decides and broadcasts */
+        double dBestTime = 1e30;
+        for (int iRun = 0; iRun < 3; ++iRun) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            MPITimer Timer;
+            ON_MAIN_PROC(Processor) {
+                MPIMatMulMain(M, N, Processor, Raw);
+            } else {
+                MPIMatMulWorker<double>(Processor);
+            }
+            dBestTime = std::min(dBestTime, Timer.TimeDelta());
+        }
+        double dGFlops = dFlops / dBestTime / 1e9;
+        ON_MAIN_PROC(Processor) {
+            LOGD("matmul %s tile=%ld: %.2f GFLOP/s", ShapeClassName(Shape.emShape), lTileRows, dGFlops);
+        }
+        if (dGFlops > dBest) {
+            dBest = dGFlops;
+            lBest = lTileRows;
+        }
+    }
+    MPI_Bcast(&lBest, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    return { CPUModel(), "matmul", Shape.emShape, GemmDefaultParams(), lBest, dBest };
+}
+
+/**
+ * @brief Barrier that sleeps instead of polling, so that the waiting
+ * processes leave the cores to the gemm sweep of process 0
+ *
+ */
+void SleepingBarrier() {
+    MPI_Request Request;
+    MPI_Ibarrier(MPI_COMM_WORLD, &Request);
+    int iDone = 0;
+    MPI_Test(&Request, &iDone, MPI_STATUS_IGNORE);
+    while (not iDone) {
+        usleep(1000);
+        MPI_Test(&Request, &iDone, MPI_STATUS_IGNORE);
+    }
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(NULL, NULL);
+    MPIProcessorInfo Processor;
+
+    bool bQuick = false;
+    std::string sPath = getenv(TUNING_FILE_ENV) != nullptr ? getenv(TUNING_FILE_ENV) : TUNING_DEFAULT_FILE;
+    for (int idx = 1; idx < argc; ++idx) {
+        if (strcmp(argv[idx], "--quick") == 0) {
+            bQuick = true;
+        } else {
+            sPath = argv[idx];
+        }
+    }
+
+    /** Representatives of each class, --quick shrinks the larger ones */
+    const size_t ulLarge = bQuick ? 800 : 1280, ulMedium = bQuick ? 256 : 512;
+    const tShape aShapes[] = {
+        { emShapeClass::SMALL, 96, 96, 96 },
+        { emShapeClass::SKINNY, ulLarge, 24, ulLarge },
+        { emShapeClass::MEDIUM, ulMedium, ulMedium, ulMedium },
+        { emShapeClass::LARGE, ulLarge, ulLarge, ulLarge },
+    };
+
+    std::vector<tTuningEntry> vecNew;
+    ON_MAIN_PROC(Processor) {
+        LOGI("Tuning for %s", CPUModel().c_str());
+        for (const auto& Shape : aShapes) {
+            vecNew.push_back(TuneGemm<float>("gemm_f32", Shape, gemm_f32_tuned));
+            vecNew.push_back(TuneGemm<double>("gemm_f64", Shape, gemm_f64_tuned));
+        }
+    }
+    SleepingBarrier();
+    if (Processor.iSize() > 1) {
+        for (const auto& Shape : aShapes) {
+            if (Shape.emShape != emShapeClass::MEDIUM and Shape.emShape != emShapeClass::LARGE) continue;
+            tTuningEntry Entry = TuneMatMul(Shape, Processor);
+            vecNew.push_back(Entry);
+        }
+    }
+
+    int iRet = MATRIX_OK;
+    ON_MAIN_PROC(Processor) {
+        /** Keep what other machines wrote, replace our own lines */
+        std::vector<tTuningEntry> vecEntries, vecOld;
+        LoadTuningFile(sPath, vecOld);
+        for (const auto& Entry : vecOld) {
+            bool bReplaced = false;
+            for (const auto& New : vecNew) {
+                bReplaced |= New.sCPU == Entry.sCPU and New.sOp == Entry.sOp and New.emShape == Entry.emShape;
+            }
+            if (not bReplaced) vecEntries.push_back(Entry);
+        }
+        for (const auto& Entry : vecNew) {
+            vecEntries.push_back(Entry);
+            LOGI("%-8s %-6s kernel=%-6s mc=%-4zu kc=%-4zu nc=%-4zu tile=%-4ld %.2f GFLOP/s", Entry.sOp.c_str(),
+                 ShapeClassName(Entry.emShape), GemmKernelName(Entry.Gemm.emKernel), Entry.Gemm.ulMC, Entry.Gemm.ulKC,
+                 Entry.Gemm.ulNC, Entry.lTileRows, Entry.dGFlops);
+        }
+        iRet = SaveTuningFile(sPath, vecEntries);
+        if (iRet == MATRIX_OK) {
+            LOGI("Wrote %s, loaded by later runs in this directory or with %s=%s", sPath.c_str(), TUNING_FILE_ENV, sPath.c_str());
+        } else {
+            LOGE("Can not write %s", sPath.c_str());
+        }
+    }
+
+    MPI_Finalize();
+    return iRet;
+}
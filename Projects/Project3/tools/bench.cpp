@@ -0,0 +1,519 @@
+/**
+ * @file bench.cpp
+ * @author davidliyutong (davidliyutong@sjtu.edu.cn)
+ * @brief Benchmark suite: gemm kernels, batched gemm, CSV I/O, LU, MPI MatMul
+ * (1D, planned, 2.5D), chained DistMatrix products, MapReduce WordCount and
+ * external programs (GetPI, GetPrime, Hadoop, ...) over rank counts
+ * @version 0.1
+ * @date 2022-06-13
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * mpirun -n P ./bench [--suite gemm,batched,csv,factorize,matmul,dist,mapreduce] [--quick]
+ *                     [--format json|csv] [--out FILE] [--baseline FILE] [--threshold 0.1]
+ *                     [--reps N] [--warmup N] [--perf] [--corpus FILE]
+ * ./bench --exec "NAME=COMMAND with {np}" [--exec ...] --np 1,2,4 [--corpus FILE] [...]
+ * ./bench --help
+ *
+ * --exec runs its commands through sh, replacing {np} with every entry of
+ * --np, and must itself be started without mpirun. The mapreduce suite
+ * counts the words of --corpus, which it generates first if missing (a
+ * temporary one without --corpus); with --corpus the --exec cases report
+ * throughput over its bytes too, so a Hadoop WordCount of the same file,
+ *
+ *     ./bench --corpus words.txt --exec "hadoop=hadoop jar hadoop-mapreduce-examples-2.10.1.jar wordcount /input /output-{np}"
+ *
+ * with words.txt put to /input, compares to mapreduce/wordcount/npP. With --baseline the exit
+ * status is the number of cases slower than the baseline by more than
+ * --threshold. --perf adds hardware counters (when the kernel lets us open
+ * them) and the roofline of each case to the report.
+ */
+#include "Bench.hpp"
+#include "DistMatrix.hpp"
+#include "Factorize.hpp"
+#include "MatMul.hpp"
+#include "MatMul25D.hpp"
+#include "MatMulPlan.hpp"
+#include "MPIProcessorInfo.hpp"
+#include "MapReduce.hpp"
+#include "Matrix.hpp"
+#include "debug.h"
+#include "gemm.hpp"
+#include "parallel.hpp"
+#include <cctype>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <sys/stat.h>
+#include <type_traits>
+
+using namespace mpimath;
+
+typedef struct {
+    std::vector<std::string> vecSuites;
+    std::vector<std::pair<std::string, std::string>> vecExec;
+    std::vector<int> vecNP;
+    std::string sFormat;
+    std::string sOut;
+    std::string sBaseline;
+    std::string sCorpus;
+    double dThreshold;
+    bool bQuick;
+    tBenchConfig Config;
+} tBenchArgs;
+
+template<typename T>
+void FillRandom(T* pData, size_t ulSize, unsigned uSeed) {
+    std::mt19937 Rng(uSeed);
+    std::uniform_real_distribution<float> Dist(-1, 1);
+    const float fScale = std::is_integral<T>::value ? 100.0f : 1.0f;
+    for (size_t idx = 0; idx < ulSize; ++idx) pData[idx] = T(Dist(Rng) * fScale);
+}
+
+std::string ShapeName(size_t ulM, size_t ulK, size_t ulN) {
+    return std::to_string(ulM) + "x" + std::to_string(ulK) + "x" + std::to_string(ulN);
+}
+
+std::vector<std::string> Split(const std::string& sList, char cSep) {
+    std::vector<std::string> vecItems;
+    std::istringstream Stream(sList);
+    std::string sItem;
+    while (std::getline(Stream, sItem, cSep)) {
+        if (not sItem.empty()) vecItems.push_back(sItem);
+    }
+    return vecItems;
+}
+
+/**
+ * @brief One product through the type dispatched gemm
+ *
+ */
+template<typename T>
+void BenchGemmType(const char* sType, size_t ulM, size_t ulK, size_t ulN, const tBenchConfig& Config, std::vector<tBenchResult>& vecResults) {
+    typedef typename tGemmTraits<T>::AccType TAcc;
+    std::vector<T> vecA(ulM * ulK), vecB(ulK * ulN);
+    std::vector<TAcc> vecC(ulM * ulN);
+    FillRandom(vecA.data(), vecA.size(), 1);
+    FillRandom(vecB.data(), vecB.size(), 2);
+    const double dBytes = (double)(vecA.size() + vecB.size()) * sizeof(T) + (double)vecC.size() * sizeof(TAcc);
+    vecResults.push_back(BenchRun(std::string("gemm/") + sType + "/default/" + ShapeName(ulM, ulK, ulN), Config,
+                                  2.0 * ulM * ulK * ulN, dBytes, [&] {
+                                      gemm(vecC.data(), vecA.data(), vecB.data(), ulM, ulK, ulK, ulN);
+                                  }));
+    vecResults.back().ulElemBytes = sizeof(TAcc);
+}
+
+/**
+ * @brief Every kernel level of gemm_f32 / gemm_f64
+ *
+ */
+template<typename T>
+void BenchGemmKernels(const char* sType, size_t ulM, size_t ulK, size_t ulN, const tBenchConfig& Config,
+                      int (*fnGemm)(const tGemmParams&, T*, const T*, const T*, size_t, size_t, size_t, size_t),
+                      std::vector<tBenchResult>& vecResults) {
+    std::vector<T> vecA(ulM * ulK), vecB(ulK * ulN), vecC(ulM * ulN);
+    FillRandom(vecA.data(), vecA.size(), 1);
+    FillRandom(vecB.data(), vecB.size(), 2);
+    const double dBytes = (double)(vecA.size() + vecB.size() + vecC.size()) * sizeof(T);
+    for (int iKernel = 0; iKernel < (int)emGemmKernel::COUNT; ++iKernel) {
+        /** The naive loop is only there for reference */
+        if ((emGemmKernel)iKernel == emGemmKernel::NAIVE and ulM * ulK * ulN > 512ul * 512 * 512) continue;
+        tGemmParams Params = { (emGemmKernel)iKernel, 0, 0, 0 };
+        vecResults.push_back(BenchRun(std::string("gemm/") + sType + "/" + GemmKernelName(Params.emKernel) + "/" +
+                                      ShapeName(ulM, ulK, ulN), Config, 2.0 * ulM * ulK * ulN, dBytes, [&] {
+                                          fnGemm(Params, vecC.data(), vecA.data(), vecB.data(), ulM, ulK, ulK, ulN);
+                                      }));
+        vecResults.back().ulElemBytes = sizeof(T);
+    }
+}
+
+void SuiteGemm(const tBenchArgs& Args, std::vector<tBenchResult>& vecResults) {
+    std::vector<std::vector<size_t>> vecShapes = { { 64, 64, 64 }, { 256, 256, 256 }, { 1024, 16, 1024 } };
+    if (not Args.bQuick) {
+        vecShapes.push_back({ 512, 512, 512 });
+        vecShapes.push_back({ 1024, 1024, 1024 });
+    }
+    for (const auto& vecShape : vecShapes) {
+        const size_t ulM = vecShape[0], ulK = vecShape[1], ulN = vecShape[2];
+        BenchGemmKernels<float>("f32", ulM, ulK, ulN, Args.Config, gemm_f32_tuned, vecResults);
+        BenchGemmKernels<double>("f64", ulM, ulK, ulN, Args.Config, gemm_f64_tuned, vecResults);
+        BenchGemmType<float>("f32", ulM, ulK, ulN, Args.Config, vecResults);
+        BenchGemmType<double>("f64", ulM, ulK, ulN, Args.Config, vecResults);
+        BenchGemmType<bf16_t>("bf16", ulM, ulK, ulN, Args.Config, vecResults);
+        BenchGemmType<fp16_t>("fp16", ulM, ulK, ulN, Args.Config, vecResults);
+        BenchGemmType<int8_t>("i8", ulM, ulK, ulN, Args.Config, vecResults);
+    }
+}
+
+/** 1, 2, 4, ... up to DefaultNumThreads(), and DefaultNumThreads() itself */
+std::vector<unsigned> ThreadCounts() {
+    std::vector<unsigned> vecThreads;
+    for (unsigned uThreads = 1; uThreads < DefaultNumThreads(); uThreads *= 2) vecThreads.push_back(uThreads);
+    vecThreads.push_back(DefaultNumThreads());
+    return vecThreads;
+}
+
+void SuiteBatched(const tBenchArgs& Args, std::vector<tBenchResult>& vecResults) {
+    for (size_t ulDim : { 8, 16, 64 }) {
+        const size_t ulBatch = (Args.bQuick ? 1 << 20 : 1 << 23) / (ulDim * ulDim);
+        std::vector<double> vecA(ulBatch * ulDim * ulDim), vecB(vecA.size()), vecC(vecA.size());
+        FillRandom(vecA.data(), vecA.size(), 1);
+        FillRandom(vecB.data(), vecB.size(), 2);
+        for (unsigned uThreads : ThreadCounts()) {
+            vecResults.push_back(BenchRun("batched/f64/" + std::to_string(ulBatch) + "x" + ShapeName(ulDim, ulDim, ulDim) +
+                                          "/t" + std::to_string(uThreads), Args.Config, 2.0 * ulBatch * ulDim * ulDim * ulDim,
+                                          3.0 * vecA.size() * sizeof(double), [&] {
+                                              gemm_batched_f64(vecC.data(), vecA.data(), vecB.data(), ulBatch, ulDim, ulDim, ulDim,
+                                                               (size_t)-1, (size_t)-1, (size_t)-1, uThreads);
+                                          }));
+        }
+    }
+}
+
+void SuiteCSV(const tBenchArgs& Args, std::vector<tBenchResult>& vecResults) {
+    const size_t ulDim = Args.bQuick ? 500 : 2000;
+    Matrix2D<double> Mat(ulDim, ulDim), MatIn;
+    FillRandom(Mat.pData(), Mat.Size(), 1);
+    const std::string sPath = "bench_csv.csv";
+    for (unsigned uThreads : ThreadCounts()) {
+        vecResults.push_back(BenchRun("csv/write/" + std::to_string(ulDim) + "x" + std::to_string(ulDim) + "/t" + std::to_string(uThreads),
+                                      Args.Config, 0, 0, [&] { CSVWrite(sPath, Mat.pData(), ulDim, ulDim, uThreads); }));
+    }
+    std::ifstream File(sPath, std::ios::ate | std::ios::binary);
+    const double dFileBytes = (double)File.tellg();
+    for (size_t idx = vecResults.size() - ThreadCounts().size(); idx < vecResults.size(); ++idx) vecResults[idx].dBytes = dFileBytes;
+    vecResults.push_back(BenchRun("csv/read/" + std::to_string(ulDim) + "x" + std::to_string(ulDim), Args.Config, 0, dFileBytes,
+                                  [&] { MatIn.ReadCSV(sPath); }));
+    remove(sPath.c_str());
+}
+
+void SuiteFactorize(const tBenchArgs& Args, std::vector<tBenchResult>& vecResults) {
+    const size_t ulDim = Args.bQuick ? 256 : 1024;
+    Matrix2D<double> A(ulDim, ulDim), F;
+    FillRandom(A.pData(), A.Size(), 1);
+    for (size_t i = 0; i < ulDim; ++i) A.pData()[i * ulDim + i] += (double)ulDim;
+    std::vector<int> vecPiv;
+    vecResults.push_back(BenchRun("factorize/lu/" + std::to_string(ulDim), Args.Config, 2.0 / 3.0 * ulDim * ulDim * ulDim,
+                                  (double)A.ulDataSize(), [&] {
+                                      F = A;
+                                      LUFactor(F, vecPiv);
+                                  }));
+    vecResults.push_back(BenchRun("factorize/cholesky/" + std::to_string(ulDim), Args.Config, 1.0 / 3.0 * ulDim * ulDim * ulDim,
+                                  (double)A.ulDataSize(), [&] {
+                                      F = A;
+                                      CholeskyFactor(F);
+                                  }));
+}
+
+/**
+ * @brief MPIMatMulMain, MatMulPlan and MPIMatMul25D on MPI_COMM_WORLD,
+ * collective; the main process times each run between barriers
+ *
+ */
+void SuiteMatMul(const tBenchArgs& Args, MPIProcessorInfo& Processor, std::vector<tBenchResult>& vecResults) {
+    /** A single rank has no workers and would only time the local product under MPI names */
+    if (Processor.iSize() < 2) {
+        ON_MAIN_PROC(Processor) {
+            LOGW("Suite matmul needs at least 2 processes, skipped");
+        }
+        return;
+    }
+    std::vector<size_t> vecDims = { 64, 256, 512 };
+    if (not Args.bQuick) vecDims.push_back(1024);
+    for (size_t ulDim : vecDims) {
+        Matrix2D<double> M, N;
+        ON_MAIN_PROC(Processor) {
+            M.Init(ulDim, ulDim);
+            N.Init(ulDim, ulDim);
+            FillRandom(M.pData(), M.Size(), 1);
+            FillRandom(N.pData(), N.Size(), 2);
+        }
+        std::vector<double> vecSamples;
+        for (int iRun = 0; iRun < Args.Config.iWarmups + Args.Config.iReps; ++iRun) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            double dBegin = BenchNow();
+            ON_MAIN_PROC(Processor) {
+                MPIMatMulMain(M, N, Processor);
+            } else {
+                MPIMatMulWorker<double>(Processor);
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+            if (iRun >= Args.Config.iWarmups) vecSamples.push_back(BenchNow() - dBegin);
+        }
+        /** M, N and the result cross the network once */
+        vecResults.push_back(BenchSummarize("matmul/f64/" + ShapeName(ulDim, ulDim, ulDim) + "/np" + std::to_string(Processor.iSize()),
+                                            vecSamples, 2.0 * ulDim * ulDim * ulDim, 3.0 * ulDim * ulDim * sizeof(double)));
+
+        /** The same products through one MatMulPlan */
+        vecSamples.clear();
+        {
+            MatMulPlan<double> Plan((long)ulDim, (long)ulDim, (long)ulDim, Processor);
+            for (int iRun = 0; iRun < Args.Config.iWarmups + Args.Config.iReps; ++iRun) {
+                MPI_Barrier(MPI_COMM_WORLD);
+                double dBegin = BenchNow();
+                Plan.Execute(M, N);
+                MPI_Barrier(MPI_COMM_WORLD);
+                if (iRun >= Args.Config.iWarmups) vecSamples.push_back(BenchNow() - dBegin);
+            }
+        }
+        vecResults.push_back(BenchSummarize("matmul_plan/f64/" + ShapeName(ulDim, ulDim, ulDim) + "/np" + std::to_string(Processor.iSize()),
+                                            vecSamples, 2.0 * ulDim * ulDim * ulDim, 3.0 * ulDim * ulDim * sizeof(double)));
+
+        /** The same products on the 2.5D grid, named after its replication factor */
+        vecSamples.clear();
+        tGrid25D Grid = { 1, 1 };
+        for (int iRun = 0; iRun < Args.Config.iWarmups + Args.Config.iReps; ++iRun) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            double dBegin = BenchNow();
+            MPIMatMul25D(M, N, Processor, 0, &Grid);
+            MPI_Barrier(MPI_COMM_WORLD);
+            if (iRun >= Args.Config.iWarmups) vecSamples.push_back(BenchNow() - dBegin);
+        }
+        vecResults.push_back(BenchSummarize("matmul_25d/f64/" + ShapeName(ulDim, ulDim, ulDim) + "/np" + std::to_string(Processor.iSize()) +
+                                                "/c" + std::to_string(Grid.iReplicas),
+                                            vecSamples, 2.0 * ulDim * ulDim * ulDim, 3.0 * ulDim * ulDim * sizeof(double)));
+    }
+}
+
+/**
+ * @brief Chains of products A = A * B: MPIMatMulMain scatters and gathers on
+ * every step, DistMatrix keeps A in rows and B in place between steps
+ *
+ */
+void SuiteDist(const tBenchArgs& Args, MPIProcessorInfo& Processor, std::vector<tBenchResult>& vecResults) {
+    const int iChain = 4;
+    std::vector<size_t> vecDims = { 256 };
+    if (not Args.bQuick) vecDims.push_back(512);
+    for (size_t ulDim : vecDims) {
+        Matrix2D<double> A, B;
+        ON_MAIN_PROC(Processor) {
+            A.Init(ulDim, ulDim);
+            B.Init(ulDim, ulDim);
+            FillRandom(A.pData(), A.Size(), 1);
+            FillRandom(B.pData(), B.Size(), 2);
+        }
+        std::vector<double> vecMatMul, vecDist;
+        for (int iRun = 0; iRun < Args.Config.iWarmups + Args.Config.iReps; ++iRun) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            double dBegin = BenchNow();
+            Matrix2D<double> C = A;
+            for (int iStep = 0; iStep < iChain; ++iStep) {
+                ON_MAIN_PROC(Processor) {
+                    C = MPIMatMulMain(C, B, Processor);
+                } else {
+                    MPIMatMulWorker<double>(Processor);
+                }
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+            if (iRun >= Args.Config.iWarmups) vecMatMul.push_back(BenchNow() - dBegin);
+
+            MPI_Barrier(MPI_COMM_WORLD);
+            dBegin = BenchNow();
+            {
+                DistMatrix<double> DA = DistMatrix<double>::Scatter(A, DistLayoutRow(ulDim, ulDim, Processor.iSize()));
+                DistMatrix<double> DB = DistMatrix<double>::Scatter(B, DistLayoutRow(ulDim, ulDim, Processor.iSize()));
+                DB = DB.Redistribute(DistOperandLayout(DA.Layout(), DB.Layout()));
+                for (int iStep = 0; iStep < iChain; ++iStep) DA = DA * DB;
+                DA.Gather();
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+            if (iRun >= Args.Config.iWarmups) vecDist.push_back(BenchNow() - dBegin);
+        }
+        const std::string sCase = ShapeName(ulDim, ulDim, ulDim) + "x" + std::to_string(iChain) + "/np" + std::to_string(Processor.iSize());
+        const double dFlops = iChain * 2.0 * ulDim * ulDim * ulDim, dMatrix = (double)ulDim * ulDim * sizeof(double);
+        vecResults.push_back(BenchSummarize("chain/f64/matmul/" + sCase, vecMatMul, dFlops, iChain * 3.0 * dMatrix));
+        vecResults.push_back(BenchSummarize("chain/f64/dist/" + sCase, vecDist, dFlops, 3.0 * dMatrix));
+    }
+}
+
+/** Bytes of a file, 0 if it does not exist */
+double FileBytes(const std::string& sPath) {
+    struct stat Stat;
+    return stat(sPath.c_str(), &Stat) == 0 ? (double)Stat.st_size : 0.0;
+}
+
+/** Lines of words with a skewed vocabulary, like natural text */
+void WriteCorpus(const std::string& sPath, size_t ulBytes) {
+    std::mt19937 Rng(7);
+    std::uniform_real_distribution<double> Dist(0, 1);
+    FILE* pFile = fopen(sPath.c_str(), "w");
+    if (pFile == nullptr) {
+        LOGE("Can not write %s", sPath.c_str());
+        return;
+    }
+    std::string sLine;
+    for (size_t ulWritten = 0; ulWritten < ulBytes; ulWritten += sLine.size()) {
+        sLine.clear();
+        for (int iWord = 0; iWord < 12; ++iWord) {
+            sLine += "word" + std::to_string((int)(std::pow(Dist(Rng), 4) * 100000));
+            sLine += iWord == 11 ? '\n' : ' ';
+        }
+        fwrite(sLine.data(), 1, sLine.size(), pFile);
+    }
+    fclose(pFile);
+}
+
+/**
+ * @brief WordCount of a corpus with MapReduce, collective; the main process
+ * times map, shuffle and reduce between barriers
+ *
+ */
+void SuiteMapReduce(const tBenchArgs& Args, MPIProcessorInfo& Processor, std::vector<tBenchResult>& vecResults) {
+    const std::string sCorpus = Args.sCorpus.empty() ? "bench_corpus.txt" : Args.sCorpus;
+    ON_MAIN_PROC(Processor) {
+        if (FileBytes(sCorpus) == 0) WriteCorpus(sCorpus, Args.bQuick ? 16UL << 20 : 256UL << 20);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    const double dBytes = FileBytes(sCorpus);
+    std::vector<double> vecSamples;
+    for (int iRun = 0; iRun < Args.Config.iWarmups + Args.Config.iReps; ++iRun) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        const double dBegin = BenchNow();
+        MapReduce<std::string, int64_t> Job(Processor);
+        Job.Combiner([](int64_t& lAcc, const int64_t& lValue) { lAcc += lValue; });
+        Job.MapLines(InputSplits({ sCorpus }, 16 << 20), [](const char* pLine, size_t ulLength, auto& Emit) {
+            for (size_t ulBegin = 0, idx = 0; idx <= ulLength; ++idx) {
+                if (idx < ulLength and not isspace((unsigned char)pLine[idx])) continue;
+                if (idx > ulBegin) Emit(std::string(pLine + ulBegin, idx - ulBegin), (int64_t)1);
+                ulBegin = idx + 1;
+            }
+        });
+        Job.Reduce([](const std::string&, const std::vector<int64_t>& vecValues) { return vecValues.front(); });
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (iRun >= Args.Config.iWarmups) vecSamples.push_back(BenchNow() - dBegin);
+    }
+    ON_MAIN_PROC(Processor) {
+        if (Args.sCorpus.empty()) remove(sCorpus.c_str());
+    }
+    vecResults.push_back(BenchSummarize("mapreduce/wordcount/np" + std::to_string(Processor.iSize()), vecSamples, 0, dBytes));
+}
+
+void SuiteExec(const tBenchArgs& Args, std::vector<tBenchResult>& vecResults) {
+    const double dBytes = Args.sCorpus.empty() ? 0 : FileBytes(Args.sCorpus);
+    for (const auto& Exec : Args.vecExec) {
+        for (int iNP : Args.vecNP) {
+            std::string sCommand = Exec.second;
+            for (size_t ulPos; (ulPos = sCommand.find("{np}")) != std::string::npos;) {
+                sCommand.replace(ulPos, 4, std::to_string(iNP));
+            }
+            bool bFailed = false;
+            tBenchResult Res = BenchRun("exec/" + Exec.first + "/np" + std::to_string(iNP), Args.Config, 0, dBytes, [&] {
+                bFailed |= BenchExec(sCommand + " >/dev/null 2>&1") < 0;
+            });
+            if (bFailed) {
+                LOGE("'%s' failed", sCommand.c_str());
+                continue;
+            }
+            vecResults.push_back(Res);
+        }
+    }
+}
+
+/** --help, the same usage as the comment at the top of this file */
+void PrintUsage(const char* sProgram) {
+    printf("Usage: mpirun -n P %s [--suite gemm,batched,csv,factorize,matmul,dist,mapreduce] [--quick]\n"
+           "                        [--format json|csv] [--out FILE] [--baseline FILE] [--threshold 0.1]\n"
+           "                        [--reps N] [--warmup N] [--perf] [--corpus FILE]\n"
+           "       %s --exec \"NAME=COMMAND with {np}\" [--exec ...] --np 1,2,4 [--corpus FILE] [...]\n\n"
+           "  --suite      comma separated suites, all of them by default; matmul needs P >= 2\n"
+           "  --quick      smaller sizes, for a quick check\n"
+           "  --format     report format, json by default\n"
+           "  --out        report file, - (stdout) by default\n"
+           "  --baseline   report to compare with; the exit status is the number of regressions\n"
+           "  --threshold  slowdown counted as a regression, %.2f by default\n"
+           "  --reps       timed runs of every case, 10 by default\n"
+           "  --warmup     untimed runs before them, 2 by default\n"
+           "  --perf       hardware counters and roofline of every case\n"
+           "  --corpus     text counted by mapreduce and the --exec cases, generated if missing\n"
+           "  --exec       external command, run without mpirun for every entry of --np\n",
+           sProgram, sProgram, BENCH_DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char** argv) {
+    tBenchArgs Args = { {}, {}, { 1 }, "json", "-", "", "", BENCH_DEFAULT_THRESHOLD, false, { 2, 10, 0, false } };
+    for (int idx = 1; idx < argc; ++idx) {
+        const std::string sArg = argv[idx];
+        const bool bValue = idx + 1 < argc;
+        if (sArg == "--help" or sArg == "-h") {
+            PrintUsage(argv[0]);
+            return 0;
+        } else if (sArg == "--quick") {
+            Args.bQuick = true;
+        } else if (sArg == "--perf") {
+            Args.Config.bPerf = true;
+        } else if (sArg == "--suite" and bValue) {
+            Args.vecSuites = Split(argv[++idx], ',');
+        } else if (sArg == "--exec" and bValue) {
+            std::string sExec = argv[++idx];
+            size_t ulEq = sExec.find('=');
+            if (ulEq == std::string::npos) {
+                LOGE_S("--exec takes NAME=COMMAND");
+                return 1;
+            }
+            Args.vecExec.push_back({ sExec.substr(0, ulEq), sExec.substr(ulEq + 1) });
+        } else if (sArg == "--np" and bValue) {
+            Args.vecNP.clear();
+            for (const auto& sNP : Split(argv[++idx], ',')) Args.vecNP.push_back(atoi(sNP.c_str()));
+        } else if (sArg == "--format" and bValue) {
+            Args.sFormat = argv[++idx];
+        } else if (sArg == "--out" and bValue) {
+            Args.sOut = argv[++idx];
+        } else if (sArg == "--baseline" and bValue) {
+            Args.sBaseline = argv[++idx];
+        } else if (sArg == "--threshold" and bValue) {
+            Args.dThreshold = atof(argv[++idx]);
+        } else if (sArg == "--corpus" and bValue) {
+            Args.sCorpus = argv[++idx];
+        } else if (sArg == "--reps" and bValue) {
+            Args.Config.iReps = std::max(1, atoi(argv[++idx]));
+        } else if (sArg == "--warmup" and bValue) {
+            Args.Config.iWarmups = std::max(0, atoi(argv[++idx]));
+        } else {
+            LOGE_S("Unknown argument %s", sArg.c_str());
+            return 1;
+        }
+    }
+    if (Args.vecSuites.empty() and Args.vecExec.empty()) {
+        Args.vecSuites = { "gemm", "batched", "csv", "factorize", "matmul", "dist", "mapreduce" };
+    }
+    auto HasSuite = [&](const char* sSuite) {
+        return std::find(Args.vecSuites.begin(), Args.vecSuites.end(), sSuite) != Args.vecSuites.end();
+    };
+
+    /** --exec alone starts mpirun itself, so MPI stays uninitialized */
+    std::vector<tBenchResult> vecResults;
+    bool bMain = true;
+    if (not Args.vecSuites.empty()) {
+        MPI_Init(NULL, NULL);
+        MPIProcessorInfo Processor;
+        Processor.Bind(MPIProcessorInfo::BindPolicyFromEnv());
+        bMain = Processor.iRank() == 0;
+        if (bMain) {
+            if (HasSuite("gemm")) SuiteGemm(Args, vecResults);
+            if (HasSuite("batched")) SuiteBatched(Args, vecResults);
+            if (HasSuite("csv")) SuiteCSV(Args, vecResults);
+            if (HasSuite("factorize")) SuiteFactorize(Args, vecResults);
+        }
+        if (HasSuite("matmul")) SuiteMatMul(Args, Processor, vecResults);
+        if (HasSuite("dist")) SuiteDist(Args, Processor, vecResults);
+        if (HasSuite("mapreduce")) SuiteMapReduce(Args, Processor, vecResults);
+        LogFinalize();
+        MPI_Finalize();
+    }
+    if (not bMain) return 0;
+    SuiteExec(Args, vecResults);
+
+    if (BenchWrite(Args.sOut, Args.sFormat, vecResults) != MATRIX_OK) {
+        LOGE("Can not write %s", Args.sOut.c_str());
+        return 1;
+    }
+    if (Args.sBaseline.empty()) return 0;
+    std::map<std::string, double> mapBaseline;
+    if (BenchLoadBaseline(Args.sBaseline, mapBaseline) != MATRIX_OK) {
+        LOGE("Can not read baseline %s", Args.sBaseline.c_str());
+        return 1;
+    }
+    int iRegressions = BenchCompare(vecResults, mapBaseline, Args.dThreshold);
+    LOGI("%d regressions against %s (threshold %.0f%%)", iRegressions, Args.sBaseline.c_str(), Args.dThreshold * 100);
+    return std::min(iRegressions, 255);
+}